@@ -591,6 +591,12 @@ struct OBSStudioAPI : obs_frontend_callbacks {
 			[redo](const std::string &data) { redo(data.c_str()); }, undo_data, redo_data, repeatable);
 	}
 
+	char *obs_frontend_save_profiler_trace(void) override
+	{
+		std::string path;
+		return SaveProfilerTrace(path) ? bstrdup(path.c_str()) : nullptr;
+	}
+
 	void on_load(obs_data_t *settings) override
 	{
 		for (size_t i = saveCallbacks.size(); i > 0; i--) {
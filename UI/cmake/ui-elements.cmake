@@ -67,6 +67,8 @@ target_sources(
     source-label.hpp
     source-tree.cpp
     source-tree.hpp
+    undo-delta.cpp
+    undo-delta.hpp
     undo-stack-obs.cpp
     undo-stack-obs.hpp
     url-push-button.cpp
@@ -108,6 +108,7 @@ bool opt_allow_opengl = false;
 bool opt_always_on_top = false;
 bool opt_disable_updater = false;
 bool opt_disable_missing_files_check = false;
+static long long opt_profiler_trace_seconds = 0;
 string opt_starting_collection;
 string opt_starting_profile;
 string opt_starting_scene;
@@ -1859,6 +1860,27 @@ static void SaveProfilerData(const ProfilerSnapshot &snap)
 		blog(LOG_WARNING, "Could not save profiler data to '%s'", static_cast<const char *>(path));
 }
 
+bool SaveProfilerTrace(string &path)
+{
+	if (!profiler_trace_active()) {
+		blog(LOG_WARNING, "Profiler timeline capture is not active, "
+				  "start OBS with --profiler-trace to enable it");
+		return false;
+	}
+
+	string name = "obs-studio/profiler_data/" + GenerateTimeDateFilename("trace.json", true);
+	BPtr<char> tracePath = GetAppConfigPathPtr(name.c_str());
+
+	if (!profiler_trace_dump_json(tracePath)) {
+		blog(LOG_WARNING, "Could not save profiler trace to '%s'", tracePath.Get());
+		return false;
+	}
+
+	blog(LOG_INFO, "Saved profiler trace to '%s'", tracePath.Get());
+	path = tracePath.Get();
+	return true;
+}
+
 static auto ProfilerFree = [](void *) {
 	profiler_stop();
 
@@ -1892,6 +1914,9 @@ static int run_program(fstream &logFile, int argc, char *argv[])
 	profiler_start();
 	profile_register_root(run_program_init, 0);
 
+	if (opt_profiler_trace_seconds > 0)
+		profiler_trace_start((uint64_t)opt_profiler_trace_seconds * 1000000000ULL);
+
 	ScopeProfiler prof{run_program_init};
 
 #ifdef _WIN32
@@ -2389,13 +2414,11 @@ static void delete_safe_mode_sentinel(void)
 #ifndef _WIN32
 void OBSApp::SigIntSignalHandler(int s)
 {
-	/* Handles SIGINT and writes to a socket. Qt will read
+	/* Handles SIGINT and SIGUSR1 and writes to a socket. Qt will read
 	 * from the socket in the main thread event loop and trigger
 	 * a call to the ProcessSigInt slot, where we can safely run
 	 * shutdown code without signal safety issues. */
-	UNUSED_PARAMETER(s);
-
-	char a = 1;
+	char a = s == SIGUSR1 ? 2 : 1;
 	send(sigintFd[0], &a, sizeof(a), 0);
 }
 #endif
@@ -2408,6 +2431,12 @@ void OBSApp::ProcessSigInt(void)
 	char tmp;
 	recv(sigintFd[1], &tmp, sizeof(tmp), 0);
 
+	if (tmp == 2) {
+		string path;
+		SaveProfilerTrace(path);
+		return;
+	}
+
 	OBSBasic *main = reinterpret_cast<OBSBasic *>(GetMainWindow());
 	if (main)
 		main->close();
@@ -2461,6 +2490,7 @@ int main(int argc, char *argv[])
 	sig_handler.sa_flags = 0;
 
 	sigaction(SIGINT, &sig_handler, NULL);
+	sigaction(SIGUSR1, &sig_handler, NULL);
 
 	/* Block SIGPIPE in all threads, this can happen if a thread calls write on
 	a closed pipe. */
@@ -2570,6 +2600,10 @@ int main(int argc, char *argv[])
 		} else if (arg_is(argv[i], "--disable-missing-files-check", nullptr)) {
 			opt_disable_missing_files_check = true;
 
+		} else if (arg_is(argv[i], "--profiler-trace", nullptr)) {
+			if (++i < argc)
+				opt_profiler_trace_seconds = atoll(argv[i]);
+
 		} else if (arg_is(argv[i], "--steam", nullptr)) {
 			steam = true;
 
@@ -2597,7 +2631,9 @@ int main(int argc, char *argv[])
 				"--always-on-top: Start in 'always on top' mode.\n\n"
 				"--unfiltered_log: Make log unfiltered.\n\n"
 				"--disable-updater: Disable built-in updater (Windows/Mac only)\n\n"
-				"--disable-missing-files-check: Disable the missing files dialog which can appear on startup.\n\n";
+				"--disable-missing-files-check: Disable the missing files dialog which can appear on startup.\n\n"
+				"--profiler-trace <seconds>: Keep a timeline of the last <seconds> of profiled calls,\n"
+				"which can be saved as a Chrome trace.\n\n";
 
 #ifdef _WIN32
 			MessageBoxA(NULL, help.c_str(), "Help", MB_OK | MB_ICONASTERISK);
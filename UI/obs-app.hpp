@@ -233,6 +233,8 @@ signals:
 int GetAppConfigPath(char *path, size_t size, const char *name);
 char *GetAppConfigPathPtr(const char *name);
 
+bool SaveProfilerTrace(std::string &path);
+
 int GetProgramDataPath(char *path, size_t size, const char *name);
 char *GetProgramDataPathPtr(const char *name);
 
@@ -597,3 +597,8 @@ void obs_frontend_add_undo_redo_action(const char *name, const undo_redo_cb undo
 	if (callbacks_valid())
 		c->obs_frontend_add_undo_redo_action(name, undo, redo, undo_data, redo_data, repeatable);
 }
+
+char *obs_frontend_save_profiler_trace(void)
+{
+	return !!callbacks_valid() ? c->obs_frontend_save_profiler_trace() : nullptr;
+}
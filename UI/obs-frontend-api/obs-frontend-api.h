@@ -238,6 +238,8 @@ typedef void (*undo_redo_cb)(const char *data);
 EXPORT void obs_frontend_add_undo_redo_action(const char *name, const undo_redo_cb undo, const undo_redo_cb redo,
 					      const char *undo_data, const char *redo_data, bool repeatable);
 
+EXPORT char *obs_frontend_save_profiler_trace(void);
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef __cplusplus
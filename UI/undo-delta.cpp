@@ -0,0 +1,60 @@
+#include "undo-delta.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#define MAX_DELTA_DEPTH 32
+
+undo_delta_ptr undo_delta::make(const undo_delta_ptr &base, const std::string &base_data, const std::string &data)
+{
+	auto delta = std::make_shared<undo_delta>();
+	delta->size = data.size();
+
+	if (base && base->depth < MAX_DELTA_DEPTH) {
+		size_t max = std::min(base_data.size(), data.size());
+		size_t prefix = std::mismatch(data.begin(), data.begin() + max, base_data.begin()).first - data.begin();
+		size_t suffix = std::mismatch(data.rbegin(), data.rbegin() + (max - prefix), base_data.rbegin()).first -
+				data.rbegin();
+
+		/* not worth it for unrelated data */
+		if (prefix + suffix >= data.size() / 2) {
+			delta->base = base;
+			delta->prefix = prefix;
+			delta->suffix = suffix;
+			delta->data = data.substr(prefix, data.size() - prefix - suffix);
+			delta->depth = base->depth + 1;
+			return delta;
+		}
+	}
+
+	delta->data = data;
+	return delta;
+}
+
+std::string undo_delta::materialize() const
+{
+	std::vector<const undo_delta *> chain;
+	for (const undo_delta *d = this; d; d = d->base.get())
+		chain.push_back(d);
+
+	std::string data;
+	std::string next;
+
+	for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+		const undo_delta *d = *it;
+
+		if (!d->base) {
+			data = d->data;
+			continue;
+		}
+
+		next.clear();
+		next.reserve(d->size);
+		next.append(data, 0, d->prefix);
+		next.append(d->data);
+		next.append(data, data.size() - d->suffix, d->suffix);
+		data.swap(next);
+	}
+
+	return data;
+}
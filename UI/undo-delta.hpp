@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+/* undo/redo data is stored as the difference to data stored before it, as
+ * most actions only change a small part of the same scene */
+struct undo_delta {
+	std::shared_ptr<const undo_delta> base;
+	size_t prefix = 0;
+	size_t suffix = 0;
+	std::string data;
+	size_t size = 0;
+	int depth = 0;
+
+	static std::shared_ptr<const undo_delta> make(const std::shared_ptr<const undo_delta> &base,
+						      const std::string &base_data, const std::string &data);
+	std::string materialize() const;
+};
+
+typedef std::shared_ptr<const undo_delta> undo_delta_ptr;
@@ -2,6 +2,8 @@
 
 #include <util/util.hpp>
 
+#include <unordered_set>
+
 #define MAX_STACK_SIZE 5000
 
 undo_stack::undo_stack(ui_ptr ui) : ui(ui)
@@ -16,10 +18,46 @@ void undo_stack::reset_repeatable_state()
 	last_is_repeatable = false;
 }
 
+undo_delta_ptr undo_stack::push_data(const std::string &data)
+{
+	last_delta = undo_delta::make(last_delta, last_data, data);
+	last_data = data;
+	return last_delta;
+}
+
+size_t undo_stack::memory_usage() const
+{
+	std::unordered_set<const undo_delta *> counted;
+	size_t size = sizeof(*this) + last_data.capacity();
+
+	/* deltas can be shared as the base of others, count them once */
+	auto count = [&](const undo_delta_ptr &delta) {
+		for (const undo_delta *d = delta.get(); d && counted.insert(d).second; d = d->base.get())
+			size += sizeof(*d) + d->data.capacity();
+	};
+
+	for (const auto *items : {&undo_items, &redo_items}) {
+		for (const undo_redo_t &item : *items) {
+			size += sizeof(item) + item.name.capacity() * sizeof(QChar);
+			count(item.undo_data);
+			count(item.redo_data);
+		}
+	}
+
+	count(last_delta);
+	return size;
+}
+
 void undo_stack::clear()
 {
+	if (!undo_items.empty() || !redo_items.empty())
+		blog(LOG_INFO, "Cleared undo stack: %zu undo, %zu redo actions, %zu KiB", undo_items.size(),
+		     redo_items.size(), memory_usage() / 1024);
+
 	undo_items.clear();
 	redo_items.clear();
+	last_delta.reset();
+	last_data.clear();
 	last_is_repeatable = false;
 
 	ui->actionMainUndo->setText(QTStr("Undo.Undo"));
@@ -46,11 +84,13 @@ void undo_stack::add_action(const QString &name, const undo_redo_cb &undo, const
 
 	if (last_is_repeatable && repeatable && name == undo_items[0].name) {
 		undo_items[0].redo = redo;
-		undo_items[0].redo_data = redo_data;
+		undo_items[0].redo_data = push_data(redo_data);
 		return;
 	}
 
-	undo_redo_t n = {name, undo_data, redo_data, undo, redo};
+	undo_delta_ptr undo_delta = push_data(undo_data);
+	undo_delta_ptr redo_delta = push_data(redo_data);
+	undo_redo_t n = {name, undo_delta, redo_delta, undo, redo};
 
 	last_is_repeatable = repeatable;
 	undo_items.push_front(n);
@@ -71,7 +111,7 @@ void undo_stack::undo()
 	last_is_repeatable = false;
 
 	undo_redo_t temp = undo_items.front();
-	temp.undo(temp.undo_data);
+	temp.undo(temp.undo_data->materialize());
 	redo_items.push_front(temp);
 	undo_items.pop_front();
 
@@ -94,7 +134,7 @@ void undo_stack::redo()
 	last_is_repeatable = false;
 
 	undo_redo_t temp = redo_items.front();
-	temp.redo(temp.redo_data);
+	temp.redo(temp.redo_data->materialize());
 	undo_items.push_front(temp);
 	redo_items.pop_front();
 
@@ -10,6 +10,7 @@
 #include <memory>
 
 #include "ui_OBSBasic.h"
+#include "undo-delta.hpp"
 
 class undo_stack : public QObject {
 	Q_OBJECT
@@ -20,8 +21,8 @@ class undo_stack : public QObject {
 
 	struct undo_redo_t {
 		QString name;
-		std::string undo_data;
-		std::string redo_data;
+		undo_delta_ptr undo_data;
+		undo_delta_ptr redo_data;
 		undo_redo_cb undo;
 		undo_redo_cb redo;
 	};
@@ -29,6 +30,8 @@ class undo_stack : public QObject {
 	ui_ptr ui;
 	std::deque<undo_redo_t> undo_items;
 	std::deque<undo_redo_t> redo_items;
+	undo_delta_ptr last_delta;
+	std::string last_data;
 	int disable_refs = 0;
 	bool enabled = true;
 	bool last_is_repeatable = false;
@@ -41,6 +44,8 @@ class undo_stack : public QObject {
 	void disable_internal();
 	void clear_redo();
 
+	undo_delta_ptr push_data(const std::string &data);
+
 private slots:
 	void reset_repeatable_state();
 
@@ -57,4 +62,7 @@ public:
 			const std::string &undo_data, const std::string &redo_data, bool repeatable = false);
 	void undo();
 	void redo();
+
+	/* approximate memory used by the stored undo/redo data in bytes */
+	size_t memory_usage() const;
 };
@@ -613,7 +613,8 @@ static void SaveAudioDevice(const char *name, int channel, obs_data_t *parent, v
 
 static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder, obs_data_array_t *quickTransitionData,
 				    int transitionDuration, obs_data_array_t *transitions, OBSScene &scene,
-				    OBSSource &curProgramScene, obs_data_array_t *savedProjectorList)
+				    OBSSource &curProgramScene, obs_data_array_t *savedProjectorList,
+				    obs_save_cache_t *saveCache, BPtr<char> &sourcesJson, BPtr<char> &groupsJson)
 {
 	obs_data_t *saveData = obs_data_create();
 
@@ -638,19 +639,25 @@ static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder, obs_data_array
 	};
 	using FilterAudioSources_t = decltype(FilterAudioSources);
 
-	obs_data_array_t *sourcesArray = obs_save_sources_filtered(
+	sourcesJson = obs_save_cache_sources_json(
+		saveCache,
 		[](void *data, obs_source_t *source) {
 			auto &func = *static_cast<FilterAudioSources_t *>(data);
 			return func(source);
 		},
-		static_cast<void *>(&FilterAudioSources));
+		static_cast<void *>(&FilterAudioSources), 4);
 
 	/* -------------------------------- */
 	/* save group sources separately    */
 
 	/* saving separately ensures they won't be loaded in older versions */
-	obs_data_array_t *groupsArray = obs_save_sources_filtered(
-		[](void *, obs_source_t *source) { return obs_source_is_group(source); }, nullptr);
+	groupsJson = obs_save_cache_sources_json(
+		saveCache, [](void *, obs_source_t *source) { return obs_source_is_group(source); }, nullptr, 4);
+
+	/* the arrays are spliced into the placeholders when the file is
+	 * written, see SaveCollectionTask */
+	OBSDataArrayAutoRelease sourcesArray = obs_data_array_create();
+	OBSDataArrayAutoRelease groupsArray = obs_data_array_create();
 
 	/* -------------------------------- */
 
@@ -670,8 +677,6 @@ static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder, obs_data_array
 	obs_data_set_array(saveData, "quick_transitions", quickTransitionData);
 	obs_data_set_array(saveData, "transitions", transitions);
 	obs_data_set_array(saveData, "saved_projectors", savedProjectorList);
-	obs_data_array_release(sourcesArray);
-	obs_data_array_release(groupsArray);
 
 	obs_data_set_string(saveData, "current_transition", obs_source_get_name(transition));
 	obs_data_set_int(saveData, "transition_duration", transitionDuration);
@@ -816,8 +821,49 @@ obs_data_array_t *OBSBasic::SaveProjectors()
 	return savedProjectors;
 }
 
+struct CollectionSaveJob {
+	std::string file;
+	std::string json;
+	BPtr<char> sources;
+	BPtr<char> groups;
+};
+
+static bool SpliceArray(std::string &json, const char *key, const char *array)
+{
+	std::string placeholder = std::string("\n    \"") + key + "\": []";
+	size_t pos = json.find(placeholder);
+	if (pos == std::string::npos)
+		return false;
+
+	json.replace(pos + placeholder.size() - 2, 2, array);
+	return true;
+}
+
+static void SaveCollectionTask(void *param)
+{
+	std::unique_ptr<CollectionSaveJob> job(static_cast<CollectionSaveJob *>(param));
+
+	if (!SpliceArray(job->json, "sources", job->sources) || !SpliceArray(job->json, "groups", job->groups)) {
+		blog(LOG_ERROR, "Could not save scene data to %s: invalid save data", job->file.c_str());
+		return;
+	}
+
+	if (!os_quick_write_utf8_file_safe(job->file.c_str(), job->json.c_str(), job->json.size(), false, "tmp", "bak"))
+		blog(LOG_ERROR, "Could not save scene data to %s", job->file.c_str());
+}
+
 void OBSBasic::Save(const char *file)
 {
+	ProfileScope("OBSBasic::Save");
+
+	if (!saveCache)
+		saveCache = obs_save_cache_create();
+	if (!saveQueue)
+		saveQueue = os_task_queue_create();
+
+	BPtr<char> sourcesJson;
+	BPtr<char> groupsJson;
+
 	OBSScene scene = GetCurrentScene();
 	OBSSource curProgramScene = OBSGetStrongRef(programScene);
 	if (!curProgramScene)
@@ -828,7 +874,8 @@ void OBSBasic::Save(const char *file)
 	OBSDataArrayAutoRelease quickTrData = SaveQuickTransitions();
 	OBSDataArrayAutoRelease savedProjectorList = SaveProjectors();
 	OBSDataAutoRelease saveData = GenerateSaveData(sceneOrder, quickTrData, ui->transitionDuration->value(),
-						       transitions, scene, curProgramScene, savedProjectorList);
+						       transitions, scene, curProgramScene, savedProjectorList,
+						       saveCache, sourcesJson, groupsJson);
 
 	obs_data_set_bool(saveData, "preview_locked", ui->preview->Locked());
 	obs_data_set_bool(saveData, "scaling_enabled", ui->preview->IsFixedScaling());
@@ -880,8 +927,16 @@ void OBSBasic::Save(const char *file)
 		obs_data_set_obj(saveData, "migration_resolution", res);
 	}
 
-	if (!obs_data_save_json_pretty_safe(saveData, file, "tmp", "bak"))
-		blog(LOG_ERROR, "Could not save scene data to %s", file);
+	/* only assembling and writing the file is left to the task, the save
+	 * data references live source data and has to be serialized here */
+	CollectionSaveJob *job = new CollectionSaveJob;
+	job->file = file;
+	job->json = obs_data_get_json_pretty(saveData);
+	job->sources = std::move(sourcesJson);
+	job->groups = std::move(groupsJson);
+
+	if (!saveQueue || !os_task_queue_queue_task(saveQueue, SaveCollectionTask, job))
+		SaveCollectionTask(job);
 }
 
 void OBSBasic::DeferSaveBegin()
@@ -2887,6 +2942,10 @@ OBSBasic::~OBSBasic()
 	delete cpuUsageTimer;
 	os_cpu_usage_info_destroy(cpuUsageInfo);
 
+	/* finishes any pending save */
+	os_task_queue_destroy(saveQueue);
+	obs_save_cache_destroy(saveCache);
+
 	obs_hotkey_set_callback_routing_func(nullptr, nullptr);
 	ClearHotkeys();
 
@@ -2949,11 +3008,14 @@ OBSBasic::~OBSBasic()
 
 void OBSBasic::SaveProjectNow()
 {
-	if (disableSaving)
-		return;
+	if (!disableSaving) {
+		projectChanged = true;
+		SaveProjectDeferred();
+	}
 
-	projectChanged = true;
-	SaveProjectDeferred();
+	/* callers rely on the file being written once this returns */
+	if (saveQueue)
+		os_task_queue_wait(saveQueue);
 }
 
 void OBSBasic::SaveProject()
@@ -4708,6 +4770,9 @@ void OBSBasic::ClearSceneData()
 	obs_enum_scenes(cb, nullptr);
 	obs_enum_sources(cb, nullptr);
 
+	obs_save_cache_destroy(saveCache);
+	saveCache = nullptr;
+
 	OnEvent(OBS_FRONTEND_EVENT_SCENE_COLLECTION_CLEANUP);
 
 	undo_s.clear();
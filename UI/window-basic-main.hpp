@@ -48,6 +48,7 @@
 
 #include <util/platform.h>
 #include <util/threading.h>
+#include <util/task.h>
 #include <util/util.hpp>
 
 #include <QPointer>
@@ -252,6 +253,12 @@ private:
 	bool loaded = false;
 	long disableSaving = 1;
 	bool projectChanged = false;
+
+	/* sources are only serialized again when they change, and the file is
+	 * written on a background task */
+	obs_save_cache_t *saveCache = nullptr;
+	os_task_queue_t *saveQueue = nullptr;
+
 	bool previewEnabled = true;
 	ContextBarSize contextBarSize = ContextBarSize_Normal;
 
@@ -11,6 +11,7 @@ target_sources(
     obs-nix-platform.h
     obs-nix-x11.c
     obs-nix.c
+    util/buffered-file-io-uring.c
     util/pipe-posix.c
     util/platform-nix.c
     util/threading-posix.c
@@ -19,10 +19,15 @@
 #include "../util/base.h"
 #include "../util/platform.h"
 #include "../util/dstr.h"
+#include "../util/task.h"
+#include "../util/threading.h"
 #include "vec4.h"
 
 #define blog(level, format, ...) blog(level, "%s: " format, __FUNCTION__, __VA_ARGS__)
 
+#define DEFAULT_FRAME_CACHE_LIMIT (512ULL * 1024 * 1024)
+#define GIF_DECODE_AHEAD 8
+
 static void *bi_def_bitmap_create(int width, int height)
 {
 	return bmalloc((size_t)4 * width * height);
@@ -55,26 +60,318 @@ static void bi_def_bitmap_modified(void *bitmap)
 	UNUSED_PARAMETER(bitmap);
 }
 
-static inline int get_full_decoded_gif_size(gs_image_file_t *image)
+/* ------------------------------------------------------------------------- */
+/* Frames of animated gifs are decoded ahead of time on a task lane of the
+ * shared task pool, and kept in a cache shared by all image files.  When the
+ * cache is full the least recently used frames are dropped, and decoded again
+ * if they are needed again.  The frame being uploaded is pinned. */
+
+struct gif_cached_frame {
+	struct gs_gif_decoder *decoder;
+	int index;
+	long refs;
+	uint8_t *data;
+
+	struct gif_cached_frame *prev;
+	struct gif_cached_frame *next;
+};
+
+struct gs_gif_decoder {
+	gs_image_file_t *image;
+	enum gs_image_alpha_mode alpha_mode;
+
+	/* protected by the frame cache mutex once the first frame is cached */
+	uint64_t *mem_usage;
+	size_t frame_size;
+
+	/* protected by the frame cache mutex */
+	struct gif_cached_frame **frames;
+
+	os_task_lane_t *lane;
+	volatile long target;
+	volatile bool queued;
+
+	/* only used by the task lane */
+	int last_decoded_frame;
+
+	/* only used by the thread updating the texture */
+	int displayed_frame;
+};
+
+/* decoded frames are no longer kept in the image itself, so the decoder is
+ * stored in the animation_frame_data slot to keep the public layout */
+static inline struct gs_gif_decoder *get_decoder(const gs_image_file_t *image)
+{
+	return (struct gs_gif_decoder *)image->animation_frame_data;
+}
+
+static struct {
+	pthread_mutex_t mutex;
+
+	/* most recently used first */
+	struct gif_cached_frame *first;
+	struct gif_cached_frame *last;
+
+	uint64_t size;
+	uint64_t limit;
+} frame_cache = {PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, DEFAULT_FRAME_CACHE_LIMIT};
+
+static void lru_remove(struct gif_cached_frame *frame)
 {
-	return image->gif.width * image->gif.height * 4 * image->gif.frame_count;
+	if (frame->prev)
+		frame->prev->next = frame->next;
+	else
+		frame_cache.first = frame->next;
+
+	if (frame->next)
+		frame->next->prev = frame->prev;
+	else
+		frame_cache.last = frame->prev;
+
+	frame->prev = NULL;
+	frame->next = NULL;
 }
 
-static inline void *alloc_mem(gs_image_file_t *image, uint64_t *mem_usage, size_t size)
+static void lru_push_front(struct gif_cached_frame *frame)
 {
-	UNUSED_PARAMETER(image);
+	frame->next = frame_cache.first;
+	if (frame_cache.first)
+		frame_cache.first->prev = frame;
+	else
+		frame_cache.last = frame;
+	frame_cache.first = frame;
+}
+
+static void free_frame(struct gif_cached_frame *frame)
+{
+	struct gs_gif_decoder *decoder = frame->decoder;
+
+	lru_remove(frame);
+	decoder->frames[frame->index] = NULL;
+
+	frame_cache.size -= decoder->frame_size;
+	if (decoder->mem_usage)
+		*decoder->mem_usage -= decoder->frame_size;
+
+	bfree(frame->data);
+	bfree(frame);
+}
+
+static void evict_frames(struct gif_cached_frame *keep)
+{
+	struct gif_cached_frame *frame = frame_cache.last;
+
+	while (frame && frame_cache.size > frame_cache.limit) {
+		struct gif_cached_frame *prev = frame->prev;
+
+		if (frame != keep && !frame->refs)
+			free_frame(frame);
+		frame = prev;
+	}
+}
+
+void gs_image_file_set_frame_cache_limit(uint64_t limit)
+{
+	pthread_mutex_lock(&frame_cache.mutex);
+	frame_cache.limit = limit ? limit : DEFAULT_FRAME_CACHE_LIMIT;
+	evict_frames(NULL);
+	pthread_mutex_unlock(&frame_cache.mutex);
+}
+
+static void cache_frame(struct gs_gif_decoder *decoder, int index, uint8_t *data)
+{
+	struct gif_cached_frame *frame = bzalloc(sizeof(*frame));
+	frame->decoder = decoder;
+	frame->index = index;
+	frame->data = data;
+
+	pthread_mutex_lock(&frame_cache.mutex);
+
+	if (decoder->frames[index])
+		free_frame(decoder->frames[index]);
+
+	decoder->frames[index] = frame;
+	lru_push_front(frame);
+
+	frame_cache.size += decoder->frame_size;
+	if (decoder->mem_usage)
+		*decoder->mem_usage += decoder->frame_size;
+
+	evict_frames(frame);
+
+	pthread_mutex_unlock(&frame_cache.mutex);
+}
+
+static bool frame_cached(struct gs_gif_decoder *decoder, int index)
+{
+	pthread_mutex_lock(&frame_cache.mutex);
+	bool cached = decoder->frames[index] != NULL;
+	pthread_mutex_unlock(&frame_cache.mutex);
+	return cached;
+}
+
+static struct gif_cached_frame *pin_frame(struct gs_gif_decoder *decoder, int index)
+{
+	pthread_mutex_lock(&frame_cache.mutex);
+
+	struct gif_cached_frame *frame = decoder->frames[index];
+	if (frame) {
+		frame->refs++;
+		lru_remove(frame);
+		lru_push_front(frame);
+	}
+
+	pthread_mutex_unlock(&frame_cache.mutex);
+	return frame;
+}
+
+static void unpin_frame(struct gif_cached_frame *frame)
+{
+	pthread_mutex_lock(&frame_cache.mutex);
+	frame->refs--;
+	pthread_mutex_unlock(&frame_cache.mutex);
+}
+
+static bool cache_has_room(struct gs_gif_decoder *decoder)
+{
+	pthread_mutex_lock(&frame_cache.mutex);
+	bool room = frame_cache.size + decoder->frame_size <= frame_cache.limit;
+	pthread_mutex_unlock(&frame_cache.mutex);
+	return room;
+}
+
+static bool decode_frame(struct gs_gif_decoder *decoder, int index)
+{
+	gs_image_file_t *image = decoder->image;
+	const size_t area = (size_t)image->gif.width * image->gif.height;
+
+	/* frames are drawn on top of the previous ones, if looped start over */
+	if (index != decoder->last_decoded_frame) {
+		int first = (index < decoder->last_decoded_frame) ? 0 : decoder->last_decoded_frame + 1;
+
+		for (int i = first; i <= index; i++) {
+			if (gif_decode_frame(&image->gif, i) != GIF_OK) {
+				decoder->last_decoded_frame = -1;
+				return false;
+			}
+
+			decoder->last_decoded_frame = i;
+		}
+	}
+
+	/* the decoded image is drawn on by the next frame, so it has to stay
+	 * as it is */
+	uint8_t *data = bmalloc(decoder->frame_size);
+	const uint8_t *src = image->gif.frame_image;
+
+	if (decoder->alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB) {
+		gs_premultiply_xyza_srgb_loop_restrict(data, src, area);
+	} else if (decoder->alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY) {
+		gs_premultiply_xyza_loop_restrict(data, src, area);
+	} else {
+		memcpy(data, src, decoder->frame_size);
+	}
+
+	cache_frame(decoder, index, data);
+	return true;
+}
+
+static void gif_decode_task(void *param)
+{
+	struct gs_gif_decoder *decoder = param;
+	const int frame_count = (int)decoder->image->gif.frame_count;
+
+	/* requests made from here on queue another task */
+	os_atomic_set_bool(&decoder->queued, false);
+
+	long target = os_atomic_load_long(&decoder->target);
+	struct gif_cached_frame *pinned = NULL;
+
+	for (int i = 0; i <= GIF_DECODE_AHEAD && i < frame_count; i++) {
+		int index = (int)((target + i) % frame_count);
+
+		if (i) {
+			/* don't decode ahead of a frame that is not needed
+			 * anymore, or by evicting other frames */
+			if (os_atomic_load_long(&decoder->target) != target)
+				break;
+			if (!cache_has_room(decoder))
+				break;
+		}
+
+		if (!frame_cached(decoder, index) && !decode_frame(decoder, index))
+			break;
+
+		/* the frames decoded ahead must not evict the target */
+		if (!i)
+			pinned = pin_frame(decoder, index);
+	}
+
+	if (pinned)
+		unpin_frame(pinned);
+}
+
+static void request_frame(struct gs_gif_decoder *decoder, int index)
+{
+	os_atomic_set_long(&decoder->target, index);
+
+	if (!os_atomic_set_bool(&decoder->queued, true)) {
+		if (!os_task_lane_queue_task(decoder->lane, gif_decode_task, decoder))
+			os_atomic_set_bool(&decoder->queued, false);
+	}
+}
+
+static struct gs_gif_decoder *gif_decoder_create(gs_image_file_t *image, uint64_t *mem_usage,
+						 enum gs_image_alpha_mode alpha_mode)
+{
+	struct gs_gif_decoder *decoder = bzalloc(sizeof(*decoder));
+	os_task_pool_t *pool = os_task_pool_get_shared();
+
+	decoder->image = image;
+	decoder->alpha_mode = alpha_mode;
+	decoder->mem_usage = mem_usage;
+	decoder->frame_size = (size_t)image->gif.width * image->gif.height * 4;
+	decoder->frames = bzalloc(image->gif.frame_count * sizeof(struct gif_cached_frame *));
+	decoder->lane = os_task_lane_create(pool, true, OS_TASK_PRIORITY_NORMAL);
+	decoder->last_decoded_frame = -1;
+	decoder->displayed_frame = -1;
+
+	os_task_pool_release(pool);
 
 	if (mem_usage)
-		*mem_usage += size;
-	return bzalloc(size);
+		*mem_usage += image->gif.frame_count * sizeof(struct gif_cached_frame *);
+
+	/* the first frame is needed right away */
+	decode_frame(decoder, 0);
+	return decoder;
+}
+
+static void gif_decoder_destroy(struct gs_gif_decoder *decoder)
+{
+	if (!decoder)
+		return;
+
+	os_task_lane_cancel(decoder->lane);
+	os_task_lane_destroy(decoder->lane);
+
+	pthread_mutex_lock(&frame_cache.mutex);
+	for (unsigned int i = 0; i < decoder->image->gif.frame_count; i++) {
+		if (decoder->frames[i])
+			free_frame(decoder->frames[i]);
+	}
+	pthread_mutex_unlock(&frame_cache.mutex);
+
+	bfree(decoder->frames);
+	bfree(decoder);
 }
 
+/* ------------------------------------------------------------------------- */
+
 static bool init_animated_gif(gs_image_file_t *image, const char *path, uint64_t *mem_usage,
 			      enum gs_image_alpha_mode alpha_mode)
 {
 	bool is_animated_gif = true;
 	gif_result result;
-	uint64_t max_size;
 	size_t size, size_read;
 	FILE *file;
 
@@ -120,20 +417,8 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path, uint64_t
 		goto fail;
 	}
 
-	max_size = (uint64_t)image->gif.width * (uint64_t)image->gif.height * (uint64_t)image->gif.frame_count * 4LLU;
-
-	if ((uint64_t)get_full_decoded_gif_size(image) != max_size) {
-		blog(LOG_WARNING, "Gif '%s' overflowed maximum pointer size", path);
-		goto fail;
-	}
-
 	image->is_animated_gif = (image->gif.frame_count > 1 && result >= 0);
 	if (image->is_animated_gif) {
-		gif_decode_frame(&image->gif, 0);
-
-		image->animation_frame_cache = alloc_mem(image, mem_usage, image->gif.frame_count * sizeof(uint8_t *));
-		image->animation_frame_data = alloc_mem(image, mem_usage, get_full_decoded_gif_size(image));
-
 		for (unsigned int i = 0; i < image->gif.frame_count; i++) {
 			if (gif_decode_frame(&image->gif, i) != GIF_OK)
 				blog(LOG_WARNING,
@@ -142,8 +427,6 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path, uint64_t
 				     i, path);
 		}
 
-		gif_decode_frame(&image->gif, 0);
-
 		image->cx = (uint32_t)image->gif.width;
 		image->cy = (uint32_t)image->gif.height;
 		image->format = GS_RGBA;
@@ -153,11 +436,7 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path, uint64_t
 			*mem_usage += size;
 		}
 
-		if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB) {
-			gs_premultiply_xyza_srgb_loop(image->gif.frame_image, (size_t)image->cx * image->cy);
-		} else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY) {
-			gs_premultiply_xyza_loop(image->gif.frame_image, (size_t)image->cx * image->cy);
-		}
+		image->animation_frame_data = (uint8_t *)gif_decoder_create(image, mem_usage, alpha_mode);
 	} else {
 		gif_finalise(&image->gif);
 		bfree(image->gif_data);
@@ -226,9 +505,8 @@ void gs_image_file_free(gs_image_file_t *image)
 
 	if (image->loaded) {
 		if (image->is_animated_gif) {
+			gif_decoder_destroy(get_decoder(image));
 			gif_finalise(&image->gif);
-			bfree(image->animation_frame_cache);
-			bfree(image->animation_frame_data);
 		}
 
 		gs_texture_destroy(image->texture);
@@ -265,8 +543,19 @@ void gs_image_file_init_texture(gs_image_file_t *image)
 		return;
 
 	if (image->is_animated_gif) {
-		image->texture = gs_texture_create(image->cx, image->cy, image->format, 1,
-						   (const uint8_t **)&image->gif.frame_image, GS_DYNAMIC);
+		struct gs_gif_decoder *decoder = get_decoder(image);
+		struct gif_cached_frame *frame = pin_frame(decoder, image->cur_frame);
+		const uint8_t *data = frame ? frame->data : NULL;
+
+		image->texture =
+			gs_texture_create(image->cx, image->cy, image->format, 1, frame ? &data : NULL, GS_DYNAMIC);
+
+		if (frame) {
+			decoder->displayed_frame = image->cur_frame;
+			unpin_frame(frame);
+		} else {
+			request_frame(decoder, image->cur_frame);
+		}
 
 	} else {
 		image->texture = gs_texture_create(image->cx, image->cy, image->format, 1,
@@ -308,43 +597,7 @@ static inline int calculate_new_frame(gs_image_file_t *image, uint64_t elapsed_t
 	return new_frame;
 }
 
-static void decode_new_frame(gs_image_file_t *image, int new_frame, enum gs_image_alpha_mode alpha_mode)
-{
-	if (!image->animation_frame_cache[new_frame]) {
-		int last_frame;
-
-		/* if looped, decode frame 0 */
-		last_frame = (new_frame < image->last_decoded_frame) ? 0 : image->last_decoded_frame + 1;
-
-		/* decode missed frames */
-		for (int i = last_frame; i < new_frame; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				return;
-		}
-
-		/* decode actual desired frame */
-		if (gif_decode_frame(&image->gif, new_frame) == GIF_OK) {
-			const size_t area = (size_t)image->gif.width * image->gif.height;
-			size_t pos = new_frame * area * 4;
-			image->animation_frame_cache[new_frame] = image->animation_frame_data + pos;
-
-			if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB) {
-				gs_premultiply_xyza_srgb_loop(image->gif.frame_image, area);
-			} else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY) {
-				gs_premultiply_xyza_loop(image->gif.frame_image, area);
-			}
-
-			memcpy(image->animation_frame_cache[new_frame], image->gif.frame_image, area * 4);
-
-			image->last_decoded_frame = new_frame;
-		}
-	}
-
-	image->cur_frame = new_frame;
-}
-
-static bool gs_image_file_tick_internal(gs_image_file_t *image, uint64_t elapsed_time_ns,
-					enum gs_image_alpha_mode alpha_mode)
+static bool gs_image_file_tick_internal(gs_image_file_t *image, uint64_t elapsed_time_ns)
 {
 	int loops;
 
@@ -359,62 +612,81 @@ static bool gs_image_file_tick_internal(gs_image_file_t *image, uint64_t elapsed
 		int new_frame = calculate_new_frame(image, elapsed_time_ns, loops);
 
 		if (new_frame != image->cur_frame) {
-			decode_new_frame(image, new_frame, alpha_mode);
-			return true;
+			image->cur_frame = new_frame;
+			request_frame(get_decoder(image), new_frame);
 		}
 	}
 
-	return false;
+	/* until the current frame has been decoded and uploaded */
+	return image->cur_frame != get_decoder(image)->displayed_frame;
 }
 
 bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
 {
-	return gs_image_file_tick_internal(image, elapsed_time_ns, false);
+	return gs_image_file_tick_internal(image, elapsed_time_ns);
 }
 
 bool gs_image_file2_tick(gs_image_file2_t *if2, uint64_t elapsed_time_ns)
 {
-	return gs_image_file_tick_internal(&if2->image, elapsed_time_ns, false);
+	return gs_image_file_tick_internal(&if2->image, elapsed_time_ns);
 }
 
 bool gs_image_file3_tick(gs_image_file3_t *if3, uint64_t elapsed_time_ns)
 {
-	return gs_image_file_tick_internal(&if3->image2.image, elapsed_time_ns, if3->alpha_mode);
+	return gs_image_file_tick_internal(&if3->image2.image, elapsed_time_ns);
 }
 
 bool gs_image_file4_tick(gs_image_file4_t *if4, uint64_t elapsed_time_ns)
 {
-	return gs_image_file_tick_internal(&if4->image3.image2.image, elapsed_time_ns, if4->image3.alpha_mode);
+	return gs_image_file_tick_internal(&if4->image3.image2.image, elapsed_time_ns);
 }
 
-static void gs_image_file_update_texture_internal(gs_image_file_t *image, enum gs_image_alpha_mode alpha_mode)
+static void gs_image_file_update_texture_internal(gs_image_file_t *image)
 {
+	struct gs_gif_decoder *decoder = get_decoder(image);
+	struct gif_cached_frame *frame;
+
 	if (!image->is_animated_gif || !image->loaded)
 		return;
 
-	if (!image->animation_frame_cache[image->cur_frame])
-		decode_new_frame(image, image->cur_frame, alpha_mode);
+	/* keeps showing the last frame until the current one is decoded */
+	frame = pin_frame(decoder, image->cur_frame);
+	if (!frame) {
+		request_frame(decoder, image->cur_frame);
+		return;
+	}
+
+	gs_texture_set_image(image->texture, frame->data, image->gif.width * 4, false);
+	decoder->displayed_frame = image->cur_frame;
 
-	gs_texture_set_image(image->texture, image->animation_frame_cache[image->cur_frame], image->gif.width * 4,
-			     false);
+	unpin_frame(frame);
 }
 
 void gs_image_file_update_texture(gs_image_file_t *image)
 {
-	gs_image_file_update_texture_internal(image, false);
+	gs_image_file_update_texture_internal(image);
 }
 
 void gs_image_file2_update_texture(gs_image_file2_t *if2)
 {
-	gs_image_file_update_texture_internal(&if2->image, false);
+	gs_image_file_update_texture_internal(&if2->image);
 }
 
 void gs_image_file3_update_texture(gs_image_file3_t *if3)
 {
-	gs_image_file_update_texture_internal(&if3->image2.image, if3->alpha_mode);
+	gs_image_file_update_texture_internal(&if3->image2.image);
 }
 
 void gs_image_file4_update_texture(gs_image_file4_t *if4)
 {
-	gs_image_file_update_texture_internal(&if4->image3.image2.image, if4->image3.alpha_mode);
+	gs_image_file_update_texture_internal(&if4->image3.image2.image);
+}
+
+uint64_t gs_image_file2_get_mem_usage(gs_image_file2_t *if2)
+{
+	/* frames of animated gifs are cached and evicted in the background */
+	pthread_mutex_lock(&frame_cache.mutex);
+	uint64_t mem_usage = if2->mem_usage;
+	pthread_mutex_unlock(&frame_cache.mutex);
+	return mem_usage;
 }
@@ -66,6 +66,10 @@ typedef struct gs_image_file2 gs_image_file2_t;
 typedef struct gs_image_file3 gs_image_file3_t;
 typedef struct gs_image_file4 gs_image_file4_t;
 
+/* Limits the memory used by decoded frames of animated gifs, shared by all
+ * image files.  0 restores the default limit. */
+EXPORT void gs_image_file_set_frame_cache_limit(uint64_t limit);
+
 EXPORT void gs_image_file_init(gs_image_file_t *image, const char *file);
 EXPORT void gs_image_file_free(gs_image_file_t *image);
 
@@ -77,6 +81,7 @@ EXPORT void gs_image_file2_init(gs_image_file2_t *if2, const char *file);
 
 EXPORT bool gs_image_file2_tick(gs_image_file2_t *if2, uint64_t elapsed_time_ns);
 EXPORT void gs_image_file2_update_texture(gs_image_file2_t *if2);
+EXPORT uint64_t gs_image_file2_get_mem_usage(gs_image_file2_t *if2);
 
 EXPORT void gs_image_file3_init(gs_image_file3_t *if3, const char *file, enum gs_image_alpha_mode alpha_mode);
 
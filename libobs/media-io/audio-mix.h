@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string.h>
+
+#include "../util/c99defs.h"
+#include "../util/sse-intrin.h"
+
+/*
+ * Planar float audio kernels used by the audio thread (mixing, clamping,
+ * balancing and mono downmixing).
+ *
+ * These use SSE2 (NEON through simde on ARM), which is part of the baseline
+ * of every architecture libobs builds for, so no runtime dispatch is needed.
+ * All operations are done element-wise in the same order as the scalar tail.
+ * Results match the plain C loops they replace, except that a compiler may
+ * fuse the multiply-add of the scalar loops into a single FMA, which rounds
+ * differently.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* dst[i] += src[i] */
+static inline void audio_mix_add(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 out = _mm_loadu_ps(dst + i);
+		__m128 in = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(out, in));
+	}
+
+	for (; i < count; i++)
+		dst[i] += src[i];
+}
+
+/* dst[i] += src[i] * mul[i] */
+static inline void audio_mix_add_mul(float *dst, const float *src, const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 out = _mm_loadu_ps(dst + i);
+		__m128 in = _mm_mul_ps(_mm_loadu_ps(src + i), _mm_loadu_ps(mul + i));
+		_mm_storeu_ps(dst + i, _mm_add_ps(out, in));
+	}
+
+	for (; i < count; i++)
+		dst[i] += src[i] * mul[i];
+}
+
+/* data[i] *= mul */
+static inline void audio_mix_mul(float *data, float mul, size_t count)
+{
+	const __m128 mul4 = _mm_set1_ps(mul);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), mul4));
+
+	for (; i < count; i++)
+		data[i] *= mul;
+}
+
+/* Clamps samples to [-1.0, 1.0], NaN samples are replaced with silence */
+static inline void audio_mix_clamp(float *data, size_t count)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 neg_one = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_and_ps(val, _mm_cmpeq_ps(val, val));
+		val = _mm_min_ps(val, one);
+		val = _mm_max_ps(val, neg_one);
+		_mm_storeu_ps(data + i, val);
+	}
+
+	for (; i < count; i++) {
+		float val = data[i];
+		val = (val == val) ? val : 0.0f;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+/* Averages all channels and writes the result back to every channel */
+static inline void audio_mix_downmix_mono(float **data, size_t channels, size_t frames)
+{
+	const float channels_i = 1.0f / (float)channels;
+
+	for (size_t channel = 1; channel < channels; channel++)
+		audio_mix_add(data[0], data[channel], frames);
+
+	audio_mix_mul(data[0], channels_i, frames);
+
+	for (size_t channel = 1; channel < channels; channel++)
+		memcpy(data[channel], data[0], frames * sizeof(float));
+}
+
+#ifdef __cplusplus
+}
+#endif
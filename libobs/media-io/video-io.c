@@ -22,6 +22,7 @@
 #include "../util/profiler.h"
 #include "../util/threading.h"
 #include "../util/darray.h"
+#include "../util/deque.h"
 #include "../util/util_uint64.h"
 
 #include "format-conversion.h"
@@ -33,14 +34,32 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
+#define MAX_QUEUED_INPUT_FRAMES 2
 
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+
+	/* number of queued input frames still referencing this frame */
+	volatile long refs;
+
+	/* planes of the cache itself, while the frame references external
+	 * memory that is released once the frame is available again */
+	uint8_t *data[MAX_AV_PLANES];
+	uint32_t linesize[MAX_AV_PLANES];
+	void (*release)(void *param);
+	void *release_param;
+};
+
+struct queued_input_frame {
+	struct video_data frame;
+	struct cached_frame_info *cfi;
+	int count;
 };
 
 struct video_input {
+	struct video_output *video;
 	struct video_scale_info conversion;
 	video_scaler_t *scaler;
 	struct video_frame frame[MAX_CONVERT_BUFFERS];
@@ -58,14 +77,20 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
-};
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+	/* each input scales and delivers its frames on its own thread so that
+	 * a slow scaler or encoder only lags that input */
+	pthread_t thread;
+	bool thread_created;
+	os_sem_t *frame_sem;
+	pthread_mutex_t frames_mutex;
+	struct deque frames;
+	volatile bool stop;
+	bool detached;
+
+	volatile long skipped_frames;
+	volatile long total_frames;
+};
 
 struct video_output {
 	struct video_output_info info;
@@ -80,10 +105,15 @@ struct video_output {
 	volatile long total_frames;
 
 	pthread_mutex_t input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input *) inputs;
+
+	pthread_mutex_t detached_mutex;
+	pthread_cond_t detached_cond;
+	long detached_inputs;
 
 	size_t available_frames;
 	size_t first_added;
+	size_t first_locked;
 	size_t last_added;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
@@ -95,6 +125,48 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
+static void release_external_frame(struct cached_frame_info *cfi)
+{
+	if (!cfi->release)
+		return;
+
+	cfi->release(cfi->release_param);
+	cfi->release = NULL;
+	cfi->release_param = NULL;
+
+	memcpy(cfi->frame.data, cfi->data, sizeof(cfi->data));
+	memcpy(cfi->frame.linesize, cfi->linesize, sizeof(cfi->linesize));
+}
+
+/* Cache frames are made available again in order once they have been sent to
+ * every input and no input queue references them anymore.  Must be called
+ * with data_mutex locked. */
+static void release_frames(struct video_output *video)
+{
+	while (video->available_frames < video->info.cache_size) {
+		struct cached_frame_info *cfi = &video->cache[video->first_locked];
+
+		if (cfi->count || os_atomic_load_long(&cfi->refs))
+			break;
+
+		release_external_frame(cfi);
+
+		if (++video->first_locked == video->info.cache_size)
+			video->first_locked = 0;
+
+		if (++video->available_frames == video->info.cache_size)
+			video->last_added = video->first_locked;
+	}
+}
+
+static void release_input_frame(struct video_output *video, struct queued_input_frame *qif)
+{
+	pthread_mutex_lock(&video->data_mutex);
+	os_atomic_dec_long(&qif->cfi->refs);
+	release_frames(video);
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
 static inline bool scale_video_output(struct video_input *input, struct video_data *data)
 {
 	bool success = true;
@@ -123,11 +195,149 @@ static inline bool scale_video_output(struct video_input *input, struct video_da
 	return success;
 }
 
+static void drain_input_frames(struct video_input *input)
+{
+	struct queued_input_frame qif;
+
+	pthread_mutex_lock(&input->frames_mutex);
+	while (input->frames.size) {
+		deque_pop_front(&input->frames, &qif, sizeof(qif));
+		release_input_frame(input->video, &qif);
+	}
+	pthread_mutex_unlock(&input->frames_mutex);
+}
+
+static void video_input_free(struct video_input *input);
+
+static void *video_input_thread(void *param)
+{
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+	const uint64_t frame_step = video->frame_time * input->frame_rate_divisor;
+	bool detached = false;
+
+	os_set_thread_name("video-io: input thread");
+
+	const char *input_thread_name =
+		profile_store_name(obs_get_profiler_name_store(), "video_input_thread(%s)", video->info.name);
+
+	while (os_sem_wait(input->frame_sem) == 0) {
+		struct queued_input_frame qif;
+
+		pthread_mutex_lock(&input->frames_mutex);
+		if (os_atomic_load_bool(&input->stop)) {
+			detached = input->detached;
+			pthread_mutex_unlock(&input->frames_mutex);
+			break;
+		}
+		if (!input->frames.size) {
+			pthread_mutex_unlock(&input->frames_mutex);
+			continue;
+		}
+		deque_pop_front(&input->frames, &qif, sizeof(qif));
+		pthread_mutex_unlock(&input->frames_mutex);
+
+		profile_start(input_thread_name);
+
+		if (scale_video_output(input, &qif.frame)) {
+			for (int i = 0; i < qif.count && !os_atomic_load_bool(&input->stop); i++) {
+				input->callback(input->param, &qif.frame);
+				qif.frame.timestamp += frame_step;
+			}
+		}
+
+		profile_end(input_thread_name);
+		profile_reenable_thread();
+
+		release_input_frame(video, &qif);
+	}
+
+	/* the input disconnected itself from its own callback, so nobody else
+	 * is left to clean it up */
+	if (detached) {
+		pthread_detach(pthread_self());
+		input->thread_created = false;
+		video_input_free(input);
+
+		pthread_mutex_lock(&video->detached_mutex);
+		if (--video->detached_inputs == 0)
+			pthread_cond_signal(&video->detached_cond);
+		pthread_mutex_unlock(&video->detached_mutex);
+	}
+
+	return NULL;
+}
+
+static void video_input_stop(struct video_input *input)
+{
+	if (!input->thread_created)
+		return;
+
+	pthread_mutex_lock(&input->frames_mutex);
+	os_atomic_set_bool(&input->stop, true);
+	pthread_mutex_unlock(&input->frames_mutex);
+
+	os_sem_post(input->frame_sem);
+	pthread_join(input->thread, NULL);
+	input->thread_created = false;
+}
+
+static void video_input_free(struct video_input *input)
+{
+	video_input_stop(input);
+	drain_input_frames(input);
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&input->frame[i]);
+	video_scaler_destroy(input->scaler);
+
+	deque_free(&input->frames);
+	os_sem_destroy(input->frame_sem);
+	pthread_mutex_destroy(&input->frames_mutex);
+	bfree(input);
+}
+
+/* Queues the current frame for an input.  If the input has fallen behind, the
+ * last queued frame is delivered again instead, the same way the output
+ * repeats frames when the cache is full.  Returns true if the input lagged. */
+static bool video_input_queue_frame(struct video_input *input, struct cached_frame_info *cfi)
+{
+	struct queued_input_frame qif;
+	bool lagged = false;
+
+	os_atomic_inc_long(&input->total_frames);
+
+	pthread_mutex_lock(&input->frames_mutex);
+
+	if (input->frames.size >= MAX_QUEUED_INPUT_FRAMES * sizeof(qif)) {
+		deque_pop_back(&input->frames, &qif, sizeof(qif));
+		qif.count++;
+		deque_push_back(&input->frames, &qif, sizeof(qif));
+
+		os_atomic_inc_long(&input->skipped_frames);
+		lagged = true;
+	} else {
+		qif.frame = cfi->frame;
+		qif.cfi = cfi;
+		qif.count = 1;
+		os_atomic_inc_long(&cfi->refs);
+		deque_push_back(&input->frames, &qif, sizeof(qif));
+	}
+
+	pthread_mutex_unlock(&input->frames_mutex);
+
+	if (!lagged)
+		os_sem_post(input->frame_sem);
+
+	return lagged;
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
 	bool complete;
 	bool skipped;
+	bool lagged = false;
 
 	/* -------------------------------- */
 
@@ -142,8 +352,7 @@ static inline bool video_output_cur_frame(struct video_output *video)
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
-		struct video_data frame = frame_info->frame;
+		struct video_input *input = video->inputs.array[i];
 
 		// an explicit counter is used instead of remainder calculation
 		// to allow multiple encoders started at the same time to start on
@@ -155,8 +364,8 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (skip)
 			continue;
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (video_input_queue_frame(input, frame_info))
+			lagged = true;
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -173,13 +382,16 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		release_frames(video);
 	} else if (skipped) {
 		--frame_info->skipped;
 		os_atomic_inc_long(&video->skipped_frames);
+		lagged = false;
 	}
 
+	if (lagged)
+		os_atomic_inc_long(&video->skipped_frames);
+
 	pthread_mutex_unlock(&video->data_mutex);
 
 	/* -------------------------------- */
@@ -231,6 +443,9 @@ static inline void init_cache(struct video_output *video)
 		frame = (struct video_frame *)&video->cache[i];
 
 		video_frame_init(frame, video->info.format, video->info.width, video->info.height);
+
+		memcpy(video->cache[i].data, frame->data, sizeof(frame->data));
+		memcpy(video->cache[i].linesize, frame->linesize, sizeof(frame->linesize));
 	}
 
 	video->available_frames = video->info.cache_size;
@@ -254,18 +469,26 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail0;
 	if (pthread_mutex_init_recursive(&out->input_mutex) != 0)
 		goto fail1;
-	if (os_sem_init(&out->update_semaphore, 0) != 0)
+	if (pthread_mutex_init(&out->detached_mutex, NULL) != 0)
 		goto fail2;
-	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
+	if (pthread_cond_init(&out->detached_cond, NULL) != 0)
 		goto fail3;
+	if (os_sem_init(&out->update_semaphore, 0) != 0)
+		goto fail4;
+	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
+		goto fail5;
 
 	init_cache(out);
 
 	*video = out;
 	return VIDEO_OUTPUT_SUCCESS;
 
-fail3:
+fail5:
 	os_sem_destroy(out->update_semaphore);
+fail4:
+	pthread_cond_destroy(&out->detached_cond);
+fail3:
+	pthread_mutex_destroy(&out->detached_mutex);
 fail2:
 	pthread_mutex_destroy(&out->input_mutex);
 fail1:
@@ -285,14 +508,23 @@ void video_output_close(video_t *video)
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video->inputs.array[i]);
 	da_free(video->inputs);
 
-	for (size_t i = 0; i < video->info.cache_size; i++)
+	pthread_mutex_lock(&video->detached_mutex);
+	while (video->detached_inputs > 0)
+		pthread_cond_wait(&video->detached_cond, &video->detached_mutex);
+	pthread_mutex_unlock(&video->detached_mutex);
+
+	for (size_t i = 0; i < video->info.cache_size; i++) {
+		release_external_frame(&video->cache[i]);
 		video_frame_free((struct video_frame *)&video->cache[i]);
+	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 	os_sem_destroy(video->update_semaphore);
+	pthread_cond_destroy(&video->detached_cond);
+	pthread_mutex_destroy(&video->detached_mutex);
 	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 
@@ -303,7 +535,7 @@ static size_t video_get_input_idx(const video_t *video, void (*callback)(void *p
 				  void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -408,30 +640,37 @@ bool video_output_connect2(video_t *video, const struct video_scale_info *conver
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param = param;
+		input->video = video;
+		input->callback = callback;
+		input->param = param;
 
-		input.frame_rate_divisor = frame_rate_divisor;
+		input->frame_rate_divisor = frame_rate_divisor;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = video->info.format;
-			input.conversion.width = video->info.width;
-			input.conversion.height = video->info.height;
-			input.conversion.range = video->info.range;
-			input.conversion.colorspace = video->info.colorspace;
+			input->conversion.format = video->info.format;
+			input->conversion.width = video->info.width;
+			input->conversion.height = video->info.height;
+			input->conversion.range = video->info.range;
+			input->conversion.colorspace = video->info.colorspace;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
+
+		pthread_mutex_init_value(&input->frames_mutex);
+		success = pthread_mutex_init(&input->frames_mutex, NULL) == 0 &&
+			  os_sem_init(&input->frame_sem, 0) == 0 && video_input_init(input, video);
+		if (success) {
+			input->thread_created = pthread_create(&input->thread, NULL, video_input_thread, input) == 0;
+			success = input->thread_created;
+		}
 
-		success = video_input_init(&input, video);
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -440,6 +679,8 @@ bool video_output_connect2(video_t *video, const struct video_scale_info *conver
 				os_atomic_set_bool(&video->raw_active, true);
 			}
 			da_push_back(video->inputs, &input);
+		} else {
+			video_input_free(input);
 		}
 	}
 
@@ -448,6 +689,16 @@ bool video_output_connect2(video_t *video, const struct video_scale_info *conver
 	return success;
 }
 
+static void log_input_skipped(struct video_input *input)
+{
+	long skipped = os_atomic_load_long(&input->skipped_frames);
+	long total = os_atomic_load_long(&input->total_frames);
+
+	if (skipped)
+		blog(LOG_INFO, "video-io: Input %ux%u lagged on %ld/%ld frames (%0.1f%%)", input->conversion.width,
+		     input->conversion.height, skipped, total, (double)skipped / (double)total * 100.0);
+}
+
 static void log_skipped(video_t *video)
 {
 	long skipped = os_atomic_load_long(&video->skipped_frames);
@@ -469,11 +720,13 @@ void video_output_disconnect(video_t *video, void (*callback)(void *param, struc
 
 	video = get_root(video);
 
+	struct video_input *input = NULL;
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
 
 		if (video->inputs.num == 0) {
@@ -485,6 +738,63 @@ void video_output_disconnect(video_t *video, void (*callback)(void *param, struc
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	if (!input)
+		return;
+
+	log_input_skipped(input);
+
+	/* the input thread can't join itself (e.g. an encoder that stops
+	 * itself on error), so let it clean up after itself on exit */
+	if (input->thread_created && pthread_equal(pthread_self(), input->thread)) {
+		pthread_mutex_lock(&video->detached_mutex);
+		video->detached_inputs++;
+		pthread_mutex_unlock(&video->detached_mutex);
+
+		pthread_mutex_lock(&input->frames_mutex);
+		os_atomic_set_bool(&input->stop, true);
+		input->detached = true;
+		pthread_mutex_unlock(&input->frames_mutex);
+
+		os_sem_post(input->frame_sem);
+	} else {
+		video_input_free(input);
+	}
+}
+
+static uint32_t get_input_frames(video_t *video, void (*callback)(void *param, struct video_data *frame), void *param,
+				 bool skipped)
+{
+	uint32_t frames = 0;
+
+	if (!video || !callback)
+		return 0;
+
+	video = get_root(video);
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input *input = video->inputs.array[idx];
+		frames = (uint32_t)os_atomic_load_long(skipped ? &input->skipped_frames : &input->total_frames);
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return frames;
+}
+
+uint32_t video_output_get_input_skipped_frames(video_t *video, void (*callback)(void *param, struct video_data *frame),
+					       void *param)
+{
+	return get_input_frames(video, callback, param, true);
+}
+
+uint32_t video_output_get_input_total_frames(video_t *video, void (*callback)(void *param, struct video_data *frame),
+					     void *param)
+{
+	return get_input_frames(video, callback, param, false);
 }
 
 bool video_output_active(const video_t *video)
@@ -512,8 +822,17 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame, int coun
 	pthread_mutex_lock(&video->data_mutex);
 
 	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
+		cfi = &video->cache[video->last_added];
+
+		/* the newest frame may already have been sent to every input and
+		 * only be waiting on lagging inputs, so send it again */
+		if (cfi->count == 0) {
+			video->first_added = video->last_added;
+			os_sem_post(video->update_semaphore);
+		}
+
+		cfi->count += count;
+		cfi->skipped += count;
 		locked = false;
 
 	} else {
@@ -537,6 +856,31 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame, int coun
 	return locked;
 }
 
+bool video_output_set_external_frame(video_t *video, const struct video_frame *frame, void (*release)(void *param),
+				     void *param)
+{
+	struct cached_frame_info *cfi;
+
+	if (!video || !frame || !release)
+		return false;
+
+	video = get_root(video);
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	cfi = &video->cache[video->last_added];
+	release_external_frame(cfi);
+
+	memcpy(cfi->frame.data, frame->data, sizeof(frame->data));
+	memcpy(cfi->frame.linesize, frame->linesize, sizeof(frame->linesize));
+	cfi->release = release;
+	cfi->release_param = param;
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	return true;
+}
+
 void video_output_unlock_frame(video_t *video)
 {
 	if (!video)
@@ -310,6 +310,12 @@ EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *video_output_get_info(const video_t *video);
 EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame, int count, uint64_t timestamp);
+/* Makes the frame locked with video_output_lock_frame reference the planes of
+ * the specified frame instead of copying them into the cache.  The planes
+ * must stay valid until release is called, which happens from any thread
+ * once every input is done with the frame, or when the output is closed. */
+EXPORT bool video_output_set_external_frame(video_t *video, const struct video_frame *frame,
+					    void (*release)(void *param), void *param);
 EXPORT void video_output_unlock_frame(video_t *video);
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
 EXPORT void video_output_stop(video_t *video);
@@ -323,6 +329,15 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+/* Each connected input is fed on its own thread, so lag is tracked per input
+ * as well (frames that had to be repeated because the input fell behind) */
+EXPORT uint32_t video_output_get_input_skipped_frames(video_t *video,
+						      void (*callback)(void *param, struct video_data *frame),
+						      void *param);
+EXPORT uint32_t video_output_get_input_total_frames(video_t *video,
+						    void (*callback)(void *param, struct video_data *frame),
+						    void *param);
+
 extern void video_output_inc_texture_encoders(video_t *video);
 extern void video_output_dec_texture_encoders(video_t *video);
 extern void video_output_inc_texture_frames(video_t *video);
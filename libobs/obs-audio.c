@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "media-io/audio-mix.h"
 
 struct ts_info {
 	uint64_t start;
@@ -30,14 +31,23 @@ struct ts_info {
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
 	struct obs_core_audio *audio = p;
+	size_t idx = da_find(audio->render_order, &source, 0);
 
-	if (da_find(audio->render_order, &source, 0) == DARRAY_INVALID) {
+	if (idx == DARRAY_INVALID) {
 		obs_source_t *s = obs_source_get_ref(source);
-		if (s)
-			da_push_back(audio->render_order, &s);
+		if (!s)
+			return;
+
+		idx = audio->render_order.num;
+		da_push_back(audio->render_order, &s);
 	}
 
-	UNUSED_PARAMETER(parent);
+	/* the parent mixes the audio of the source, so it has to be rendered
+	 * after it */
+	if (parent && audio->render_lane) {
+		struct audio_render_edge edge = {parent, idx};
+		da_push_back(audio->render_edges, &edge);
+	}
 }
 
 static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
@@ -45,8 +55,8 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 	return (size_t)util_mul_div64(t, sample_rate, 1000000000ULL);
 }
 
-static inline void mix_audio(struct audio_output_data *mixes, obs_source_t *source, size_t channels, size_t sample_rate,
-			     struct ts_info *ts)
+static inline void mix_audio(struct audio_output_data *mixes, obs_source_t *source, uint32_t mixers, size_t channels,
+			     size_t sample_rate, struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -63,16 +73,14 @@ static inline void mix_audio(struct audio_output_data *mixes, obs_source_t *sour
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud = source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			mix += start_point;
-			end = aud + total_floats;
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *mix = mixes[mix_idx].data[ch] + start_point;
+			const float *aud = source->audio_output_buf[mix_idx][ch];
 
-			while (aud < end)
-				*(mix++) += *(aud++);
+			audio_mix_add(mix, aud, total_floats);
 		}
 	}
 }
@@ -448,6 +456,126 @@ static inline void release_audio_sources(struct obs_core_audio *audio)
 		obs_source_release(audio->render_order.array[i]);
 }
 
+static void render_audio_source(obs_source_t *source, const struct audio_render_tick *tick)
+{
+	struct obs_core_audio *audio = &obs->audio;
+	uint64_t start = source_profiler_source_audio_render_start();
+
+	obs_source_audio_render(source, tick->mixers, tick->channels, tick->sample_rate, tick->size);
+
+	/* if a source has gone backward in time and we can no
+	 * longer buffer, drop some or all of its audio */
+	if (audio_buffering_maxed(audio) && source->audio_ts != 0 && source->audio_ts < tick->start_ts) {
+		if (source->info.audio_render) {
+			blog(LOG_DEBUG,
+			     "render audio source %s timestamp has "
+			     "gone backwards",
+			     obs_source_get_name(source));
+
+			/* just avoid further damage */
+			source->audio_pending = true;
+#if DEBUG_AUDIO == 1
+			/* this should really be fixed */
+			assert(false);
+#endif
+		} else {
+			pthread_mutex_lock(&source->audio_buf_mutex);
+			bool rerender = ignore_audio(source, tick->channels, tick->sample_rate, tick->start_ts);
+			pthread_mutex_unlock(&source->audio_buf_mutex);
+
+			/* if we (potentially) recovered, re-render */
+			if (rerender)
+				obs_source_audio_render(source, tick->mixers, tick->channels, tick->sample_rate,
+							tick->size);
+		}
+	}
+
+	source_profiler_source_audio_render_end(source, start);
+}
+
+static void render_audio_node(void *param);
+
+static inline void queue_audio_node(struct obs_core_audio *audio, struct audio_render_node *node)
+{
+	if (!os_task_lane_queue_task(audio->render_lane, render_audio_node, node))
+		render_audio_node(node);
+}
+
+static void render_audio_node(void *param)
+{
+	struct obs_core_audio *audio = &obs->audio;
+	struct audio_render_node *node = param;
+
+	while (node) {
+		struct audio_render_node *next = NULL;
+
+		render_audio_source(node->source, &audio->render_tick);
+
+		/* continue with the first parent that became ready on this
+		 * thread, the others go back to the pool */
+		for (size_t i = 0; i < node->dependents.num; i++) {
+			struct audio_render_node *dependent = audio->render_nodes.array + node->dependents.array[i];
+
+			if (os_atomic_dec_long(&dependent->deps_left) != 0)
+				continue;
+
+			if (!next)
+				next = dependent;
+			else
+				queue_audio_node(audio, dependent);
+		}
+
+		node = next;
+	}
+}
+
+static void render_audio_sources(struct obs_core_audio *audio)
+{
+	size_t num = audio->render_order.num;
+	struct audio_render_node *nodes;
+
+	if (!audio->render_lane || num < 2) {
+		for (size_t i = 0; i < num; i++)
+			render_audio_source(audio->render_order.array[i], &audio->render_tick);
+		return;
+	}
+
+	/* never shrunk so that the dependency arrays can be reused */
+	if (audio->render_nodes.num < num)
+		da_resize(audio->render_nodes, num);
+
+	nodes = audio->render_nodes.array;
+
+	for (size_t i = 0; i < num; i++) {
+		nodes[i].source = audio->render_order.array[i];
+		nodes[i].num_deps = 0;
+		da_resize(nodes[i].dependents, 0);
+	}
+
+	for (size_t i = 0; i < audio->render_edges.num; i++) {
+		struct audio_render_edge *edge = audio->render_edges.array + i;
+		size_t parent = da_find(audio->render_order, &edge->parent, 0);
+
+		/* children always precede their parents in the render order,
+		 * anything else is ignored to keep the graph acyclic */
+		if (parent == DARRAY_INVALID || parent <= edge->child)
+			continue;
+
+		da_push_back(nodes[edge->child].dependents, &parent);
+		nodes[parent].num_deps++;
+	}
+
+	for (size_t i = 0; i < num; i++)
+		nodes[i].deps_left = nodes[i].num_deps;
+
+	for (size_t i = 0; i < num; i++) {
+		if (!nodes[i].num_deps)
+			queue_audio_node(audio, &nodes[i]);
+	}
+
+	os_task_lane_wait(audio->render_lane);
+}
+
 static inline void execute_audio_tasks(void)
 {
 	struct obs_core_audio *audio = &obs->audio;
@@ -479,6 +607,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in, uint6
 
 	da_resize(audio->render_order, 0);
 	da_resize(audio->root_nodes, 0);
+	da_resize(audio->render_edges, 0);
 
 	deque_push_back(&audio->buffered_timestamps, &ts, sizeof(ts));
 	deque_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
@@ -531,36 +660,13 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in, uint6
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate, audio_size);
-
-		/* if a source has gone backward in time and we can no
-		 * longer buffer, drop some or all of its audio */
-		if (audio_buffering_maxed(audio) && source->audio_ts != 0 && source->audio_ts < ts.start) {
-			if (source->info.audio_render) {
-				blog(LOG_DEBUG,
-				     "render audio source %s timestamp has "
-				     "gone backwards",
-				     obs_source_get_name(source));
-
-				/* just avoid further damage */
-				source->audio_pending = true;
-#if DEBUG_AUDIO == 1
-				/* this should really be fixed */
-				assert(false);
-#endif
-			} else {
-				pthread_mutex_lock(&source->audio_buf_mutex);
-				bool rerender = ignore_audio(source, channels, sample_rate, ts.start);
-				pthread_mutex_unlock(&source->audio_buf_mutex);
-
-				/* if we (potentially) recovered, re-render */
-				if (rerender)
-					obs_source_audio_render(source, mixers, channels, sample_rate, audio_size);
-			}
-		}
-	}
+	audio->render_tick.mixers = mixers;
+	audio->render_tick.channels = channels;
+	audio->render_tick.sample_rate = sample_rate;
+	audio->render_tick.size = audio_size;
+	audio->render_tick.start_ts = ts.start;
+
+	render_audio_sources(audio);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
@@ -590,7 +696,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in, uint6
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate, &ts);
+				mix_audio(mixes, source, mixers, channels, sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -299,6 +299,11 @@ static void add_connection(struct obs_encoder *encoder)
 		struct audio_convert_info audio_info = {0};
 		get_audio_info(encoder, &audio_info);
 
+		if (!encoder->audio_lane && obs->audio.task_pool)
+			encoder->audio_lane = os_task_lane_create(obs->audio.task_pool, true, OS_TASK_PRIORITY_HIGH);
+
+		os_atomic_set_bool(&encoder->audio_encode_failed, false);
+
 		audio_output_connect(encoder->media, encoder->mixer_idx, &audio_info, receive_audio, encoder);
 	} else {
 		struct video_scale_info info = {0};
@@ -323,11 +328,34 @@ static void add_connection(struct obs_encoder *encoder)
 	set_encoder_active(encoder, true);
 }
 
+/* waits for the audio frames that are still queued to be encoded */
+static void finish_audio_encoding(struct obs_encoder *encoder)
+{
+	/* encoding errors stop the encoder from within the lane */
+	if (os_task_lane_inside(encoder->audio_lane))
+		return;
+
+	os_task_lane_wait(encoder->audio_lane);
+
+	if (encoder->audio_frames_encoded) {
+		blog(LOG_DEBUG,
+		     "encoder '%s': %" PRIu64 " audio frames encoded, max queue depth %ld, "
+		     "average queue latency %.2f ms",
+		     encoder->context.name, encoder->audio_frames_encoded, encoder->audio_queue_max,
+		     (double)encoder->audio_queue_wait_ns / (double)encoder->audio_frames_encoded / 1000000.0);
+	}
+
+	encoder->audio_queue_max = 0;
+	encoder->audio_queue_wait_ns = 0;
+	encoder->audio_frames_encoded = 0;
+}
+
 void obs_encoder_group_actually_destroy(obs_encoder_group_t *group);
 static void remove_connection(struct obs_encoder *encoder, bool shutdown)
 {
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		audio_output_disconnect(encoder->media, encoder->mixer_idx, receive_audio, encoder);
+		finish_audio_encoding(encoder);
 	} else {
 		if (gpu_encode_available(encoder)) {
 			stop_gpu_encode(encoder);
@@ -381,6 +409,7 @@ void obs_encoder_destroy(obs_encoder_t *encoder)
 
 		obs_encoder_set_group(encoder, NULL);
 
+		os_task_lane_destroy(encoder->audio_lane);
 		free_audio_buffers(encoder);
 
 		if (encoder->context.data)
@@ -1581,10 +1610,88 @@ fail:
 	return success;
 }
 
+struct audio_encode_job {
+	struct obs_encoder *encoder;
+	int64_t pts;
+	uint64_t queued_ts;
+	uint8_t *data[MAX_AV_PLANES];
+};
+
+static const char *encode_audio_frame_name = "encode_audio_frame";
+static void encode_audio_frame(void *param)
+{
+	struct audio_encode_job *job = param;
+	struct obs_encoder *encoder = job->encoder;
+	struct encoder_frame enc_frame;
+
+	profile_start(encode_audio_frame_name);
+
+	encoder->audio_queue_wait_ns += os_gettime_ns() - job->queued_ts;
+
+	/* this frame included */
+	long queued = os_atomic_load_long(&encoder->audio_queued);
+	if (queued > encoder->audio_queue_max)
+		encoder->audio_queue_max = queued;
+
+	/* the frames queued before an error was handled are dropped */
+	if (!os_atomic_load_bool(&encoder->audio_encode_failed)) {
+		encoder->audio_frames_encoded++;
+		memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+		for (size_t i = 0; i < encoder->planes; i++) {
+			enc_frame.data[i] = job->data[i];
+			enc_frame.linesize[i] = (uint32_t)encoder->framesize_bytes;
+		}
+
+		enc_frame.frames = (uint32_t)encoder->framesize;
+		enc_frame.pts = job->pts;
+
+		if (!do_encode(encoder, &enc_frame, NULL))
+			os_atomic_set_bool(&encoder->audio_encode_failed, true);
+	}
+
+	os_atomic_dec_long(&encoder->audio_queued);
+	bfree(job);
+
+	profile_end(encode_audio_frame_name);
+}
+
+static bool queue_audio_data(struct obs_encoder *encoder)
+{
+	/* keep the planes as aligned as separately allocated ones */
+	size_t header_size = (sizeof(struct audio_encode_job) + 31) & ~(size_t)31;
+	size_t plane_size = (encoder->framesize_bytes + 31) & ~(size_t)31;
+	struct audio_encode_job *job = bmalloc(header_size + encoder->planes * plane_size);
+	uint8_t *planes = (uint8_t *)job + header_size;
+
+	job->encoder = encoder;
+	job->pts = encoder->cur_pts;
+
+	for (size_t i = 0; i < encoder->planes; i++) {
+		job->data[i] = planes + i * plane_size;
+		deque_pop_front(&encoder->audio_input_buffer[i], job->data[i], encoder->framesize_bytes);
+	}
+
+	os_atomic_inc_long(&encoder->audio_queued);
+	job->queued_ts = os_gettime_ns();
+
+	if (!os_task_lane_queue_task(encoder->audio_lane, encode_audio_frame, job)) {
+		os_atomic_dec_long(&encoder->audio_queued);
+		bfree(job);
+		return false;
+	}
+
+	encoder->cur_pts += encoder->framesize;
+	return true;
+}
+
 static bool send_audio_data(struct obs_encoder *encoder)
 {
 	struct encoder_frame enc_frame;
 
+	if (encoder->audio_lane)
+		return queue_audio_data(encoder);
+
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
 	for (size_t i = 0; i < encoder->planes; i++) {
@@ -1690,6 +1797,9 @@ static void receive_audio(void *param, size_t mix_idx, struct audio_data *in)
 	if (!buffer_audio(encoder, &audio))
 		goto end;
 
+	if (os_atomic_load_bool(&encoder->audio_encode_failed))
+		goto end;
+
 	while (encoder->audio_input_buffer[0].size >= encoder->framesize_bytes) {
 		if (!send_audio_data(encoder)) {
 			break;
@@ -1722,14 +1832,251 @@ void obs_encoder_remove_output(struct obs_encoder *encoder, struct obs_output *o
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Encoder packet pool
+ *
+ * Packet data is allocated as [pool header][long refs][data].  Blocks are
+ * rounded up to a size class and returned to a per-class freelist when their
+ * last reference is released, so steady-state encoding does not have to go
+ * through the allocator for every packet.  Classes are powers of 2 and stop
+ * at 64 KiB; larger packets (mostly keyframes) are allocated exactly, as
+ * outputs such as the replay buffer hold many of them and account for them
+ * by their packet size.  Pooled blocks are marked with
+ * PACKET_POOL_REF_FLAG in their reference count; packet data that was
+ * allocated elsewhere (plain bmalloc with a leading reference count) is still
+ * released with bfree.
+ *
+ * The pool itself is reference counted by every outstanding block, as packets
+ * may still be held by outputs or plugins after libobs has shut down. */
+
+#define PACKET_POOL_REF_FLAG 0x40000000L
+#define PACKET_POOL_REF_MASK (~PACKET_POOL_REF_FLAG)
+#define PACKET_POOL_MIN_SHIFT 10 /* 1 KiB */
+#define PACKET_POOL_CLASSES 7    /* 1 KiB to 64 KiB, powers of 2 */
+#define PACKET_POOL_MAX_CACHED_BYTES (4 * 1024 * 1024)
+
+struct packet_pool;
+
+struct packet_pool_block {
+	struct packet_pool *pool;
+	struct packet_pool_block *next;
+	size_t size_class;
+	size_t capacity;
+};
+
+struct packet_pool_class {
+	pthread_mutex_t mutex;
+	struct packet_pool_block *free;
+	size_t free_count;
+	size_t max_free;
+};
+
+struct packet_pool {
+	struct packet_pool_class classes[PACKET_POOL_CLASSES];
+	volatile long refs;
+	volatile bool shutdown;
+
+	volatile long reused;
+	volatile long allocated;
+	volatile long oversized;
+	volatile long outstanding;
+	volatile long peak_outstanding;
+};
+
+#define PACKET_POOL_HEADER_SIZE ((sizeof(struct packet_pool_block) + 15) & ~(size_t)15)
+
+static inline size_t packet_pool_class_capacity(size_t size_class)
+{
+	return (size_t)1 << (PACKET_POOL_MIN_SHIFT + size_class);
+}
+
+static inline struct packet_pool_block *packet_pool_block_from_refs(long *p_refs)
+{
+	return (struct packet_pool_block *)((uint8_t *)p_refs - PACKET_POOL_HEADER_SIZE);
+}
+
+static inline long *packet_pool_block_refs(struct packet_pool_block *block)
+{
+	return (long *)((uint8_t *)block + PACKET_POOL_HEADER_SIZE);
+}
+
+static void packet_pool_destroy(struct packet_pool *pool)
+{
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++)
+		pthread_mutex_destroy(&pool->classes[i].mutex);
+	bfree(pool);
+}
+
+static inline void packet_pool_release(struct packet_pool *pool)
+{
+	if (os_atomic_dec_long(&pool->refs) == 0)
+		packet_pool_destroy(pool);
+}
+
+static struct packet_pool *packet_pool_create(void)
+{
+	struct packet_pool *pool = bzalloc(sizeof(struct packet_pool));
+
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		struct packet_pool_class *pc = &pool->classes[i];
+		size_t max_free = PACKET_POOL_MAX_CACHED_BYTES / packet_pool_class_capacity(i);
+
+		pthread_mutex_init_value(&pc->mutex);
+		if (pthread_mutex_init(&pc->mutex, NULL) != 0) {
+			while (i--)
+				pthread_mutex_destroy(&pool->classes[i].mutex);
+			bfree(pool);
+			return NULL;
+		}
+
+		pc->max_free = max_free ? max_free : 1;
+	}
+
+	pool->refs = 1;
+	return pool;
+}
+
+static long *packet_pool_alloc(struct packet_pool *pool, size_t size)
+{
+	struct packet_pool_block *block = NULL;
+	struct packet_pool_class *pc;
+	size_t size_class = 0;
+	long outstanding;
+	long peak;
+
+	size += sizeof(long);
+	while (size_class < PACKET_POOL_CLASSES && packet_pool_class_capacity(size_class) < size)
+		size_class++;
+
+	if (size_class == PACKET_POOL_CLASSES) {
+		os_atomic_inc_long(&pool->oversized);
+		return NULL;
+	}
+
+	pc = &pool->classes[size_class];
+
+	pthread_mutex_lock(&pc->mutex);
+	if (pc->free) {
+		block = pc->free;
+		pc->free = block->next;
+		pc->free_count--;
+	}
+	pthread_mutex_unlock(&pc->mutex);
+
+	if (block) {
+		os_atomic_inc_long(&pool->reused);
+	} else {
+		block = bmalloc(PACKET_POOL_HEADER_SIZE + packet_pool_class_capacity(size_class));
+		block->pool = pool;
+		block->size_class = size_class;
+		block->capacity = packet_pool_class_capacity(size_class);
+		os_atomic_inc_long(&pool->allocated);
+	}
+
+	block->next = NULL;
+	os_atomic_inc_long(&pool->refs);
+
+	outstanding = os_atomic_inc_long(&pool->outstanding);
+	peak = os_atomic_load_long(&pool->peak_outstanding);
+	while (outstanding > peak && !os_atomic_compare_exchange_long(&pool->peak_outstanding, &peak, outstanding))
+		;
+
+	return packet_pool_block_refs(block);
+}
+
+static void packet_pool_free(long *p_refs)
+{
+	struct packet_pool_block *block = packet_pool_block_from_refs(p_refs);
+	struct packet_pool *pool = block->pool;
+	struct packet_pool_class *pc = &pool->classes[block->size_class];
+	bool cached = false;
+
+	os_atomic_dec_long(&pool->outstanding);
+
+	if (!os_atomic_load_bool(&pool->shutdown)) {
+		pthread_mutex_lock(&pc->mutex);
+		if (pc->free_count < pc->max_free) {
+			block->next = pc->free;
+			pc->free = block;
+			pc->free_count++;
+			cached = true;
+		}
+		pthread_mutex_unlock(&pc->mutex);
+	}
+
+	if (!cached)
+		bfree(block);
+
+	packet_pool_release(pool);
+}
+
+bool obs_encoder_packet_pool_init(void)
+{
+	obs->data.packet_pool = packet_pool_create();
+	return obs->data.packet_pool != NULL;
+}
+
+void obs_encoder_packet_pool_free(void)
+{
+	struct packet_pool *pool = obs->data.packet_pool;
+	long reused, allocated, total;
+
+	if (!pool)
+		return;
+
+	obs->data.packet_pool = NULL;
+	os_atomic_set_bool(&pool->shutdown, true);
+
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		struct packet_pool_class *pc = &pool->classes[i];
+		struct packet_pool_block *block;
+
+		pthread_mutex_lock(&pc->mutex);
+		block = pc->free;
+		pc->free = NULL;
+		pc->free_count = 0;
+		pthread_mutex_unlock(&pc->mutex);
+
+		while (block) {
+			struct packet_pool_block *next = block->next;
+			bfree(block);
+			block = next;
+		}
+	}
+
+	reused = os_atomic_load_long(&pool->reused);
+	allocated = os_atomic_load_long(&pool->allocated);
+	total = reused + allocated;
+
+	if (total) {
+		blog(LOG_INFO, "Encoder packet pool: %ld packets, %ld reused (%.1f%%), %ld new blocks, %ld too large",
+		     total, reused, (double)reused * 100.0 / (double)total, allocated,
+		     os_atomic_load_long(&pool->oversized));
+		blog(LOG_INFO, "Encoder packet pool: peak of %ld packets in flight",
+		     os_atomic_load_long(&pool->peak_outstanding));
+	}
+
+	packet_pool_release(pool);
+}
+
 void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src)
 {
-	long *p_refs;
+	struct packet_pool *pool = obs ? obs->data.packet_pool : NULL;
+	long *p_refs = NULL;
 
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
+
+	if (pool)
+		p_refs = packet_pool_alloc(pool, src->size);
+
+	if (p_refs) {
+		*p_refs = PACKET_POOL_REF_FLAG | 1;
+	} else {
+		p_refs = bmalloc(src->size + sizeof(long));
+		*p_refs = 1;
+	}
+
 	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
 	memcpy(dst->data, src->data, src->size);
 }
 
@@ -1753,8 +2100,14 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 
 	if (pkt->data) {
 		long *p_refs = ((long *)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+		long refs = os_atomic_dec_long(p_refs);
+
+		if ((refs & PACKET_POOL_REF_MASK) == 0) {
+			if (refs & PACKET_POOL_REF_FLAG)
+				packet_pool_free(p_refs);
+			else
+				bfree(p_refs);
+		}
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
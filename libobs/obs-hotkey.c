@@ -455,6 +455,15 @@ static inline void load_modifier(uint32_t *modifiers, obs_data_t *data, const ch
 		*modifiers |= flag;
 }
 
+/* bindings are saved with the source that registered the hotkey.  the
+ * registerer can not be freed without unregistering its hotkeys, which
+ * requires the hotkey lock held by the caller */
+static inline void bindings_changed(obs_hotkey_t *hotkey)
+{
+	if (hotkey->registerer_type == OBS_HOTKEY_REGISTERER_SOURCE && hotkey->registerer)
+		obs_source_save_changed(((obs_weak_source_t *)hotkey->registerer)->source);
+}
+
 static inline void create_binding(obs_hotkey_t *hotkey, obs_key_combination_t combo)
 {
 	obs_hotkey_binding_t *binding = da_push_back_new(obs->hotkeys.bindings);
@@ -464,6 +473,7 @@ static inline void create_binding(obs_hotkey_t *hotkey, obs_key_combination_t co
 	binding->key = combo;
 	binding->hotkey_id = hotkey->id;
 	binding->hotkey = hotkey;
+	bindings_changed(hotkey);
 }
 
 static inline void load_binding(obs_hotkey_t *hotkey, obs_data_t *data)
@@ -810,6 +820,7 @@ static inline bool remove_bindings(obs_hotkey_id id)
 		if (binding->pressed)
 			release_pressed_binding(binding);
 
+		bindings_changed(binding->hotkey);
 		da_erase(obs->hotkeys.bindings, idx);
 		removed = true;
 	}
@@ -48,6 +48,10 @@
 
 #define NUM_TEXTURES 2
 #define NUM_CHANNELS 3
+
+/* raw outputs can keep staged frames mapped while they use them, so there are
+ * more sets of stage surfaces than textures */
+#define NUM_STAGE_SURFACES 6
 #define MICROSECOND_DEN 1000000
 #define NUM_ENCODE_TEXTURES 10
 #define NUM_ENCODE_TEXTURE_FRAMES_TO_WAIT 1
@@ -263,11 +267,22 @@ struct obs_task_info {
 	void *param;
 };
 
+struct obs_video_stage {
+	/* only accessed by the graphics thread */
+	bool mapped;
+
+	/* while video-io references the mapped surfaces */
+	volatile bool held;
+};
+
 struct obs_core_video_mix {
 	struct obs_view *view;
 
 	gs_stagesurf_t *active_copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
-	gs_stagesurf_t *copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
+	gs_stagesurf_t *copy_surfaces[NUM_STAGE_SURFACES][NUM_CHANNELS];
+	struct obs_video_stage stages[NUM_STAGE_SURFACES];
+	int active_stages[NUM_TEXTURES];
+	int next_stage;
 	gs_texture_t *convert_textures[NUM_CHANNELS];
 	gs_texture_t *convert_textures_encode[NUM_CHANNELS];
 #ifdef _WIN32
@@ -372,12 +387,46 @@ extern void add_ready_encoder_group(obs_encoder_t *encoder);
 
 struct audio_monitor;
 
+/* a source in the audio render order that can render once all the sources
+ * it mixes have been rendered */
+struct audio_render_node {
+	struct obs_source *source;
+	DARRAY(size_t) dependents;
+	long num_deps;
+	volatile long deps_left;
+};
+
+struct audio_render_edge {
+	struct obs_source *parent;
+	size_t child;
+};
+
+struct audio_render_tick {
+	uint32_t mixers;
+	size_t channels;
+	size_t sample_rate;
+	size_t size;
+	uint64_t start_ts;
+};
+
 struct obs_core_audio {
 	audio_t *audio;
 
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	/* audio encoding runs on its own pool, so it never waits behind
+	 * unrelated tasks queued to the shared pool */
+	os_task_pool_t *task_pool;
+
+	/* independent subtrees of the render order are rendered in parallel
+	 * on a separate pool, so rendering never waits behind encoding */
+	os_task_pool_t *render_pool;
+	os_task_lane_t *render_lane;
+	DARRAY(struct audio_render_edge) render_edges;
+	DARRAY(struct audio_render_node) render_nodes;
+	struct audio_render_tick render_tick;
+
 	uint64_t buffered_ts;
 	struct deque buffered_timestamps;
 	uint64_t buffering_wait_ticks;
@@ -428,6 +477,8 @@ struct obs_core_data {
 
 	DARRAY(char *) protocols;
 	DARRAY(obs_source_t *) sources_to_tick;
+
+	struct packet_pool *packet_pool;
 };
 
 /* user hotkeys */
@@ -882,8 +933,17 @@ struct obs_source {
 
 	/* private data */
 	obs_data_t *private_settings;
+
+	/* incremented whenever anything saved by obs_save_source may have
+	 * changed, see obs_save_cache */
+	volatile long save_serial;
 };
 
+static inline void obs_source_save_changed(obs_source_t *source)
+{
+	os_atomic_inc_long(&source->save_serial);
+}
+
 extern struct obs_source_info *get_source_info(const char *id);
 extern struct obs_source_info *get_source_info2(const char *unversioned_id, uint32_t ver);
 extern bool obs_source_init_context(struct obs_source *source, obs_data_t *settings, const char *name, const char *uuid,
@@ -1187,7 +1247,8 @@ extern const struct obs_output_info *find_output(const char *id);
 
 extern void obs_output_remove_encoder(struct obs_output *output, struct obs_encoder *encoder);
 
-extern void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src);
+extern bool obs_encoder_packet_pool_init(void);
+extern void obs_encoder_packet_pool_free(void);
 void obs_output_destroy(obs_output_t *output);
 
 /* ------------------------------------------------------------------------- */
@@ -1274,6 +1335,18 @@ struct obs_encoder {
 	struct deque audio_input_buffer[MAX_AV_PLANES];
 	uint8_t *audio_output_buffer[MAX_AV_PLANES];
 
+	/* audio frames are encoded on a lane of the audio task pool so the
+	 * audio thread only has to copy the samples */
+	os_task_lane_t *audio_lane;
+	volatile bool audio_encode_failed;
+	volatile long audio_queued;
+
+	/* only written by the tasks of the (serial) audio lane, and read
+	 * after waiting for it */
+	long audio_queue_max;
+	uint64_t audio_queue_wait_ns;
+	uint64_t audio_frames_encoded;
+
 	/* if a video encoder is paired with an audio encoder, make it start
 	 * up at the specific timestamp.  if this is the audio encoder,
 	 * it waits until it's ready to sync up with video */
@@ -1382,5 +1455,10 @@ extern uint64_t source_profiler_source_render_begin(gs_timer_t **timer);
 /* Submit start timestamp and GPU timer after rendering source */
 extern void source_profiler_source_render_end(obs_source_t *source, uint64_t start, gs_timer_t *timer);
 
+/* Get timestamp for start of audio render */
+extern uint64_t source_profiler_source_audio_render_start(void);
+/* Submit audio render start timestamp for source (from any thread) */
+extern void source_profiler_source_audio_render_end(obs_source_t *source, uint64_t start);
+
 /* Remove source from profiler hashmaps */
 extern void source_profiler_remove_source(obs_source_t *source);
@@ -2022,28 +2022,40 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	return true;
 }
 
+/* returns whether the new packet needs to be placed before cur_packet */
+static inline bool interleaved_packet_before(const struct encoder_packet *out, const struct encoder_packet *cur_packet)
+{
+	// sort video packets with same DTS by track index,
+	// to prevent the pruning logic from removing additional
+	// video tracks
+	if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO &&
+	    cur_packet->type == OBS_ENCODER_VIDEO && out->track_idx > cur_packet->track_idx)
+		return false;
+
+	if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO)
+		return true;
+
+	return out->dts_usec < cur_packet->dts_usec;
+}
+
 static inline void insert_interleaved_packet(struct obs_output *output, struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
+	size_t low = 0;
+	size_t high = output->interleaved_packets.num;
 
-		// sort video packets with same DTS by track index,
-		// to prevent the pruning logic from removing additional
-		// video tracks
-		if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO &&
-		    cur_packet->type == OBS_ENCODER_VIDEO && out->track_idx > cur_packet->track_idx)
-			continue;
+	/* the array is always kept in this order, so the insertion point can
+	 * be found with a binary search.  in the common case the packet ends
+	 * up at the end of the array, which makes the insert itself cheap. */
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
 
-		if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
+		if (interleaved_packet_before(out, output->interleaved_packets.array + mid))
+			high = mid;
+		else
+			low = mid + 1;
 	}
 
-	da_insert(output->interleaved_packets, idx, out);
+	da_insert(output->interleaved_packets, low, out);
 }
 
 static void resort_interleaved_packets(struct obs_output *output)
@@ -0,0 +1,197 @@
+#include "obs-internal.h"
+
+struct save_cache_entry {
+	obs_source_t *source;
+	obs_weak_source_t *weak;
+
+	/* serial of the source followed by the serials of its filters, as
+	 * they were when the source was last serialized */
+	DARRAY(long) serials;
+
+	size_t indent;
+	struct dstr json;
+
+	UT_hash_handle hh;
+};
+
+struct obs_save_cache {
+	struct save_cache_entry *entries;
+	DARRAY(long) serials;
+};
+
+obs_save_cache_t *obs_save_cache_create(void)
+{
+	return bzalloc(sizeof(struct obs_save_cache));
+}
+
+static void entry_free(struct save_cache_entry *entry)
+{
+	obs_weak_source_release(entry->weak);
+	da_free(entry->serials);
+	dstr_free(&entry->json);
+	bfree(entry);
+}
+
+void obs_save_cache_destroy(obs_save_cache_t *cache)
+{
+	struct save_cache_entry *entry, *tmp;
+
+	if (!cache)
+		return;
+
+	HASH_ITER (hh, cache->entries, entry, tmp) {
+		HASH_DEL(cache->entries, entry);
+		entry_free(entry);
+	}
+
+	da_free(cache->serials);
+	bfree(cache);
+}
+
+/* returns false if the source has to be serialized regardless of its serial,
+ * as sources that implement the save callback can change it without any
+ * signal */
+static bool get_serials(obs_source_t *source, obs_save_cache_t *cache)
+{
+	bool cacheable = !source->info.save;
+	long serial = os_atomic_load_long(&source->save_serial);
+
+	da_resize(cache->serials, 0);
+	da_push_back(cache->serials, &serial);
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		obs_source_t *filter = source->filters.array[i];
+		serial = os_atomic_load_long(&filter->save_serial);
+
+		if (filter->info.save)
+			cacheable = false;
+		da_push_back(cache->serials, &serial);
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+	return cacheable;
+}
+
+static inline bool serials_equal(const struct save_cache_entry *entry, const obs_save_cache_t *cache)
+{
+	return entry->serials.num == cache->serials.num &&
+	       memcmp(entry->serials.array, cache->serials.array, cache->serials.num * sizeof(long)) == 0;
+}
+
+static void cat_indented(struct dstr *dst, const char *json, size_t indent)
+{
+	static const char spaces[] = "                                ";
+	const char *line = json;
+	const char *end;
+
+	while ((end = strchr(line, '\n')) != NULL) {
+		dstr_ncat(dst, line, end - line + 1);
+
+		for (size_t i = indent; i > 0;) {
+			size_t count = i < sizeof(spaces) - 1 ? i : sizeof(spaces) - 1;
+			dstr_ncat(dst, spaces, count);
+			i -= count;
+		}
+
+		line = end + 1;
+	}
+
+	dstr_cat(dst, line);
+}
+
+static void serialize_source(struct save_cache_entry *entry, size_t indent)
+{
+	obs_data_t *data = obs_save_source(entry->source);
+
+	dstr_free(&entry->json);
+	cat_indented(&entry->json, obs_data_get_json_pretty(data), indent);
+	entry->indent = indent;
+
+	obs_data_release(data);
+}
+
+static struct save_cache_entry *get_entry(obs_save_cache_t *cache, obs_source_t *source, size_t indent)
+{
+	struct save_cache_entry *entry;
+	bool cacheable = get_serials(source, cache);
+
+	HASH_FIND_PTR(cache->entries, &source, entry);
+
+	/* a new source can be created at the address of a destroyed one */
+	if (entry && (obs_weak_source_expired(entry->weak) || !obs_weak_source_references_source(entry->weak, source))) {
+		HASH_DEL(cache->entries, entry);
+		entry_free(entry);
+		entry = NULL;
+	}
+
+	if (!entry) {
+		entry = bzalloc(sizeof(*entry));
+		entry->source = source;
+		entry->weak = obs_source_get_weak_source(source);
+		HASH_ADD_PTR(cache->entries, source, entry);
+
+	} else if (cacheable && entry->indent == indent && serials_equal(entry, cache)) {
+		return entry;
+	}
+
+	/* the serials are taken before serializing, a change made while
+	 * serializing is picked up the next time */
+	da_copy(entry->serials, cache->serials);
+	serialize_source(entry, indent);
+	return entry;
+}
+
+static void remove_expired(obs_save_cache_t *cache)
+{
+	struct save_cache_entry *entry, *tmp;
+
+	HASH_ITER (hh, cache->entries, entry, tmp) {
+		if (obs_weak_source_expired(entry->weak)) {
+			HASH_DEL(cache->entries, entry);
+			entry_free(entry);
+		}
+	}
+}
+
+char *obs_save_cache_sources_json(obs_save_cache_t *cache, obs_save_source_filter_cb cb, void *data_, size_t indent)
+{
+	struct obs_core_data *data = &obs->data;
+	struct dstr json = {0};
+	obs_source_t *source;
+	bool empty = true;
+
+	if (!cache)
+		return NULL;
+
+	dstr_copy(&json, "[");
+
+	pthread_mutex_lock(&data->sources_mutex);
+
+	source = data->public_sources;
+
+	while (source) {
+		if (source->info.type != OBS_SOURCE_TYPE_FILTER && !source->removed && !source->temp_removed &&
+		    cb(data_, source)) {
+			struct save_cache_entry *entry = get_entry(cache, source, indent + 4);
+
+			if (!empty)
+				dstr_cat(&json, ",");
+			cat_indented(&json, "\n", indent + 4);
+			dstr_cat_dstr(&json, &entry->json);
+			empty = false;
+		}
+
+		source = (obs_source_t *)source->context.hh.next;
+	}
+
+	pthread_mutex_unlock(&data->sources_mutex);
+
+	remove_expired(cache);
+
+	if (!empty)
+		cat_indented(&json, "\n", indent);
+	dstr_cat(&json, "]");
+	return json.array;
+}
@@ -19,6 +19,7 @@
 #include "util/threading.h"
 #include "util/util_uint64.h"
 #include "graphics/math-defs.h"
+#include "media-io/audio-mix.h"
 #include "obs-scene.h"
 #include "obs-internal.h"
 
@@ -1557,23 +1558,12 @@ static void process_all_audio_actions(struct obs_scene_item *item, size_t sample
 
 static void mix_audio_with_buf(float *p_out, float *p_in, float *buf_in, size_t pos, size_t count)
 {
-	register float *out = p_out + pos;
-	register float *buf = buf_in;
-	register float *in = p_in;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++) * *(buf++);
+	audio_mix_add_mul(p_out + pos, p_in, buf_in, count);
 }
 
 static inline void mix_audio(float *p_out, float *p_in, size_t pos, size_t count)
 {
-	register float *out = p_out + pos;
-	register float *in = p_in;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++);
+	audio_mix_add(p_out + pos, p_in, count);
 }
 
 static inline struct scene_source_mix *get_source_mix(struct obs_scene *scene, struct obs_source *source)
@@ -445,6 +445,8 @@ void obs_source_set_deinterlace_mode(obs_source_t *source, enum obs_deinterlace_
 	if (source->deinterlace_mode == mode)
 		return;
 
+	obs_source_save_changed(source);
+
 	if (source->deinterlace_mode == OBS_DEINTERLACE_MODE_DISABLE) {
 		enable_deinterlacing(source, mode);
 	} else if (mode == OBS_DEINTERLACE_MODE_DISABLE) {
@@ -468,6 +470,7 @@ void obs_source_set_deinterlace_field_order(obs_source_t *source, enum obs_deint
 	if (!obs_source_valid(source, "obs_source_set_deinterlace_field_order"))
 		return;
 
+	obs_source_save_changed(source);
 	source->deinterlace_top_first = field_order == OBS_DEINTERLACE_FIELD_ORDER_TOP;
 }
 
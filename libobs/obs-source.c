@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-mix.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/util_uint64.h"
@@ -115,12 +116,22 @@ static const char *source_signals[] = {
 	NULL,
 };
 
+/* nearly all changes to a source are signaled, treat any signal as a change
+ * of the saved data */
+static void source_signal_save_changed(void *data, const char *signal, calldata_t *params)
+{
+	UNUSED_PARAMETER(signal);
+	UNUSED_PARAMETER(params);
+	obs_source_save_changed(data);
+}
+
 bool obs_source_init_context(struct obs_source *source, obs_data_t *settings, const char *name, const char *uuid,
 			     obs_data_t *hotkey_data, bool private)
 {
 	if (!obs_context_data_init(&source->context, OBS_OBJ_TYPE_SOURCE, settings, name, uuid, hotkey_data, private))
 		return false;
 
+	signal_handler_connect_global(source->context.signals, source_signal_save_changed, source);
 	return signal_handler_add_array(source->context.signals, source_signals);
 }
 
@@ -928,6 +939,9 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 		obs_data_apply(source->context.settings, settings);
 	}
 
+	/* the update of video sources is deferred, and so is its signal */
+	obs_source_save_changed(source);
+
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		os_atomic_inc_long(&source->defer_update_count);
 	} else if (source->context.data && source->info.update) {
@@ -3180,6 +3194,9 @@ obs_data_t *obs_source_get_settings(const obs_source_t *source)
 	if (!obs_source_valid(source, "obs_source_get_settings"))
 		return NULL;
 
+	/* the caller may modify the settings without updating the source */
+	obs_source_save_changed((obs_source_t *)source);
+
 	obs_data_addref(source->context.settings);
 	return source->context.settings;
 }
@@ -3229,7 +3246,7 @@ static inline void copy_frame_data_plane(struct obs_source_frame *dst, const str
 	}
 }
 
-static void copy_frame_data(struct obs_source_frame *dst, const struct obs_source_frame *src)
+static void copy_frame_info(struct obs_source_frame *dst, const struct obs_source_frame *src)
 {
 	dst->flip = src->flip;
 	dst->flags = src->flags;
@@ -3243,6 +3260,11 @@ static void copy_frame_data(struct obs_source_frame *dst, const struct obs_sourc
 		memcpy(dst->color_range_min, src->color_range_min, size);
 		memcpy(dst->color_range_max, src->color_range_max, size);
 	}
+}
+
+static void copy_frame_data(struct obs_source_frame *dst, const struct obs_source_frame *src)
+{
+	copy_frame_info(dst, src);
 
 	switch (src->format) {
 	case VIDEO_FORMAT_I420:
@@ -3358,7 +3380,7 @@ static void clean_cache(obs_source_t *source)
 
 #define MAX_ASYNC_FRAMES 30
 //if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+static struct obs_source_frame *get_async_cache_frame(struct obs_source *source, const struct obs_source_frame *frame)
 {
 	struct obs_source_frame *new_frame = NULL;
 
@@ -3411,11 +3433,34 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source, co
 
 	pthread_mutex_unlock(&source->async_mutex);
 
-	copy_frame_data(new_frame, frame);
+	return new_frame;
+}
+
+static inline struct obs_source_frame *cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame = get_async_cache_frame(source, frame);
+
+	if (new_frame)
+		copy_frame_data(new_frame, frame);
 
 	return new_frame;
 }
 
+static void output_async_frame(obs_source_t *source, struct obs_source_frame *output)
+{
+	pthread_mutex_lock(&source->async_mutex);
+	if (output) {
+		if (os_atomic_dec_long(&output->refs) == 0) {
+			obs_source_frame_destroy(output);
+			output = NULL;
+		} else {
+			da_push_back(source->async_frames, &output);
+			source->async_active = true;
+		}
+	}
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
 static void obs_source_output_video_internal(obs_source_t *source, const struct obs_source_frame *frame)
 {
 	if (!obs_source_valid(source, "obs_source_output_video"))
@@ -3435,17 +3480,43 @@ static void obs_source_output_video_internal(obs_source_t *source, const struct
 	struct obs_source_frame *output = cache_video(source, frame);
 
 	/* ------------------------------------------- */
-	pthread_mutex_lock(&source->async_mutex);
-	if (output) {
-		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
-			output = NULL;
-		} else {
-			da_push_back(source->async_frames, &output);
-			source->async_active = true;
-		}
+	output_async_frame(source, output);
+}
+
+struct obs_source_frame *obs_source_borrow_video_frame(obs_source_t *source, const struct obs_source_frame *info)
+{
+	if (!obs_source_valid(source, "obs_source_borrow_video_frame"))
+		return NULL;
+	if (!obs_ptr_valid(info, "obs_source_borrow_video_frame"))
+		return NULL;
+	if (destroying(source))
+		return NULL;
+
+	struct obs_source_frame new_info = *info;
+	new_info.full_range = format_is_yuv(info->format) ? new_info.full_range : true;
+
+	struct obs_source_frame *frame = get_async_cache_frame(source, &new_info);
+	if (frame)
+		copy_frame_info(frame, &new_info);
+
+	return frame;
+}
+
+void obs_source_output_borrowed_video(obs_source_t *source, struct obs_source_frame *frame)
+{
+	if (!obs_source_valid(source, "obs_source_output_borrowed_video"))
+		return;
+	if (!obs_ptr_valid(frame, "obs_source_output_borrowed_video"))
+		return;
+
+	/* the frame still has to go back to the cache it was borrowed from */
+	if (destroying(source)) {
+		obs_source_release_frame(source, frame);
+		return;
 	}
-	pthread_mutex_unlock(&source->async_mutex);
+
+	source_profiler_async_frame_received(source);
+	output_async_frame(source, frame);
 }
 
 void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame)
@@ -3795,54 +3866,39 @@ static void copy_audio_data(obs_source_t *source, const uint8_t *const data[], u
 		source->audio_storage_size = size;
 }
 
-/* TODO: SSE optimization */
 static void downmix_to_mono_planar(struct obs_source *source, uint32_t frames)
 {
 	size_t channels = audio_output_get_channels(obs->audio.audio);
-	const float channels_i = 1.0f / (float)channels;
 	float **data = (float **)source->audio_data.data;
 
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[0][frame] += data[channel][frame];
-	}
-
-	for (uint32_t frame = 0; frame < frames; frame++)
-		data[0][frame] *= channels_i;
-
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[channel][frame] = data[0][frame];
-	}
+	audio_mix_downmix_mono(data, channels, frames);
 }
 
 static void process_audio_balancing(struct obs_source *source, uint32_t frames, float balance,
 				    enum obs_balance_type type)
 {
 	float **data = (float **)source->audio_data.data;
+	float left, right;
 
 	switch (type) {
 	case OBS_BALANCE_TYPE_SINE_LAW:
-		for (uint32_t frame = 0; frame < frames; frame++) {
-			data[0][frame] = data[0][frame] * sinf((1.0f - balance) * (M_PI / 2.0f));
-			data[1][frame] = data[1][frame] * sinf(balance * (M_PI / 2.0f));
-		}
+		left = sinf((1.0f - balance) * (M_PI / 2.0f));
+		right = sinf(balance * (M_PI / 2.0f));
 		break;
 	case OBS_BALANCE_TYPE_SQUARE_LAW:
-		for (uint32_t frame = 0; frame < frames; frame++) {
-			data[0][frame] = data[0][frame] * sqrtf(1.0f - balance);
-			data[1][frame] = data[1][frame] * sqrtf(balance);
-		}
+		left = sqrtf(1.0f - balance);
+		right = sqrtf(balance);
 		break;
 	case OBS_BALANCE_TYPE_LINEAR:
-		for (uint32_t frame = 0; frame < frames; frame++) {
-			data[0][frame] = data[0][frame] * (1.0f - balance);
-			data[1][frame] = data[1][frame] * balance;
-		}
+		left = 1.0f - balance;
+		right = balance;
 		break;
 	default:
-		break;
+		return;
 	}
+
+	audio_mix_mul(data[0], left, frames);
+	audio_mix_mul(data[1], right, frames);
 }
 
 /* resamples/remixes new audio to the designated main audio output format */
@@ -5066,11 +5122,7 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 
 static inline void multiply_output_audio(obs_source_t *source, size_t mix, size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_mix_mul(source->audio_output_buf[mix][0], vol, AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix, size_t channels, float *vol_data)
@@ -5103,7 +5155,7 @@ static inline void apply_audio_action(obs_source_t *source, const struct audio_a
 	}
 }
 
-static void apply_audio_actions(obs_source_t *source, size_t channels, size_t sample_rate)
+static void apply_audio_actions(obs_source_t *source, uint32_t mixers, size_t channels, size_t sample_rate)
 {
 	float vol_data[AUDIO_OUTPUT_FRAMES];
 	float cur_vol = get_source_volume(source, source->audio_ts);
@@ -5142,7 +5194,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels, size_t sa
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) != 0)
+		if ((source->audio_mixers & mixers & (1 << mix)) != 0)
 			multiply_vol_data(source, mix, channels, vol_data);
 	}
 }
@@ -5165,7 +5217,7 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers, size_t cha
 		uint64_t duration = conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
-			apply_audio_actions(source, channels, sample_rate);
+			apply_audio_actions(source, mixers, channels, sample_rate);
 			return;
 		}
 	}
@@ -5174,9 +5226,16 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers, size_t cha
 	if (vol == 1.0f)
 		return;
 
-	if (vol == 0.0f || mixers == 0) {
-		memset(source->audio_output_buf[0][0], 0,
-		       AUDIO_OUTPUT_FRAMES * sizeof(float) * MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES);
+	if (mixers == 0)
+		return;
+
+	if (vol == 0.0f) {
+		size_t size = AUDIO_OUTPUT_FRAMES * sizeof(float) * channels;
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((mixers & (1 << mix)) != 0)
+				memset(source->audio_output_buf[mix][0], 0, size);
+		}
 		return;
 	}
 
@@ -5272,6 +5331,8 @@ static inline void process_audio_source_tick(obs_source_t *source, uint32_t mixe
 
 	pthread_mutex_unlock(&source->audio_buf_mutex);
 
+	/* mix 0 doubles as the staging buffer for the source's audio, the
+	 * other mixes are only written if somebody is listening to them */
 	for (size_t mix = 1; mix < MAX_AUDIO_MIXES; mix++) {
 		uint32_t mix_and_val = (1 << mix);
 
@@ -5283,7 +5344,10 @@ static inline void process_audio_source_tick(obs_source_t *source, uint32_t mixe
 			mix_and_val = 1;
 		}
 
-		if ((source->audio_mixers & mix_and_val) == 0 || (mixers & mix_and_val) == 0) {
+		if ((mixers & mix_and_val) == 0)
+			continue;
+
+		if ((source->audio_mixers & mix_and_val) == 0) {
 			memset(source->audio_output_buf[mix][0], 0, size * channels);
 			continue;
 		}
@@ -5297,7 +5361,7 @@ static inline void process_audio_source_tick(obs_source_t *source, uint32_t mixe
 		return;
 	}
 
-	if ((source->audio_mixers & 1) == 0 || (mixers & 1) == 0)
+	if ((source->audio_mixers & 1) == 0 && (mixers & 1) != 0)
 		memset(source->audio_output_buf[0][0], 0, size * channels);
 
 	apply_audio_volume(source, mixers, channels, sample_rate);
@@ -5462,6 +5526,8 @@ obs_data_t *obs_source_get_private_settings(obs_source_t *source)
 	if (!obs_ptr_valid(source, "obs_source_get_private_settings"))
 		return NULL;
 
+	obs_source_save_changed(source);
+
 	obs_data_addref(source->private_settings);
 	return source->private_settings;
 }
@@ -29,6 +29,25 @@
 #include <windows.h>
 #endif
 
+/* Sources with nothing to do this frame are skipped entirely, which avoids
+ * taking a reference to every source in the hash table each frame. */
+static inline bool source_needs_tick(const struct obs_source *source)
+{
+	const uint32_t flags = source->info.output_flags;
+
+	if (source->info.video_tick || source->filter_texrender)
+		return true;
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+		return true;
+	if ((flags & (OBS_SOURCE_ASYNC | OBS_SOURCE_CONTROLLABLE_MEDIA)) != 0)
+		return true;
+	if (os_atomic_load_long(&source->defer_update_count) > 0)
+		return true;
+
+	/* show/hide and activate/deactivate are dispatched from the tick */
+	return !!source->show_refs != source->showing || !!source->activate_refs != source->active;
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
@@ -56,7 +75,7 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	pthread_mutex_unlock(&data->draw_callbacks_mutex);
 
 	/* ------------------------------------- */
-	/* get an array of all sources to tick   */
+	/* get an array of sources to tick      */
 
 	da_clear(data->sources_to_tick);
 
@@ -64,7 +83,7 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 
 	source = data->sources;
 	while (source) {
-		obs_source_t *s = obs_source_get_ref(source);
+		obs_source_t *s = source_needs_tick(source) ? obs_source_get_ref(source) : NULL;
 		if (s)
 			da_push_back(data->sources_to_tick, &s);
 		source = (struct obs_source *)source->context.hh_uuid.next;
@@ -129,6 +148,39 @@ static inline void unmap_last_surface(struct obs_core_video_mix *video)
 			video->mapped_surfaces[c] = NULL;
 		}
 	}
+
+	/* stage surfaces handed to the video output stay mapped until every
+	 * raw output is done with them, but they can only be unmapped here */
+	for (int i = 0; i < NUM_STAGE_SURFACES; ++i) {
+		struct obs_video_stage *stage = &video->stages[i];
+
+		if (stage->mapped && !os_atomic_load_bool(&stage->held)) {
+			for (int c = 0; c < NUM_CHANNELS; ++c) {
+				if (video->copy_surfaces[i][c])
+					gs_stagesurface_unmap(video->copy_surfaces[i][c]);
+			}
+			stage->mapped = false;
+		}
+	}
+}
+
+/* the stage surfaces of the previous texture have not been downloaded yet,
+ * and the ones still held by the video output are mapped */
+static inline int get_free_stage(struct obs_core_video_mix *video, int cur_texture)
+{
+	int prev_texture = cur_texture == 0 ? NUM_TEXTURES - 1 : cur_texture - 1;
+	int prev_stage = video->active_stages[prev_texture];
+
+	for (int i = 0; i < NUM_STAGE_SURFACES; ++i) {
+		int idx = (video->next_stage + i) % NUM_STAGE_SURFACES;
+
+		if (idx != prev_stage && !video->stages[idx].mapped) {
+			video->next_stage = (idx + 1) % NUM_STAGE_SURFACES;
+			return idx;
+		}
+	}
+
+	return -1;
 }
 
 static inline bool can_reuse_mix_texture(const struct obs_core_video_mix *mix, size_t *idx)
@@ -404,12 +456,23 @@ static void render_convert_texture(struct obs_core_video_mix *video, gs_texture_
 static const char *stage_output_texture_name = "stage_output_texture";
 static inline void stage_output_texture(struct obs_core_video_mix *video, int cur_texture,
 					gs_texture_t *const *const convert_textures, gs_texture_t *output_texture,
-					gs_stagesurf_t *const *const copy_surfaces, size_t channel_count)
+					gs_stagesurf_t *const *copy_surfaces, size_t channel_count)
 {
 	profile_start(stage_output_texture_name);
 
 	unmap_last_surface(video);
 
+	int stage = -1;
+	if (!copy_surfaces) {
+		stage = get_free_stage(video, cur_texture);
+		if (stage < 0) {
+			profile_end(stage_output_texture_name);
+			return;
+		}
+
+		copy_surfaces = video->copy_surfaces[stage];
+	}
+
 	if (!video->gpu_conversion) {
 		gs_stagesurf_t *copy = copy_surfaces[0];
 		if (copy)
@@ -419,6 +482,7 @@ static inline void stage_output_texture(struct obs_core_video_mix *video, int cu
 		for (size_t i = 1; i < NUM_CHANNELS; ++i)
 			video->active_copy_surfaces[cur_texture][i] = NULL;
 
+		video->active_stages[cur_texture] = stage;
 		video->textures_copied[cur_texture] = true;
 	} else if (video->texture_converted) {
 		for (size_t i = 0; i < channel_count; i++) {
@@ -431,6 +495,7 @@ static inline void stage_output_texture(struct obs_core_video_mix *video, int cu
 		for (size_t i = channel_count; i < NUM_CHANNELS; ++i)
 			video->active_copy_surfaces[cur_texture][i] = NULL;
 
+		video->active_stages[cur_texture] = stage;
 		video->textures_copied[cur_texture] = true;
 	}
 
@@ -546,7 +611,7 @@ static inline void render_video(struct obs_core_video_mix *video, bool raw_activ
 
 	if (raw_active || gpu_active) {
 		gs_texture_t *const *convert_textures = video->convert_textures;
-		gs_stagesurf_t *const *copy_surfaces = video->copy_surfaces[cur_texture];
+		gs_stagesurf_t *const *copy_surfaces = NULL;
 		size_t channel_count = NUM_CHANNELS;
 		gs_texture_t *output_texture = render_output_texture(video);
 
@@ -774,7 +839,94 @@ static inline void copy_rgbx_frame(struct video_frame *output, const struct vide
 	}
 }
 
-static inline void output_video_data(struct obs_core_video_mix *video, struct video_data *input_frame, int count)
+/* the mapped planes can be handed to the video output as they are if they are
+ * laid out the way the video output expects them */
+static bool get_frame_view(struct video_frame *output, const struct video_data *input,
+			   const struct video_output_info *info, bool gpu_conversion)
+{
+	memset(output, 0, sizeof(*output));
+
+	if (!gpu_conversion) {
+		output->data[0] = input->data[0];
+		output->linesize[0] = input->linesize[0];
+		return true;
+	}
+
+	switch (info->format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I010:
+		for (size_t i = 0; i < 3; i++) {
+			output->data[i] = input->data[i];
+			output->linesize[i] = input->linesize[i];
+		}
+		return true;
+
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_P010:
+	case VIDEO_FORMAT_P216:
+	case VIDEO_FORMAT_P416:
+		/* both planes in a single surface */
+		if (!input->linesize[1])
+			return false;
+
+		for (size_t i = 0; i < 2; i++) {
+			output->data[i] = input->data[i];
+			output->linesize[i] = input->linesize[i];
+		}
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static void release_stage(void *param)
+{
+	struct obs_video_stage *stage = param;
+	os_atomic_set_bool(&stage->held, false);
+}
+
+static inline int get_held_stage_count(struct obs_core_video_mix *video)
+{
+	int count = 0;
+
+	for (int i = 0; i < NUM_STAGE_SURFACES; i++) {
+		if (os_atomic_load_bool(&video->stages[i].held))
+			count++;
+	}
+
+	return count;
+}
+
+/* hands the mapped stage surfaces to the video output instead of copying
+ * them, as long as enough stage surfaces remain for staging new frames */
+static bool output_stage(struct obs_core_video_mix *video, const struct video_data *input_frame, int stage)
+{
+	const struct video_output_info *info = video_output_get_info(video->video);
+	struct video_frame view;
+
+	if (stage < 0 || get_held_stage_count(video) >= NUM_STAGE_SURFACES - NUM_TEXTURES)
+		return false;
+	if (!get_frame_view(&view, input_frame, info, video->gpu_conversion))
+		return false;
+
+	os_atomic_set_bool(&video->stages[stage].held, true);
+	if (!video_output_set_external_frame(video->video, &view, release_stage, &video->stages[stage])) {
+		os_atomic_set_bool(&video->stages[stage].held, false);
+		return false;
+	}
+
+	/* unmapped once released rather than with the next frame */
+	video->stages[stage].mapped = true;
+	for (int c = 0; c < NUM_CHANNELS; ++c)
+		video->mapped_surfaces[c] = NULL;
+
+	return true;
+}
+
+static inline void output_video_data(struct obs_core_video_mix *video, struct video_data *input_frame, int count,
+				     int stage)
 {
 	const struct video_output_info *info;
 	struct video_frame output_frame;
@@ -784,10 +936,11 @@ static inline void output_video_data(struct obs_core_video_mix *video, struct vi
 
 	locked = video_output_lock_frame(video->video, &output_frame, count, input_frame->timestamp);
 	if (locked) {
-		if (video->gpu_conversion) {
-			set_gpu_converted_data(&output_frame, input_frame, info);
-		} else {
-			copy_rgbx_frame(&output_frame, input_frame, info);
+		if (!output_stage(video, input_frame, stage)) {
+			if (video->gpu_conversion)
+				set_gpu_converted_data(&output_frame, input_frame, info);
+			else
+				copy_rgbx_frame(&output_frame, input_frame, info);
 		}
 
 		video_output_unlock_frame(video->video);
@@ -905,7 +1058,7 @@ static inline void output_frame(struct obs_core_video_mix *video)
 
 		frame.timestamp = vframe_info.timestamp;
 		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
+		output_video_data(video, &frame, vframe_info.count, video->active_stages[prev_texture]);
 		profile_end(output_frame_output_video_data_name);
 	}
 
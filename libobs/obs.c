@@ -370,8 +370,11 @@ static bool obs_init_textures(struct obs_core_video_mix *video)
 		break;
 	}
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+	for (size_t i = 0; i < NUM_TEXTURES; i++)
+		video->active_stages[i] = -1;
+
 #ifdef _WIN32
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
 		if (video->using_nv12_tex) {
 			video->copy_surfaces_encode[i] = gs_stagesurface_create_nv12(info->width, info->height);
 			if (!video->copy_surfaces_encode[i]) {
@@ -385,8 +388,10 @@ static bool obs_init_textures(struct obs_core_video_mix *video)
 				break;
 			}
 		}
+	}
 #endif
 
+	for (size_t i = 0; i < NUM_STAGE_SURFACES && success; i++) {
 		if (video->gpu_conversion) {
 			if (!obs_init_gpu_copy_surfaces(video, i)) {
 				success = false;
@@ -434,20 +439,22 @@ static bool obs_init_textures(struct obs_core_video_mix *video)
 	if (success) {
 		video->render_space = space;
 	} else {
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < NUM_STAGE_SURFACES; i++) {
 			for (size_t c = 0; c < NUM_CHANNELS; c++) {
 				if (video->copy_surfaces[i][c]) {
 					gs_stagesurface_destroy(video->copy_surfaces[i][c]);
 					video->copy_surfaces[i][c] = NULL;
 				}
 			}
+		}
 #ifdef _WIN32
+		for (size_t i = 0; i < NUM_TEXTURES; i++) {
 			if (video->copy_surfaces_encode[i]) {
 				gs_stagesurface_destroy(video->copy_surfaces_encode[i]);
 				video->copy_surfaces_encode[i] = NULL;
 			}
-#endif
 		}
+#endif
 
 		if (video->render_texture) {
 			gs_texture_destroy(video->render_texture);
@@ -728,15 +735,24 @@ static void obs_free_render_textures(struct obs_core_video_mix *video)
 		}
 	}
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+	/* the video output has been closed, nothing references them anymore */
+	for (size_t i = 0; i < NUM_STAGE_SURFACES; i++) {
 		for (size_t c = 0; c < NUM_CHANNELS; c++) {
 			if (video->copy_surfaces[i][c]) {
+				if (video->stages[i].mapped)
+					gs_stagesurface_unmap(video->copy_surfaces[i][c]);
 				gs_stagesurface_destroy(video->copy_surfaces[i][c]);
 				video->copy_surfaces[i][c] = NULL;
 			}
+		}
+
+		video->stages[i].mapped = false;
+		video->stages[i].held = false;
+	}
 
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t c = 0; c < NUM_CHANNELS; c++)
 			video->active_copy_surfaces[i][c] = NULL;
-		}
 #ifdef _WIN32
 		if (video->copy_surfaces_encode[i]) {
 			gs_stagesurface_destroy(video->copy_surfaces_encode[i]);
@@ -854,6 +870,10 @@ static void obs_free_graphics(void)
 
 static void set_audio_thread(void *unused);
 
+/* threads of the audio task pool, used to render independent audio sources
+ * and to run audio encoders */
+#define MAX_AUDIO_TASK_THREADS 4
+
 static bool obs_init_audio(struct audio_output_info *ai)
 {
 	struct obs_core_audio *audio = &obs->audio;
@@ -869,6 +889,20 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	struct obs_task_info audio_init = {.task = set_audio_thread};
 	deque_push_back(&audio->tasks, &audio_init, sizeof(audio_init));
 
+	size_t threads = (size_t)os_get_logical_cores();
+	if (threads > MAX_AUDIO_TASK_THREADS)
+		threads = MAX_AUDIO_TASK_THREADS;
+
+	audio->task_pool = os_task_pool_create(threads);
+
+	/* rendering gets its own workers so the audio thread never waits
+	 * behind encode tasks queued by the encoders */
+	if (threads > 1) {
+		audio->render_pool = os_task_pool_create(threads);
+		if (audio->render_pool)
+			audio->render_lane = os_task_lane_create(audio->render_pool, false, OS_TASK_PRIORITY_HIGH);
+	}
+
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
@@ -899,9 +933,17 @@ static void obs_free_audio(void)
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	os_task_lane_destroy(audio->render_lane);
+	os_task_pool_release(audio->render_pool);
+	os_task_pool_release(audio->task_pool);
+
 	deque_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
+	da_free(audio->render_edges);
+	for (size_t i = 0; i < audio->render_nodes.num; i++)
+		da_free(audio->render_nodes.array[i].dependents);
+	da_free(audio->render_nodes);
 
 	da_free(audio->monitors);
 	bfree(audio->monitoring_device_name);
@@ -939,6 +981,8 @@ static bool obs_init_data(void)
 
 	if (!obs_view_init(&data->main_view))
 		goto fail;
+	if (!obs_encoder_packet_pool_init())
+		goto fail;
 
 	data->sources = NULL;
 	data->public_sources = NULL;
@@ -1021,6 +1065,8 @@ static void obs_free_data(void)
 		bfree(data->protocols.array[i]);
 	da_free(data->protocols);
 	da_free(data->sources_to_tick);
+
+	obs_encoder_packet_pool_free();
 }
 
 static const char *obs_signals[] = {
@@ -2284,7 +2330,7 @@ obs_data_t *obs_save_source(obs_source_t *source)
 {
 	obs_data_array_t *filters = obs_data_array_create();
 	obs_data_t *source_data = obs_data_create();
-	obs_data_t *settings = obs_source_get_settings(source);
+	obs_data_t *settings = source->context.settings;
 	obs_data_t *hotkey_data = source->context.hotkey_data;
 	obs_data_t *hotkeys;
 	float volume = obs_source_get_volume(source);
@@ -2307,6 +2353,9 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	int di_order = (int)obs_source_get_deinterlace_field_order(source);
 	DARRAY(obs_source_t *) filters_copy;
 
+	/* not obs_source_get_settings, saving is not a change */
+	obs_data_addref(settings);
+
 	obs_source_save(source);
 	hotkeys = obs_hotkeys_save_source(source);
 
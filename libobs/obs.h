@@ -774,6 +774,28 @@ EXPORT obs_data_array_t *obs_save_sources(void);
 typedef bool (*obs_save_source_filter_cb)(void *data, obs_source_t *source);
 EXPORT obs_data_array_t *obs_save_sources_filtered(obs_save_source_filter_cb cb, void *data);
 
+/**
+ * Cache for saving sources repeatedly
+ *
+ *   Keeps the JSON of every source saved through it, and only serializes a
+ * source again once the source or one of its filters may have changed.
+ * Sources of types that implement the save callback are always serialized
+ * again.  A cache must only be used from one thread at a time.
+ */
+typedef struct obs_save_cache obs_save_cache_t;
+
+EXPORT obs_save_cache_t *obs_save_cache_create(void);
+EXPORT void obs_save_cache_destroy(obs_save_cache_t *cache);
+
+/**
+ * Returns the same sources obs_save_sources_filtered would save, as a pretty
+ * printed JSON array.  Every line but the first is indented by the specified
+ * number of spaces, to embed the array into a larger document.  The returned
+ * string must be freed with bfree.
+ */
+EXPORT char *obs_save_cache_sources_json(obs_save_cache_t *cache, obs_save_source_filter_cb cb, void *data,
+					 size_t indent);
+
 /** Reset source UUIDs. NOTE: this function is only to be used by the UI and
  *  will be removed in a future version! */
 EXPORT void obs_reset_source_uuids(void);
@@ -1324,6 +1346,22 @@ EXPORT void obs_source_draw(gs_texture_t *image, int x, int y, uint32_t cx, uint
 EXPORT void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame);
 EXPORT void obs_source_output_video2(obs_source_t *source, const struct obs_source_frame2 *frame);
 
+/**
+ * Borrows a frame from the source's async frame cache so that it can be
+ * filled in place, avoiding the copy done by obs_source_output_video.
+ *
+ * Only the format, dimensions and color properties of info are used, its data
+ * pointers are ignored.  The returned frame's data and linesize must be
+ * respected when writing to it.  Returns NULL if the source has too many
+ * frames queued.
+ *
+ * The frame must then be either passed to obs_source_output_borrowed_video,
+ * or handed back without being output with obs_source_release_frame.
+ */
+EXPORT struct obs_source_frame *obs_source_borrow_video_frame(obs_source_t *source,
+							      const struct obs_source_frame *info);
+EXPORT void obs_source_output_borrowed_video(obs_source_t *source, struct obs_source_frame *frame);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 EXPORT void obs_source_output_cea708(obs_source_t *source, const struct obs_source_cea_708 *captions);
@@ -2319,6 +2357,9 @@ EXPORT uint32_t obs_encoder_get_caps(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst, struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/** Copies a packet into a new reference counted packet */
+EXPORT void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src);
+
 EXPORT void *obs_encoder_create_rerouted(obs_encoder_t *encoder, const char *reroute_id);
 
 /** Returns whether encoder is paused */
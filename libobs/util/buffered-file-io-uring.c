@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "buffered-file-io.h"
+#include "bmem.h"
+#include "base.h"
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+
+/* O_DIRECT requires the memory, offset and size of writes to be aligned to
+ * the logical block size, which is at most the page size in practice */
+#define DIRECT_ALIGNMENT 4096
+
+/* a chunk is split into an unaligned head, an aligned body and an unaligned
+ * tail, only the body is written with O_DIRECT */
+#define OPS_PER_CHUNK 3
+
+struct uring_op {
+	struct io_chunk *chunk;
+	struct iovec iov;
+	uint64_t offset;
+	bool direct;
+};
+
+struct uring_output {
+	int fd;
+	int direct_fd;
+	int ring_fd;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_entries;
+	unsigned *sq_array;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	unsigned to_submit;
+
+	uint64_t preallocate_size;
+	uint64_t allocated_end;
+};
+
+static inline int io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static bool init_ring(struct uring_output *out)
+{
+	struct io_uring_params params;
+	uint8_t *sq;
+	uint8_t *cq;
+
+	memset(&params, 0, sizeof(params));
+
+	out->ring_fd = io_uring_setup(IO_MAX_QUEUE_DEPTH * OPS_PER_CHUNK, &params);
+	if (out->ring_fd < 0)
+		return false;
+
+	out->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	out->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (out->cq_ring_size > out->sq_ring_size)
+			out->sq_ring_size = out->cq_ring_size;
+		out->cq_ring_size = 0;
+	}
+
+	out->sq_ring = mmap(NULL, out->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->ring_fd,
+			    IORING_OFF_SQ_RING);
+	if (out->sq_ring == MAP_FAILED) {
+		out->sq_ring = NULL;
+		return false;
+	}
+
+	if (out->cq_ring_size) {
+		out->cq_ring = mmap(NULL, out->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				    out->ring_fd, IORING_OFF_CQ_RING);
+		if (out->cq_ring == MAP_FAILED) {
+			out->cq_ring = NULL;
+			return false;
+		}
+	}
+
+	out->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	out->sqes = mmap(NULL, out->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->ring_fd,
+			 IORING_OFF_SQES);
+	if (out->sqes == MAP_FAILED) {
+		out->sqes = NULL;
+		return false;
+	}
+
+	sq = out->sq_ring;
+	cq = out->cq_ring ? out->cq_ring : out->sq_ring;
+
+	out->sq_head = (unsigned *)(sq + params.sq_off.head);
+	out->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	out->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	out->sq_entries = (unsigned *)(sq + params.sq_off.ring_entries);
+	out->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+	out->cq_head = (unsigned *)(cq + params.cq_off.head);
+	out->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	out->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+	out->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	return true;
+}
+
+static void uring_destroy(void *data)
+{
+	struct uring_output *out = data;
+	struct stat st;
+
+	if (out->sqes)
+		munmap(out->sqes, out->sqes_size);
+	if (out->cq_ring)
+		munmap(out->cq_ring, out->cq_ring_size);
+	if (out->sq_ring)
+		munmap(out->sq_ring, out->sq_ring_size);
+	if (out->ring_fd >= 0)
+		close(out->ring_fd);
+
+	/* give back the space that was reserved but not written */
+	if (out->allocated_end && fstat(out->fd, &st) == 0 && (uint64_t)st.st_size < out->allocated_end)
+		fallocate(out->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, st.st_size,
+			  (off_t)(out->allocated_end - (uint64_t)st.st_size));
+
+	if (out->direct_fd >= 0)
+		close(out->direct_fd);
+	if (out->fd >= 0)
+		close(out->fd);
+	bfree(out);
+}
+
+static void *uring_create(const char *path, const struct buffered_file_serializer_options *options)
+{
+	struct uring_output *out = bzalloc(sizeof(*out));
+	out->ring_fd = -1;
+	out->direct_fd = -1;
+
+	out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (out->fd < 0 || !init_ring(out)) {
+		uring_destroy(out);
+		return NULL;
+	}
+
+	/* not every file system supports O_DIRECT, tmpfs for example */
+	if (options->direct_io) {
+		out->direct_fd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+		if (out->direct_fd < 0)
+			blog(LOG_INFO, "O_DIRECT is not supported for '%s', using buffered writes", path);
+	}
+
+	out->preallocate_size = options->preallocate_size;
+	return out;
+}
+
+static size_t uring_get_alignment(void *data)
+{
+	struct uring_output *out = data;
+	return out->direct_fd >= 0 ? DIRECT_ALIGNMENT : 0;
+}
+
+static void queue_write(struct uring_output *out, struct io_chunk *chunk, int fd, uint8_t *data, size_t size,
+			uint64_t offset)
+{
+	/* the ring has room for every op of every chunk in flight */
+	unsigned tail = *out->sq_tail;
+	unsigned idx = tail & *out->sq_mask;
+	struct io_uring_sqe *sqe = &out->sqes[idx];
+	struct uring_op *op = bmalloc(sizeof(*op));
+
+	op->chunk = chunk;
+	op->iov.iov_base = data;
+	op->iov.iov_len = size;
+	op->offset = offset;
+	op->direct = fd == out->direct_fd;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->addr = (uint64_t)(uintptr_t)&op->iov;
+	sqe->len = 1;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+
+	out->sq_array[idx] = idx;
+	__atomic_store_n(out->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	chunk->pending++;
+	out->to_submit++;
+}
+
+static bool submit_queued(struct uring_output *out)
+{
+	while (out->to_submit) {
+		int ret = io_uring_enter(out->ring_fd, out->to_submit, 0, 0);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+
+			blog(LOG_ERROR, "io_uring_enter failed: %s", strerror(errno));
+			return false;
+		}
+
+		out->to_submit -= (unsigned)ret;
+	}
+
+	return true;
+}
+
+static void preallocate(struct uring_output *out, uint64_t end)
+{
+	if (!out->preallocate_size || end + out->preallocate_size / 2 <= out->allocated_end)
+		return;
+
+	uint64_t new_end = end + out->preallocate_size;
+	if (fallocate(out->fd, FALLOC_FL_KEEP_SIZE, (off_t)out->allocated_end,
+		      (off_t)(new_end - out->allocated_end)) != 0) {
+		blog(LOG_INFO, "Preallocating disk space failed: %s", strerror(errno));
+		out->preallocate_size = 0;
+		return;
+	}
+
+	out->allocated_end = new_end;
+}
+
+static bool uring_submit(void *data, struct io_chunk *chunk)
+{
+	struct uring_output *out = data;
+	uint64_t offset = chunk->offset;
+	uint64_t end = offset + chunk->size;
+
+	chunk->pending = 0;
+	preallocate(out, end);
+
+	uint64_t body_start = (offset + DIRECT_ALIGNMENT - 1) & ~(uint64_t)(DIRECT_ALIGNMENT - 1);
+	uint64_t body_end = end & ~(uint64_t)(DIRECT_ALIGNMENT - 1);
+
+	if (out->direct_fd < 0 || body_end <= body_start) {
+		queue_write(out, chunk, out->fd, chunk->data, chunk->size, offset);
+		return submit_queued(out);
+	}
+
+	if (body_start > offset)
+		queue_write(out, chunk, out->fd, chunk->data, body_start - offset, offset);
+
+	queue_write(out, chunk, out->direct_fd, chunk->data + (body_start - offset), body_end - body_start,
+		    body_start);
+
+	if (end > body_end)
+		queue_write(out, chunk, out->fd, chunk->data + (body_end - offset), end - body_end, body_end);
+
+	return submit_queued(out);
+}
+
+static void complete_op(struct uring_output *out, struct uring_op *op, int res)
+{
+	struct io_chunk *chunk = op->chunk;
+
+	/* some file systems only reject O_DIRECT once written to, write the
+	 * rest of the file through the page cache instead */
+	if (res == -EINVAL && op->direct) {
+		if (out->direct_fd >= 0) {
+			blog(LOG_INFO, "O_DIRECT write rejected, using buffered writes");
+			close(out->direct_fd);
+			out->direct_fd = -1;
+		}
+
+		queue_write(out, chunk, out->fd, op->iov.iov_base, op->iov.iov_len, op->offset);
+		chunk->pending--;
+		bfree(op);
+		return;
+	}
+
+	if (res < 0 || (size_t)res != op->iov.iov_len) {
+		blog(LOG_ERROR, "Write of %zu bytes at %" PRIu64 " failed: %s", op->iov.iov_len, op->offset,
+		     res < 0 ? strerror(-res) : "short write");
+		chunk->error = true;
+	}
+
+	if (--chunk->pending == 0)
+		chunk->state = IO_CHUNK_DONE;
+
+	bfree(op);
+}
+
+static bool uring_complete(void *data, bool wait)
+{
+	struct uring_output *out = data;
+
+	while (wait) {
+		int ret = io_uring_enter(out->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+		if (ret >= 0)
+			break;
+		if (errno != EINTR) {
+			blog(LOG_ERROR, "io_uring_enter failed: %s", strerror(errno));
+			return false;
+		}
+	}
+
+	unsigned head = *out->cq_head;
+	unsigned tail = __atomic_load_n(out->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &out->cqes[head & *out->cq_mask];
+		complete_op(out, (struct uring_op *)(uintptr_t)cqe->user_data, cqe->res);
+	}
+
+	__atomic_store_n(out->cq_head, head, __ATOMIC_RELEASE);
+
+	/* writes that were retried without O_DIRECT */
+	return submit_queued(out);
+}
+
+#else
+
+static void *uring_create(const char *path, const struct buffered_file_serializer_options *options)
+{
+	UNUSED_PARAMETER(path);
+	UNUSED_PARAMETER(options);
+	return NULL;
+}
+
+static void uring_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static size_t uring_get_alignment(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 0;
+}
+
+static bool uring_submit(void *data, struct io_chunk *chunk)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(chunk);
+	return false;
+}
+
+static bool uring_complete(void *data, bool wait)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(wait);
+	return false;
+}
+
+#endif
+
+const struct io_backend io_uring_backend = {
+	.name = "io_uring",
+	.create = uring_create,
+	.destroy = uring_destroy,
+	.get_alignment = uring_get_alignment,
+	.submit = uring_submit,
+	.complete = uring_complete,
+};
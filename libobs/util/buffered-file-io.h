@@ -0,0 +1,49 @@
+#pragma once
+
+/* I/O backends of the buffered file serializer, only used internally */
+
+#include "buffered-file-serializer.h"
+
+#define IO_MAX_QUEUE_DEPTH 64
+
+enum io_chunk_state {
+	IO_CHUNK_FREE,
+	IO_CHUNK_IN_FLIGHT,
+	IO_CHUNK_DONE,
+};
+
+struct io_chunk {
+	/* data is placed within mem so that it has the same alignment as its
+	 * offset in the file */
+	uint8_t *mem;
+	uint8_t *data;
+	size_t size;
+	uint64_t offset;
+
+	enum io_chunk_state state;
+	bool error;
+	uint64_t submit_time;
+
+	/* backend specific */
+	int pending;
+};
+
+struct io_backend {
+	const char *name;
+
+	void *(*create)(const char *path, const struct buffered_file_serializer_options *options);
+	void (*destroy)(void *data);
+
+	/* alignment data needs to have relative to its offset, if any */
+	size_t (*get_alignment)(void *data);
+
+	/* starts writing the chunk, it is set to IO_CHUNK_DONE once written */
+	bool (*submit)(void *data, struct io_chunk *chunk);
+
+	/* processes completed writes, waiting for at least one if requested */
+	bool (*complete)(void *data, bool wait);
+};
+
+#ifdef __linux__
+extern const struct io_backend io_uring_backend;
+#endif
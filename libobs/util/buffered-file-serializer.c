@@ -15,6 +15,7 @@
  */
 
 #include "buffered-file-serializer.h"
+#include "buffered-file-io.h"
 
 #include <inttypes.h>
 
@@ -25,6 +26,72 @@
 
 static const size_t DEFAULT_BUF_SIZE = 256ULL * 1048576ULL; // 256 MiB
 static const size_t DEFAULT_CHUNK_SIZE = 1048576;           // 1 MiB
+static const uint32_t DEFAULT_QUEUE_DEPTH = 4;
+
+/* ========================================================================== */
+/* stdio backend                                                              */
+
+struct stdio_output {
+	FILE *file;
+};
+
+static void *stdio_create(const char *path, const struct buffered_file_serializer_options *options)
+{
+	struct stdio_output *out;
+	FILE *file = os_fopen(path, "wb");
+
+	UNUSED_PARAMETER(options);
+
+	if (!file)
+		return NULL;
+
+	out = bzalloc(sizeof(*out));
+	out->file = file;
+	return out;
+}
+
+static void stdio_destroy(void *data)
+{
+	struct stdio_output *out = data;
+
+	fclose(out->file);
+	bfree(out);
+}
+
+static size_t stdio_get_alignment(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 0;
+}
+
+static bool stdio_submit(void *data, struct io_chunk *chunk)
+{
+	struct stdio_output *out = data;
+
+	chunk->state = IO_CHUNK_DONE;
+
+	if (os_fseeki64(out->file, (int64_t)chunk->offset, SEEK_SET) != 0 ||
+	    fwrite(chunk->data, 1, chunk->size, out->file) != chunk->size)
+		chunk->error = true;
+
+	return true;
+}
+
+static bool stdio_complete(void *data, bool wait)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(wait);
+	return true;
+}
+
+static const struct io_backend stdio_backend = {
+	.name = "stdio",
+	.create = stdio_create,
+	.destroy = stdio_destroy,
+	.get_alignment = stdio_get_alignment,
+	.submit = stdio_submit,
+	.complete = stdio_complete,
+};
 
 /* ========================================================================== */
 /* Buffered writer based on ffmpeg-mux implementation                         */
@@ -42,12 +109,25 @@ struct io_buffer {
 	os_event_t *new_data_available_event;
 	pthread_t io_thread;
 	pthread_mutex_t data_mutex;
-	FILE *output_file;
 	struct deque data;
 	uint64_t next_pos;
 
 	size_t buffer_size;
 	size_t chunk_size;
+
+	const struct io_backend *backend;
+	void *backend_data;
+	size_t alignment;
+
+	struct io_chunk *chunks;
+	uint32_t queue_depth;
+	uint32_t in_flight;
+
+	/* end of the last chunk that was submitted */
+	uint64_t submit_pos;
+
+	pthread_mutex_t stats_mutex;
+	struct buffered_file_serializer_stats stats;
 };
 
 struct file_output_data {
@@ -55,46 +135,180 @@ struct file_output_data {
 	struct io_buffer io;
 };
 
+static bool init_chunks(struct io_buffer *io)
+{
+	io->chunks = bzalloc(sizeof(struct io_chunk) * io->queue_depth);
+
+	for (uint32_t i = 0; i < io->queue_depth; i++) {
+		/* room to offset the data by up to the alignment */
+		io->chunks[i].mem = bmalloc(io->chunk_size + io->alignment * 2);
+		if (!io->chunks[i].mem)
+			return false;
+	}
+
+	return true;
+}
+
+static void free_chunks(struct io_buffer *io)
+{
+	if (!io->chunks)
+		return;
+
+	for (uint32_t i = 0; i < io->queue_depth; i++)
+		bfree(io->chunks[i].mem);
+	bfree(io->chunks);
+	io->chunks = NULL;
+}
+
+static void set_chunk_offset(struct io_buffer *io, struct io_chunk *chunk, uint64_t offset)
+{
+	uint8_t *data = chunk->mem;
+
+	if (io->alignment) {
+		uintptr_t mask = (uintptr_t)io->alignment - 1;
+		data = (uint8_t *)(((uintptr_t)data + mask) & ~mask);
+		data += offset & mask;
+	}
+
+	chunk->data = data;
+	chunk->offset = offset;
+	chunk->size = 0;
+}
+
+/* Collects the writes that have completed, waiting for at least one if
+ * requested.  Returns false on write errors. */
+static bool reap_chunks(struct file_output_data *out, bool wait)
+{
+	struct io_buffer *io = &out->io;
+	bool success = true;
+
+	if (!io->in_flight)
+		return true;
+	if (!io->backend->complete(io->backend_data, wait))
+		return false;
+
+	uint64_t now = os_gettime_ns();
+
+	pthread_mutex_lock(&io->stats_mutex);
+
+	for (uint32_t i = 0; i < io->queue_depth; i++) {
+		struct io_chunk *chunk = &io->chunks[i];
+		if (chunk->state != IO_CHUNK_DONE)
+			continue;
+
+		if (chunk->error) {
+			blog(LOG_ERROR, "Error writing %zu bytes at %" PRIu64 " to '%s'", chunk->size, chunk->offset,
+			     out->filename.array);
+			success = false;
+		}
+
+		uint64_t latency = now - chunk->submit_time;
+		io->stats.writes++;
+		io->stats.bytes_written += chunk->size;
+		io->stats.total_latency_ns += latency;
+		if (latency > io->stats.max_latency_ns)
+			io->stats.max_latency_ns = latency;
+
+		chunk->state = IO_CHUNK_FREE;
+		chunk->error = false;
+		io->in_flight--;
+	}
+
+	io->stats.in_flight = io->in_flight;
+
+	pthread_mutex_unlock(&io->stats_mutex);
+	return success;
+}
+
+static bool drain_chunks(struct file_output_data *out)
+{
+	while (out->io.in_flight) {
+		if (!reap_chunks(out, true))
+			return false;
+	}
+
+	return true;
+}
+
+static struct io_chunk *get_free_chunk(struct file_output_data *out)
+{
+	struct io_buffer *io = &out->io;
+
+	for (;;) {
+		if (!reap_chunks(out, io->in_flight == io->queue_depth))
+			return NULL;
+
+		for (uint32_t i = 0; i < io->queue_depth; i++) {
+			if (io->chunks[i].state == IO_CHUNK_FREE) {
+				io->chunks[i].size = 0;
+				return &io->chunks[i];
+			}
+		}
+	}
+}
+
+static bool submit_chunk(struct file_output_data *out, struct io_chunk *chunk)
+{
+	struct io_buffer *io = &out->io;
+
+	/* writes that are in flight are only guaranteed not to overlap while
+	 * they are sequential, wait for them before writing elsewhere */
+	if (chunk->offset != io->submit_pos && !drain_chunks(out))
+		return false;
+
+	chunk->state = IO_CHUNK_IN_FLIGHT;
+	chunk->submit_time = os_gettime_ns();
+
+	if (!io->backend->submit(io->backend_data, chunk)) {
+		chunk->state = IO_CHUNK_FREE;
+		return false;
+	}
+
+	io->submit_pos = chunk->offset + chunk->size;
+	io->in_flight++;
+
+	pthread_mutex_lock(&io->stats_mutex);
+	io->stats.in_flight = io->in_flight;
+	if (io->in_flight > io->stats.max_in_flight)
+		io->stats.max_in_flight = io->in_flight;
+	pthread_mutex_unlock(&io->stats_mutex);
+
+	/* synchronous backends complete chunks right away */
+	return reap_chunks(out, false);
+}
+
 static void *io_thread(void *opaque)
 {
 	struct file_output_data *out = opaque;
 	os_set_thread_name("buffered writer i/o thread");
 
-	// Chunk collects the writes into a larger batch
-	size_t chunk_used = 0;
+	// Chunk collects the writes into a larger batch, the chunks that
+	// were submitted before may still be in flight
+	struct io_chunk *chunk = NULL;
 	size_t chunk_size = out->io.chunk_size;
 
-	unsigned char *chunk = bmalloc(chunk_size);
-	if (!chunk) {
-		os_atomic_set_bool(&out->io.output_error, true);
-		fprintf(stderr, "Error allocating memory for output\n");
-		goto error;
-	}
-
 	bool shutting_down;
-	bool want_seek = false;
 	bool force_flush_chunk = false;
 
-	// current_seek_position is a virtual position updated as we read from
-	// the buffer, if it becomes discontinuous due to a seek request we
-	// flush the chunk. next_seek_position is the actual offset we should
-	// seek to when we write the chunk.
-	uint64_t current_seek_position = 0;
-	uint64_t next_seek_position;
-
 	for (;;) {
 		// Wait for data to be written to the buffer
 		os_event_wait(out->io.new_data_available_event);
 
 		// Loop to write in chunk_size chunks
 		for (;;) {
+			if (!chunk) {
+				chunk = get_free_chunk(out);
+				if (!chunk)
+					goto error;
+			}
+
 			pthread_mutex_lock(&out->io.data_mutex);
 
 			shutting_down = os_atomic_load_bool(&out->io.shutdown_requested);
 
 			// Fetch as many writes as possible from the deque
-			// and fill up our local chunk. This may involve
-			// seeking, so take care of that as well.
+			// and fill up our local chunk. Writes that are not
+			// contiguous with the chunk go into the next one.
 			for (;;) {
 				size_t available = out->io.data.size;
 
@@ -107,28 +321,13 @@ static void *io_thread(void *opaque)
 				struct io_header header;
 				deque_peek_front(&out->io.data, &header, sizeof(header));
 
-				// Do we need to seek?
-				if (header.seek_offset != current_seek_position) {
-
-					// If there's already part of a chunk pending,
-					// flush it at the current offset. Similarly,
-					// if we already plan to seek, then seek.
-					if (chunk_used || want_seek) {
-						force_flush_chunk = true;
-						break;
-					}
+				if (!chunk->size) {
+					set_chunk_offset(&out->io, chunk, header.seek_offset);
 
-					// Mark that we need to seek and where to
-					want_seek = true;
-					next_seek_position = header.seek_offset;
-
-					// Update our virtual position
-					current_seek_position = header.seek_offset;
-				}
-
-				// Make sure there's enough room for the data, if
-				// not then force a flush
-				if (header.data_length + chunk_used > chunk_size) {
+				} else if (header.seek_offset != chunk->offset + chunk->size ||
+					   header.data_length + chunk->size > chunk_size) {
+					// Flush the pending chunk if the write
+					// requires seeking or doesn't fit
 					force_flush_chunk = true;
 					break;
 				}
@@ -137,11 +336,9 @@ static void *io_thread(void *opaque)
 				deque_pop_front(&out->io.data, NULL, sizeof(header));
 
 				// Copy from the buffer to our local chunk
-				deque_pop_front(&out->io.data, chunk + chunk_used, header.data_length);
+				deque_pop_front(&out->io.data, chunk->data + chunk->size, header.data_length);
 
-				// Update offsets
-				chunk_used += header.data_length;
-				current_seek_position += header.data_length;
+				chunk->size += header.data_length;
 			}
 
 			// Signal that there is more room in the buffer
@@ -150,7 +347,7 @@ static void *io_thread(void *opaque)
 			// Try to avoid lots of small writes unless this was the final
 			// data left in the buffer. The buffer might be entirely empty
 			// if we were woken up to exit.
-			if (!force_flush_chunk && (!chunk_used || (chunk_used < 65536 && !shutting_down))) {
+			if (!force_flush_chunk && (!chunk->size || (chunk->size < 65536 && !shutting_down))) {
 				os_event_reset(out->io.new_data_available_event);
 				pthread_mutex_unlock(&out->io.data_mutex);
 				break;
@@ -158,35 +355,11 @@ static void *io_thread(void *opaque)
 
 			pthread_mutex_unlock(&out->io.data_mutex);
 
-			// Seek if we need to
-			if (want_seek) {
-				os_fseeki64(out->io.output_file, next_seek_position, SEEK_SET);
-
-				// Update the next virtual position, making sure to take
-				// into account the size of the chunk we're about to write.
-				current_seek_position = next_seek_position + chunk_used;
-
-				want_seek = false;
-
-				// If we did a seek but do not have any data left to write
-				// return to the start of the loop.
-				if (!chunk_used) {
-					force_flush_chunk = false;
-					continue;
-				}
-			}
-
 			// Write the current chunk to the output file
-			size_t bytes_written = fwrite(chunk, 1, chunk_used, out->io.output_file);
-			if (bytes_written != chunk_used) {
-				blog(LOG_ERROR, "Error writing to '%s': %s (%zu != %zu)\n", out->filename.array,
-				     strerror(errno), bytes_written, chunk_used);
-				os_atomic_set_bool(&out->io.output_error, true);
-
+			if (!submit_chunk(out, chunk))
 				goto error;
-			}
 
-			chunk_used = 0;
+			chunk = NULL;
 			force_flush_chunk = false;
 		}
 
@@ -195,11 +368,21 @@ static void *io_thread(void *opaque)
 			break;
 	}
 
+	if (drain_chunks(out))
+		goto finish;
+
 error:
-	if (chunk)
-		bfree(chunk);
+	blog(LOG_ERROR, "Error writing to '%s'", out->filename.array);
+	os_atomic_set_bool(&out->io.output_error, true);
+	os_event_signal(out->io.buffer_space_available_event);
 
-	fclose(out->io.output_file);
+	// Make sure the backend no longer references the chunks
+	while (out->io.in_flight && out->io.backend->complete(out->io.backend_data, true))
+		reap_chunks(out, false);
+
+finish:
+	out->io.backend->destroy(out->io.backend_data);
+	out->io.backend_data = NULL;
 	return NULL;
 }
 
@@ -271,6 +454,10 @@ static size_t file_output_write(void *opaque, const void *buf, size_t buf_size)
 
 		if (free_space < next_chunk_size + sizeof(struct io_header)) {
 			blog(LOG_DEBUG, "Waiting for I/O thread...");
+			pthread_mutex_lock(&out->io.stats_mutex);
+			out->io.stats.buffer_full_waits++;
+			pthread_mutex_unlock(&out->io.stats_mutex);
+
 			// No space, wait for the I/O thread to make space
 			os_event_reset(out->io.buffer_space_available_event);
 			pthread_mutex_unlock(&out->io.data_mutex);
@@ -325,6 +512,56 @@ bool buffered_file_serializer_init_defaults(struct serializer *s, const char *pa
 }
 
 bool buffered_file_serializer_init(struct serializer *s, const char *path, size_t max_bufsize, size_t chunk_size)
+{
+	struct buffered_file_serializer_options options = {
+		.max_bufsize = max_bufsize,
+		.chunk_size = chunk_size,
+	};
+
+	return buffered_file_serializer_init_with_options(s, path, &options);
+}
+
+static const struct io_backend *get_backend(enum buffered_file_io_backend backend)
+{
+	switch (backend) {
+	case BUFFERED_FILE_IO_URING:
+#ifdef __linux__
+		return &io_uring_backend;
+#else
+		return NULL;
+#endif
+	case BUFFERED_FILE_IO_DEFAULT:
+	case BUFFERED_FILE_IO_STDIO:
+		break;
+	}
+
+	return &stdio_backend;
+}
+
+static bool create_backend(struct io_buffer *io, const char *path,
+			   const struct buffered_file_serializer_options *options)
+{
+	io->backend = get_backend(options->backend);
+
+	if (io->backend) {
+		io->backend_data = io->backend->create(path, options);
+		if (io->backend_data)
+			return true;
+	}
+
+	if (io->backend == &stdio_backend)
+		return false;
+
+	/* io_uring may be unsupported by the kernel or blocked by a sandbox */
+	blog(LOG_WARNING, "Buffered file I/O backend %d unavailable, falling back to stdio", (int)options->backend);
+
+	io->backend = &stdio_backend;
+	io->backend_data = io->backend->create(path, options);
+	return io->backend_data != NULL;
+}
+
+bool buffered_file_serializer_init_with_options(struct serializer *s, const char *path,
+						const struct buffered_file_serializer_options *options)
 {
 	struct file_output_data *out;
 
@@ -332,18 +569,41 @@ bool buffered_file_serializer_init(struct serializer *s, const char *path, size_
 
 	dstr_init_copy(&out->filename, path);
 
-	out->io.output_file = os_fopen(path, "wb");
-	if (!out->io.output_file)
+	if (!create_backend(&out->io, path, options)) {
+		dstr_free(&out->filename);
+		bfree(out);
+		return false;
+	}
+
+	out->io.buffer_size = options->max_bufsize ? options->max_bufsize : DEFAULT_BUF_SIZE;
+	out->io.chunk_size = options->chunk_size ? options->chunk_size : DEFAULT_CHUNK_SIZE;
+	out->io.alignment = out->io.backend->get_alignment(out->io.backend_data);
+
+	if (out->io.backend == &stdio_backend) {
+		out->io.queue_depth = 1;
+	} else {
+		out->io.queue_depth = options->queue_depth ? options->queue_depth : DEFAULT_QUEUE_DEPTH;
+		if (out->io.queue_depth > IO_MAX_QUEUE_DEPTH)
+			out->io.queue_depth = IO_MAX_QUEUE_DEPTH;
+	}
+
+	if (!init_chunks(&out->io)) {
+		out->io.backend->destroy(out->io.backend_data);
+		free_chunks(&out->io);
+		dstr_free(&out->filename);
+		bfree(out);
 		return false;
+	}
 
-	out->io.buffer_size = max_bufsize ? max_bufsize : DEFAULT_BUF_SIZE;
-	out->io.chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+	out->io.stats.backend = out->io.backend->name;
+	out->io.stats.queue_depth = out->io.queue_depth;
 
 	// Start at 1MB, this can grow up to max_bufsize depending
 	// on how fast data is going in and out.
 	deque_reserve(&out->io.data, 1048576);
 
 	pthread_mutex_init(&out->io.data_mutex, NULL);
+	pthread_mutex_init(&out->io.stats_mutex, NULL);
 
 	os_event_init(&out->io.buffer_space_available_event, OS_EVENT_TYPE_AUTO);
 	os_event_init(&out->io.new_data_available_event, OS_EVENT_TYPE_AUTO);
@@ -360,6 +620,24 @@ bool buffered_file_serializer_init(struct serializer *s, const char *path, size_
 	return true;
 }
 
+bool buffered_file_serializer_get_stats(struct serializer *s, struct buffered_file_serializer_stats *stats)
+{
+	struct file_output_data *out = s ? s->data : NULL;
+
+	if (!out || !stats)
+		return false;
+
+	pthread_mutex_lock(&out->io.stats_mutex);
+	*stats = out->io.stats;
+	pthread_mutex_unlock(&out->io.stats_mutex);
+
+	pthread_mutex_lock(&out->io.data_mutex);
+	stats->buffered_bytes = out->io.data.size;
+	pthread_mutex_unlock(&out->io.data_mutex);
+
+	return true;
+}
+
 void buffered_file_serializer_free(struct serializer *s)
 {
 	struct file_output_data *out = s->data;
@@ -380,10 +658,20 @@ void buffered_file_serializer_free(struct serializer *s)
 		os_event_destroy(out->io.buffer_space_available_event);
 
 		pthread_mutex_destroy(&out->io.data_mutex);
+		pthread_mutex_destroy(&out->io.stats_mutex);
 
+		const struct buffered_file_serializer_stats *stats = &out->io.stats;
 		blog(LOG_DEBUG, "Final buffer capacity: %zu KiB", out->io.data.capacity / 1024);
+		blog(LOG_DEBUG,
+		     "Buffered writer stats: %s, %" PRIu64 " writes, %" PRIu64 " KiB, max in flight %" PRIu32
+		     "/%" PRIu32 ", avg latency %.2f ms, max latency %.2f ms, %" PRIu64 " buffer full waits",
+		     stats->backend, stats->writes, stats->bytes_written / 1024, stats->max_in_flight,
+		     stats->queue_depth,
+		     stats->writes ? (double)stats->total_latency_ns / (double)stats->writes / 1000000.0 : 0.0,
+		     (double)stats->max_latency_ns / 1000000.0, stats->buffer_full_waits);
 
 		deque_free(&out->io.data);
+		free_chunks(&out->io);
 	}
 
 	dstr_free(&out->filename);
@@ -22,11 +22,53 @@
 extern "C" {
 #endif
 
+enum buffered_file_io_backend {
+	BUFFERED_FILE_IO_DEFAULT,
+	BUFFERED_FILE_IO_STDIO,
+	BUFFERED_FILE_IO_URING,
+};
+
+struct buffered_file_serializer_options {
+	size_t max_bufsize;
+	size_t chunk_size;
+
+	enum buffered_file_io_backend backend;
+
+	/* number of chunks being written at once, ignored by stdio */
+	uint32_t queue_depth;
+
+	/* bypass the page cache where supported */
+	bool direct_io;
+
+	/* disk space to reserve ahead of the write position, 0 to disable */
+	uint64_t preallocate_size;
+};
+
+struct buffered_file_serializer_stats {
+	const char *backend;
+	uint32_t queue_depth;
+
+	uint32_t in_flight;
+	uint32_t max_in_flight;
+
+	uint64_t writes;
+	uint64_t bytes_written;
+	uint64_t total_latency_ns;
+	uint64_t max_latency_ns;
+
+	size_t buffered_bytes;
+	uint64_t buffer_full_waits;
+};
+
 EXPORT bool buffered_file_serializer_init_defaults(struct serializer *s, const char *path);
 EXPORT bool buffered_file_serializer_init(struct serializer *s, const char *path, size_t max_bufsize,
 					  size_t chunk_size);
+EXPORT bool buffered_file_serializer_init_with_options(struct serializer *s, const char *path,
+						       const struct buffered_file_serializer_options *options);
 EXPORT void buffered_file_serializer_free(struct serializer *s);
 
+EXPORT bool buffered_file_serializer_get_stats(struct serializer *s, struct buffered_file_serializer_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -83,7 +83,7 @@ struct profile_root_entry {
 	pthread_mutex_t *mutex;
 	const char *name;
 	profile_entry *entry;
-	profile_call *prev_call;
+	uint64_t prev_start_time;
 };
 
 static inline uint64_t diff_ns_to_usec(uint64_t prev, uint64_t next)
@@ -222,17 +222,17 @@ static profile_entry *get_child(profile_entry *parent, const char *name)
 	return init_entry(da_push_back_new(parent->children), name);
 }
 
-static void merge_call(profile_entry *entry, profile_call *call, profile_call *prev_call)
+static void merge_call(profile_entry *entry, profile_call *call, uint64_t prev_start_time)
 {
 	const size_t num = call->children.num;
 	for (size_t i = 0; i < num; i++) {
 		profile_call *child = &call->children.array[i];
-		merge_call(get_child(entry, child->name), child, NULL);
+		merge_call(get_child(entry, child->name), child, 0);
 	}
 
-	if (entry->expected_time_between_calls != 0 && prev_call) {
+	if (entry->expected_time_between_calls != 0 && prev_start_time) {
 		migrate_old_entries(&entry->times_between_calls, true);
-		uint64_t usec = diff_ns_to_usec(prev_call->start_time, call->start_time);
+		uint64_t usec = diff_ns_to_usec(prev_start_time, call->start_time);
 		add_hashmap_entry(&entry->times_between_calls, usec, 1);
 	}
 
@@ -248,25 +248,474 @@ static void merge_call(profile_entry *entry, profile_call *call, profile_call *p
 #endif
 }
 
-static bool enabled = false;
+static volatile bool enabled = false;
 static pthread_mutex_t root_mutex = PTHREAD_MUTEX_INITIALIZER;
 static DARRAY(profile_root_entry) root_entries;
 
-static THREAD_LOCAL profile_call *thread_context = NULL;
 static THREAD_LOCAL bool thread_enabled = true;
 
+/* ------------------------------------------------------------------------- */
+/* Per-thread call records
+ *
+ * profile_start/profile_end never lock or allocate after a thread's first
+ * call; they only append a start/end record to a ring buffer owned by the
+ * calling thread.  The rings are drained by the profiler thread (and before
+ * taking a snapshot), which rebuilds the call trees and merges them into the
+ * root entries.
+ *
+ * A start record is only written if there is still room for the end records
+ * of every open call, so a full ring drops whole call subtrees instead of
+ * corrupting the tree being rebuilt. */
+
+#define PROFILE_RECORD_COUNT 4096
+#define PROFILE_RECORD_MASK (PROFILE_RECORD_COUNT - 1)
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_DRAIN_INTERVAL_MS 5
+
+enum profile_record_type {
+	PROFILE_RECORD_START,
+	PROFILE_RECORD_END,
+};
+
+struct profile_record {
+	const char *name;
+	uint64_t time;
+#ifdef TRACK_OVERHEAD
+	uint64_t overhead_time;
+#endif
+	enum profile_record_type type;
+};
+
+typedef struct profile_thread_buffer profile_thread_buffer;
+struct profile_thread_buffer {
+	volatile long tail;
+	struct profile_record records[PROFILE_RECORD_COUNT];
+	volatile long head;
+
+	/* drain side, protected by buffers_mutex */
+	profile_call *context;
+	const char *thread_name;
+	long thread_id;
+	bool thread_exited;
+};
+
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(profile_thread_buffer *) thread_buffers;
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t buffer_key;
+static volatile long dropped_calls = 0;
+static volatile long next_thread_id = 0;
+static volatile long buffers_generation = 0;
+
+static pthread_t drain_thread;
+static os_event_t *drain_stop_event = NULL;
+static bool drain_thread_active = false;
+
+static THREAD_LOCAL profile_thread_buffer *thread_buffer = NULL;
+static THREAD_LOCAL long thread_buffer_generation = 0;
+static THREAD_LOCAL const char *thread_names[PROFILE_MAX_DEPTH];
+static THREAD_LOCAL size_t thread_depth = 0;
+static THREAD_LOCAL size_t thread_skip_depth = 0;
+
+static void free_call_context(profile_call *context);
+static void merge_context(profile_call *context);
+
+static void free_thread_buffer_context(profile_thread_buffer *buf)
+{
+	profile_call *root = buf->context;
+
+	while (root && root->parent)
+		root = root->parent;
+
+	free_call_context(root);
+	buf->context = NULL;
+}
+
+/* The key holds the thread id rather than the buffer, as profiler_free may
+ * already have freed the buffer by the time the thread exits.  Threads that
+ * never run key destructors leave their buffers to profiler_free. */
+static void thread_buffer_destroy(void *data)
+{
+	long thread_id = (long)(intptr_t)data;
+
+	pthread_mutex_lock(&buffers_mutex);
+	for (size_t i = 0; i < thread_buffers.num; i++) {
+		profile_thread_buffer *buf = thread_buffers.array[i];
+
+		if (buf->thread_id == thread_id) {
+			buf->thread_exited = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+static void create_buffer_key(void)
+{
+	pthread_key_create(&buffer_key, thread_buffer_destroy);
+}
+
+static profile_thread_buffer *create_thread_buffer(void)
+{
+	profile_thread_buffer *buf = bzalloc(sizeof(profile_thread_buffer));
+	buf->thread_id = os_atomic_inc_long(&next_thread_id);
+
+	pthread_once(&buffer_key_once, create_buffer_key);
+	pthread_setspecific(buffer_key, (void *)(intptr_t)buf->thread_id);
+
+	pthread_mutex_lock(&buffers_mutex);
+	da_push_back(thread_buffers, &buf);
+	thread_buffer_generation = buffers_generation;
+	pthread_mutex_unlock(&buffers_mutex);
+
+	thread_buffer = buf;
+	return buf;
+}
+
+static inline size_t thread_buffer_space(const profile_thread_buffer *buf)
+{
+	long head = os_atomic_load_long(&buf->head);
+	return (size_t)((head - buf->tail - 1) & PROFILE_RECORD_MASK);
+}
+
+static inline void push_record(profile_thread_buffer *buf, enum profile_record_type type, const char *name,
+			       uint64_t time, uint64_t overhead_time)
+{
+	long tail = buf->tail;
+	struct profile_record *record = &buf->records[tail];
+
+	record->name = name;
+	record->time = time;
+#ifdef TRACK_OVERHEAD
+	record->overhead_time = overhead_time;
+#else
+	UNUSED_PARAMETER(overhead_time);
+#endif
+	record->type = type;
+
+	os_atomic_set_long(&buf->tail, (tail + 1) & PROFILE_RECORD_MASK);
+}
+
+/* Timeline capture: when enabled, every completed call is also kept as a
+ * timestamped event in a bounded ring so that the last few seconds can be
+ * dumped as a Chrome trace. */
+
+#define PROFILE_TRACE_EVENT_COUNT (1 << 18)
+
+struct profile_trace_event {
+	const char *name;
+	const char *thread_name;
+	uint64_t start_time;
+	uint64_t end_time;
+	long thread_id;
+};
+
+/* protected by buffers_mutex */
+static struct profile_trace_event *trace_events = NULL;
+static size_t trace_next = 0;
+static size_t trace_count = 0;
+static uint64_t trace_window = 0;
+
+static void add_trace_event(profile_thread_buffer *buf, const profile_call *call)
+{
+	struct profile_trace_event *event = &trace_events[trace_next];
+
+	event->name = call->name;
+	event->thread_name = buf->thread_name;
+	event->start_time = call->start_time;
+	event->end_time = call->end_time;
+	event->thread_id = buf->thread_id;
+
+	trace_next = (trace_next + 1) % PROFILE_TRACE_EVENT_COUNT;
+	if (trace_count < PROFILE_TRACE_EVENT_COUNT)
+		trace_count++;
+}
+
+static void replay_start(profile_thread_buffer *buf, const struct profile_record *record)
+{
+	profile_call new_call = {
+		.name = record->name,
+#ifdef TRACK_OVERHEAD
+		.overhead_start = record->overhead_time,
+#endif
+		.start_time = record->time,
+		.parent = buf->context,
+	};
+
+	profile_call *call = NULL;
+
+	if (new_call.parent) {
+		size_t idx = da_push_back(new_call.parent->children, &new_call);
+		call = &new_call.parent->children.array[idx];
+	} else {
+		call = bmalloc(sizeof(profile_call));
+		memcpy(call, &new_call, sizeof(profile_call));
+
+		if (!buf->thread_name)
+			buf->thread_name = call->name;
+	}
+
+	buf->context = call;
+}
+
+static void replay_end(profile_thread_buffer *buf, const struct profile_record *record)
+{
+	profile_call *call = buf->context;
+
+	if (!call->name)
+		call->name = record->name;
+
+	call->end_time = record->time;
+#ifdef TRACK_OVERHEAD
+	call->overhead_end = record->overhead_time;
+#endif
+
+	buf->context = call->parent;
+
+	if (trace_events)
+		add_trace_event(buf, call);
+
+	if (!call->parent)
+		merge_context(call);
+}
+
+static void drain_thread_buffer(profile_thread_buffer *buf)
+{
+	long head = buf->head;
+	long tail = os_atomic_load_long(&buf->tail);
+
+	while (head != tail) {
+		const struct profile_record *record = &buf->records[head];
+
+		if (record->type == PROFILE_RECORD_START)
+			replay_start(buf, record);
+		else
+			replay_end(buf, record);
+
+		head = (head + 1) & PROFILE_RECORD_MASK;
+	}
+
+	os_atomic_set_long(&buf->head, head);
+}
+
+static void drain_thread_buffers(void)
+{
+	pthread_mutex_lock(&buffers_mutex);
+
+	for (size_t i = thread_buffers.num; i > 0; i--) {
+		profile_thread_buffer *buf = thread_buffers.array[i - 1];
+
+		drain_thread_buffer(buf);
+
+		if (buf->thread_exited) {
+			free_thread_buffer_context(buf);
+			bfree(buf);
+			da_erase(thread_buffers, i - 1);
+		}
+	}
+
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+static void *profiler_drain_thread(void *param)
+{
+	os_set_thread_name("profiler: drain");
+
+	while (os_event_timedwait(drain_stop_event, PROFILE_DRAIN_INTERVAL_MS) == ETIMEDOUT)
+		drain_thread_buffers();
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+void profiler_trace_start(uint64_t window_ns)
+{
+	pthread_mutex_lock(&buffers_mutex);
+	if (!trace_events)
+		trace_events = bmalloc(sizeof(struct profile_trace_event) * PROFILE_TRACE_EVENT_COUNT);
+	trace_next = 0;
+	trace_count = 0;
+	trace_window = window_ns;
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+void profiler_trace_stop(void)
+{
+	pthread_mutex_lock(&buffers_mutex);
+	bfree(trace_events);
+	trace_events = NULL;
+	trace_next = 0;
+	trace_count = 0;
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+bool profiler_trace_active(void)
+{
+	bool active;
+
+	pthread_mutex_lock(&buffers_mutex);
+	active = trace_events != NULL;
+	pthread_mutex_unlock(&buffers_mutex);
+
+	return active;
+}
+
+static void dstr_cat_json_string(struct dstr *dst, const char *str)
+{
+	dstr_cat_ch(dst, '"');
+
+	for (; str && *str; str++) {
+		unsigned char ch = (unsigned char)*str;
+
+		if (ch == '"' || ch == '\\') {
+			dstr_cat_ch(dst, '\\');
+			dstr_cat_ch(dst, (char)ch);
+		} else if (ch < 0x20) {
+			dstr_catf(dst, "\\u%04x", ch);
+		} else {
+			dstr_cat_ch(dst, (char)ch);
+		}
+	}
+
+	dstr_cat_ch(dst, '"');
+}
+
+static void dstr_cat_trace_usec(struct dstr *dst, uint64_t ns)
+{
+	dstr_catf(dst, "%" PRIu64 ".%03u", ns / 1000, (unsigned)(ns % 1000));
+}
+
+static bool trace_flush(FILE *f, struct dstr *buffer, bool force)
+{
+	if (!force && buffer->len < 64 * 1024)
+		return true;
+
+	bool success = fwrite(buffer->array, 1, buffer->len, f) == buffer->len;
+	dstr_resize(buffer, 0);
+	return success;
+}
+
+bool profiler_trace_dump_json(const char *filename)
+{
+	struct profile_trace_event *events = NULL;
+	DARRAY(long) thread_ids = {0};
+	struct dstr buffer = {0};
+	size_t count = 0;
+	bool success = true;
+
+	drain_thread_buffers();
+
+	pthread_mutex_lock(&buffers_mutex);
+	if (trace_events && trace_count) {
+		uint64_t now = os_gettime_ns();
+		uint64_t cutoff = now > trace_window ? now - trace_window : 0;
+		size_t first = (trace_next + PROFILE_TRACE_EVENT_COUNT - trace_count) % PROFILE_TRACE_EVENT_COUNT;
+
+		events = bmalloc(sizeof(struct profile_trace_event) * trace_count);
+		for (size_t i = 0; i < trace_count; i++) {
+			struct profile_trace_event *event = &trace_events[(first + i) % PROFILE_TRACE_EVENT_COUNT];
+			if (event->end_time >= cutoff)
+				events[count++] = *event;
+		}
+	}
+	pthread_mutex_unlock(&buffers_mutex);
+
+	if (!events)
+		return false;
+
+	FILE *f = os_fopen(filename, "wb");
+	if (!f) {
+		bfree(events);
+		return false;
+	}
+
+	dstr_cat(&buffer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (size_t i = 0; i < count && success; i++) {
+		const struct profile_trace_event *event = &events[i];
+
+		if (da_find(thread_ids, &event->thread_id, 0) == DARRAY_INVALID) {
+			da_push_back(thread_ids, &event->thread_id);
+
+			dstr_catf(&buffer,
+				  "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%ld,"
+				  "\"args\":{\"name\":",
+				  i ? "," : "", event->thread_id);
+			dstr_cat_json_string(&buffer, event->thread_name);
+			dstr_cat(&buffer, "}}");
+		}
+
+		dstr_cat(&buffer, ",\n{\"name\":");
+		dstr_cat_json_string(&buffer, event->name);
+		dstr_catf(&buffer, ",\"ph\":\"X\",\"pid\":1,\"tid\":%ld,\"ts\":", event->thread_id);
+		dstr_cat_trace_usec(&buffer, event->start_time);
+		dstr_cat(&buffer, ",\"dur\":");
+		dstr_cat_trace_usec(&buffer, event->end_time - event->start_time);
+		dstr_cat_ch(&buffer, '}');
+
+		success = trace_flush(f, &buffer, false);
+	}
+
+	dstr_cat(&buffer, "\n]}\n");
+	success = trace_flush(f, &buffer, true) && success;
+
+	fclose(f);
+	dstr_free(&buffer);
+	da_free(thread_ids);
+	bfree(events);
+	return success;
+}
+
+static void start_drain_thread(void)
+{
+	if (drain_thread_active)
+		return;
+	if (os_event_init(&drain_stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		return;
+
+	drain_thread_active = pthread_create(&drain_thread, NULL, profiler_drain_thread, NULL) == 0;
+	if (!drain_thread_active) {
+		os_event_destroy(drain_stop_event);
+		drain_stop_event = NULL;
+	}
+}
+
+static void stop_drain_thread(void)
+{
+	if (!drain_thread_active)
+		return;
+
+	os_event_signal(drain_stop_event);
+	pthread_join(drain_thread, NULL);
+	os_event_destroy(drain_stop_event);
+	drain_stop_event = NULL;
+	drain_thread_active = false;
+}
+
 void profiler_start(void)
 {
 	pthread_mutex_lock(&root_mutex);
-	enabled = true;
+	os_atomic_set_bool(&enabled, true);
 	pthread_mutex_unlock(&root_mutex);
+
+	start_drain_thread();
 }
 
 void profiler_stop(void)
 {
+	long dropped;
+
+	stop_drain_thread();
+	drain_thread_buffers();
+
 	pthread_mutex_lock(&root_mutex);
-	enabled = false;
+	os_atomic_set_bool(&enabled, false);
 	pthread_mutex_unlock(&root_mutex);
+
+	dropped = os_atomic_load_long(&dropped_calls);
+	if (dropped)
+		blog(LOG_WARNING, "Profiler: %ld calls were dropped because a thread's record buffer was full",
+		     dropped);
 }
 
 void profile_reenable_thread(void)
@@ -274,9 +723,7 @@ void profile_reenable_thread(void)
 	if (thread_enabled)
 		return;
 
-	pthread_mutex_lock(&root_mutex);
-	thread_enabled = enabled;
-	pthread_mutex_unlock(&root_mutex);
+	thread_enabled = os_atomic_load_bool(&enabled);
 }
 
 static bool lock_root(void)
@@ -324,15 +771,15 @@ void profile_register_root(const char *name, uint64_t expected_time_between_call
 	pthread_mutex_unlock(&root_mutex);
 }
 
-static void free_call_context(profile_call *context);
-
 static void merge_context(profile_call *context)
 {
 	pthread_mutex_t *mutex = NULL;
 	profile_entry *entry = NULL;
-	profile_call *prev_call = NULL;
+	uint64_t prev_start_time = 0;
 
-	if (!lock_root()) {
+	pthread_mutex_lock(&root_mutex);
+	if (!enabled) {
+		pthread_mutex_unlock(&root_mutex);
 		free_call_context(context);
 		return;
 	}
@@ -341,18 +788,18 @@ static void merge_context(profile_call *context)
 
 	mutex = r_entry->mutex;
 	entry = r_entry->entry;
-	prev_call = r_entry->prev_call;
+	prev_start_time = r_entry->prev_start_time;
 
-	r_entry->prev_call = context;
+	r_entry->prev_start_time = context->start_time;
 
 	pthread_mutex_lock(mutex);
 	pthread_mutex_unlock(&root_mutex);
 
-	merge_call(entry, context, prev_call);
+	merge_call(entry, context, prev_start_time);
 
 	pthread_mutex_unlock(mutex);
 
-	free_call_context(prev_call);
+	free_call_context(context);
 }
 
 void profile_start(const char *name)
@@ -360,26 +807,37 @@ void profile_start(const char *name)
 	if (!thread_enabled)
 		return;
 
-	profile_call new_call = {
-		.name = name,
 #ifdef TRACK_OVERHEAD
-		.overhead_start = os_gettime_ns(),
+	uint64_t overhead_start = os_gettime_ns();
+#else
+	uint64_t overhead_start = 0;
 #endif
-		.parent = thread_context,
-	};
 
-	profile_call *call = NULL;
+	if (!thread_depth && !os_atomic_load_bool(&enabled)) {
+		thread_enabled = false;
+		return;
+	}
 
-	if (new_call.parent) {
-		size_t idx = da_push_back(new_call.parent->children, &new_call);
-		call = &new_call.parent->children.array[idx];
-	} else {
-		call = bmalloc(sizeof(profile_call));
-		memcpy(call, &new_call, sizeof(profile_call));
+	if (thread_depth < PROFILE_MAX_DEPTH)
+		thread_names[thread_depth] = name;
+	thread_depth++;
+
+	if (thread_skip_depth)
+		return;
+
+	/* buffers of a previous profiler session were freed by profiler_free */
+	profile_thread_buffer *buf = thread_buffer;
+	if (!buf || thread_buffer_generation != os_atomic_load_long(&buffers_generation))
+		buf = create_thread_buffer();
+
+	/* keep room for the end records of every open call, including this one */
+	if (thread_depth > PROFILE_MAX_DEPTH || thread_buffer_space(buf) < thread_depth + 1) {
+		thread_skip_depth = thread_depth;
+		os_atomic_inc_long(&dropped_calls);
+		return;
 	}
 
-	thread_context = call;
-	call->start_time = os_gettime_ns();
+	push_record(buf, PROFILE_RECORD_START, name, os_gettime_ns(), overhead_start);
 }
 
 void profile_end(const char *name)
@@ -388,45 +846,52 @@ void profile_end(const char *name)
 	if (!thread_enabled)
 		return;
 
-	profile_call *call = thread_context;
-	if (!call) {
+	if (!thread_depth) {
 		blog(LOG_ERROR, "Called profile end with no active profile");
 		return;
 	}
 
-	if (!call->name)
-		call->name = name;
+	size_t idx = thread_depth - 1;
 
-	if (call->name != name) {
-		blog(LOG_ERROR,
-		     "Called profile end with mismatching name: "
-		     "start(\"%s\"[%p]) <-> end(\"%s\"[%p])",
-		     call->name, call->name, name, name);
+	if (idx < PROFILE_MAX_DEPTH) {
+		if (!thread_names[idx])
+			thread_names[idx] = name;
 
-		profile_call *parent = call->parent;
-		while (parent && parent->parent && parent->name != name)
-			parent = parent->parent;
+		if (thread_names[idx] != name) {
+			blog(LOG_ERROR,
+			     "Called profile end with mismatching name: "
+			     "start(\"%s\"[%p]) <-> end(\"%s\"[%p])",
+			     thread_names[idx], thread_names[idx], name, name);
 
-		if (!parent || parent->name != name)
-			return;
+			bool found = false;
+			for (size_t i = idx; i > 0 && !found; i--)
+				found = thread_names[i - 1] == name;
+
+			if (!found)
+				return;
 
-		while (call->name != name) {
-			profile_end(call->name);
-			call = call->parent;
+			while (thread_names[thread_depth - 1] != name)
+				profile_end(thread_names[thread_depth - 1]);
 		}
 	}
 
-	thread_context = call->parent;
+	if (thread_skip_depth) {
+		if (thread_depth == thread_skip_depth)
+			thread_skip_depth = 0;
+		thread_depth--;
+		return;
+	}
 
-	call->end_time = end;
-#ifdef TRACK_OVERHEAD
-	call->overhead_end = os_gettime_ns();
-#endif
+	thread_depth--;
 
-	if (call->parent)
+	if (thread_buffer_generation != os_atomic_load_long(&buffers_generation))
 		return;
 
-	merge_context(call);
+#ifdef TRACK_OVERHEAD
+	push_record(thread_buffer, PROFILE_RECORD_END, name, end, os_gettime_ns());
+#else
+	push_record(thread_buffer, PROFILE_RECORD_END, name, end, 0);
+#endif
 }
 
 static int profiler_time_entry_compare(const void *first, const void *second)
@@ -768,11 +1233,29 @@ void profiler_free(void)
 {
 	DARRAY(profile_root_entry) old_root_entries = {0};
 
+	stop_drain_thread();
+
 	pthread_mutex_lock(&root_mutex);
-	enabled = false;
+	os_atomic_set_bool(&enabled, false);
 	da_move(old_root_entries, root_entries);
 	pthread_mutex_unlock(&root_mutex);
 
+	/* Threads that are still running notice the new generation and
+	 * allocate a new buffer if the profiler is started again */
+	pthread_mutex_lock(&buffers_mutex);
+	for (size_t i = 0; i < thread_buffers.num; i++) {
+		profile_thread_buffer *buf = thread_buffers.array[i];
+
+		free_thread_buffer_context(buf);
+		bfree(buf);
+	}
+	da_free(thread_buffers);
+	os_atomic_inc_long(&buffers_generation);
+
+	bfree(trace_events);
+	trace_events = NULL;
+	pthread_mutex_unlock(&buffers_mutex);
+
 	for (size_t i = 0; i < old_root_entries.num; i++) {
 		profile_root_entry *entry = &old_root_entries.array[i];
 
@@ -783,8 +1266,6 @@ void profiler_free(void)
 		bfree(entry->mutex);
 		entry->mutex = NULL;
 
-		free_call_context(entry->prev_call);
-
 		free_profile_entry(entry->entry);
 		bfree(entry->entry);
 	}
@@ -887,6 +1368,8 @@ profiler_snapshot_t *profile_snapshot_create(void)
 {
 	profiler_snapshot_t *snap = bzalloc(sizeof(profiler_snapshot_t));
 
+	drain_thread_buffers();
+
 	pthread_mutex_lock(&root_mutex);
 	da_reserve(snap->roots, root_entries.num);
 	for (size_t i = 0; i < root_entries.num; i++) {
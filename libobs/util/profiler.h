@@ -32,6 +32,17 @@ EXPORT void profiler_print_time_between_calls(profiler_snapshot_t *snap);
 
 EXPORT void profiler_free(void);
 
+/* ------------------------------------------------------------------------- */
+/* Timeline capture */
+
+/* Keeps begin/end times of every profiled call from the last window_ns
+ * nanoseconds, so that they can be saved as a Chrome trace */
+EXPORT void profiler_trace_start(uint64_t window_ns);
+EXPORT void profiler_trace_stop(void);
+EXPORT bool profiler_trace_active(void);
+
+EXPORT bool profiler_trace_dump_json(const char *filename);
+
 /* ------------------------------------------------------------------------- */
 /* Profiler name storage */
 
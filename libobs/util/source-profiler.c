@@ -69,6 +69,8 @@ struct profiler_entry {
 	struct ucirclebuf async_frame_ts;
 	/* Timestamps of last N async frames rendered */
 	struct ucirclebuf async_rendered_ts;
+	/* Audio render times for last N audio ticks */
+	struct ucirclebuf audio_render;
 
 	UT_hash_handle hh;
 };
@@ -163,6 +165,14 @@ static void source_samples_destroy(struct source_samples *sample)
 	bfree(sample);
 }
 
+/* Audio is rendered at its own rate, keep about the same timeframe */
+static size_t get_audio_samples(void)
+{
+	audio_t *audio = obs_get_audio();
+	size_t sample_rate = audio ? audio_output_get_sample_rate(audio) : 48000;
+	return sample_rate * 5 / AUDIO_OUTPUT_FRAMES;
+}
+
 static struct profiler_entry *entry_create(const uintptr_t key)
 {
 	struct profiler_entry *ent = bzalloc(sizeof(struct profiler_entry));
@@ -174,6 +184,7 @@ static struct profiler_entry *entry_create(const uintptr_t key)
 	ucirclebuf_init(&ent->render_gpu_sum, profiler_samples);
 	ucirclebuf_init(&ent->async_frame_ts, profiler_samples);
 	ucirclebuf_init(&ent->async_rendered_ts, profiler_samples);
+	ucirclebuf_init(&ent->audio_render, get_audio_samples());
 	return ent;
 }
 
@@ -186,6 +197,7 @@ static void entry_destroy(struct profiler_entry *entry)
 	ucirclebuf_free(&entry->render_gpu_sum);
 	ucirclebuf_free(&entry->async_frame_ts);
 	ucirclebuf_free(&entry->async_rendered_ts);
+	ucirclebuf_free(&entry->audio_render);
 	bfree(entry);
 }
 
@@ -478,6 +490,37 @@ void source_profiler_source_render_end(obs_source_t *source, uint64_t start, gs_
 	}
 }
 
+uint64_t source_profiler_source_audio_render_start(void)
+{
+	if (!enabled)
+		return 0;
+
+	return os_gettime_ns();
+}
+
+/* Called from the audio thread and the task pool, audio only sources have no
+ * samples so the entry is created here if necessary */
+void source_profiler_source_audio_render_end(obs_source_t *source, uint64_t start)
+{
+	if (!enabled || !start)
+		return;
+
+	const uint64_t delta = os_gettime_ns() - start;
+
+	pthread_rwlock_wrlock(&hm_rwlock);
+
+	struct profiler_entry *ent;
+	HASH_FIND_PTR(hm_entries, &source, ent);
+	if (!ent) {
+		ent = entry_create((uintptr_t)source);
+		HASH_ADD_PTR(hm_entries, key, ent);
+	}
+
+	ucirclebuf_push(&ent->audio_render, delta);
+
+	pthread_rwlock_unlock(&hm_rwlock);
+}
+
 static void task_delete_source(void *key)
 {
 	struct source_samples *smp;
@@ -560,6 +603,23 @@ static inline void calculate_render(struct profiler_entry *ent, struct profiler_
 	}
 }
 
+static inline void calculate_audio_render(struct profiler_entry *ent, struct profiler_result *result)
+{
+	size_t idx;
+	uint64_t sum = 0;
+
+	for (idx = 0; idx < ent->audio_render.num; idx++) {
+		const uint64_t delta = ent->audio_render.array[idx];
+		if (delta > result->audio_render_max)
+			result->audio_render_max = delta;
+
+		sum += delta;
+	}
+
+	if (idx)
+		result->audio_render_avg = sum / idx;
+}
+
 static inline void calculate_fps(const struct ucirclebuf *frames, double *avg, uint64_t *best, uint64_t *worst)
 {
 	uint64_t deltas = 0, delta_sum = 0, best_delta = 0, worst_delta = 0;
@@ -605,6 +665,7 @@ bool source_profiler_fill_result(obs_source_t *source, struct profiler_result *r
 	if (ent) {
 		calculate_tick(ent, result);
 		calculate_render(ent, result);
+		calculate_audio_render(ent, result);
 
 		if (is_async_video_source(source)) {
 			calculate_fps(&ent->async_frame_ts, &result->async_input, &result->async_input_best,
@@ -1,164 +1,525 @@
 #include "task.h"
 #include "bmem.h"
 #include "threading.h"
+#include "platform.h"
 #include "deque.h"
 
-struct os_task_queue {
+#include <sched.h>
+
+#define NUM_PRIORITIES 3
+#define SHARED_POOL_MIN_THREADS 4
+
+struct os_task_info {
+	os_task_t task;
+	void *param;
+};
+
+/* An item queued to a worker is either a plain task, or a token that runs
+ * the next task of a lane */
+struct os_task_item {
+	os_task_t task;
+	void *param;
+	struct os_task_lane *lane;
+};
+
+struct os_task_worker {
+	struct os_task_pool *pool;
+	size_t index;
 	pthread_t thread;
+
+	pthread_mutex_t mutex;
+	struct deque items[NUM_PRIORITIES];
+};
+
+struct os_task_pool {
+	volatile long refs;
+	volatile bool stop;
+	bool free_on_exit;
+
 	os_sem_t *sem;
-	long id;
+	volatile long next_worker;
 
-	bool waiting;
-	bool tasks_processed;
-	os_event_t *wait_event;
+	size_t num_workers;
+	struct os_task_worker *workers;
+};
+
+struct os_task_lane {
+	struct os_task_pool *pool;
+	volatile long refs;
+	bool serial;
+	enum os_task_priority priority;
 
 	pthread_mutex_t mutex;
+	pthread_cond_t cond;
 	struct deque tasks;
+	size_t pending;
+	uint64_t completed;
+	bool scheduled;
 };
 
-struct os_task_info {
-	os_task_t task;
-	void *param;
+struct os_task_queue {
+	os_task_lane_t *lane;
 };
 
-static THREAD_LOCAL bool exit_thread = false;
-static THREAD_LOCAL long thread_id = 0;
-static volatile long thread_id_counter = 1;
+static THREAD_LOCAL struct os_task_worker *current_worker = NULL;
+static THREAD_LOCAL const struct os_task_lane *current_lane = NULL;
 
-static void *tiny_tubular_task_thread(void *param);
+static pthread_mutex_t shared_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct os_task_pool *shared_pool = NULL;
 
-os_task_queue_t *os_task_queue_create(void)
+/* ------------------------------------------------------------------------- */
+/* Task pool */
+
+static inline enum os_task_priority valid_priority(enum os_task_priority priority)
+{
+	return (priority >= OS_TASK_PRIORITY_LOW && priority <= OS_TASK_PRIORITY_HIGH) ? priority
+										   : OS_TASK_PRIORITY_NORMAL;
+}
+
+static void pool_push(struct os_task_pool *pool, enum os_task_priority priority, const struct os_task_item *item)
+{
+	struct os_task_worker *worker = current_worker;
+
+	/* tasks queued from a worker stay on that worker unless stolen */
+	if (!worker || worker->pool != pool) {
+		unsigned long idx = (unsigned long)os_atomic_inc_long(&pool->next_worker);
+		worker = &pool->workers[idx % pool->num_workers];
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+	deque_push_back(&worker->items[priority], item, sizeof(*item));
+	pthread_mutex_unlock(&worker->mutex);
+
+	os_sem_post(pool->sem);
+}
+
+static bool pool_pop(struct os_task_pool *pool, struct os_task_worker *self, struct os_task_item *item)
+{
+	for (size_t priority = NUM_PRIORITIES; priority > 0; priority--) {
+		for (size_t i = 0; i < pool->num_workers; i++) {
+			struct os_task_worker *worker = &pool->workers[(self->index + i) % pool->num_workers];
+			struct deque *items = &worker->items[priority - 1];
+			bool found = false;
+
+			pthread_mutex_lock(&worker->mutex);
+			if (items->size) {
+				deque_pop_front(items, item, sizeof(*item));
+				found = true;
+			}
+			pthread_mutex_unlock(&worker->mutex);
+
+			if (found)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void lane_release(struct os_task_lane *lane);
+static void lane_schedule(struct os_task_lane *lane);
+
+static void run_lane_task(struct os_task_lane *lane)
 {
-	struct os_task_queue *tq = bzalloc(sizeof(*tq));
-	tq->id = os_atomic_inc_long(&thread_id_counter);
+	struct os_task_info ti;
+	bool have_task = false;
+	bool reschedule = false;
 
-	if (pthread_mutex_init(&tq->mutex, NULL) != 0)
+	pthread_mutex_lock(&lane->mutex);
+	if (lane->tasks.size) {
+		deque_pop_front(&lane->tasks, &ti, sizeof(ti));
+		have_task = true;
+	} else if (lane->serial) {
+		/* all tasks were cancelled */
+		lane->scheduled = false;
+	}
+	pthread_mutex_unlock(&lane->mutex);
+
+	if (have_task) {
+		current_lane = lane;
+		ti.task(ti.param);
+		current_lane = NULL;
+
+		pthread_mutex_lock(&lane->mutex);
+		lane->pending--;
+		lane->completed++;
+		if (lane->serial) {
+			reschedule = lane->tasks.size != 0;
+			lane->scheduled = reschedule;
+		}
+		if (!lane->pending)
+			pthread_cond_broadcast(&lane->cond);
+		pthread_mutex_unlock(&lane->mutex);
+
+		if (reschedule)
+			lane_schedule(lane);
+	}
+
+	lane_release(lane);
+}
+
+static void pool_free(struct os_task_pool *pool, size_t num_threads);
+
+static void *task_pool_thread(void *param)
+{
+	struct os_task_worker *worker = param;
+	struct os_task_pool *pool = worker->pool;
+
+	current_worker = worker;
+	os_set_thread_name("task_pool_thread");
+
+	while (os_sem_wait(pool->sem) == 0) {
+		struct os_task_item item;
+		bool found;
+
+		/* every post belongs to a queued item, but another worker may
+		 * have taken it from a queue that was already scanned, in
+		 * which case a later one is guaranteed to be there.  yield
+		 * between scans rather than spinning on the queue locks */
+		while (!(found = pool_pop(pool, worker, &item)) && !os_atomic_load_bool(&pool->stop))
+			sched_yield();
+
+		if (!found)
+			break;
+
+		if (item.lane)
+			run_lane_task(item.lane);
+		else
+			item.task(item.param);
+	}
+
+	current_worker = NULL;
+
+	if (pool->free_on_exit)
+		pool_free(pool, pool->num_workers);
+	return NULL;
+}
+
+static void pool_free(struct os_task_pool *pool, size_t num_threads)
+{
+	for (size_t i = 0; i < num_threads; i++) {
+		struct os_task_worker *worker = &pool->workers[i];
+
+		pthread_mutex_destroy(&worker->mutex);
+		for (size_t j = 0; j < NUM_PRIORITIES; j++)
+			deque_free(&worker->items[j]);
+	}
+
+	os_sem_destroy(pool->sem);
+	bfree(pool->workers);
+	bfree(pool);
+}
+
+static void pool_stop(struct os_task_pool *pool, size_t num_threads)
+{
+	struct os_task_worker *self = current_worker;
+	bool inside = self && self->pool == pool;
+
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < num_threads; i++)
+		os_sem_post(pool->sem);
+
+	for (size_t i = 0; i < num_threads; i++) {
+		if (&pool->workers[i] != self)
+			pthread_join(pool->workers[i].thread, NULL);
+	}
+
+	/* released from one of its own tasks, the worker running it frees
+	 * the pool once it returns */
+	if (inside) {
+		pool->free_on_exit = true;
+		pthread_detach(self->thread);
+		return;
+	}
+
+	pool_free(pool, num_threads);
+}
+
+os_task_pool_t *os_task_pool_create(size_t num_threads)
+{
+	struct os_task_pool *pool;
+	size_t initialized = 0;
+	size_t started = 0;
+
+	if (!num_threads) {
+		int cores = os_get_logical_cores();
+		num_threads = cores > 0 ? (size_t)cores : 1;
+	}
+
+	pool = bzalloc(sizeof(*pool));
+	pool->refs = 1;
+	pool->num_workers = num_threads;
+	pool->workers = bzalloc(sizeof(struct os_task_worker) * num_threads);
+
+	if (os_sem_init(&pool->sem, 0) != 0)
 		goto fail1;
-	if (os_sem_init(&tq->sem, 0) != 0)
-		goto fail2;
-	if (os_event_init(&tq->wait_event, OS_EVENT_TYPE_AUTO) != 0)
-		goto fail3;
-	if (pthread_create(&tq->thread, NULL, tiny_tubular_task_thread, tq) != 0)
-		goto fail4;
 
-	return tq;
+	for (; initialized < num_threads; initialized++) {
+		struct os_task_worker *worker = &pool->workers[initialized];
+
+		worker->pool = pool;
+		worker->index = initialized;
+
+		pthread_mutex_init_value(&worker->mutex);
+		if (pthread_mutex_init(&worker->mutex, NULL) != 0)
+			goto fail2;
+	}
+
+	for (; started < num_threads; started++) {
+		struct os_task_worker *worker = &pool->workers[started];
+
+		if (pthread_create(&worker->thread, NULL, task_pool_thread, worker) != 0)
+			goto fail3;
+	}
+
+	return pool;
 
-fail4:
-	os_event_destroy(tq->wait_event);
 fail3:
-	os_sem_destroy(tq->sem);
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < started; i++)
+		os_sem_post(pool->sem);
+	for (size_t i = 0; i < started; i++)
+		pthread_join(pool->workers[i].thread, NULL);
 fail2:
-	pthread_mutex_destroy(&tq->mutex);
+	for (size_t i = 0; i < initialized; i++)
+		pthread_mutex_destroy(&pool->workers[i].mutex);
+	os_sem_destroy(pool->sem);
 fail1:
-	bfree(tq);
+	bfree(pool->workers);
+	bfree(pool);
 	return NULL;
 }
 
-bool os_task_queue_queue_task(os_task_queue_t *tq, os_task_t task, void *param)
+os_task_pool_t *os_task_pool_get_shared(void)
 {
-	struct os_task_info ti = {
+	struct os_task_pool *pool;
+
+	pthread_mutex_lock(&shared_pool_mutex);
+	if (shared_pool) {
+		os_atomic_inc_long(&shared_pool->refs);
+	} else {
+		int cores = os_get_logical_cores();
+		shared_pool = os_task_pool_create(cores > SHARED_POOL_MIN_THREADS ? (size_t)cores
+										  : SHARED_POOL_MIN_THREADS);
+	}
+	pool = shared_pool;
+	pthread_mutex_unlock(&shared_pool_mutex);
+
+	return pool;
+}
+
+void os_task_pool_release(os_task_pool_t *pool)
+{
+	bool destroy;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&shared_pool_mutex);
+	destroy = os_atomic_dec_long(&pool->refs) == 0;
+	if (destroy && pool == shared_pool)
+		shared_pool = NULL;
+	pthread_mutex_unlock(&shared_pool_mutex);
+
+	if (destroy)
+		pool_stop(pool, pool->num_workers);
+}
+
+size_t os_task_pool_num_threads(const os_task_pool_t *pool)
+{
+	return pool ? pool->num_workers : 0;
+}
+
+bool os_task_pool_queue_task(os_task_pool_t *pool, enum os_task_priority priority, os_task_t task, void *param)
+{
+	struct os_task_item item = {
 		task,
 		param,
+		NULL,
 	};
 
-	if (!tq)
+	if (!pool || !task)
 		return false;
 
-	pthread_mutex_lock(&tq->mutex);
-	deque_push_back(&tq->tasks, &ti, sizeof(ti));
-	pthread_mutex_unlock(&tq->mutex);
-	os_sem_post(tq->sem);
+	pool_push(pool, valid_priority(priority), &item);
 	return true;
 }
 
-static void wait_for_thread(void *data)
+/* ------------------------------------------------------------------------- */
+/* Task lanes */
+
+static void lane_release(struct os_task_lane *lane)
 {
-	os_task_queue_t *tq = data;
-	os_event_signal(tq->wait_event);
+	if (os_atomic_dec_long(&lane->refs) != 0)
+		return;
+
+	pthread_cond_destroy(&lane->cond);
+	pthread_mutex_destroy(&lane->mutex);
+	deque_free(&lane->tasks);
+	bfree(lane);
 }
 
-static void stop_thread(void *unused)
+static void lane_schedule(struct os_task_lane *lane)
 {
-	exit_thread = true;
-	UNUSED_PARAMETER(unused);
+	struct os_task_item item = {
+		NULL,
+		NULL,
+		lane,
+	};
+
+	os_atomic_inc_long(&lane->refs);
+	pool_push(lane->pool, lane->priority, &item);
 }
 
-void os_task_queue_destroy(os_task_queue_t *tq)
+os_task_lane_t *os_task_lane_create(os_task_pool_t *pool, bool serial, enum os_task_priority priority)
 {
-	if (!tq)
-		return;
+	struct os_task_lane *lane;
 
-	os_task_queue_queue_task(tq, stop_thread, NULL);
-	pthread_join(tq->thread, NULL);
-	os_event_destroy(tq->wait_event);
-	os_sem_destroy(tq->sem);
-	pthread_mutex_destroy(&tq->mutex);
-	deque_free(&tq->tasks);
-	bfree(tq);
+	if (!pool)
+		return NULL;
+
+	lane = bzalloc(sizeof(*lane));
+	lane->refs = 1;
+	lane->serial = serial;
+	lane->priority = valid_priority(priority);
+
+	pthread_mutex_init_value(&lane->mutex);
+	if (pthread_mutex_init(&lane->mutex, NULL) != 0)
+		goto fail1;
+	if (pthread_cond_init(&lane->cond, NULL) != 0)
+		goto fail2;
+
+	os_atomic_inc_long(&pool->refs);
+	lane->pool = pool;
+	return lane;
+
+fail2:
+	pthread_mutex_destroy(&lane->mutex);
+fail1:
+	bfree(lane);
+	return NULL;
 }
 
-bool os_task_queue_wait(os_task_queue_t *tq)
+void os_task_lane_destroy(os_task_lane_t *lane)
 {
-	if (!tq)
-		return false;
+	struct os_task_pool *pool;
 
+	if (!lane)
+		return;
+
+	pool = lane->pool;
+
+	os_task_lane_wait(lane);
+	lane_release(lane);
+	os_task_pool_release(pool);
+}
+
+bool os_task_lane_queue_task(os_task_lane_t *lane, os_task_t task, void *param)
+{
 	struct os_task_info ti = {
-		wait_for_thread,
-		tq,
+		task,
+		param,
 	};
+	bool schedule;
+
+	if (!lane || !task)
+		return false;
+
+	pthread_mutex_lock(&lane->mutex);
+	deque_push_back(&lane->tasks, &ti, sizeof(ti));
+	lane->pending++;
+	schedule = !lane->serial || !lane->scheduled;
+	lane->scheduled = true;
+	pthread_mutex_unlock(&lane->mutex);
+
+	if (schedule)
+		lane_schedule(lane);
+	return true;
+}
+
+bool os_task_lane_wait(os_task_lane_t *lane)
+{
+	uint64_t completed;
+	bool tasks_processed;
 
-	pthread_mutex_lock(&tq->mutex);
-	tq->waiting = true;
-	tq->tasks_processed = false;
-	deque_push_back(&tq->tasks, &ti, sizeof(ti));
-	pthread_mutex_unlock(&tq->mutex);
+	if (!lane)
+		return false;
 
-	os_sem_post(tq->sem);
-	os_event_wait(tq->wait_event);
+	/* waiting on the lane from one of its own tasks would never return */
+	if (current_lane == lane)
+		return false;
 
-	pthread_mutex_lock(&tq->mutex);
-	bool tasks_processed = tq->tasks_processed;
-	pthread_mutex_unlock(&tq->mutex);
+	pthread_mutex_lock(&lane->mutex);
+	completed = lane->completed;
+	while (lane->pending)
+		pthread_cond_wait(&lane->cond, &lane->mutex);
+	tasks_processed = lane->completed != completed;
+	pthread_mutex_unlock(&lane->mutex);
 
 	return tasks_processed;
 }
 
-bool os_task_queue_inside(os_task_queue_t *tq)
+size_t os_task_lane_cancel(os_task_lane_t *lane)
 {
-	return tq->id == thread_id;
+	size_t cancelled;
+
+	if (!lane)
+		return 0;
+
+	pthread_mutex_lock(&lane->mutex);
+	cancelled = lane->tasks.size / sizeof(struct os_task_info);
+	deque_free(&lane->tasks);
+	lane->pending -= cancelled;
+	if (!lane->pending)
+		pthread_cond_broadcast(&lane->cond);
+	pthread_mutex_unlock(&lane->mutex);
+
+	return cancelled;
 }
 
-static void *tiny_tubular_task_thread(void *param)
+bool os_task_lane_inside(const os_task_lane_t *lane)
 {
-	struct os_task_queue *tq = param;
-	thread_id = tq->id;
-
-	os_set_thread_name(__FUNCTION__);
+	return lane && current_lane == lane;
+}
 
-	while (!exit_thread && os_sem_wait(tq->sem) == 0) {
-		struct os_task_info ti;
+/* ------------------------------------------------------------------------- */
+/* Task queue */
 
-		pthread_mutex_lock(&tq->mutex);
-		deque_pop_front(&tq->tasks, &ti, sizeof(ti));
-		if (tq->tasks.size && ti.task == wait_for_thread) {
-			deque_push_back(&tq->tasks, &ti, sizeof(ti));
-			deque_pop_front(&tq->tasks, &ti, sizeof(ti));
-		}
-		if (tq->tasks.size && ti.task == stop_thread) {
-			deque_push_back(&tq->tasks, &ti, sizeof(ti));
-			deque_pop_front(&tq->tasks, &ti, sizeof(ti));
-		}
-		if (tq->waiting) {
-			if (ti.task == wait_for_thread) {
-				tq->waiting = false;
-			} else {
-				tq->tasks_processed = true;
-			}
-		}
-		pthread_mutex_unlock(&tq->mutex);
+os_task_queue_t *os_task_queue_create(void)
+{
+	os_task_pool_t *pool = os_task_pool_get_shared();
+	os_task_lane_t *lane = os_task_lane_create(pool, true, OS_TASK_PRIORITY_NORMAL);
+	struct os_task_queue *tq = NULL;
 
-		ti.task(ti.param);
+	if (lane) {
+		tq = bzalloc(sizeof(*tq));
+		tq->lane = lane;
 	}
 
-	return NULL;
+	os_task_pool_release(pool);
+	return tq;
+}
+
+bool os_task_queue_queue_task(os_task_queue_t *tq, os_task_t task, void *param)
+{
+	return tq ? os_task_lane_queue_task(tq->lane, task, param) : false;
+}
+
+void os_task_queue_destroy(os_task_queue_t *tq)
+{
+	if (!tq)
+		return;
+
+	os_task_lane_destroy(tq->lane);
+	bfree(tq);
+}
+
+bool os_task_queue_wait(os_task_queue_t *tq)
+{
+	return tq ? os_task_lane_wait(tq->lane) : false;
+}
+
+bool os_task_queue_inside(os_task_queue_t *tq)
+{
+	return tq ? os_task_lane_inside(tq->lane) : false;
 }
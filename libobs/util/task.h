@@ -6,11 +6,56 @@
 extern "C" {
 #endif
 
+typedef void (*os_task_t)(void *param);
+
+/* ------------------------------------------------------------------------- */
+/* Task pool
+ *
+ * A pool of worker threads that run tasks.  Each worker has its own queues
+ * and idle workers steal tasks from the others, so one slow task only
+ * occupies one worker.  Tasks are queued to lanes: a serial lane runs its
+ * tasks one at a time in the order they were queued, a concurrent lane can
+ * run several of its tasks at once.  Lanes can be waited on and their
+ * pending tasks can be cancelled. */
+
+struct os_task_pool;
+struct os_task_lane;
+typedef struct os_task_pool os_task_pool_t;
+typedef struct os_task_lane os_task_lane_t;
+
+enum os_task_priority {
+	OS_TASK_PRIORITY_LOW,
+	OS_TASK_PRIORITY_NORMAL,
+	OS_TASK_PRIORITY_HIGH,
+};
+
+/* num_threads of 0 uses the number of logical cores */
+EXPORT os_task_pool_t *os_task_pool_create(size_t num_threads);
+/* Returns a new reference to the pool shared by the whole process */
+EXPORT os_task_pool_t *os_task_pool_get_shared(void);
+EXPORT void os_task_pool_release(os_task_pool_t *pool);
+EXPORT size_t os_task_pool_num_threads(const os_task_pool_t *pool);
+EXPORT bool os_task_pool_queue_task(os_task_pool_t *pool, enum os_task_priority priority, os_task_t task,
+				    void *param);
+
+EXPORT os_task_lane_t *os_task_lane_create(os_task_pool_t *pool, bool serial, enum os_task_priority priority);
+/* Waits for all queued tasks of the lane to finish before destroying it */
+EXPORT void os_task_lane_destroy(os_task_lane_t *lane);
+EXPORT bool os_task_lane_queue_task(os_task_lane_t *lane, os_task_t task, void *param);
+/* Returns true if any tasks were run while waiting */
+EXPORT bool os_task_lane_wait(os_task_lane_t *lane);
+/* Removes tasks that have not started yet, returns how many were removed */
+EXPORT size_t os_task_lane_cancel(os_task_lane_t *lane);
+EXPORT bool os_task_lane_inside(const os_task_lane_t *lane);
+
+/* ------------------------------------------------------------------------- */
+/* Task queue
+ *
+ * A serial lane on the shared task pool. */
+
 struct os_task_queue;
 typedef struct os_task_queue os_task_queue_t;
 
-typedef void (*os_task_t)(void *param);
-
 EXPORT os_task_queue_t *os_task_queue_create(void);
 EXPORT bool os_task_queue_queue_task(os_task_queue_t *tt, os_task_t task, void *param);
 EXPORT void os_task_queue_destroy(os_task_queue_t *tt);
@@ -316,7 +316,7 @@ static obs_properties_t *image_source_properties(void *data)
 uint64_t image_source_get_memory_usage(void *data)
 {
 	struct image_source *s = data;
-	return s->if4.image3.image2.mem_usage;
+	return gs_image_file2_get_mem_usage(&s->if4.image3.image2);
 }
 
 static void missing_file_callback(void *src, const char *new_path, void *data)
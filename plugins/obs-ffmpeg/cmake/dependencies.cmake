@@ -12,6 +12,10 @@ if(NOT TARGET OBS::opts-parser)
   add_subdirectory("${CMAKE_SOURCE_DIR}/shared/opts-parser" "${CMAKE_BINARY_DIR}/shared/opts-parser")
 endif()
 
+if(NOT TARGET OBS::mp4-mux)
+  add_subdirectory("${CMAKE_SOURCE_DIR}/shared/mp4-mux" "${CMAKE_BINARY_DIR}/shared/mp4-mux")
+endif()
+
 if(OS_WINDOWS)
   find_package(AMF 1.4.29 REQUIRED)
   add_subdirectory(obs-amf-test)
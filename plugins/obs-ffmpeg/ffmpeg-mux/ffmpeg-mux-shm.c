@@ -0,0 +1,437 @@
+#ifdef __linux__
+
+#include "ffmpeg-mux-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define FFM_SHM_MAGIC 0x4d4d4646 /* "FFMM" */
+#define FFM_SHM_VERSION 1
+
+/* how often a waiting side checks whether the other side is still alive */
+#define LIVENESS_INTERVAL_MS 100
+
+enum ffm_shm_state {
+	FFM_SHM_WAITING,
+	FFM_SHM_ATTACHED,
+	FFM_SHM_REJECTED,
+};
+
+struct ffm_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+
+	uint32_t state;
+	uint32_t writer_closed;
+	uint32_t reader_closed;
+
+	/* futex words, bumped whenever data/space becomes available while the
+	 * other side is waiting for it */
+	uint32_t data_seq;
+	uint32_t space_seq;
+	uint32_t reader_waiting;
+	uint32_t writer_waiting;
+
+	/* monotonic byte positions, each written by one side only */
+	uint64_t write_pos __attribute__((aligned(64)));
+	uint64_t read_pos __attribute__((aligned(64)));
+
+	/* held by the reader for as long as it is attached.  the mutex is
+	 * robust, so the writer can tell when the reader process is gone */
+	pthread_mutex_t reader_lock __attribute__((aligned(64)));
+};
+
+#define DATA_OFFSET ((sizeof(struct ffm_shm_header) + 63) & ~(size_t)63)
+
+struct ffm_shm {
+	struct ffm_shm_header *header;
+	uint8_t *data;
+	size_t map_size;
+	uint64_t size;
+	bool writer;
+	bool attached;
+	bool linked;
+	pid_t parent;
+	char name[64];
+};
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint32_t load32(uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void store32(uint32_t *ptr, uint32_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t load64(uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void store64(uint64_t *ptr, uint64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline bool cas32(uint32_t *ptr, uint32_t expected, uint32_t val)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, val, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/* the mapping is shared between processes, so no FUTEX_PRIVATE_FLAG */
+static void futex_wait(uint32_t *ptr, uint32_t val, uint32_t timeout_ms)
+{
+	struct timespec ts = {
+		.tv_sec = timeout_ms / 1000,
+		.tv_nsec = (long)(timeout_ms % 1000) * 1000000,
+	};
+
+	syscall(SYS_futex, ptr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(uint32_t *ptr)
+{
+	syscall(SYS_futex, ptr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static inline void signal_seq(uint32_t *seq)
+{
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+	futex_wake(seq);
+}
+
+static void unlink_name(struct ffm_shm *shm)
+{
+	if (shm->linked) {
+		shm_unlink(shm->name);
+		shm->linked = false;
+	}
+}
+
+static bool map_shm(struct ffm_shm *shm, int fd, size_t map_size)
+{
+	void *ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED)
+		return false;
+
+	shm->header = ptr;
+	shm->data = (uint8_t *)ptr + DATA_OFFSET;
+	shm->map_size = map_size;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* obs side                                                                  */
+
+struct ffm_shm *ffm_shm_create(size_t size)
+{
+	static uint32_t counter = 0;
+	struct ffm_shm *shm;
+	pthread_mutexattr_t attr;
+	int fd;
+
+	if (!size)
+		size = FFM_SHM_DEFAULT_SIZE;
+
+	shm = calloc(1, sizeof(*shm));
+	shm->writer = true;
+	shm->size = size;
+
+	snprintf(shm->name, sizeof(shm->name), "/obs-ffmpeg-mux-%d-%u", (int)getpid(),
+		 __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED));
+
+	fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		free(shm);
+		return NULL;
+	}
+
+	shm->linked = true;
+
+	if (ftruncate(fd, (off_t)(DATA_OFFSET + size)) != 0) {
+		close(fd);
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+	if (!map_shm(shm, fd, DATA_OFFSET + size)) {
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+
+	struct ffm_shm_header *header = shm->header;
+	header->size = size;
+	header->version = FFM_SHM_VERSION;
+	header->state = FFM_SHM_WAITING;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&header->reader_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	/* written last, the reader does not touch anything before it sees
+	 * a valid magic value */
+	store32(&header->magic, FFM_SHM_MAGIC);
+	return shm;
+}
+
+const char *ffm_shm_get_name(const struct ffm_shm *shm)
+{
+	return shm->name;
+}
+
+bool ffm_shm_attached(struct ffm_shm *shm)
+{
+	if (load32(&shm->header->state) != FFM_SHM_ATTACHED)
+		return false;
+
+	/* the reader has the ring mapped, so the name is no longer needed */
+	unlink_name(shm);
+	return true;
+}
+
+static bool reader_alive(struct ffm_shm *shm)
+{
+	struct ffm_shm_header *header = shm->header;
+
+	if (load32(&header->reader_closed))
+		return false;
+
+	int ret = pthread_mutex_trylock(&header->reader_lock);
+	if (ret == EBUSY)
+		return true;
+
+	/* the reader either died while holding the lock or has let go of it
+	 * without marking the ring as closed, either way it is gone */
+	if (ret == EOWNERDEAD)
+		pthread_mutex_consistent(&header->reader_lock);
+	if (ret == 0 || ret == EOWNERDEAD)
+		pthread_mutex_unlock(&header->reader_lock);
+
+	store32(&header->reader_closed, 1);
+	return false;
+}
+
+static uint64_t wait_for_space(struct ffm_shm *shm, uint64_t write_pos)
+{
+	struct ffm_shm_header *header = shm->header;
+
+	for (;;) {
+		uint64_t space = shm->size - (write_pos - load64(&header->read_pos));
+		if (space)
+			return space;
+		if (!reader_alive(shm))
+			return 0;
+
+		store32(&header->writer_waiting, 1);
+		uint32_t seq = load32(&header->space_seq);
+
+		space = shm->size - (write_pos - load64(&header->read_pos));
+		if (!space)
+			futex_wait(&header->space_seq, seq, LIVENESS_INTERVAL_MS);
+
+		store32(&header->writer_waiting, 0);
+	}
+}
+
+bool ffm_shm_write(struct ffm_shm *shm, const void *data, size_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+	const uint8_t *src = data;
+	uint64_t write_pos = header->write_pos;
+
+	while (size) {
+		uint64_t space = wait_for_space(shm, write_pos);
+		if (!space)
+			return false;
+
+		size_t offset = (size_t)(write_pos % shm->size);
+		size_t count = space < size ? (size_t)space : size;
+		size_t first = shm->size - offset < count ? (size_t)(shm->size - offset) : count;
+
+		memcpy(shm->data + offset, src, first);
+		memcpy(shm->data, src + first, count - first);
+
+		src += count;
+		size -= count;
+		write_pos += count;
+		store64(&header->write_pos, write_pos);
+
+		if (load32(&header->reader_waiting))
+			signal_seq(&header->data_seq);
+	}
+
+	return true;
+}
+
+void ffm_shm_close(struct ffm_shm *shm)
+{
+	if (!shm)
+		return;
+
+	/* a reader that has not attached by now reads everything from the
+	 * pipe, there is no point in it attaching later */
+	cas32(&shm->header->state, FFM_SHM_WAITING, FFM_SHM_REJECTED);
+	store32(&shm->header->writer_closed, 1);
+	signal_seq(&shm->header->data_seq);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ffmpeg-mux side                                                           */
+
+struct ffm_shm *ffm_shm_attach(const char *name)
+{
+	struct ffm_shm *shm;
+	struct ffm_shm_header *header;
+	int fd;
+
+	if (strlen(name) >= sizeof(shm->name))
+		return NULL;
+
+	fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+	if (fd == -1)
+		return NULL;
+
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size <= (off_t)DATA_OFFSET) {
+		close(fd);
+		return NULL;
+	}
+
+	shm = calloc(1, sizeof(*shm));
+	strcpy(shm->name, name);
+
+	if (!map_shm(shm, fd, (size_t)size)) {
+		free(shm);
+		return NULL;
+	}
+
+	header = shm->header;
+	shm->size = header->size;
+
+	if (load32(&header->magic) != FFM_SHM_MAGIC || header->version != FFM_SHM_VERSION ||
+	    DATA_OFFSET + shm->size != (uint64_t)size) {
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+
+	if (pthread_mutex_lock(&header->reader_lock) != 0) {
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+
+	/* obs may have closed the ring already, in which case everything is
+	 * on stdin */
+	if (!cas32(&header->state, FFM_SHM_WAITING, FFM_SHM_ATTACHED)) {
+		pthread_mutex_unlock(&header->reader_lock);
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+
+	shm->attached = true;
+	shm->parent = getppid();
+	return shm;
+}
+
+static inline bool writer_alive(struct ffm_shm *shm)
+{
+	return !load32(&shm->header->writer_closed) && getppid() == shm->parent;
+}
+
+static uint64_t wait_for_data(struct ffm_shm *shm, uint64_t read_pos)
+{
+	struct ffm_shm_header *header = shm->header;
+
+	for (;;) {
+		uint64_t avail = load64(&header->write_pos) - read_pos;
+		if (avail)
+			return avail;
+
+		/* check the position once more after seeing the writer close,
+		 * it may have written its last data right before */
+		if (!writer_alive(shm))
+			return load64(&header->write_pos) - read_pos;
+
+		store32(&header->reader_waiting, 1);
+		uint32_t seq = load32(&header->data_seq);
+
+		if (load64(&header->write_pos) == read_pos && !load32(&header->writer_closed))
+			futex_wait(&header->data_seq, seq, LIVENESS_INTERVAL_MS);
+
+		store32(&header->reader_waiting, 0);
+	}
+}
+
+size_t ffm_shm_read(struct ffm_shm *shm, void *data, size_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+	uint8_t *dst = data;
+	uint64_t read_pos = header->read_pos;
+	size_t total = 0;
+
+	while (total < size) {
+		uint64_t avail = wait_for_data(shm, read_pos);
+		if (!avail)
+			break;
+
+		size_t offset = (size_t)(read_pos % shm->size);
+		size_t count = avail < size - total ? (size_t)avail : size - total;
+		size_t first = shm->size - offset < count ? (size_t)(shm->size - offset) : count;
+
+		memcpy(dst, shm->data + offset, first);
+		memcpy(dst + first, shm->data, count - first);
+
+		dst += count;
+		total += count;
+		read_pos += count;
+		store64(&header->read_pos, read_pos);
+
+		if (load32(&header->writer_waiting))
+			signal_seq(&header->space_seq);
+	}
+
+	return total;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void ffm_shm_destroy(struct ffm_shm *shm)
+{
+	if (!shm)
+		return;
+
+	if (shm->header) {
+		struct ffm_shm_header *header = shm->header;
+
+		if (shm->writer) {
+			ffm_shm_close(shm);
+		} else if (shm->attached) {
+			store32(&header->reader_closed, 1);
+			signal_seq(&header->space_seq);
+			pthread_mutex_unlock(&header->reader_lock);
+		}
+
+		munmap(shm->header, shm->map_size);
+	}
+
+	unlink_name(shm);
+	free(shm);
+}
+
+#endif
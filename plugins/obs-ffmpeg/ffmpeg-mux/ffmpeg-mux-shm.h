@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared memory transport between obs and ffmpeg-mux (Linux only)
+ *
+ *   The same byte stream that is otherwise written to the stdin pipe of
+ * ffmpeg-mux (packet info structures followed by packet data) is written to
+ * a single producer/single consumer ring in shared memory instead.  Futexes
+ * are only used when one side actually has to wait, so a steady stream of
+ * packets costs no system calls.
+ *
+ *   obs creates the ring and appends FFM_SHM_ARG<name> to the command line.
+ * ffmpeg-mux attaches to it as early as possible, but obs does not wait for
+ * that: it keeps writing to the pipe until it sees the ring attached, then
+ * writes an FFM_PACKET_SWITCH_SHM packet info to the pipe and continues in
+ * the ring.  The mux process reads stdin until it gets that packet info, so
+ * a mux binary that never attaches (for example because it does not know
+ * the argument) simply keeps using the pipe.
+ */
+
+#define FFM_SHM_ARG "--shm="
+#define FFM_SHM_DEFAULT_SIZE (4 * 1024 * 1024)
+
+struct ffm_shm;
+
+#ifdef __linux__
+/* obs side */
+struct ffm_shm *ffm_shm_create(size_t size);
+const char *ffm_shm_get_name(const struct ffm_shm *shm);
+bool ffm_shm_attached(struct ffm_shm *shm);
+bool ffm_shm_write(struct ffm_shm *shm, const void *data, size_t size);
+void ffm_shm_close(struct ffm_shm *shm);
+
+/* ffmpeg-mux side */
+struct ffm_shm *ffm_shm_attach(const char *name);
+size_t ffm_shm_read(struct ffm_shm *shm, void *data, size_t size);
+
+void ffm_shm_destroy(struct ffm_shm *shm);
+#endif
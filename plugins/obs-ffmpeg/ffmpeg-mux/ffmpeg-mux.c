@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-shm.h"
 
 #include <util/threading.h>
 #include <util/platform.h>
@@ -45,6 +46,11 @@
 
 static char *global_stream_key = "";
 
+#ifdef __linux__
+static struct ffm_shm *global_shm = NULL;
+static bool shm_active = false;
+#endif
+
 struct resize_buf {
 	uint8_t *buf;
 	size_t size;
@@ -600,6 +606,11 @@ static size_t safe_read(void *vdata, size_t size)
 	uint8_t *data = vdata;
 	size_t total = size;
 
+#ifdef __linux__
+	if (shm_active)
+		return ffm_shm_read(global_shm, data, size);
+#endif
+
 	while (size > 0) {
 		size_t in_size = fread(data, 1, size, stdin);
 		if (in_size == 0)
@@ -612,11 +623,30 @@ static size_t safe_read(void *vdata, size_t size)
 	return total;
 }
 
+/* obs switches to the shared memory ring at any packet boundary once it has
+ * seen it attached, until then everything comes in on stdin */
+static bool read_info(struct ffm_packet_info *info)
+{
+	if (safe_read(info, sizeof(*info)) != sizeof(*info))
+		return false;
+
+#ifdef __linux__
+	if (info->type == FFM_PACKET_SWITCH_SHM) {
+		if (!global_shm)
+			return false;
+
+		shm_active = true;
+		return read_info(info);
+	}
+#endif
+	return true;
+}
+
 static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
 {
 	struct ffm_packet_info info = {0};
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
+	bool success = read_info(&info);
 	if (success) {
 		uint8_t *data = malloc(info.size);
 
@@ -1127,6 +1157,22 @@ static inline bool read_change_file(struct ffmpeg_mux *ffm, uint32_t size, struc
 	return true;
 }
 
+#ifdef __linux__
+/* obs appends the shared memory argument after all the regular ones, so the
+ * argument is removed again before the rest of the command line is parsed */
+static void attach_shm(int *argc, char **argv)
+{
+	if (*argc < 2 || strncmp(argv[*argc - 1], FFM_SHM_ARG, strlen(FFM_SHM_ARG)) != 0)
+		return;
+
+	global_shm = ffm_shm_attach(argv[*argc - 1] + strlen(FFM_SHM_ARG));
+	if (!global_shm)
+		fprintf(stderr, "warning: Failed to attach to shared memory, reading from stdin\n");
+
+	(*argc)--;
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef _WIN32
@@ -1162,13 +1208,20 @@ int main(int argc, char *argv[])
 #endif
 	setvbuf(stderr, NULL, _IONBF, 0);
 
+#ifdef __linux__
+	attach_shm(&argc, argv);
+#endif
+
 	ret = ffmpeg_mux_init(&ffm, argc, argv);
 	if (ret != FFM_SUCCESS) {
 		fprintf(stderr, "Couldn't initialize muxer\n");
+#ifdef __linux__
+		ffm_shm_destroy(global_shm);
+#endif
 		return ret;
 	}
 
-	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
+	while (!fail && read_info(&info)) {
 		if (info.type == FFM_PACKET_CHANGE_FILE) {
 			fail = !read_change_file(&ffm, info.size, &rb_filename, argc, argv);
 			continue;
@@ -1187,6 +1240,10 @@ int main(int argc, char *argv[])
 	resize_buf_free(&rb);
 	resize_buf_free(&rb_filename);
 
+#ifdef __linux__
+	ffm_shm_destroy(global_shm);
+#endif
+
 #ifdef _WIN32
 	for (int i = 0; i < argc; i++)
 		free(argv[i]);
@@ -17,11 +17,15 @@
 #include "ffmpeg-mux/ffmpeg-mux.h"
 #include "obs-ffmpeg-mux.h"
 #include "obs-ffmpeg-formats.h"
+#include "mp4-mux.h"
 
 #ifdef _WIN32
 #include "util/windows/win-version.h"
 #endif
 
+#include <util/buffered-file-serializer.h>
+#include <util/profiler.h>
+
 #include <libavformat/avformat.h>
 
 #define do_log(level, format, ...) \
@@ -52,7 +56,14 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 		obs_encoder_packet_release(&pkt);
 	}
 
+	while (stream->entries.size > 0) {
+		struct replay_store_entry entry;
+		deque_pop_front(&stream->entries, &entry, sizeof(entry));
+		replay_store_release(stream->store, &entry);
+	}
+
 	deque_free(&stream->packets);
+	deque_free(&stream->entries);
 	stream->cur_size = 0;
 	stream->cur_time = 0;
 	stream->max_size = 0;
@@ -71,9 +82,11 @@ static void ffmpeg_mux_destroy(void *data)
 	for (size_t i = 0; i < stream->mux_packets.num; i++)
 		obs_encoder_packet_release(&stream->mux_packets.array[i]);
 	da_free(stream->mux_packets);
+	da_free(stream->mux_entries);
 	deque_free(&stream->packets);
+	replay_store_destroy(stream->store);
 
-	os_process_pipe_destroy(stream->pipe);
+	stop_pipe(stream);
 	dstr_free(&stream->path);
 	dstr_free(&stream->printable_path);
 	dstr_free(&stream->stream_key);
@@ -306,8 +319,68 @@ void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 {
 	os_process_args_t *args = NULL;
 	build_command_line(stream, &args, path);
+
+#ifdef __linux__
+	stream->shm = ffm_shm_create(FFM_SHM_DEFAULT_SIZE);
+	if (stream->shm)
+		os_process_args_add_argf(args, "%s%s", FFM_SHM_ARG, ffm_shm_get_name(stream->shm));
+#endif
+
 	stream->pipe = os_process_pipe_create2(args, "w");
 	os_process_args_destroy(args);
+
+#ifdef __linux__
+	stream->shm_active = false;
+	if (!stream->pipe) {
+		ffm_shm_destroy(stream->shm);
+		stream->shm = NULL;
+	}
+#endif
+}
+
+int stop_pipe(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+#ifdef __linux__
+	/* lets the mux process read whatever is left in the ring and exit,
+	 * the ring itself has to stay mapped until it has done so */
+	ffm_shm_close(stream->shm);
+#endif
+
+	ret = os_process_pipe_destroy(stream->pipe);
+	stream->pipe = NULL;
+
+#ifdef __linux__
+	ffm_shm_destroy(stream->shm);
+	stream->shm = NULL;
+	stream->shm_active = false;
+#endif
+	return ret;
+}
+
+static bool mux_write(struct ffmpeg_muxer *stream, const void *data, size_t size)
+{
+#ifdef __linux__
+	if (stream->shm_active)
+		return ffm_shm_write(stream->shm, data, size);
+#endif
+	return os_process_pipe_write(stream->pipe, data, size) == size;
+}
+
+/* Called before each packet info.  The mux process attaches to the ring in
+ * its own time, everything before that goes through the pipe. */
+static void mux_check_shm(struct ffmpeg_muxer *stream)
+{
+#ifdef __linux__
+	if (!stream->shm || stream->shm_active || !ffm_shm_attached(stream->shm))
+		return;
+
+	struct ffm_packet_info info = {.type = FFM_PACKET_SWITCH_SHM};
+	stream->shm_active = os_process_pipe_write(stream->pipe, (const uint8_t *)&info, sizeof(info)) == sizeof(info);
+#else
+	UNUSED_PARAMETER(stream);
+#endif
 }
 
 static void set_file_not_readable_error(struct ffmpeg_muxer *stream, obs_data_t *settings, const char *path)
@@ -466,8 +539,7 @@ int deactivate(struct ffmpeg_muxer *stream, int code)
 	}
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = stop_pipe(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -603,7 +675,6 @@ static void generate_filename(struct ffmpeg_muxer *stream, struct dstr *dst, boo
 bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
 
 	struct ffm_packet_info info = {.pts = packet->pts,
 				       .dts = packet->dts,
@@ -622,16 +693,16 @@ bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 		}
 	}
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info, sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
+	mux_check_shm(stream);
+
+	if (!mux_write(stream, &info, sizeof(info))) {
+		warn("Writing info structure to mux process failed");
 		signal_failure(stream);
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
+	if (!mux_write(stream, packet->data, packet->size)) {
+		warn("Writing packet data to mux process failed");
 		signal_failure(stream);
 		return false;
 	}
@@ -711,20 +782,19 @@ static inline bool should_split(struct ffmpeg_muxer *stream, struct encoder_pack
 
 static bool send_new_filename(struct ffmpeg_muxer *stream, const char *filename)
 {
-	size_t ret;
 	uint32_t size = (uint32_t)strlen(filename);
 	struct ffm_packet_info info = {.type = FFM_PACKET_CHANGE_FILE, .size = size};
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info, sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
+	mux_check_shm(stream);
+
+	if (!mux_write(stream, &info, sizeof(info))) {
+		warn("Writing info structure to mux process failed");
 		signal_failure(stream);
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)filename, size);
-	if (ret != size) {
-		warn("os_process_pipe_write for packet data failed");
+	if (!mux_write(stream, filename, size)) {
+		warn("Writing file name to mux process failed");
 		signal_failure(stream);
 		return false;
 	}
@@ -974,6 +1044,28 @@ static void replay_buffer_destroy(void *data)
 	ffmpeg_mux_destroy(data);
 }
 
+static void replay_buffer_update_store(struct ffmpeg_muxer *stream, const char *dir)
+{
+	if (stream->store && (!dir || strcmp(replay_store_get_dir(stream->store), dir) != 0)) {
+		/* a previous save may still be reading from the store */
+		if (stream->mux_thread_joinable) {
+			pthread_join(stream->mux_thread, NULL);
+			stream->mux_thread_joinable = false;
+		}
+
+		replay_store_destroy(stream->store);
+		stream->store = NULL;
+	}
+
+	if (dir && !stream->store) {
+		stream->store = replay_store_create(dir, REPLAY_STORE_DEFAULT_SEGMENT_SIZE);
+		if (stream->store)
+			info("Caching replay buffer on disk in '%s'", dir);
+		else
+			warn("Failed to create replay buffer disk cache in '%s', keeping replay buffer in memory", dir);
+	}
+}
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -986,6 +1078,11 @@ static bool replay_buffer_start(void *data)
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+
+	const char *cache_dir = obs_data_get_string(s, "disk_cache_dir");
+	if (!*cache_dir)
+		cache_dir = obs_data_get_string(s, "directory");
+	replay_buffer_update_store(stream, obs_data_get_bool(s, "disk_cache") ? cache_dir : NULL);
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -996,45 +1093,76 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
+static inline bool replay_buffer_empty(struct ffmpeg_muxer *stream)
+{
+	return stream->store ? !stream->entries.size : !stream->packets.size;
+}
+
+static void replay_buffer_peek_front(struct ffmpeg_muxer *stream, int64_t *dts_usec, bool *video_keyframe)
+{
+	if (stream->store) {
+		struct replay_store_entry entry;
+		deque_peek_front(&stream->entries, &entry, sizeof(entry));
+		*dts_usec = entry.dts_usec;
+		*video_keyframe = entry.type == OBS_ENCODER_VIDEO && entry.keyframe;
+	} else {
+		struct encoder_packet pkt;
+		deque_peek_front(&stream->packets, &pkt, sizeof(pkt));
+		*dts_usec = pkt.dts_usec;
+		*video_keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+	}
+}
+
 static bool purge_front(struct ffmpeg_muxer *stream)
 {
-	struct encoder_packet pkt;
 	bool keyframe;
+	size_t size;
 
-	if (!stream->packets.size)
+	if (replay_buffer_empty(stream))
 		return false;
 
-	deque_pop_front(&stream->packets, &pkt, sizeof(pkt));
+	if (stream->store) {
+		struct replay_store_entry entry;
+		deque_pop_front(&stream->entries, &entry, sizeof(entry));
 
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+		keyframe = entry.type == OBS_ENCODER_VIDEO && entry.keyframe;
+		size = entry.size;
+		replay_store_release(stream->store, &entry);
+	} else {
+		struct encoder_packet pkt;
+		deque_pop_front(&stream->packets, &pkt, sizeof(pkt));
+
+		keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+		size = pkt.size;
+		obs_encoder_packet_release(&pkt);
+	}
 
 	if (keyframe)
 		stream->keyframes--;
 
-	if (!stream->packets.size) {
+	if (replay_buffer_empty(stream)) {
 		stream->cur_size = 0;
 		stream->cur_time = 0;
 	} else {
-		struct encoder_packet first;
-		deque_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
+		bool first_keyframe;
+		replay_buffer_peek_front(stream, &stream->cur_time, &first_keyframe);
+		stream->cur_size -= (int64_t)size;
 	}
 
-	obs_encoder_packet_release(&pkt);
 	return keyframe;
 }
 
 static inline void purge(struct ffmpeg_muxer *stream)
 {
 	if (purge_front(stream)) {
-		struct encoder_packet pkt;
+		int64_t dts_usec;
+		bool keyframe;
 
 		for (;;) {
-			if (!stream->packets.size)
+			if (replay_buffer_empty(stream))
 				return;
-			deque_peek_front(&stream->packets, &pkt, sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
+			replay_buffer_peek_front(stream, &dts_usec, &keyframe);
+			if (keyframe)
 				return;
 
 			purge_front(stream);
@@ -1045,86 +1173,285 @@ static inline void purge(struct ffmpeg_muxer *stream)
 static inline void replay_buffer_purge(struct ffmpeg_muxer *stream, struct encoder_packet *pkt)
 {
 	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
+		if (replay_buffer_empty(stream) || stream->keyframes <= 2)
 			return;
 
 		while ((stream->cur_size + (int64_t)pkt->size) > stream->max_size)
 			purge(stream);
 	}
 
-	if (!stream->packets.size || stream->keyframes <= 2)
+	if (replay_buffer_empty(stream) || stream->keyframes <= 2)
 		return;
 
 	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
 		purge(stream);
 }
 
-static void insert_packet(mux_packets_t *packets, struct encoder_packet *packet, int64_t video_offset,
-			  int64_t *audio_offsets, int64_t video_pts_offset, int64_t *audio_dts_offsets)
+struct replay_offsets {
+	bool found_video;
+	bool found_audio[MAX_AUDIO_MIXES];
+	int64_t video_offset;
+	int64_t video_pts_offset;
+	int64_t audio_offsets[MAX_AUDIO_MIXES];
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES];
+};
+
+static void apply_offsets(struct replay_offsets *offsets, enum obs_encoder_type type, size_t track_idx,
+			  int32_t timebase_den, int64_t *pts, int64_t *dts, int64_t *dts_usec)
 {
-	struct encoder_packet pkt;
-	size_t idx;
+	if (type == OBS_ENCODER_VIDEO) {
+		if (!offsets->found_video) {
+			offsets->video_pts_offset = *pts;
+			offsets->video_offset = *pts * 1000000 / timebase_den;
+			offsets->found_video = true;
+		}
 
-	obs_encoder_packet_ref(&pkt, packet);
+		*dts_usec -= offsets->video_offset;
+		*dts -= offsets->video_pts_offset;
+		*pts -= offsets->video_pts_offset;
+	} else {
+		if (!offsets->found_audio[track_idx]) {
+			offsets->found_audio[track_idx] = true;
+			offsets->audio_offsets[track_idx] = *dts_usec;
+			offsets->audio_dts_offsets[track_idx] = *dts;
+		}
+
+		*dts_usec -= offsets->audio_offsets[track_idx];
+		*dts -= offsets->audio_dts_offsets[track_idx];
+		*pts -= offsets->audio_dts_offsets[track_idx];
+	}
+}
 
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_pts_offset;
-		pkt.pts -= video_pts_offset;
+static inline size_t mux_packet_count(struct ffmpeg_muxer *stream)
+{
+	return stream->store ? stream->mux_entries.num : stream->mux_packets.num;
+}
+
+static inline void get_mux_packet_info(struct ffmpeg_muxer *stream, size_t idx, enum obs_encoder_type *type,
+				       size_t *track_idx, int64_t *dts_usec)
+{
+	if (stream->store) {
+		struct replay_store_entry *entry = &stream->mux_entries.array[idx];
+		*type = (enum obs_encoder_type)entry->type;
+		*track_idx = entry->track_idx;
+		*dts_usec = entry->dts_usec;
 	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+		struct encoder_packet *pkt = &stream->mux_packets.array[idx];
+		*type = pkt->type;
+		*track_idx = pkt->track_idx;
+		*dts_usec = pkt->dts_usec;
 	}
+}
 
-	for (idx = packets->num; idx > 0; idx--) {
-		struct encoder_packet *p = packets->array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
-			break;
+typedef DARRAY(size_t) mux_order_t;
+
+struct merge_track {
+	enum obs_encoder_type type;
+	size_t track_idx;
+	mux_order_t packets;
+	size_t pos;
+};
+
+/* The packets of each track are already in dts order, so the mux order is
+ * a merge of the tracks rather than a full sort.  With only a handful of
+ * tracks, picking the earliest track head linearly keeps this O(n). */
+static void get_mux_order(struct ffmpeg_muxer *stream, mux_order_t *order)
+{
+	DARRAY(struct merge_track) tracks = {0};
+	size_t num = mux_packet_count(stream);
+	enum obs_encoder_type type;
+	size_t track_idx;
+	int64_t dts_usec;
+
+	for (size_t i = 0; i < num; i++) {
+		struct merge_track *track = NULL;
+
+		get_mux_packet_info(stream, i, &type, &track_idx, &dts_usec);
+
+		for (size_t t = 0; t < tracks.num; t++) {
+			if (tracks.array[t].type == type && tracks.array[t].track_idx == track_idx) {
+				track = &tracks.array[t];
+				break;
+			}
+		}
+
+		if (!track) {
+			track = da_push_back_new(tracks);
+			track->type = type;
+			track->track_idx = track_idx;
+		}
+
+		da_push_back(track->packets, &i);
+	}
+
+	da_reserve(*order, num);
+
+	for (size_t i = 0; i < num; i++) {
+		struct merge_track *next = NULL;
+		int64_t next_dts_usec = 0;
+		size_t next_idx = 0;
+
+		for (size_t t = 0; t < tracks.num; t++) {
+			struct merge_track *track = &tracks.array[t];
+			if (track->pos == track->packets.num)
+				continue;
+
+			size_t idx = track->packets.array[track->pos];
+			get_mux_packet_info(stream, idx, &type, &track_idx, &dts_usec);
+
+			/* on equal timestamps, keep the order of arrival */
+			if (!next || dts_usec < next_dts_usec || (dts_usec == next_dts_usec && idx < next_idx)) {
+				next = track;
+				next_dts_usec = dts_usec;
+				next_idx = idx;
+			}
+		}
+
+		da_push_back(*order, &next_idx);
+		next->pos++;
 	}
 
-	da_insert(*packets, idx, &pkt);
+	for (size_t t = 0; t < tracks.num; t++)
+		da_free(tracks.array[t].packets);
+	da_free(tracks);
 }
 
-static void *replay_buffer_mux_thread(void *data)
+static void release_mux_packet(struct ffmpeg_muxer *stream, size_t idx)
 {
-	struct ffmpeg_muxer *stream = data;
-	bool error = false;
+	if (stream->store)
+		replay_store_release(stream->store, &stream->mux_entries.array[idx]);
+	else
+		obs_encoder_packet_release(&stream->mux_packets.array[idx]);
+}
+
+static bool write_mux_packet(struct ffmpeg_muxer *stream, struct mp4_mux *mux, size_t idx)
+{
+	struct encoder_packet stored;
+	struct encoder_packet *pkt;
+	bool success;
+
+	if (stream->store) {
+		if (!replay_store_get_packet(stream->store, &stream->mux_entries.array[idx], &stored))
+			return false;
+		pkt = &stored;
+	} else {
+		pkt = &stream->mux_packets.array[idx];
+	}
+
+	if (!mux)
+		return write_packet(stream, pkt);
+
+	if (!stream->store)
+		return mp4_mux_submit_packet(mux, pkt);
 
+	/* the muxer holds on to packets until their fragment is written, but
+	 * stored packet data is only mapped until the next read */
+	struct encoder_packet instance;
+	obs_encoder_packet_create_instance(&instance, pkt);
+	success = mp4_mux_submit_packet(mux, &instance);
+	obs_encoder_packet_release(&instance);
+	return success;
+}
+
+/* Packets are released as soon as they have been written, so that store
+ * segments can be reused by the replay buffer while a long save is still in
+ * progress.  *written is the number of packets of the order released so far. */
+static bool replay_buffer_write_pipe(struct ffmpeg_muxer *stream, const mux_order_t *order, size_t *written)
+{
 	start_pipe(stream, stream->path.array);
 
 	if (!stream->pipe) {
 		warn("Failed to create process pipe");
-		error = true;
-		goto error;
+		return false;
 	}
 
 	if (!send_headers(stream)) {
 		warn("Could not write headers for file '%s'", stream->path.array);
-		error = true;
-		goto error;
+		return false;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		if (!write_packet(stream, pkt)) {
+	for (size_t i = 0; i < order->num; i++) {
+		bool success = write_mux_packet(stream, NULL, order->array[i]);
+		release_mux_packet(stream, order->array[i]);
+		*written = i + 1;
+
+		if (!success) {
 			warn("Could not write packet for file '%s'", stream->path.array);
-			error = true;
-			goto error;
+			return false;
 		}
-		obs_encoder_packet_release(pkt);
 	}
 
-	info("Wrote replay buffer to '%s'", stream->path.array);
+	return true;
+}
 
-error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
-	if (error) {
-		for (size_t i = 0; i < stream->mux_packets.num; i++)
-			obs_encoder_packet_release(&stream->mux_packets.array[i]);
+static bool replay_buffer_write_mp4(struct ffmpeg_muxer *stream, const mux_order_t *order, size_t *written)
+{
+	struct serializer s;
+	bool success = true;
+
+	if (!buffered_file_serializer_init_defaults(&s, stream->path.array)) {
+		warn("Unable to open MP4 file '%s'", stream->path.array);
+		return false;
 	}
+
+	struct mp4_mux *mux = mp4_mux_create(stream->output, &s, MP4_USE_NEGATIVE_CTS);
+
+	for (size_t i = 0; i < order->num; i++) {
+		success = write_mux_packet(stream, mux, order->array[i]) && serializer_get_pos(&s) != -1;
+		release_mux_packet(stream, order->array[i]);
+		*written = i + 1;
+
+		if (!success) {
+			warn("Could not write packet for file '%s'", stream->path.array);
+			break;
+		}
+	}
+
+	if (success && (!mp4_mux_finalise(mux) || serializer_get_pos(&s) == -1)) {
+		warn("Could not finalize file '%s'", stream->path.array);
+		success = false;
+	}
+
+	mp4_mux_destroy(mux);
+	buffered_file_serializer_free(&s);
+	return success;
+}
+
+static const char *replay_buffer_mux_name = "replay_buffer_mux_thread";
+static const char *replay_buffer_save_name = "replay_buffer_save";
+
+static void *replay_buffer_mux_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	mux_order_t order = {0};
+	size_t written = 0;
+	bool error;
+
+	os_set_thread_name("replay_buffer_mux_thread");
+	profile_start(replay_buffer_mux_name);
+
+	get_mux_order(stream, &order);
+
+	if (stream->native_mux)
+		error = !replay_buffer_write_mp4(stream, &order, &written);
+	else
+		error = !replay_buffer_write_pipe(stream, &order, &written);
+
+	if (!error)
+		info("Wrote replay buffer to '%s'", stream->path.array);
+
+	stop_pipe(stream);
+
+	for (size_t i = written; i < order.num; i++)
+		release_mux_packet(stream, order.array[i]);
+	if (stream->store)
+		replay_store_read_end(stream->store);
+
+	da_free(order);
 	da_free(stream->mux_packets);
+	da_free(stream->mux_entries);
+
+	profile_end(replay_buffer_mux_name);
 	os_atomic_set_bool(&stream->muxing, false);
 
 	if (!error) {
@@ -1136,45 +1463,90 @@ error:
 	return NULL;
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+static void replay_buffer_save_entries(struct ffmpeg_muxer *stream)
+{
+	const size_t size = sizeof(struct replay_store_entry);
+	size_t num_entries = stream->entries.size / size;
+	struct replay_offsets offsets = {0};
+
+	da_resize(stream->mux_entries, num_entries);
+
+	for (size_t i = 0; i < num_entries; i++) {
+		struct replay_store_entry *entry = &stream->mux_entries.array[i];
+
+		*entry = *(struct replay_store_entry *)deque_data(&stream->entries, i * size);
+		replay_store_ref(stream->store, entry);
+
+		apply_offsets(&offsets, (enum obs_encoder_type)entry->type, entry->track_idx, entry->timebase_den,
+			      &entry->pts, &entry->dts, &entry->dts_usec);
+	}
+}
+
+static void replay_buffer_save_packets(struct ffmpeg_muxer *stream)
 {
 	const size_t size = sizeof(struct encoder_packet);
 	size_t num_packets = stream->packets.size / size;
+	struct replay_offsets offsets = {0};
 
-	da_reserve(stream->mux_packets, num_packets);
+	da_resize(stream->mux_packets, num_packets);
 
-	/* ---------------------------- */
-	/* reorder packets */
+	for (size_t i = 0; i < num_packets; i++) {
+		struct encoder_packet *pkt = &stream->mux_packets.array[i];
 
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_pts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+		obs_encoder_packet_ref(pkt, deque_data(&stream->packets, i * size));
 
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = deque_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_pts_offset = pkt->pts;
-				video_offset = video_pts_offset * 1000000 / pkt->timebase_den;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
-		}
+		apply_offsets(&offsets, pkt->type, pkt->track_idx, pkt->timebase_den, &pkt->pts, &pkt->dts,
+			      &pkt->dts_usec);
+	}
+}
+
+static bool native_mux_codec(obs_encoder_t *encoder)
+{
+	static const char *codecs[] = {"h264", "hevc", "av1",       "aac",       "opus",
+				       "flac", "alac", "pcm_s16le", "pcm_s24le", "pcm_f32le"};
+
+	if (!encoder)
+		return true;
 
-		insert_packet(&stream->mux_packets, pkt, video_offset, audio_offsets, video_pts_offset,
-			      audio_dts_offsets);
+	const char *codec = obs_encoder_get_codec(encoder);
+	for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		if (strcmp(codec, codecs[i]) == 0)
+			return true;
 	}
 
+	return false;
+}
+
+static bool native_mux_supported(struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	const char *ext = obs_data_get_string(settings, "extension");
+	const char *muxer_settings = obs_data_get_string(settings, "muxer_settings");
+
+	/* custom muxer settings are only understood by ffmpeg */
+	bool supported = astrcmpi(ext, "mp4") == 0 && !*muxer_settings;
+	obs_data_release(settings);
+
+	for (size_t i = 0; supported && i < MAX_OUTPUT_VIDEO_ENCODERS; i++)
+		supported = native_mux_codec(obs_output_get_video_encoder2(stream->output, i));
+	for (size_t i = 0; supported && i < MAX_OUTPUT_AUDIO_ENCODERS; i++)
+		supported = native_mux_codec(obs_output_get_audio_encoder(stream->output, i));
+
+	return supported;
+}
+
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	profile_start(replay_buffer_save_name);
+
+	/* only take references here, ordering the packets is left to the
+	 * mux thread */
+	if (stream->store)
+		replay_buffer_save_entries(stream);
+	else
+		replay_buffer_save_packets(stream);
+
+	stream->native_mux = native_mux_supported(stream);
 	generate_filename(stream, &stream->path, true);
 
 	os_atomic_set_bool(&stream->muxing, true);
@@ -1183,6 +1555,8 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 		warn("Failed to create muxer thread");
 		os_atomic_set_bool(&stream->muxing, false);
 	}
+
+	profile_end(replay_buffer_save_name);
 }
 
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
@@ -1220,14 +1594,26 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
+	replay_buffer_purge(stream, packet);
 
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
+	if (replay_buffer_empty(stream))
+		stream->cur_time = packet->dts_usec;
+
+	if (stream->store) {
+		struct replay_store_entry entry;
+
+		if (!replay_store_push(stream->store, packet, &entry)) {
+			warn("Failed to write packet to the replay buffer disk cache");
+			deactivate_replay_buffer(stream, OBS_OUTPUT_ERROR);
+			return;
+		}
+		deque_push_back(&stream->entries, &entry, sizeof(entry));
+	} else {
+		obs_encoder_packet_ref(&pkt, packet);
+		deque_push_back(&stream->packets, &pkt, sizeof(pkt));
+	}
 
-	deque_push_back(&stream->packets, packet, sizeof(*packet));
+	stream->cur_size += packet->size;
 
 	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
 		stream->keyframes++;
@@ -1253,6 +1639,7 @@ static void replay_buffer_defaults(obs_data_t *s)
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
+	obs_data_set_default_bool(s, "disk_cache", false);
 }
 
 struct obs_output_info replay_buffer = {
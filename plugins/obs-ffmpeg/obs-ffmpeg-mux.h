@@ -9,11 +9,17 @@
 #include <util/platform.h>
 #include <util/threading.h>
 
+#include "replay-store.h"
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
+
 typedef DARRAY(struct encoder_packet) mux_packets_t;
+typedef DARRAY(struct replay_store_entry) mux_entries_t;
 
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
+	struct ffm_shm *shm;
+	bool shm_active;
 	int64_t stop_ts;
 	uint64_t total_bytes;
 	bool sent_headers;
@@ -36,8 +42,15 @@ struct ffmpeg_muxer {
 	int keyframes;
 	obs_hotkey_id hotkey;
 	volatile bool muxing;
+	bool native_mux;
 	mux_packets_t mux_packets;
 
+	/* replay buffer with disk cache, packet data is kept in the store and
+	 * only the index entries are kept in memory */
+	replay_store_t *store;
+	struct deque entries;
+	mux_entries_t mux_entries;
+
 	/* split file */
 	bool found_video;
 	bool found_audio[MAX_AUDIO_MIXES];
@@ -69,6 +82,7 @@ struct ffmpeg_muxer {
 bool stopping(struct ffmpeg_muxer *stream);
 bool active(struct ffmpeg_muxer *stream);
 void start_pipe(struct ffmpeg_muxer *stream, const char *path);
+int stop_pipe(struct ffmpeg_muxer *stream);
 bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet);
 bool send_headers(struct ffmpeg_muxer *stream);
 int deactivate(struct ffmpeg_muxer *stream, int code);
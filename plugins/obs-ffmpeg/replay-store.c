@@ -0,0 +1,375 @@
+#include "replay-store.h"
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <inttypes.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define INVALID_SEGMENT UINT32_MAX
+
+/* keeps segment offsets aligned to the page size and to the allocation
+ * granularity of windows file mappings */
+#define SEGMENT_ALIGN (1024 * 1024)
+#define SEGMENT_MAX_SIZE (1024 * 1024 * 1024)
+
+struct segment {
+	long refs;
+};
+
+struct view {
+	uint8_t *data;
+	uint32_t segment;
+};
+
+struct replay_store {
+	struct dstr dir;
+	size_t segment_size;
+
+#ifdef _WIN32
+	HANDLE file;
+#else
+	int fd;
+#endif
+
+	/* protects segment reference counts, which are released by the
+	 * reader thread as well */
+	pthread_mutex_t mutex;
+	DARRAY(struct segment) segments;
+
+	struct view write_view;
+	size_t write_pos;
+
+	struct view read_view;
+};
+
+/* ------------------------------------------------------------------------- */
+/* platform specific file handling                                           */
+
+#ifdef _WIN32
+static bool open_file(struct replay_store *store)
+{
+	struct dstr path = {0};
+	wchar_t *wpath = NULL;
+
+	dstr_printf(&path, "%s/obs-replay-%lu-%llu.tmp", store->dir.array, GetCurrentProcessId(),
+		    (unsigned long long)os_gettime_ns());
+	os_utf8_to_wcs_ptr(path.array, path.len, &wpath);
+
+	store->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+				  FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+
+	bfree(wpath);
+	dstr_free(&path);
+	return store->file != INVALID_HANDLE_VALUE;
+}
+
+static void close_file(struct replay_store *store)
+{
+	if (store->file != INVALID_HANDLE_VALUE)
+		CloseHandle(store->file);
+}
+
+static bool resize_file(struct replay_store *store, uint64_t size)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)size;
+
+	return SetFilePointerEx(store->file, pos, NULL, FILE_BEGIN) && SetEndOfFile(store->file);
+}
+
+static uint8_t *map_segment(struct replay_store *store, uint32_t segment, bool writable)
+{
+	uint64_t offset = (uint64_t)segment * store->segment_size;
+	uint64_t end = offset + store->segment_size;
+
+	HANDLE mapping = CreateFileMappingW(store->file, NULL, PAGE_READWRITE, (DWORD)(end >> 32), (DWORD)end, NULL);
+	if (!mapping)
+		return NULL;
+
+	void *data = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, (DWORD)(offset >> 32),
+				   (DWORD)offset, store->segment_size);
+
+	/* the view keeps the mapping object alive */
+	CloseHandle(mapping);
+	return data;
+}
+
+static void unmap_segment(struct replay_store *store, uint8_t *data)
+{
+	UNUSED_PARAMETER(store);
+	UnmapViewOfFile(data);
+}
+
+#else
+static bool open_file(struct replay_store *store)
+{
+	struct dstr path = {0};
+
+	dstr_printf(&path, "%s/obs-replay-XXXXXX", store->dir.array);
+	store->fd = mkstemp(path.array);
+
+	/* nothing but this store needs to see the file */
+	if (store->fd != -1) {
+		unlink(path.array);
+		fcntl(store->fd, F_SETFD, FD_CLOEXEC);
+	}
+
+	dstr_free(&path);
+	return store->fd != -1;
+}
+
+static void close_file(struct replay_store *store)
+{
+	if (store->fd != -1)
+		close(store->fd);
+}
+
+static bool resize_file(struct replay_store *store, uint64_t size)
+{
+#ifdef __linux__
+	/* allocate the blocks up front, writing to a mapped hole of a full
+	 * disk would raise SIGBUS rather than return an error */
+	uint64_t cur_size = (uint64_t)lseek(store->fd, 0, SEEK_END);
+	if (size > cur_size)
+		return posix_fallocate(store->fd, (off_t)cur_size, (off_t)(size - cur_size)) == 0;
+#endif
+	return ftruncate(store->fd, (off_t)size) == 0;
+}
+
+static uint8_t *map_segment(struct replay_store *store, uint32_t segment, bool writable)
+{
+	off_t offset = (off_t)segment * (off_t)store->segment_size;
+	int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+
+	void *data = mmap(NULL, store->segment_size, prot, MAP_SHARED, store->fd, offset);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	if (!writable)
+		posix_madvise(data, store->segment_size, POSIX_MADV_SEQUENTIAL);
+	return data;
+}
+
+static void unmap_segment(struct replay_store *store, uint8_t *data)
+{
+	munmap(data, store->segment_size);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static inline void view_reset(struct replay_store *store, struct view *view)
+{
+	if (view->data)
+		unmap_segment(store, view->data);
+	view->data = NULL;
+	view->segment = INVALID_SEGMENT;
+}
+
+replay_store_t *replay_store_create(const char *dir, size_t segment_size)
+{
+	struct replay_store *store = bzalloc(sizeof(*store));
+
+	if (!segment_size)
+		segment_size = REPLAY_STORE_DEFAULT_SEGMENT_SIZE;
+	if (segment_size > SEGMENT_MAX_SIZE)
+		segment_size = SEGMENT_MAX_SIZE;
+
+	store->segment_size = (segment_size + SEGMENT_ALIGN - 1) & ~(size_t)(SEGMENT_ALIGN - 1);
+	store->write_view.segment = INVALID_SEGMENT;
+	store->read_view.segment = INVALID_SEGMENT;
+	dstr_copy(&store->dir, dir && *dir ? dir : ".");
+
+#ifdef _WIN32
+	store->file = INVALID_HANDLE_VALUE;
+#else
+	store->fd = -1;
+#endif
+
+	pthread_mutex_init_value(&store->mutex);
+	if (pthread_mutex_init(&store->mutex, NULL) != 0 || !open_file(store)) {
+		replay_store_destroy(store);
+		return NULL;
+	}
+
+	return store;
+}
+
+void replay_store_destroy(replay_store_t *store)
+{
+	if (!store)
+		return;
+
+	view_reset(store, &store->write_view);
+	view_reset(store, &store->read_view);
+	close_file(store);
+
+	pthread_mutex_destroy(&store->mutex);
+	da_free(store->segments);
+	dstr_free(&store->dir);
+	bfree(store);
+}
+
+const char *replay_store_get_dir(const replay_store_t *store)
+{
+	return store->dir.array;
+}
+
+/* must be called with the mutex locked */
+static uint32_t acquire_segment(struct replay_store *store)
+{
+	for (size_t i = 0; i < store->segments.num; i++) {
+		if (!store->segments.array[i].refs)
+			return (uint32_t)i;
+	}
+
+	uint64_t size = (uint64_t)(store->segments.num + 1) * store->segment_size;
+	if (!resize_file(store, size)) {
+		blog(LOG_WARNING, "replay_store: Failed to grow file to %" PRIu64 " bytes", size);
+		return INVALID_SEGMENT;
+	}
+
+	da_push_back_new(store->segments);
+	return (uint32_t)(store->segments.num - 1);
+}
+
+static bool next_write_segment(struct replay_store *store)
+{
+	uint32_t segment;
+
+	/* the segment being left behind can be reused right away if every
+	 * entry in it has already been released */
+	view_reset(store, &store->write_view);
+
+	pthread_mutex_lock(&store->mutex);
+	segment = acquire_segment(store);
+	pthread_mutex_unlock(&store->mutex);
+
+	if (segment == INVALID_SEGMENT)
+		return false;
+
+	store->write_view.data = map_segment(store, segment, true);
+	if (!store->write_view.data) {
+		blog(LOG_WARNING, "replay_store: Failed to map segment %" PRIu32, segment);
+		return false;
+	}
+
+	store->write_view.segment = segment;
+	store->write_pos = 0;
+	return true;
+}
+
+bool replay_store_push(replay_store_t *store, const struct encoder_packet *packet, struct replay_store_entry *entry)
+{
+	if (packet->size > store->segment_size) {
+		blog(LOG_WARNING, "replay_store: Packet of %zu bytes is larger than the segment size", packet->size);
+		return false;
+	}
+
+	if (store->write_view.segment == INVALID_SEGMENT || store->write_pos + packet->size > store->segment_size) {
+		if (!next_write_segment(store))
+			return false;
+	}
+
+	memcpy(store->write_view.data + store->write_pos, packet->data, packet->size);
+
+	entry->pts = packet->pts;
+	entry->dts = packet->dts;
+	entry->dts_usec = packet->dts_usec;
+	entry->encoder = packet->encoder;
+	entry->segment = store->write_view.segment;
+	entry->offset = (uint32_t)store->write_pos;
+	entry->size = (uint32_t)packet->size;
+	entry->timebase_num = packet->timebase_num;
+	entry->timebase_den = packet->timebase_den;
+	entry->type = (uint8_t)packet->type;
+	entry->track_idx = (uint8_t)packet->track_idx;
+	entry->keyframe = packet->keyframe;
+
+	store->write_pos += packet->size;
+
+	replay_store_ref(store, entry);
+	return true;
+}
+
+void replay_store_ref(replay_store_t *store, const struct replay_store_entry *entry)
+{
+	pthread_mutex_lock(&store->mutex);
+	store->segments.array[entry->segment].refs++;
+	pthread_mutex_unlock(&store->mutex);
+}
+
+void replay_store_release(replay_store_t *store, const struct replay_store_entry *entry)
+{
+	pthread_mutex_lock(&store->mutex);
+	store->segments.array[entry->segment].refs--;
+	pthread_mutex_unlock(&store->mutex);
+}
+
+const uint8_t *replay_store_read(replay_store_t *store, const struct replay_store_entry *entry)
+{
+	if (store->read_view.segment != entry->segment) {
+		view_reset(store, &store->read_view);
+
+		store->read_view.data = map_segment(store, entry->segment, false);
+		if (!store->read_view.data) {
+			blog(LOG_WARNING, "replay_store: Failed to map segment %" PRIu32 " for reading",
+			     entry->segment);
+			return NULL;
+		}
+
+		store->read_view.segment = entry->segment;
+	}
+
+	return store->read_view.data + entry->offset;
+}
+
+void replay_store_read_end(replay_store_t *store)
+{
+	view_reset(store, &store->read_view);
+}
+
+bool replay_store_get_packet(replay_store_t *store, const struct replay_store_entry *entry,
+			     struct encoder_packet *packet)
+{
+	const uint8_t *data = replay_store_read(store, entry);
+	if (!data)
+		return false;
+
+	memset(packet, 0, sizeof(*packet));
+	packet->data = (uint8_t *)data;
+	packet->size = entry->size;
+	packet->pts = entry->pts;
+	packet->dts = entry->dts;
+	packet->timebase_num = entry->timebase_num;
+	packet->timebase_den = entry->timebase_den;
+	packet->type = (enum obs_encoder_type)entry->type;
+	packet->keyframe = entry->keyframe;
+	packet->dts_usec = entry->dts_usec;
+	packet->track_idx = entry->track_idx;
+	packet->encoder = entry->encoder;
+	return true;
+}
+
+size_t replay_store_segment_count(replay_store_t *store)
+{
+	size_t count;
+
+	pthread_mutex_lock(&store->mutex);
+	count = store->segments.num;
+	pthread_mutex_unlock(&store->mutex);
+	return count;
+}
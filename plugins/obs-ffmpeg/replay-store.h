@@ -0,0 +1,76 @@
+#pragma once
+
+#include <obs.h>
+
+/*
+ * Disk backed packet store for the replay buffer
+ *
+ *   Packet payloads are copied into a temporary file on local disk which is
+ * split into fixed size segments.  Only the segment currently being written
+ * and the segment currently being read are mapped, so resident memory does
+ * not depend on the length of the replay.  The caller keeps the per-packet
+ * index (struct replay_store_entry) in RAM.
+ *
+ *   Segments are reference counted by the entries stored in them and are
+ * reused once every entry in them has been released.  If no segment is free,
+ * the file grows by another segment.
+ */
+
+#define REPLAY_STORE_DEFAULT_SEGMENT_SIZE (32 * 1024 * 1024)
+
+struct replay_store;
+typedef struct replay_store replay_store_t;
+
+struct replay_store_entry {
+	int64_t pts;
+	int64_t dts;
+	int64_t dts_usec;
+	obs_encoder_t *encoder;
+
+	uint32_t segment;
+	uint32_t offset;
+	uint32_t size;
+
+	int32_t timebase_num;
+	int32_t timebase_den;
+
+	uint8_t type;
+	uint8_t track_idx;
+	bool keyframe;
+};
+
+/**
+ * Creates a store with a temporary file in the specified directory.  The file
+ * is removed when the store is destroyed (or immediately, where the platform
+ * allows it).  Returns NULL on failure.
+ */
+replay_store_t *replay_store_create(const char *dir, size_t segment_size);
+void replay_store_destroy(replay_store_t *store);
+
+const char *replay_store_get_dir(const replay_store_t *store);
+
+/** Copies the packet payload into the store and fills out its index entry */
+bool replay_store_push(replay_store_t *store, const struct encoder_packet *packet, struct replay_store_entry *entry);
+
+/** Adds/removes a reference to the data of an entry */
+void replay_store_ref(replay_store_t *store, const struct replay_store_entry *entry);
+void replay_store_release(replay_store_t *store, const struct replay_store_entry *entry);
+
+/**
+ * Maps the data of an entry for reading.  The returned pointer stays valid
+ * until the next call to replay_store_read or replay_store_read_end.  Only one
+ * thread may read from a store at a time, and the entry must be referenced.
+ */
+const uint8_t *replay_store_read(replay_store_t *store, const struct replay_store_entry *entry);
+void replay_store_read_end(replay_store_t *store);
+
+/**
+ * Fills out a packet for an entry, with the data mapped for reading.  The
+ * packet data is not reference counted, so the packet must not be passed to
+ * obs_encoder_packet_ref or obs_encoder_packet_release.
+ */
+bool replay_store_get_packet(replay_store_t *store, const struct replay_store_entry *entry,
+			     struct encoder_packet *packet);
+
+/** Number of segments the file currently consists of */
+size_t replay_store_segment_count(replay_store_t *store);
@@ -309,14 +309,11 @@ void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size, bool w
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
+static void flv_video_header(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
 {
 	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -337,18 +334,23 @@ static void flv_video(struct serializer *s, int32_t dts_offset, struct encoder_p
 	s_w8(s, packet->keyframe ? 0x17 : 0x27);
 	s_w8(s, is_header ? 0 : 1);
 	s_wb24(s, get_ms_time(packet, offset));
+}
+
+static void flv_video(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_video_header(s, dts_offset, packet, is_header);
 	s_write(s, packet->data, packet->size);
 
 	write_previous_tag_size(s);
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
+static void flv_audio_header(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -368,6 +370,14 @@ static void flv_audio(struct serializer *s, int32_t dts_offset, struct encoder_p
 	/* these are the two extra bytes mentioned above */
 	s_w8(s, 0xaf);
 	s_w8(s, is_header ? 0 : 1);
+}
+
+static void flv_audio(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_audio_header(s, dts_offset, packet, is_header);
 	s_write(s, packet->data, packet->size);
 
 	write_previous_tag_size(s);
@@ -389,28 +399,20 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset, uint8_t *
 	*size = data.bytes.num;
 }
 
-void flv_packet_audio_ex(struct encoder_packet *packet, enum audio_id_t codec_id, int32_t dts_offset, uint8_t **output,
-			 size_t *size, int type, size_t idx)
+static void flv_packet_audio_ex_header(struct serializer *s, struct encoder_packet *packet, enum audio_id_t codec_id,
+				       int32_t dts_offset, int type, size_t idx)
 {
-	struct array_output_data data;
-	struct serializer s;
-
-	array_output_serializer_init(&s, &data);
-
 	assert(packet->type == OBS_ENCODER_AUDIO);
 
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
 	bool is_multitrack = idx > 0;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	int header_metadata_size = 5; // w8+wa4cc
 	if (is_multitrack)
 		header_metadata_size += 2; // w8 + w8
 
-	s_w8(&s, RTMP_PACKET_TYPE_AUDIO);
+	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
 
 #ifdef DEBUG_TIMESTAMPS
 	blog(LOG_DEBUG, "Audio: %lu", time_ms);
@@ -421,20 +423,33 @@ void flv_packet_audio_ex(struct encoder_packet *packet, enum audio_id_t codec_id
 	last_time = time_ms;
 #endif
 
-	s_wb24(&s, (uint32_t)packet->size + header_metadata_size);
-	s_wb24(&s, (uint32_t)time_ms);
-	s_w8(&s, (time_ms >> 24) & 0x7F);
-	s_wb24(&s, 0);
+	s_wb24(s, (uint32_t)packet->size + header_metadata_size);
+	s_wb24(s, (uint32_t)time_ms);
+	s_w8(s, (time_ms >> 24) & 0x7F);
+	s_wb24(s, 0);
 
-	s_w8(&s, AUDIO_HEADER_EX | (is_multitrack ? AUDIO_PACKETTYPE_MULTITRACK : type));
+	s_w8(s, AUDIO_HEADER_EX | (is_multitrack ? AUDIO_PACKETTYPE_MULTITRACK : type));
 	if (is_multitrack) {
-		s_w8(&s, MULTITRACKTYPE_ONE_TRACK | type);
-		s_wa4cc(&s, codec_id);
-		s_w8(&s, (uint8_t)idx);
+		s_w8(s, MULTITRACKTYPE_ONE_TRACK | type);
+		s_wa4cc(s, codec_id);
+		s_w8(s, (uint8_t)idx);
 	} else {
-		s_wa4cc(&s, codec_id);
+		s_wa4cc(s, codec_id);
 	}
+}
+
+void flv_packet_audio_ex(struct encoder_packet *packet, enum audio_id_t codec_id, int32_t dts_offset, uint8_t **output,
+			 size_t *size, int type, size_t idx)
+{
+	struct array_output_data data;
+	struct serializer s;
+
+	array_output_serializer_init(&s, &data);
+
+	if (!packet->data || !packet->size)
+		return;
 
+	flv_packet_audio_ex_header(&s, packet, codec_id, dts_offset, type, idx);
 	s_write(&s, packet->data, packet->size);
 
 	write_previous_tag_size(&s);
@@ -444,13 +459,9 @@ void flv_packet_audio_ex(struct encoder_packet *packet, enum audio_id_t codec_id
 }
 
 // Y2023 spec
-void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int32_t dts_offset, uint8_t **output,
-		   size_t *size, int type, size_t idx)
+static void flv_packet_ex_header(struct serializer *s, struct encoder_packet *packet, enum video_id_t codec_id,
+				 int32_t dts_offset, int type, size_t idx)
 {
-	struct array_output_data data;
-	struct serializer s;
-	array_output_serializer_init(&s, &data);
-
 	assert(packet->type == OBS_ENCODER_VIDEO);
 
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
@@ -466,10 +477,10 @@ void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int3
 	if (is_multitrack)
 		header_metadata_size += 2; // w8+w8
 
-	s_w8(&s, RTMP_PACKET_TYPE_VIDEO);
-	s_wb24(&s, (uint32_t)packet->size + header_metadata_size);
-	s_wtimestamp(&s, time_ms);
-	s_wb24(&s, 0); // always 0
+	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
+	s_wb24(s, (uint32_t)packet->size + header_metadata_size);
+	s_wtimestamp(s, time_ms);
+	s_wb24(s, 0); // always 0
 
 	uint8_t frame_type = packet->keyframe ? FT_KEY : FT_INTER;
 
@@ -478,20 +489,30 @@ void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int3
 	 * The default trackId is 0.
 	 */
 	if (is_multitrack) {
-		s_w8(&s, FRAME_HEADER_EX | PACKETTYPE_MULTITRACK | frame_type);
-		s_w8(&s, MULTITRACKTYPE_ONE_TRACK | type);
-		s_w4cc(&s, codec_id);
+		s_w8(s, FRAME_HEADER_EX | PACKETTYPE_MULTITRACK | frame_type);
+		s_w8(s, MULTITRACKTYPE_ONE_TRACK | type);
+		s_w4cc(s, codec_id);
 		// trackId
-		s_w8(&s, (uint8_t)idx);
+		s_w8(s, (uint8_t)idx);
 	} else {
-		s_w8(&s, FRAME_HEADER_EX | type | frame_type);
-		s_w4cc(&s, codec_id);
+		s_w8(s, FRAME_HEADER_EX | type | frame_type);
+		s_w4cc(s, codec_id);
 	}
 
 	// H.264/HEVC composition time offset
 	if ((codec_id == CODEC_H264 || codec_id == CODEC_HEVC) && type == PACKETTYPE_FRAMES) {
-		s_wb24(&s, get_ms_time(packet, packet->pts - packet->dts));
+		s_wb24(s, get_ms_time(packet, packet->pts - packet->dts));
 	}
+}
+
+void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int32_t dts_offset, uint8_t **output,
+		   size_t *size, int type, size_t idx)
+{
+	struct array_output_data data;
+	struct serializer s;
+	array_output_serializer_init(&s, &data);
+
+	flv_packet_ex_header(&s, packet, codec_id, dts_offset, type, idx);
 
 	// packet data
 	s_write(&s, packet->data, packet->size);
@@ -508,15 +529,20 @@ void flv_packet_start(struct encoder_packet *packet, enum video_id_t codec, uint
 	flv_packet_ex(packet, codec, 0, output, size, PACKETTYPE_SEQ_START, idx);
 }
 
-void flv_packet_frames(struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset, uint8_t **output,
-		       size_t *size, size_t idx)
+static int frames_packet_type(struct encoder_packet *packet, enum video_id_t codec)
 {
 	int packet_type = PACKETTYPE_FRAMES;
 	// PACKETTYPE_FRAMESX is an optimization to avoid sending composition
 	// time offsets of 0. See Enhanced RTMP spec.
 	if ((codec == CODEC_H264 || codec == CODEC_HEVC) && packet->dts == packet->pts)
 		packet_type = PACKETTYPE_FRAMESX;
-	flv_packet_ex(packet, codec, dts_offset, output, size, packet_type, idx);
+	return packet_type;
+}
+
+void flv_packet_frames(struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset, uint8_t **output,
+		       size_t *size, size_t idx)
+{
+	flv_packet_ex(packet, codec, dts_offset, output, size, frames_packet_type(packet, codec), idx);
 }
 
 void flv_packet_end(struct encoder_packet *packet, enum video_id_t codec, uint8_t **output, size_t *size, size_t idx)
@@ -536,6 +562,104 @@ void flv_packet_audio_frames(struct encoder_packet *packet, enum audio_id_t code
 	flv_packet_audio_ex(packet, codec, dts_offset, output, size, AUDIO_PACKETTYPE_FRAMES, idx);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Tag headers without the packet data, for sending the packet data in place */
+
+struct header_output_data {
+	uint8_t *bytes;
+	size_t pos;
+};
+
+static size_t header_output_write(void *param, const void *data, size_t size)
+{
+	struct header_output_data *out = param;
+
+	if (out->pos + size > FLV_TAG_HEADER_MAX_SIZE) {
+		assert(0 && "FLV tag header exceeds FLV_TAG_HEADER_MAX_SIZE");
+		return 0;
+	}
+
+	memcpy(out->bytes + out->pos, data, size);
+	out->pos += size;
+	return size;
+}
+
+static int64_t header_output_get_pos(void *param)
+{
+	struct header_output_data *out = param;
+	return (int64_t)out->pos;
+}
+
+static void header_output_serializer_init(struct serializer *s, struct header_output_data *data, uint8_t *header)
+{
+	data->bytes = header;
+	data->pos = 0;
+
+	s->data = data;
+	s->read = NULL;
+	s->write = header_output_write;
+	s->seek = NULL;
+	s->get_pos = header_output_get_pos;
+}
+
+static size_t finish_header(struct header_output_data *data, struct encoder_packet *packet, uint8_t *footer)
+{
+	/* previous tag size, same as write_previous_tag_size */
+	uint32_t tag_size = (uint32_t)(data->pos + packet->size);
+
+	footer[0] = (uint8_t)(tag_size >> 24);
+	footer[1] = (uint8_t)(tag_size >> 16);
+	footer[2] = (uint8_t)(tag_size >> 8);
+	footer[3] = (uint8_t)tag_size;
+	return data->pos;
+}
+
+size_t flv_packet_mux_header(struct encoder_packet *packet, int32_t dts_offset, uint8_t *header, uint8_t *footer,
+			     bool is_header)
+{
+	struct header_output_data data;
+	struct serializer s;
+
+	if (!packet->data || !packet->size)
+		return 0;
+
+	header_output_serializer_init(&s, &data, header);
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		flv_video_header(&s, dts_offset, packet, is_header);
+	else
+		flv_audio_header(&s, dts_offset, packet, is_header);
+
+	return finish_header(&data, packet, footer);
+}
+
+size_t flv_packet_frames_header(struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset,
+				uint8_t *header, uint8_t *footer, size_t idx)
+{
+	struct header_output_data data;
+	struct serializer s;
+
+	header_output_serializer_init(&s, &data, header);
+	flv_packet_ex_header(&s, packet, codec, dts_offset, frames_packet_type(packet, codec), idx);
+
+	return finish_header(&data, packet, footer);
+}
+
+size_t flv_packet_audio_frames_header(struct encoder_packet *packet, enum audio_id_t codec, int32_t dts_offset,
+				      uint8_t *header, uint8_t *footer, size_t idx)
+{
+	struct header_output_data data;
+	struct serializer s;
+
+	if (!packet->data || !packet->size)
+		return 0;
+
+	header_output_serializer_init(&s, &data, header);
+	flv_packet_audio_ex_header(&s, packet, codec, dts_offset, AUDIO_PACKETTYPE_FRAMES, idx);
+
+	return finish_header(&data, packet, footer);
+}
+
 void flv_packet_metadata(enum video_id_t codec_id, uint8_t **output, size_t *size, int bits_per_raw_sample,
 			 uint8_t color_primaries, int color_trc, int color_space, int min_luminance, int max_luminance,
 			 size_t idx)
@@ -21,6 +21,11 @@
 
 #define MILLISECOND_DEN 1000
 
+/* Largest tag header written by the flv_*_header functions */
+#define FLV_TAG_HEADER_MAX_SIZE 32
+/* Size of the previous tag size field that ends every tag */
+#define FLV_TAG_FOOTER_SIZE 4
+
 enum audio_id_t {
 	AUDIO_CODEC_NONE = 0,
 	AUDIO_CODEC_AAC = 1,
@@ -77,3 +82,17 @@ extern void flv_packet_audio_start(struct encoder_packet *packet, enum audio_id_
 				   size_t idx);
 extern void flv_packet_audio_frames(struct encoder_packet *packet, enum audio_id_t codec, int32_t dts_offset,
 				    uint8_t **output, size_t *size, size_t idx);
+
+/*
+ * Same as flv_packet_mux, flv_packet_frames and flv_packet_audio_frames, but
+ * only the tag header and footer are written, so packet->data can be sent in
+ * place between them.  header must hold FLV_TAG_HEADER_MAX_SIZE bytes and
+ * footer FLV_TAG_FOOTER_SIZE bytes.  Returns the size of the header, or 0 if
+ * the packet produces no tag.
+ */
+extern size_t flv_packet_mux_header(struct encoder_packet *packet, int32_t dts_offset, uint8_t *header,
+				    uint8_t *footer, bool is_header);
+extern size_t flv_packet_frames_header(struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset,
+				       uint8_t *header, uint8_t *footer, size_t idx);
+extern size_t flv_packet_audio_frames_header(struct encoder_packet *packet, enum audio_id_t codec, int32_t dts_offset,
+					     uint8_t *header, uint8_t *footer, size_t idx);
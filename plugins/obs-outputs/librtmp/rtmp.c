@@ -1576,11 +1576,29 @@ ReadN(RTMP *r, char *buffer, int n)
     return nOriginalSize - n;
 }
 
+static void
+AbortSend(RTMP *r, int sockerr)
+{
+    struct linger l;
+
+    r->last_error_code = sockerr;
+
+    // Force-close the socket. Sometimes a send() error isn't fatal, so
+    // we could end up writing an unpublish message which some services
+    // treat as a clean shutdown. We need to disable lingering too so
+    // the remote side sees an abortive shutdown (RST).
+    l.l_onoff = 1;
+    l.l_linger = 0;
+    setsockopt(r->m_sb.sb_socket, SOL_SOCKET, SO_LINGER, (char *)&l, sizeof(l));
+    RTMPSockBuf_Close(&r->m_sb);
+
+    RTMP_Close(r);
+}
+
 static int
 WriteN(RTMP *r, const char *buffer, int n)
 {
     const char *ptr = buffer;
-    struct linger l;
 
     while (n > 0)
     {
@@ -1603,18 +1621,7 @@ WriteN(RTMP *r, const char *buffer, int n)
             if (sockerr == EINTR && !RTMP_ctrlC)
                 continue;
 
-            r->last_error_code = sockerr;
-
-            // Force-close the socket. Sometimes a send() error isn't fatal, so
-            // we could end up writing an unpublish message which some services
-            // treat as a clean shutdown. We need to disable lingering too so
-            // the remote side sees an abortive shutdown (RST).
-            l.l_onoff = 1;
-            l.l_linger = 0;
-            setsockopt(r->m_sb.sb_socket, SOL_SOCKET, SO_LINGER, (char *)&l, sizeof(l));
-            RTMPSockBuf_Close(&r->m_sb);
-
-            RTMP_Close(r);
+            AbortSend(r, sockerr);
             n = 1;
             break;
         }
@@ -1629,6 +1636,133 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+#define RTMP_IOV_BATCH 64
+#define RTMP_COALESCE_SIZE 16384
+
+/* Sends a scattered buffer.  Plain sockets get the whole vector in one
+ * sendmsg/WSASend call, TLS, HTTP and custom send functions copy the data
+ * anyway, so for those it's coalesced into bounded chunks instead. */
+static int
+WriteNV(RTMP *r, const RTMPIOVec *vec, int count)
+{
+#ifdef _WIN32
+    WSABUF iov[RTMP_IOV_BATCH];
+#else
+    struct iovec iov[RTMP_IOV_BATCH];
+    struct msghdr msg;
+#endif
+    int i, n = 0;
+
+    if (count > RTMP_IOV_BATCH
+            || (r->Link.protocol & RTMP_FEATURE_HTTP)
+            || (r->m_bCustomSend && r->m_customSendFunc)
+#if defined(CRYPTO) && !defined(NO_SSL)
+            || r->m_sb.sb_ssl
+#endif
+       )
+    {
+        char buf[RTMP_COALESCE_SIZE];
+        int len = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            const char *ptr = vec[i].iov_base;
+            int left = vec[i].iov_len;
+
+            while (left > 0)
+            {
+                int num = RTMP_COALESCE_SIZE - len;
+                if (num > left)
+                    num = left;
+                memcpy(buf + len, ptr, num);
+                len += num;
+                ptr += num;
+                left -= num;
+
+                if (len == RTMP_COALESCE_SIZE)
+                {
+                    if (!WriteN(r, buf, len))
+                        return FALSE;
+                    len = 0;
+                }
+            }
+        }
+        return len ? WriteN(r, buf, len) : TRUE;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+#if defined(RTMP_NETSTACK_DUMP)
+        fwrite(vec[i].iov_base, 1, vec[i].iov_len, netstackdump);
+#endif
+#ifdef _WIN32
+        iov[i].buf = (CHAR *)vec[i].iov_base;
+        iov[i].len = (ULONG)vec[i].iov_len;
+#else
+        iov[i].iov_base = (void *)vec[i].iov_base;
+        iov[i].iov_len = (size_t)vec[i].iov_len;
+#endif
+        n += vec[i].iov_len;
+    }
+
+    i = 0;
+    while (n > 0)
+    {
+        int nBytes;
+
+#ifdef _WIN32
+        DWORD sent = 0;
+        nBytes = WSASend(r->m_sb.sb_socket, iov + i, count - i, &sent, 0, NULL, NULL);
+        if (nBytes == 0)
+            nBytes = (int)sent;
+#else
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov + i;
+        msg.msg_iovlen = count - i;
+        nBytes = (int)sendmsg(r->m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d bytes)", __FUNCTION__,
+                     sockerr, n);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            AbortSend(r, sockerr);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        n -= nBytes;
+
+        /* skip what was sent, a partial write can end inside a piece */
+#ifdef _WIN32
+        while (i < count && nBytes >= (int)iov[i].len)
+            nBytes -= (int)iov[i++].len;
+        if (nBytes)
+        {
+            iov[i].buf += nBytes;
+            iov[i].len -= nBytes;
+        }
+#else
+        while (i < count && nBytes >= (int)iov[i].iov_len)
+            nBytes -= (int)iov[i++].iov_len;
+        if (nBytes)
+        {
+            iov[i].iov_base = (char *)iov[i].iov_base + nBytes;
+            iov[i].iov_len -= nBytes;
+        }
+#endif
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -4085,18 +4219,20 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* Picks the chunk header type for the packet, based on the previous packet
+ * sent on the same channel, and encodes the chunk header.  The header is
+ * written right before the packet body, or into hbuf if the packet has no
+ * contiguous body. */
+static int
+EncodeChunkHeader(RTMP *r, RTMPPacket *packet, char *hbuf, char **pheader, int *phSize,
+                  int *pcSize, uint32_t *pt, char *pc)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *header, *hptr, *hend, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4159,7 +4295,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     else
     {
         header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
+        hend = hbuf + RTMP_MAX_HEADER_SIZE;
     }
 
     if (packet->m_nChannel > 319)
@@ -4217,6 +4353,54 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *pheader = header;
+    *phSize = hSize;
+    *pcSize = cSize;
+    *pt = t;
+    *pc = c;
+    return TRUE;
+}
+
+static void
+FinishSendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    /* we invoked a remote method */
+    if (packet->m_packetType == RTMP_PACKET_TYPE_INVOKE && packet->m_body)
+    {
+        AVal method;
+        char *ptr;
+        ptr = packet->m_body + 1;
+        AMF_DecodeString(ptr, &method);
+        RTMP_Log(RTMP_LOGDEBUG, "Invoking %s", method.av_val);
+        /* keep it in call queue till result arrives */
+        if (queue)
+        {
+            int txn;
+            ptr += 3 + method.av_len;
+            txn = (int)AMF_DecodeNumber(ptr);
+            AV_queue(&r->m_methodCalls, &r->m_numCalls, &method, txn);
+        }
+    }
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    uint32_t t;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (!EncodeChunkHeader(r, packet, hbuf, &header, &hSize, &cSize, &t, &c))
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4296,27 +4480,132 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             return FALSE;
     }
 
-    /* we invoked a remote method */
-    if (packet->m_packetType == RTMP_PACKET_TYPE_INVOKE)
+    FinishSendPacket(r, packet, queue);
+    return TRUE;
+}
+
+typedef struct IOVBatch
+{
+    RTMPIOVec vec[RTMP_IOV_BATCH];
+    char cbuf[RTMP_IOV_BATCH][8];
+    int count;
+    int ncbuf;
+} IOVBatch;
+
+static int
+IOVBatch_Flush(RTMP *r, IOVBatch *batch)
+{
+    int ret = batch->count ? WriteNV(r, batch->vec, batch->count) : TRUE;
+    batch->count = 0;
+    batch->ncbuf = 0;
+    return ret;
+}
+
+static int
+IOVBatch_Push(RTMP *r, IOVBatch *batch, const char *base, int len)
+{
+    if (batch->count == RTMP_IOV_BATCH && !IOVBatch_Flush(r, batch))
+        return FALSE;
+    batch->vec[batch->count].iov_base = base;
+    batch->vec[batch->count].iov_len = len;
+    batch->count++;
+    return TRUE;
+}
+
+/* Same as RTMP_SendPacket, but the body is taken from a scattered buffer
+ * instead of packet->m_body.  The chunk headers are interleaved with slices
+ * of the body so the body is never copied. */
+int
+RTMP_SendPacketV(RTMP *r, RTMPPacket *packet, const RTMPIOVec *body, int count)
+{
+    IOVBatch batch;
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    uint32_t t;
+    int nChunkSize;
+    int idx = 0, offset = 0;
+
+    packet->m_body = NULL;
+    if (!EncodeChunkHeader(r, packet, hbuf, &header, &hSize, &cSize, &t, &c))
+        return FALSE;
+
+    nSize = packet->m_nBodySize;
+    nChunkSize = r->m_outChunkSize;
+    batch.count = 0;
+    batch.ncbuf = 0;
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, (int)r->m_sb.sb_socket,
+             nSize);
+
+    if (!IOVBatch_Push(r, &batch, header, hSize))
+        return FALSE;
+
+    while (nSize > 0)
     {
-        AVal method;
-        char *ptr;
-        ptr = packet->m_body + 1;
-        AMF_DecodeString(ptr, &method);
-        RTMP_Log(RTMP_LOGDEBUG, "Invoking %s", method.av_val);
-        /* keep it in call queue till result arrives */
-        if (queue)
+        int left;
+
+        if (nSize < nChunkSize)
+            nChunkSize = nSize;
+
+        /* a chunk can span several pieces of the body */
+        left = nChunkSize;
+        while (left > 0 && idx < count)
         {
-            int txn;
-            ptr += 3 + method.av_len;
-            txn = (int)AMF_DecodeNumber(ptr);
-            AV_queue(&r->m_methodCalls, &r->m_numCalls, &method, txn);
+            int num = body[idx].iov_len - offset;
+            if (num > left)
+                num = left;
+            if (num > 0 && !IOVBatch_Push(r, &batch, body[idx].iov_base + offset, num))
+                return FALSE;
+            left -= num;
+            offset += num;
+            if (offset == body[idx].iov_len)
+            {
+                idx++;
+                offset = 0;
+            }
+        }
+        if (left)
+        {
+            RTMP_Log(RTMP_LOGERROR, "%s, body is shorter than %d bytes", __FUNCTION__,
+                     packet->m_nBodySize);
+            return FALSE;
+        }
+        nSize -= nChunkSize;
+
+        // prepare to send off remaining data in Type 3 chunks
+        if (nSize > 0)
+        {
+            char *cbuf;
+
+            if (batch.count == RTMP_IOV_BATCH && !IOVBatch_Flush(r, &batch))
+                return FALSE;
+
+            cbuf = batch.cbuf[batch.ncbuf++];
+            hSize = 1;
+            cbuf[0] = (0xc0 | c);
+            if (cSize)
+            {
+                int tmp = packet->m_nChannel - 64;
+                cbuf[1] = tmp & 0xff;
+                if (cSize == 2)
+                    cbuf[2] = tmp >> 8;
+                hSize += cSize;
+            }
+            if (t >= 0xffffff)
+            {
+                AMF_EncodeInt32(cbuf + hSize, cbuf + hSize + 4, t);
+                hSize += 4;
+            }
+            if (!IOVBatch_Push(r, &batch, cbuf, hSize))
+                return FALSE;
         }
     }
 
-    if (!r->m_vecChannelsOut[packet->m_nChannel])
-        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
-    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    if (!IOVBatch_Flush(r, &batch))
+        return FALSE;
+
+    FinishSendPacket(r, packet, FALSE);
     return TRUE;
 }
 
@@ -5314,6 +5603,30 @@ fail:
     return total;
 }
 
+/* Fills in the packet type, body size, timestamp and header type from an
+ * 11 byte FLV tag header */
+static void
+ParseFLVTagHeader(RTMPPacket *pkt, const char *buf)
+{
+    pkt->m_packetType = *buf++;
+    pkt->m_nBodySize = AMF_DecodeInt24(buf);
+    buf += 3;
+    pkt->m_nTimeStamp = AMF_DecodeInt24(buf);
+    buf += 3;
+    pkt->m_nTimeStamp |= *buf++ << 24;
+
+    if (((pkt->m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || pkt->m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !pkt->m_nTimeStamp) || pkt->m_packetType == RTMP_PACKET_TYPE_INFO)
+    {
+        pkt->m_headerType = RTMP_PACKET_SIZE_LARGE;
+    }
+    else
+    {
+        pkt->m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+    }
+}
+
 int
 RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
 {
@@ -5340,26 +5653,10 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
                 s2 -= 13;
             }
 
-            pkt->m_packetType = *buf++;
-            pkt->m_nBodySize = AMF_DecodeInt24(buf);
-            buf += 3;
-            pkt->m_nTimeStamp = AMF_DecodeInt24(buf);
-            buf += 3;
-            pkt->m_nTimeStamp |= *buf++ << 24;
-            buf += 3;
+            ParseFLVTagHeader(pkt, buf);
+            buf += 11;
             s2 -= 11;
 
-            if (((pkt->m_packetType == RTMP_PACKET_TYPE_AUDIO
-                    || pkt->m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
-                    !pkt->m_nTimeStamp) || pkt->m_packetType == RTMP_PACKET_TYPE_INFO)
-            {
-                pkt->m_headerType = RTMP_PACKET_SIZE_LARGE;
-            }
-            else
-            {
-                pkt->m_headerType = RTMP_PACKET_SIZE_MEDIUM;
-            }
-
             if (!RTMPPacket_Alloc(pkt, pkt->m_nBodySize))
             {
                 RTMP_Log(RTMP_LOGDEBUG, "%s, failed to allocate packet", __FUNCTION__);
@@ -5393,3 +5690,83 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+static int
+WriteGathered(RTMP *r, const RTMPIOVec *vec, int count, int size, int streamIdx)
+{
+    char *buf, *ptr;
+    int i, ret;
+
+    buf = malloc(size);
+    if (!buf)
+        return FALSE;
+
+    ptr = buf;
+    for (i = 0; i < count; i++)
+    {
+        memcpy(ptr, vec[i].iov_base, vec[i].iov_len);
+        ptr += vec[i].iov_len;
+    }
+
+    ret = RTMP_Write(r, buf, size, streamIdx);
+    free(buf);
+    return ret;
+}
+
+#define RTMP_WRITEV_MAX 16
+
+int
+RTMP_WriteV(RTMP *r, const RTMPIOVec *vec, int count, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    RTMPIOVec body[RTMP_WRITEV_MAX];
+    const char *buf;
+    int size = 0, skip, trim, num = 0;
+    int i;
+
+    if (count < 1)
+        return 0;
+
+    for (i = 0; i < count; i++)
+        size += vec[i].iov_len;
+
+    /* anything that isn't a single complete tag goes the copying way */
+    buf = vec[0].iov_base;
+    if (count > RTMP_WRITEV_MAX || vec[0].iov_len < 11
+            || (buf[0] == 'F' && buf[1] == 'L' && buf[2] == 'V')
+            || r->m_write.m_nBytesRead
+            || (r->Link.protocol & RTMP_FEATURE_HTTP))
+        return WriteGathered(r, vec, count, size, streamIdx);
+
+    ParseFLVTagHeader(&packet, buf);
+    if ((int)packet.m_nBodySize + 11 + 4 != size)
+        return WriteGathered(r, vec, count, size, streamIdx);
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+
+    /* strip the tag header and the trailing previous tag size */
+    skip = 11;
+    trim = (int)packet.m_nBodySize;
+    for (i = 0; i < count && trim > 0; i++)
+    {
+        int len = vec[i].iov_len;
+        if (skip >= len)
+        {
+            skip -= len;
+            continue;
+        }
+
+        body[num].iov_base = vec[i].iov_base + skip;
+        body[num].iov_len = len - skip;
+        if (body[num].iov_len > trim)
+            body[num].iov_len = trim;
+        trim -= body[num].iov_len;
+        skip = 0;
+        num++;
+    }
+
+    if (!RTMP_SendPacketV(r, &packet, body, num))
+        return -1;
+    return size;
+}
@@ -249,6 +249,13 @@ extern "C"
         char c_header[RTMP_MAX_HEADER_SIZE];
     } RTMPChunk;
 
+    /* one piece of a scattered buffer, see RTMP_WriteV */
+    typedef struct RTMPIOVec
+    {
+        const char *iov_base;
+        int iov_len;
+    } RTMPIOVec;
+
     typedef struct RTMPPacket
     {
         uint8_t m_headerType;
@@ -495,6 +502,8 @@ extern "C"
 
     int RTMP_ReadPacket(RTMP *r, RTMPPacket *packet);
     int RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue);
+    int RTMP_SendPacketV(RTMP *r, RTMPPacket *packet, const RTMPIOVec *body,
+                         int count);
     int RTMP_SendChunk(RTMP *r, RTMPChunk *chunk);
     int RTMP_IsConnected(RTMP *r);
     SOCKET RTMP_Socket(RTMP *r);
@@ -543,6 +552,9 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    /* same as RTMP_Write, but the FLV tag is scattered over several buffers
+     * and the body is sent without being copied into a packet first */
+    int RTMP_WriteV(RTMP *r, const RTMPIOVec *vec, int count, int streamIdx);
 
 #ifdef USE_HASHSWF
     /* hashswf.c */
@@ -55,6 +55,7 @@ struct mp4_output {
 
 	struct mp4_mux *muxer;
 	int flags;
+	struct buffered_file_serializer_options file_options;
 
 	int64_t last_dts_usec;
 	DARRAY(struct chapter) chapters;
@@ -212,10 +213,12 @@ static inline void apply_flag(int *flags, const char *value, int flag_value)
 		*flags &= ~flag_value;
 }
 
-static int parse_custom_options(const char *opts_str)
+static int parse_custom_options(const char *opts_str, struct buffered_file_serializer_options *file_options)
 {
 	int flags = MP4_USE_NEGATIVE_CTS;
 
+	memset(file_options, 0, sizeof(*file_options));
+
 	struct obs_options opts = obs_parse_options(opts_str);
 
 	for (size_t i = 0; i < opts.count; i++) {
@@ -229,6 +232,11 @@ static int parse_custom_options(const char *opts_str)
 			apply_flag(&flags, opt.value, MP4_USE_MDTA_KEY_VALUE);
 		} else if (strcmp(opt.name, "use_negative_cts") == 0) {
 			apply_flag(&flags, opt.value, MP4_USE_NEGATIVE_CTS);
+		} else if (strcmp(opt.name, "io_uring") == 0) {
+			/* opt-in for now, falls back to stdio where unsupported */
+			file_options->backend = atoi(opt.value) ? BUFFERED_FILE_IO_URING : BUFFERED_FILE_IO_DEFAULT;
+		} else if (strcmp(opt.name, "io_queue_depth") == 0) {
+			file_options->queue_depth = (uint32_t)atoi(opt.value);
 		} else {
 			blog(LOG_WARNING, "Unknown muxer option: %s = %s", opt.name, opt.value);
 		}
@@ -263,11 +271,11 @@ static bool mp4_output_start(void *data)
 
 	/* Allow skipping the remux step for debugging purposes. */
 	const char *muxer_settings = obs_data_get_string(settings, "muxer_settings");
-	out->flags = parse_custom_options(muxer_settings);
+	out->flags = parse_custom_options(muxer_settings, &out->file_options);
 
 	obs_data_release(settings);
 
-	if (!buffered_file_serializer_init_defaults(&out->serializer, out->path.array)) {
+	if (!buffered_file_serializer_init_with_options(&out->serializer, out->path.array, &out->file_options)) {
 		warn("Unable to open MP4 file '%s'", out->path.array);
 		return false;
 	}
@@ -391,7 +399,7 @@ static bool change_file(struct mp4_output *out, struct encoder_packet *pkt)
 	generate_filename(out, &out->path, out->allow_overwrite);
 	info("Changing output file to '%s'", out->path.array);
 
-	if (!buffered_file_serializer_init_defaults(&out->serializer, out->path.array)) {
+	if (!buffered_file_serializer_init_with_options(&out->serializer, out->path.array, &out->file_options)) {
 		warn("Unable to open MP4 file '%s'", out->path.array);
 		return false;
 	}
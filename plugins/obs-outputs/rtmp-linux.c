@@ -0,0 +1,416 @@
+#ifdef __linux__
+#include "rtmp-stream.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <linux/sockios.h>
+
+/* Only wake up for writing once the kernel has less than this fraction of
+ * the write buffer left unsent, so queued data stays in the write buffer
+ * where it counts towards congestion and frame dropping. */
+#define NOTSENT_LOWAT_DIVISOR 4
+
+#define LATENCY_FACTOR 20
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	stream->write_buf_start = 0;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_atomic_set_long(&stream->socket_unsent, 0);
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+int socket_queue_data_linux(RTMPSockBuf *sb, const char *data, int len, void *arg)
+{
+	UNUSED_PARAMETER(sb);
+
+	struct rtmp_stream *stream = arg;
+	uint64_t one = 1;
+
+	if ((size_t)len > stream->write_buf_size)
+		return 0;
+
+retry_send:
+
+	if (!RTMP_IsConnected(&stream->rtmp))
+		return 0;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (stream->write_buf_len + len > stream->write_buf_size) {
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		if (os_event_wait(stream->buffer_space_available_event)) {
+			return 0;
+		}
+
+		goto retry_send;
+	}
+
+	size_t end = (stream->write_buf_start + stream->write_buf_len) % stream->write_buf_size;
+	size_t first = stream->write_buf_size - end;
+
+	if (first > (size_t)len)
+		first = len;
+
+	memcpy(stream->write_buf + end, data, first);
+	memcpy(stream->write_buf, data + first, len - first);
+	stream->write_buf_len += len;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (write(stream->socket_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		blog(LOG_WARNING, "socket_thread_linux: Failed to signal socket thread, %d", errno);
+
+	return len;
+}
+
+static bool discard_recv_data(struct rtmp_stream *stream)
+{
+	char discard[16384];
+
+	for (;;) {
+		ssize_t ret = recv(stream->rtmp.m_sb.sb_socket, discard, sizeof(discard), 0);
+		if (ret > 0)
+			continue;
+
+		int err_code = ret == 0 ? 0 : errno;
+		if (ret < 0 && (err_code == EAGAIN || err_code == EWOULDBLOCK))
+			return true;
+		if (ret < 0 && err_code == EINTR)
+			continue;
+
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Socket error, recv() returned "
+		     "%zd, errno %d",
+		     ret, err_code);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+}
+
+static bool socket_event(struct rtmp_stream *stream, uint32_t events, bool *can_write, uint64_t last_send_time)
+{
+	if (events & EPOLLIN) {
+		if (!discard_recv_data(stream))
+			return false;
+	}
+
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_ERROR, &err_code, &size);
+
+		if (last_send_time) {
+			uint32_t diff = (uint32_t)(os_gettime_ns() / 1000000 - last_send_time);
+
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Socket closed, %u ms "
+			     "since last send (buffer: %zu / %zu)",
+			     diff, stream->write_buf_len, stream->write_buf_size);
+		}
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due to socket "
+			     "close during shutdown, %zu bytes lost, "
+			     "error %d",
+			     stream->write_buf_len, err_code);
+		else
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due to socket "
+			     "close, error %d",
+			     err_code);
+
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	if (events & EPOLLOUT)
+		*can_write = true;
+
+	return true;
+}
+
+static void update_unsent(struct rtmp_stream *stream)
+{
+	int unsent = 0;
+
+	if (ioctl(stream->rtmp.m_sb.sb_socket, SIOCOUTQNSD, &unsent) == 0)
+		os_atomic_set_long(&stream->socket_unsent, unsent);
+}
+
+enum data_ret { RET_BREAK, RET_FATAL, RET_CONTINUE };
+
+/* the socket is edge-triggered, so the buffer is written until it's empty or
+ * the socket is full, otherwise a small tail would wait for the next packet */
+static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write, uint64_t *last_send_time,
+				size_t latency_packet_size, int delay_time)
+{
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (!stream->write_buf_len) {
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	/* the queued data can wrap around the end of the ring */
+	size_t send_len = stream->write_buf_len;
+	if (send_len > latency_packet_size)
+		send_len = latency_packet_size;
+
+	size_t first = stream->write_buf_size - stream->write_buf_start;
+	if (first > send_len)
+		first = send_len;
+
+	struct iovec iov[2] = {
+		{stream->write_buf + stream->write_buf_start, first},
+		{stream->write_buf, send_len - first},
+	};
+	struct msghdr msg = {0};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = send_len > first ? 2 : 1;
+
+	ssize_t ret = sendmsg(stream->rtmp.m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+
+	if (ret > 0) {
+		stream->write_buf_start = (stream->write_buf_start + ret) % stream->write_buf_size;
+		stream->write_buf_len -= ret;
+		if (!stream->write_buf_len)
+			stream->write_buf_start = 0;
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+		os_event_signal(stream->buffer_space_available_event);
+	} else {
+		int err_code = ret == 0 ? 0 : errno;
+
+		if (ret < 0 && (err_code == EAGAIN || err_code == EWOULDBLOCK)) {
+			*can_write = false;
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+			return RET_BREAK;
+		}
+
+		if (ret < 0 && err_code == EINTR) {
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+			return RET_CONTINUE;
+		}
+
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error. */
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Socket error, send() returned "
+		     "%zd, errno %d",
+		     ret, err_code);
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return RET_CONTINUE;
+}
+
+static void set_notsent_lowat(struct rtmp_stream *stream)
+{
+	int lowat = (int)(stream->write_buf_size / NOTSENT_LOWAT_DIVISOR);
+
+	if (stream->disable_send_window_optimization) {
+		blog(LOG_INFO, "socket_thread_linux: Send window "
+			       "optimization disabled by user.");
+		return;
+	}
+
+	if (setsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) == 0) {
+		stream->socket_notsent_lowat = (size_t)lowat;
+		blog(LOG_INFO, "socket_thread_linux: Unsent data limited to %d bytes", lowat);
+	} else {
+		blog(LOG_WARNING, "socket_thread_linux: Failed to set TCP_NOTSENT_LOWAT, errno %d", errno);
+	}
+}
+
+static inline void socket_thread_linux_internal(struct rtmp_stream *stream, int epoll_fd)
+{
+	bool can_write = false;
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+
+	struct epoll_event ev = {0};
+	struct epoll_event events[2];
+
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.fd = stream->rtmp.m_sb.sb_socket;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream->rtmp.m_sb.sb_socket, &ev) != 0) {
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to epoll_ctl failure, %d", errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->socket_wake_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream->socket_wake_fd, &ev) != 0) {
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to epoll_ctl failure, %d", errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size = stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	for (;;) {
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			if (stream->write_buf_len == 0) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(stream->send_thread_signaled_exit);
+				break;
+			}
+
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+		}
+
+		int count = epoll_wait(epoll_fd, events, 2, -1);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR, "socket_thread_linux: Aborting due to epoll_wait failure, %d", errno);
+			fatal_sock_shutdown(stream);
+			return;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (events[i].data.fd == stream->socket_wake_fd) {
+				uint64_t val;
+				if (read(stream->socket_wake_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+					blog(LOG_WARNING, "socket_thread_linux: Failed to read wake event, %d", errno);
+
+			} else if (!socket_event(stream, events[i].events, &can_write, last_send_time)) {
+				return;
+			}
+		}
+
+		if (can_write) {
+			for (;;) {
+				enum data_ret ret = write_data(stream, &can_write, &last_send_time, latency_packet_size,
+							       delay_time);
+
+				switch (ret) {
+				case RET_BREAK:
+					goto exit_write_loop;
+				case RET_FATAL:
+					return;
+				case RET_CONTINUE:;
+				}
+			}
+		}
+	exit_write_loop:
+		update_unsent(stream);
+	}
+
+	blog(LOG_INFO, "socket_thread_linux: Normal exit");
+}
+
+static void *socket_thread_linux(void *data)
+{
+	struct rtmp_stream *stream = data;
+	int epoll_fd;
+
+	os_set_thread_name("rtmp-stream: socket_thread");
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to epoll_create1 failure, %d", errno);
+		fatal_sock_shutdown(stream);
+		return NULL;
+	}
+
+	socket_thread_linux_internal(stream, epoll_fd);
+
+	close(epoll_fd);
+	return NULL;
+}
+
+bool socket_thread_linux_start(struct rtmp_stream *stream)
+{
+	stream->write_buf_start = 0;
+	stream->write_buf_len = 0;
+	stream->socket_notsent_lowat = 0;
+	os_atomic_set_long(&stream->socket_unsent, 0);
+
+	stream->socket_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (stream->socket_wake_fd == -1) {
+		blog(LOG_ERROR, "socket_thread_linux: Failed to create eventfd, %d", errno);
+		return false;
+	}
+
+	set_notsent_lowat(stream);
+
+	if (pthread_create(&stream->socket_thread, NULL, socket_thread_linux, stream) != 0) {
+		close(stream->socket_wake_fd);
+		stream->socket_wake_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+void socket_thread_linux_stop(struct rtmp_stream *stream)
+{
+	uint64_t one = 1;
+
+	os_event_signal(stream->send_thread_signaled_exit);
+	if (write(stream->socket_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		blog(LOG_WARNING, "socket_thread_linux: Failed to signal socket thread, %d", errno);
+
+	pthread_join(stream->socket_thread, NULL);
+
+	close(stream->socket_wake_fd);
+	stream->socket_wake_fd = -1;
+}
+
+float socket_thread_linux_congestion(struct rtmp_stream *stream)
+{
+	/* data waiting in the write buffer plus data the kernel hasn't put on
+	 * the wire yet.  Without TCP_NOTSENT_LOWAT the kernel queue is only
+	 * limited by the socket buffer, so it isn't counted then. */
+	size_t lowat = stream->socket_notsent_lowat;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	size_t queued = stream->write_buf_len;
+	if (lowat)
+		queued += (size_t)os_atomic_load_long(&stream->socket_unsent);
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	size_t capacity = stream->write_buf_size + lowat;
+	float congestion = capacity ? (float)queued / (float)capacity : 0.0f;
+
+	return congestion > 1.0f ? 1.0f : congestion;
+}
+#endif
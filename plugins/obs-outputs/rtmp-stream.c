@@ -153,6 +153,9 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+#ifdef __linux__
+	stream->socket_wake_fd = -1;
+#endif
 
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
@@ -396,23 +399,43 @@ static int handle_socket_read(struct rtmp_stream *stream)
 	return 0;
 }
 
+/* Sends an FLV tag with the packet data in place between its header and
+ * footer, rather than muxing it into a new buffer first */
+static int send_tag(struct rtmp_stream *stream, const uint8_t *header, size_t header_size,
+		    struct encoder_packet *packet, const uint8_t *footer)
+{
+	RTMPIOVec vec[3] = {
+		{(const char *)header, (int)header_size},
+		{(const char *)packet->data, (int)packet->size},
+		{(const char *)footer, FLV_TAG_FOOTER_SIZE},
+	};
+
+	if (!header_size)
+		return 0;
+
+	return RTMP_WriteV(&stream->rtmp, vec, 3, 0);
+}
+
 static int send_packet(struct rtmp_stream *stream, struct encoder_packet *packet, bool is_header)
 {
-	uint8_t *data;
+	uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+	uint8_t footer[FLV_TAG_FOOTER_SIZE];
+	size_t header_size;
 	size_t size;
 	int ret = 0;
 
 	if (handle_socket_read(stream))
 		return -1;
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset, &data, &size, is_header);
+	header_size =
+		flv_packet_mux_header(packet, is_header ? 0 : stream->start_dts_offset, header, footer, is_header);
+	size = header_size ? header_size + packet->size + FLV_TAG_FOOTER_SIZE : 0;
 
 #ifdef TEST_FRAMEDROPS
 	droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+	ret = send_tag(stream, header, header_size, packet, footer);
 
 	if (is_header)
 		bfree(packet->data);
@@ -433,25 +456,35 @@ static int send_packet_ex(struct rtmp_stream *stream, struct encoder_packet *pac
 	if (handle_socket_read(stream))
 		return -1;
 
-	if (is_header) {
-		flv_packet_start(packet, stream->video_codec[idx], &data, &size, idx);
-	} else if (is_footer) {
-		flv_packet_end(packet, stream->video_codec[idx], &data, &size, idx);
-	} else {
-		flv_packet_frames(packet, stream->video_codec[idx], stream->start_dts_offset, &data, &size, idx);
-	}
+	if (is_header || is_footer) {
+		if (is_header)
+			flv_packet_start(packet, stream->video_codec[idx], &data, &size, idx);
+		else
+			flv_packet_end(packet, stream->video_codec[idx], &data, &size, idx);
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+		ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
+		bfree(data);
 
-	if (is_header || is_footer) // manually created packets
+		// manually created packets
 		bfree(packet->data);
-	else
+	} else {
+		uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+		uint8_t footer[FLV_TAG_FOOTER_SIZE];
+		size_t header_size = flv_packet_frames_header(packet, stream->video_codec[idx],
+							      stream->start_dts_offset, header, footer, idx);
+		size = header_size + packet->size + FLV_TAG_FOOTER_SIZE;
+
+#ifdef TEST_FRAMEDROPS
+		droptest_cap_data_rate(stream, size);
+#endif
+
+		ret = send_tag(stream, header, header_size, packet, footer);
 		obs_encoder_packet_release(packet);
+	}
 
 	stream->total_bytes_sent += size;
 	return ret;
@@ -459,26 +492,28 @@ static int send_packet_ex(struct rtmp_stream *stream, struct encoder_packet *pac
 
 static int send_audio_packet_ex(struct rtmp_stream *stream, struct encoder_packet *packet, bool is_header, size_t idx)
 {
-	uint8_t *data;
-	size_t size = 0;
 	int ret = 0;
 
 	if (handle_socket_read(stream))
 		return -1;
 
 	if (is_header) {
+		uint8_t *data;
+		size_t size = 0;
+
 		flv_packet_audio_start(packet, stream->audio_codec[idx], &data, &size, idx);
+		ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
+		bfree(data);
+		bfree(packet->data);
 	} else {
-		flv_packet_audio_frames(packet, stream->audio_codec[idx], stream->start_dts_offset, &data, &size, idx);
-	}
+		uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+		uint8_t footer[FLV_TAG_FOOTER_SIZE];
+		size_t header_size = flv_packet_audio_frames_header(packet, stream->audio_codec[idx],
+								    stream->start_dts_offset, header, footer, idx);
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
-
-	if (is_header)
-		bfree(packet->data);
-	else
+		ret = send_tag(stream, header, header_size, packet, footer);
 		obs_encoder_packet_release(packet);
+	}
 
 	return ret;
 }
@@ -708,9 +743,13 @@ static void *send_thread(void *data)
 #endif
 
 	if (stream->new_socket_loop) {
+#ifdef __linux__
+		socket_thread_linux_stop(stream);
+#else
 		os_event_signal(stream->send_thread_signaled_exit);
 		os_event_signal(stream->buffer_has_data_event);
 		pthread_join(stream->socket_thread, NULL);
+#endif
 		stream->socket_thread_active = false;
 		stream->rtmp.m_bCustomSend = false;
 	}
@@ -1054,10 +1093,7 @@ static int init_send(struct rtmp_stream *stream)
 		stream->write_buf_size = ideal_buffer_size;
 		stream->write_buf = bmalloc(ideal_buffer_size);
 
-#ifndef _WIN32
-		warn("New socket loop not supported on this platform");
-		return OBS_OUTPUT_ERROR;
-#else
+#ifdef _WIN32
 		ret = pthread_create(&stream->socket_thread, NULL, socket_thread_windows, stream);
 
 		if (ret != 0) {
@@ -1070,6 +1106,20 @@ static int init_send(struct rtmp_stream *stream)
 		stream->rtmp.m_bCustomSend = true;
 		stream->rtmp.m_customSendFunc = socket_queue_data;
 		stream->rtmp.m_customSendParam = stream;
+#elif defined(__linux__)
+		if (!socket_thread_linux_start(stream)) {
+			RTMP_Close(&stream->rtmp);
+			warn("Failed to create socket thread");
+			return OBS_OUTPUT_ERROR;
+		}
+
+		stream->socket_thread_active = true;
+		stream->rtmp.m_bCustomSend = true;
+		stream->rtmp.m_customSendFunc = socket_queue_data_linux;
+		stream->rtmp.m_customSendParam = stream;
+#else
+		warn("New socket loop not supported on this platform");
+		return OBS_OUTPUT_ERROR;
 #endif
 	}
 
@@ -1333,7 +1383,7 @@ static bool init_connect(struct rtmp_stream *stream)
 		stream->addrlen_hint = len;
 	}
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(__linux__)
 	stream->new_socket_loop = obs_data_get_bool(settings, OPT_NEWSOCKETLOOP_ENABLED);
 	stream->low_latency_mode = obs_data_get_bool(settings, OPT_LOWLATENCY_ENABLED);
 
@@ -1717,7 +1767,7 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 900);
 	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 30);
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
-#ifdef _WIN32
+#if defined(_WIN32) || defined(__linux__)
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
 #endif
@@ -1754,7 +1804,7 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 	}
 	netif_saddr_data_free(&addrs);
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(__linux__)
 	obs_properties_add_bool(props, OPT_NEWSOCKETLOOP_ENABLED, obs_module_text("RTMPStream.NewSocketLoop"));
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED, obs_module_text("RTMPStream.LowLatencyMode"));
 #endif
@@ -1779,7 +1829,11 @@ static float rtmp_stream_congestion(void *data)
 	struct rtmp_stream *stream = data;
 
 	if (stream->new_socket_loop)
+#ifdef __linux__
+		return socket_thread_linux_congestion(stream);
+#else
 		return (float)stream->write_buf_len / (float)stream->write_buf_size;
+#endif
 	else
 		return stream->min_priority > 0 ? 1.0f : stream->congestion;
 }
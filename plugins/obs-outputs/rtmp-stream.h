@@ -126,15 +126,27 @@ struct rtmp_stream {
 	uint8_t *write_buf;
 	size_t write_buf_len;
 	size_t write_buf_size;
+	size_t write_buf_start; /* read position, the Linux loop uses write_buf as a ring */
 	pthread_mutex_t write_buf_mutex;
 	os_event_t *buffer_space_available_event;
 	os_event_t *buffer_has_data_event;
 	os_event_t *socket_available_event;
 	os_event_t *send_thread_signaled_exit;
+
+#ifdef __linux__
+	int socket_wake_fd;
+	size_t socket_notsent_lowat;
+	volatile long socket_unsent;
+#endif
 };
 
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#elif defined(__linux__)
+bool socket_thread_linux_start(struct rtmp_stream *stream);
+void socket_thread_linux_stop(struct rtmp_stream *stream);
+int socket_queue_data_linux(RTMPSockBuf *sb, const char *data, int len, void *arg);
+float socket_thread_linux_congestion(struct rtmp_stream *stream);
 #endif
 
 /* Adapted from FFmpeg's libavutil/pixfmt.h
@@ -17,6 +17,9 @@
 #include <media-io/audio-io.h>
 #include <util/platform.h>
 
+#include <sys/stat.h>
+#include <inttypes.h>
+
 #include "media-playback.h"
 #include "cache.h"
 #include "media.h"
@@ -27,13 +30,768 @@ extern bool mp_media_eof(mp_media_t *m);
 extern void mp_media_next_video(mp_media_t *m, bool preload);
 extern void mp_media_next_audio(mp_media_t *m);
 extern bool mp_media_reset(mp_media_t *m);
+extern void mp_media_seek_to(mp_media_t *m, int64_t pos);
 
 static bool mp_cache_reset(mp_cache_t *c);
 
 static int64_t base_sys_ts = 0;
 
-#define v_eof(c) (c->cur_v_idx == c->video_frames.num)
-#define a_eof(c) (c->cur_a_idx == c->audio_segments.num)
+/* ------------------------------------------------------------------------- */
+/* Decoded files are shared by every cache of the same file with the same
+ * decode options, each cache only keeps its own playback position. */
+
+struct mp_cache_key {
+	char *path;
+	char *format_name;
+	char *ffmpeg_options;
+	bool hardware_decoding;
+	enum video_range_type force_range;
+	int speed;
+	size_t max_size;
+
+	/* a file changed on disk is decoded again */
+	int64_t mtime;
+	int64_t size;
+};
+
+struct mp_cache_data {
+	struct mp_cache_key key;
+	long refs;
+
+	mp_media_t m;
+	volatile bool decode_started;
+	os_event_t *decoded;
+	bool success;
+
+	bool has_video;
+	bool has_audio;
+	int64_t start_time;
+	int64_t media_duration;
+
+	DARRAY(struct obs_source_frame) video_frames;
+	DARRAY(struct obs_source_audio) audio_segments;
+
+	int64_t final_v_duration;
+	int64_t final_a_duration;
+
+	/* over the size limit only the first video frame is kept, the others
+	 * are decoded ahead of playback again */
+	bool budgeted;
+	size_t frames_size;
+	size_t frame_size;
+	uint8_t *file_data;
+	size_t file_size;
+
+	/* memory taken by the rings of all caches decoding ahead, protected
+	 * by cached_files_mutex */
+	size_t ring_bytes;
+};
+
+static pthread_mutex_t cached_files_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct mp_cache_data *) cached_files;
+
+static void init_key(struct mp_cache_key *key, const struct mp_media_info *info)
+{
+	struct stat st;
+
+	memset(key, 0, sizeof(*key));
+	key->path = (char *)info->path;
+	key->format_name = (char *)info->format;
+	key->ffmpeg_options = (char *)info->ffmpeg_options;
+	key->hardware_decoding = info->hardware_decoding;
+	key->force_range = info->force_range;
+	key->speed = info->speed < 1 || info->speed > 200 ? 100 : info->speed;
+	key->max_size = info->full_decode_max_size;
+
+	if (info->path && os_stat(info->path, &st) == 0) {
+		key->mtime = (int64_t)st.st_mtime;
+		key->size = (int64_t)st.st_size;
+	}
+}
+
+static inline bool str_equal(const char *a, const char *b)
+{
+	return (a && b) ? strcmp(a, b) == 0 : a == b;
+}
+
+static bool key_equal(const struct mp_cache_key *a, const struct mp_cache_key *b)
+{
+	return str_equal(a->path, b->path) && str_equal(a->format_name, b->format_name) &&
+	       str_equal(a->ffmpeg_options, b->ffmpeg_options) && a->hardware_decoding == b->hardware_decoding &&
+	       a->force_range == b->force_range && a->speed == b->speed && a->max_size == b->max_size &&
+	       a->mtime == b->mtime && a->size == b->size;
+}
+
+static size_t get_frame_size(const struct obs_source_frame *frame)
+{
+	size_t size = 0;
+
+	/* subsampled planes are counted at full height, which errs on the
+	 * side of budgeting */
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (frame->data[i])
+			size += (size_t)frame->linesize[i] * frame->height;
+	}
+
+	return size;
+}
+
+static void drop_frame_data(struct mp_cache_data *data)
+{
+	for (size_t i = 1; i < data->video_frames.num; i++) {
+		struct obs_source_frame *f = &data->video_frames.array[i];
+		bfree(f->data[0]);
+		memset(f->data, 0, sizeof(f->data));
+	}
+
+	data->budgeted = true;
+}
+
+static void fill_video(void *opaque, struct obs_source_frame *frame)
+{
+	struct mp_cache_data *data = opaque;
+	struct obs_source_frame dup;
+
+	data->final_v_duration = data->m.v.last_duration;
+
+	/* only the timestamps are needed to play the frame back */
+	if (data->budgeted) {
+		dup = *frame;
+		memset(dup.data, 0, sizeof(dup.data));
+		da_push_back(data->video_frames, &dup);
+		return;
+	}
+
+	obs_source_frame_init(&dup, frame->format, frame->width, frame->height);
+	obs_source_frame_copy(&dup, frame);
+
+	dup.timestamp = frame->timestamp;
+
+	da_push_back(data->video_frames, &dup);
+
+	size_t size = get_frame_size(&dup);
+	if (size > data->frame_size)
+		data->frame_size = size;
+
+	data->frames_size += size;
+	if (data->key.max_size && data->frames_size > data->key.max_size)
+		drop_frame_data(data);
+}
+
+static void fill_audio(void *opaque, struct obs_source_audio *audio)
+{
+	struct mp_cache_data *data = opaque;
+	struct obs_source_audio dup = *audio;
+
+	size_t size = get_total_audio_size(dup.format, dup.speakers, dup.frames);
+	dup.data[0] = bmalloc(size);
+
+	size_t planes = get_audio_planes(dup.format, dup.speakers);
+	if (planes > 1) {
+		size = get_audio_bytes_per_channel(dup.format) * dup.frames;
+		uint8_t *out = (uint8_t *)dup.data[0];
+
+		for (size_t i = 0; i < planes; i++) {
+			if (i > 0)
+				dup.data[i] = out;
+
+			memcpy(out, audio->data[i], size);
+			out += size;
+		}
+	} else {
+		memcpy((uint8_t *)dup.data[0], audio->data[0], size);
+	}
+
+	data->final_a_duration = data->m.a.last_duration;
+
+	da_push_back(data->audio_segments, &dup);
+}
+
+static void cache_data_destroy(struct mp_cache_data *data)
+{
+	if (data->m.fmt)
+		mp_media_free(&data->m);
+
+	for (size_t i = 0; i < data->video_frames.num; i++) {
+		struct obs_source_frame *f = &data->video_frames.array[i];
+		obs_source_frame_free(f);
+	}
+	for (size_t i = 0; i < data->audio_segments.num; i++) {
+		struct obs_source_audio *a = &data->audio_segments.array[i];
+		bfree((void *)a->data[0]);
+	}
+	da_free(data->video_frames);
+	da_free(data->audio_segments);
+
+	os_event_destroy(data->decoded);
+	bfree(data->file_data);
+	bfree(data->key.path);
+	bfree(data->key.format_name);
+	bfree(data->key.ffmpeg_options);
+	bfree(data);
+}
+
+/* opens the file, decoding happens later on the thread of the first cache
+ * that needs the frames */
+static struct mp_cache_data *cache_data_create(const struct mp_cache_key *key, const struct mp_media_info *info)
+{
+	struct mp_cache_data *data = bzalloc(sizeof(*data));
+	struct mp_media_info info2 = *info;
+
+	info2.opaque = data;
+	info2.v_cb = fill_video;
+	info2.a_cb = fill_audio;
+	info2.v_preload_cb = NULL;
+	info2.v_seek_cb = NULL;
+	info2.stop_cb = NULL;
+	info2.full_decode = true;
+
+	data->key = *key;
+	data->key.path = bstrdup(key->path);
+	data->key.format_name = bstrdup(key->format_name);
+	data->key.ffmpeg_options = bstrdup(key->ffmpeg_options);
+	data->refs = 1;
+
+	if (os_event_init(&data->decoded, OS_EVENT_TYPE_MANUAL) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init event");
+		goto fail;
+	}
+
+	mp_media_t *m = &data->m;
+
+	if (!mp_media_init(m, &info2))
+		goto fail;
+	if (!mp_media_init2(m))
+		goto fail;
+
+	data->media_duration = m->fmt->duration;
+	data->has_video = m->has_video;
+	data->has_audio = m->has_audio;
+	return data;
+
+fail:
+	cache_data_destroy(data);
+	return NULL;
+}
+
+static struct mp_cache_data *find_cache_data(const struct mp_cache_key *key)
+{
+	for (size_t i = 0; i < cached_files.num; i++) {
+		struct mp_cache_data *data = cached_files.array[i];
+
+		if (key_equal(&data->key, key)) {
+			data->refs++;
+			return data;
+		}
+	}
+
+	return NULL;
+}
+
+static struct mp_cache_data *cache_data_get(const struct mp_media_info *info)
+{
+	struct mp_cache_data *data;
+	struct mp_cache_data *existing;
+	struct mp_cache_key key;
+
+	init_key(&key, info);
+
+	pthread_mutex_lock(&cached_files_mutex);
+	data = find_cache_data(&key);
+	pthread_mutex_unlock(&cached_files_mutex);
+
+	if (data) {
+		blog(LOG_DEBUG, "MP: Sharing decoded frames of '%s'", info->path);
+		return data;
+	}
+
+	data = cache_data_create(&key, info);
+	if (!data)
+		return NULL;
+
+	/* somebody else may have opened the same file in the meantime */
+	pthread_mutex_lock(&cached_files_mutex);
+	existing = find_cache_data(&key);
+	if (!existing)
+		da_push_back(cached_files, &data);
+	pthread_mutex_unlock(&cached_files_mutex);
+
+	if (existing) {
+		cache_data_destroy(data);
+		data = existing;
+	}
+
+	return data;
+}
+
+static void cache_data_release(struct mp_cache_data *data)
+{
+	bool destroy;
+
+	if (!data)
+		return;
+
+	pthread_mutex_lock(&cached_files_mutex);
+	destroy = --data->refs == 0;
+	if (destroy)
+		da_erase_item(cached_files, &data);
+	pthread_mutex_unlock(&cached_files_mutex);
+
+	if (destroy)
+		cache_data_destroy(data);
+}
+
+/* the compressed file is kept in memory if it fits in the limit, otherwise
+ * it's read from disk again while decoding ahead */
+static void cache_data_load_file(struct mp_cache_data *data)
+{
+	FILE *file = os_fopen(data->key.path, "rb");
+	int64_t size;
+
+	if (!file)
+		return;
+
+	size = os_fgetsize(file);
+	if (size > 0 && (uint64_t)size < data->key.max_size) {
+		data->file_data = bmalloc((size_t)size);
+
+		if (fread(data->file_data, 1, (size_t)size, file) == (size_t)size) {
+			data->file_size = (size_t)size;
+		} else {
+			bfree(data->file_data);
+			data->file_data = NULL;
+		}
+	}
+
+	fclose(file);
+}
+
+static bool cache_data_decode(struct mp_cache_data *data)
+{
+	mp_media_t *m = &data->m;
+	bool success = false;
+
+	m->full_decode = true;
+
+	mp_media_reset(m);
+
+	while (!mp_media_eof(m)) {
+		if (m->has_video)
+			mp_media_next_video(m, false);
+		if (m->has_audio)
+			mp_media_next_audio(m);
+
+		if (!mp_media_prepare_frames(m))
+			goto fail;
+	}
+
+	success = true;
+
+	data->start_time = m->fmt->start_time;
+	if (data->start_time == AV_NOPTS_VALUE)
+		data->start_time = 0;
+
+	if (data->budgeted) {
+		cache_data_load_file(data);
+
+		blog(LOG_INFO,
+		     "MP: Decoded video of '%s' exceeds %zu MB, decoding it "
+		     "ahead of playback from %s",
+		     data->key.path, data->key.max_size / (1024 * 1024), data->file_data ? "memory" : "disk");
+	}
+
+fail:
+	mp_media_free(m);
+	return success;
+}
+
+/* decodes the file if nobody has started to yet, otherwise waits for it */
+static bool cache_data_wait(struct mp_cache_data *data)
+{
+	if (!os_atomic_exchange_bool(&data->decode_started, true)) {
+		data->success = cache_data_decode(data);
+
+		/* let the next cache of this file try again */
+		if (!data->success) {
+			pthread_mutex_lock(&cached_files_mutex);
+			da_erase_item(cached_files, &data);
+			pthread_mutex_unlock(&cached_files_mutex);
+		}
+
+		os_event_signal(data->decoded);
+	} else {
+		os_event_wait(data->decoded);
+	}
+
+	return data->success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Budgeted files only keep the timestamps of their video frames, the ahead
+ * thread decodes the frames just ahead of playback into a small ring, going
+ * back to the start at the end of the file so looping doesn't stall. Frames
+ * are identified by a sequence number that restarts on every seek.
+ *
+ * Caches of the same file usually play at different positions, so each one
+ * decodes ahead on its own, but their rings share whatever the compressed
+ * file leaves of the size limit. */
+
+#define RING_MIN_FRAMES 4
+#define RING_MAX_FRAMES 60
+#define RING_MAX_WAIT_NS 50000000ULL
+#define AHEAD_IO_BUFFER_SIZE 65536
+
+static int ahead_io_read(void *opaque, uint8_t *buf, int buf_size)
+{
+	mp_cache_t *c = opaque;
+	struct mp_cache_data *data = c->data;
+	size_t size = data->file_size - c->ahead_io_pos;
+
+	if (!size)
+		return AVERROR_EOF;
+	if (size > (size_t)buf_size)
+		size = (size_t)buf_size;
+
+	memcpy(buf, data->file_data + c->ahead_io_pos, size);
+	c->ahead_io_pos += size;
+	return (int)size;
+}
+
+static int64_t ahead_io_seek(void *opaque, int64_t offset, int whence)
+{
+	mp_cache_t *c = opaque;
+	int64_t size = (int64_t)c->data->file_size;
+	int64_t pos;
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case AVSEEK_SIZE:
+		return size;
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = (int64_t)c->ahead_io_pos + offset;
+		break;
+	case SEEK_END:
+		pos = size + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (pos < 0 || pos > size)
+		return AVERROR(EINVAL);
+
+	c->ahead_io_pos = (size_t)pos;
+	return pos;
+}
+
+static void ahead_fill(void *opaque, struct obs_source_frame *frame)
+{
+	mp_cache_t *c = opaque;
+	struct obs_source_frame *frames = c->data->video_frames.array;
+	size_t num = c->data->video_frames.num;
+	size_t idx = c->ahead_target;
+	struct mp_cache_slot *slot = NULL;
+
+	/* frames before the seek position, or past the last one until eof */
+	if (idx >= num || frame->timestamp < frames[idx].timestamp)
+		return;
+
+	while (idx + 1 < num && frames[idx + 1].timestamp <= frame->timestamp)
+		idx++;
+
+	uint64_t seq = c->ahead_seq + (idx - c->ahead_target);
+	c->ahead_target = idx + 1;
+	c->ahead_seq = seq + 1;
+
+	/* the first frame is always kept */
+	if (idx == 0)
+		return;
+
+	pthread_mutex_lock(&c->ring_mutex);
+	if (c->ring_gen == c->ahead_gen && c->ring_count < c->ring_size)
+		slot = &c->ring[(c->ring_head + c->ring_count) % c->ring_size];
+	pthread_mutex_unlock(&c->ring_mutex);
+
+	if (!slot)
+		return;
+
+	/* the slot past the end of the ring is only touched by this thread */
+	struct obs_source_frame *dst = &slot->frame;
+	if (dst->format != frame->format || dst->width != frame->width || dst->height != frame->height) {
+		obs_source_frame_free(dst);
+		obs_source_frame_init(dst, frame->format, frame->width, frame->height);
+	}
+
+	obs_source_frame_copy(dst, frame);
+	dst->timestamp = frame->timestamp;
+	slot->seq = seq;
+
+	pthread_mutex_lock(&c->ring_mutex);
+	if (c->ring_gen == c->ahead_gen)
+		c->ring_count++;
+	pthread_mutex_unlock(&c->ring_mutex);
+
+	os_event_signal(c->ring_event);
+}
+
+static void ahead_seek(mp_cache_t *c, uint64_t gen, size_t idx)
+{
+	struct obs_source_frame *frame = &c->data->video_frames.array[idx];
+	int64_t pos = (int64_t)frame->timestamp * c->data->key.speed / 100 / 1000;
+
+	c->ahead_gen = gen;
+	c->ahead_target = idx;
+	c->ahead_seq = 0;
+
+	mp_media_seek_to(&c->ahead, pos);
+	c->ahead.eof = false;
+}
+
+static void *mp_cache_ahead_thread(void *opaque)
+{
+	mp_cache_t *c = opaque;
+	mp_media_t *m = &c->ahead;
+	uint64_t gen = 0;
+
+	os_set_thread_name("mp_cache_ahead");
+
+	for (;;) {
+		uint64_t ring_gen;
+		size_t start_idx;
+		bool kill, full;
+
+		pthread_mutex_lock(&c->ring_mutex);
+		kill = c->ring_kill;
+		ring_gen = c->ring_gen;
+		start_idx = c->ring_start_idx;
+		full = c->ring_count == c->ring_size;
+		pthread_mutex_unlock(&c->ring_mutex);
+
+		if (kill)
+			break;
+
+		if (ring_gen != gen) {
+			gen = ring_gen;
+			ahead_seek(c, gen, start_idx);
+			if (!mp_media_prepare_frames(m))
+				goto fail;
+			continue;
+		}
+
+		if (full) {
+			os_sem_wait(c->ring_sem);
+			continue;
+		}
+
+		mp_media_next_video(m, false);
+
+		if (!mp_media_prepare_frames(m))
+			goto fail;
+
+		/* mp_media_eof() goes back to the start of the file */
+		if (mp_media_eof(m)) {
+			c->ahead_seq += c->data->video_frames.num - c->ahead_target;
+			c->ahead_target = 0;
+		}
+	}
+
+	return NULL;
+
+fail:
+	blog(LOG_WARNING, "MP: Failed to decode ahead of playback: '%s'", c->data->key.path);
+	return NULL;
+}
+
+static bool mp_cache_ahead_init(mp_cache_t *c)
+{
+	struct mp_cache_data *data = c->data;
+	struct mp_media_info info = {
+		.opaque = c,
+		.v_cb = ahead_fill,
+		.path = data->key.path,
+		.format = data->key.format_name,
+		.ffmpeg_options = data->key.ffmpeg_options,
+		.speed = data->key.speed,
+		.force_range = data->key.force_range,
+		.hardware_decoding = data->key.hardware_decoding,
+		.is_local_file = true,
+		.full_decode = true,
+	};
+	mp_media_t *m = &c->ahead;
+
+	/* a ring gets at least a few frames, even once the limit is used up */
+	pthread_mutex_lock(&cached_files_mutex);
+	size_t used = data->file_size + data->ring_bytes;
+	size_t budget = data->key.max_size > used ? data->key.max_size - used : 0;
+	size_t frames = data->frame_size ? budget / data->frame_size : RING_MIN_FRAMES;
+	if (frames < RING_MIN_FRAMES)
+		frames = RING_MIN_FRAMES;
+	if (frames > RING_MAX_FRAMES)
+		frames = RING_MAX_FRAMES;
+
+	c->ring_bytes = frames * data->frame_size;
+	data->ring_bytes += c->ring_bytes;
+	pthread_mutex_unlock(&cached_files_mutex);
+
+	c->ring = bzalloc(sizeof(*c->ring) * frames);
+	c->ring_size = frames;
+	c->ring_gen = 1;
+
+	if (pthread_mutex_init(&c->ring_mutex, NULL) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init ring mutex");
+		return false;
+	}
+	if (os_sem_init(&c->ring_sem, 0) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init ring semaphore");
+		return false;
+	}
+	if (os_event_init(&c->ring_event, OS_EVENT_TYPE_AUTO) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init ring event");
+		return false;
+	}
+
+	if (!mp_media_init(m, &info))
+		return false;
+
+	c->budgeted = true;
+	m->looping = true;
+
+	if (data->file_data) {
+		uint8_t *buf = av_malloc(AHEAD_IO_BUFFER_SIZE);
+		c->ahead_io = avio_alloc_context(buf, AHEAD_IO_BUFFER_SIZE, 0, c, ahead_io_read, NULL, ahead_io_seek);
+		if (!c->ahead_io) {
+			av_free(buf);
+			return false;
+		}
+
+		m->custom_io = c->ahead_io;
+	}
+
+	if (!mp_media_init2(m))
+		return false;
+
+	/* audio is always kept fully decoded */
+	if (m->has_audio) {
+		mp_decode_free(&m->a);
+		m->has_audio = false;
+	}
+	if (!m->has_video)
+		return false;
+
+	if (pthread_create(&c->ahead_thread, NULL, mp_cache_ahead_thread, c) != 0) {
+		blog(LOG_WARNING, "MP: Could not create ahead thread");
+		return false;
+	}
+
+	c->ahead_thread_valid = true;
+	return true;
+}
+
+static void mp_cache_ahead_free(mp_cache_t *c)
+{
+	if (c->ahead_thread_valid) {
+		pthread_mutex_lock(&c->ring_mutex);
+		c->ring_kill = true;
+		pthread_mutex_unlock(&c->ring_mutex);
+		os_sem_post(c->ring_sem);
+
+		pthread_join(c->ahead_thread, NULL);
+	}
+
+	if (c->budgeted) {
+		blog(LOG_INFO, "MP: Decoded ahead of '%s' with %zu frames: %" PRIu64 " hits, %" PRIu64 " misses",
+		     c->data->key.path, c->ring_size, c->hits, c->misses);
+		mp_media_free(&c->ahead);
+	}
+
+	if (c->ahead_io) {
+		av_freep(&c->ahead_io->buffer);
+		avio_context_free(&c->ahead_io);
+	}
+
+	for (size_t i = 0; i < c->ring_size; i++)
+		obs_source_frame_free(&c->ring[i].frame);
+	bfree(c->ring);
+
+	if (c->ring_bytes) {
+		pthread_mutex_lock(&cached_files_mutex);
+		c->data->ring_bytes -= c->ring_bytes;
+		pthread_mutex_unlock(&cached_files_mutex);
+	}
+
+	pthread_mutex_destroy(&c->ring_mutex);
+	os_sem_destroy(c->ring_sem);
+	os_event_destroy(c->ring_event);
+}
+
+/* waits up to a frame for the ahead thread if it isn't there yet, frames
+ * it decoded too late are dropped */
+static struct mp_cache_slot *ring_front(mp_cache_t *c, uint64_t wait_ns)
+{
+	uint64_t deadline = os_gettime_ns() + wait_ns;
+	struct mp_cache_slot *slot = NULL;
+	bool dropped = false;
+
+	pthread_mutex_lock(&c->ring_mutex);
+
+	for (;;) {
+		while (c->ring_count && c->ring[c->ring_head].seq < c->play_seq) {
+			c->ring_head = (c->ring_head + 1) % c->ring_size;
+			c->ring_count--;
+			dropped = true;
+		}
+
+		if (c->ring_count) {
+			if (c->ring[c->ring_head].seq == c->play_seq)
+				slot = &c->ring[c->ring_head];
+			break;
+		}
+
+		uint64_t t = os_gettime_ns();
+		if (t >= deadline)
+			break;
+
+		pthread_mutex_unlock(&c->ring_mutex);
+		os_event_timedwait(c->ring_event, (unsigned long)((deadline - t + 999999) / 1000000));
+		pthread_mutex_lock(&c->ring_mutex);
+	}
+
+	pthread_mutex_unlock(&c->ring_mutex);
+
+	if (dropped)
+		os_sem_post(c->ring_sem);
+	return slot;
+}
+
+static void ring_pop(mp_cache_t *c)
+{
+	pthread_mutex_lock(&c->ring_mutex);
+	c->ring_head = (c->ring_head + 1) % c->ring_size;
+	c->ring_count--;
+	pthread_mutex_unlock(&c->ring_mutex);
+
+	os_sem_post(c->ring_sem);
+}
+
+static void ring_restart(mp_cache_t *c, size_t idx)
+{
+	pthread_mutex_lock(&c->ring_mutex);
+	c->ring_gen++;
+	c->ring_start_idx = idx;
+	c->ring_count = 0;
+	pthread_mutex_unlock(&c->ring_mutex);
+
+	c->play_seq = 0;
+	os_sem_post(c->ring_sem);
+}
+
+/* ------------------------------------------------------------------------- */
+
+
+#define v_eof(c) (c->cur_v_idx == c->data->video_frames.num)
+#define a_eof(c) (c->cur_a_idx == c->data->audio_segments.num)
 
 static inline int64_t mp_cache_get_next_min_pts(mp_cache_t *c)
 {
@@ -110,36 +868,6 @@ static bool mp_cache_eof(mp_cache_t *c)
 	return true;
 }
 
-bool mp_cache_decode(mp_cache_t *c)
-{
-	mp_media_t *m = &c->m;
-	bool success = false;
-
-	m->full_decode = true;
-
-	mp_media_reset(m);
-
-	while (!mp_media_eof(m)) {
-		if (m->has_video)
-			mp_media_next_video(m, false);
-		if (m->has_audio)
-			mp_media_next_audio(m);
-
-		if (!mp_media_prepare_frames(m))
-			goto fail;
-	}
-
-	success = true;
-
-	c->start_time = c->m.fmt->start_time;
-	if (c->start_time == AV_NOPTS_VALUE)
-		c->start_time = 0;
-
-fail:
-	mp_media_free(m);
-	return success;
-}
-
 static void seek_to(mp_cache_t *c, int64_t pos)
 {
 	size_t new_v_idx = 0;
@@ -153,8 +881,8 @@ static void seek_to(mp_cache_t *c, int64_t pos)
 	if (c->has_video) {
 		struct obs_source_frame *v;
 
-		for (size_t i = 0; i < c->video_frames.num; i++) {
-			v = &c->video_frames.array[i];
+		for (size_t i = 0; i < c->data->video_frames.num; i++) {
+			v = &c->data->video_frames.array[i];
 			new_v_idx = i;
 			if ((int64_t)v->timestamp >= pos) {
 				break;
@@ -162,17 +890,17 @@ static void seek_to(mp_cache_t *c, int64_t pos)
 		}
 
 		size_t next_idx = new_v_idx + 1;
-		if (next_idx == c->video_frames.num) {
-			c->next_v_ts = (int64_t)v->timestamp + c->final_v_duration;
+		if (next_idx == c->data->video_frames.num) {
+			c->next_v_ts = (int64_t)v->timestamp + c->data->final_v_duration;
 		} else {
-			struct obs_source_frame *next = &c->video_frames.array[next_idx];
+			struct obs_source_frame *next = &c->data->video_frames.array[next_idx];
 			c->next_v_ts = (int64_t)next->timestamp;
 		}
 	}
 	if (c->has_audio) {
 		struct obs_source_audio *a;
-		for (size_t i = 0; i < c->audio_segments.num; i++) {
-			a = &c->audio_segments.array[i];
+		for (size_t i = 0; i < c->data->audio_segments.num; i++) {
+			a = &c->data->audio_segments.array[i];
 			new_a_idx = i;
 			if ((int64_t)a->timestamp >= pos) {
 				break;
@@ -180,10 +908,10 @@ static void seek_to(mp_cache_t *c, int64_t pos)
 		}
 
 		size_t next_idx = new_a_idx + 1;
-		if (next_idx == c->audio_segments.num) {
-			c->next_a_ts = (int64_t)a->timestamp + c->final_a_duration;
+		if (next_idx == c->data->audio_segments.num) {
+			c->next_a_ts = (int64_t)a->timestamp + c->data->final_a_duration;
 		} else {
-			struct obs_source_audio *next = &c->audio_segments.array[next_idx];
+			struct obs_source_audio *next = &c->data->audio_segments.array[next_idx];
 			c->next_a_ts = (int64_t)next->timestamp;
 		}
 	}
@@ -208,11 +936,11 @@ static inline bool mp_media_can_play_audio(mp_cache_t *c)
 static inline void calc_next_v_ts(mp_cache_t *c, struct obs_source_frame *frame)
 {
 	int64_t offset;
-	if (c->next_v_idx < c->video_frames.num) {
-		struct obs_source_frame *next = &c->video_frames.array[c->next_v_idx];
+	if (c->next_v_idx < c->data->video_frames.num) {
+		struct obs_source_frame *next = &c->data->video_frames.array[c->next_v_idx];
 		offset = (int64_t)(next->timestamp - frame->timestamp);
 	} else {
-		offset = c->final_v_duration;
+		offset = c->data->final_v_duration;
 	}
 
 	c->next_v_ts += offset;
@@ -221,42 +949,82 @@ static inline void calc_next_v_ts(mp_cache_t *c, struct obs_source_frame *frame)
 static inline void calc_next_a_ts(mp_cache_t *c, struct obs_source_audio *audio)
 {
 	int64_t offset;
-	if (c->next_a_idx < c->audio_segments.num) {
-		struct obs_source_audio *next = &c->audio_segments.array[c->next_a_idx];
+	if (c->next_a_idx < c->data->audio_segments.num) {
+		struct obs_source_audio *next = &c->data->audio_segments.array[c->next_a_idx];
 		offset = (int64_t)(next->timestamp - audio->timestamp);
 	} else {
-		offset = c->final_a_duration;
+		offset = c->data->final_a_duration;
 	}
 
 	c->next_a_ts += offset;
 }
 
+/* the frames are shared, so per-source settings are applied to the copy */
+static inline void set_frame_flags(mp_cache_t *c, struct obs_source_frame *frame)
+{
+	frame->flags &= ~OBS_SOURCE_FRAME_LINEAR_ALPHA;
+	if (c->is_linear_alpha)
+		frame->flags |= OBS_SOURCE_FRAME_LINEAR_ALPHA;
+}
+
+static void mp_cache_output_ahead(mp_cache_t *c, struct obs_source_frame *frame)
+{
+	struct obs_source_frame *frames = c->data->video_frames.array;
+	size_t next_idx = c->next_v_idx + 1;
+	uint64_t wait_ns = next_idx < c->data->video_frames.num ? frames[next_idx].timestamp - frame->timestamp
+								  : (uint64_t)c->data->final_v_duration;
+	if (wait_ns > RING_MAX_WAIT_NS)
+		wait_ns = RING_MAX_WAIT_NS;
+
+	struct mp_cache_slot *slot = ring_front(c, wait_ns);
+	if (!slot) {
+		c->misses++;
+		return;
+	}
+
+	c->hits++;
+
+	if (c->v_cb) {
+		struct obs_source_frame dup = slot->frame;
+
+		dup.timestamp = c->base_ts + dup.timestamp - c->start_ts + c->play_sys_ts - base_sys_ts;
+		set_frame_flags(c, &dup);
+		c->v_cb(c->opaque, &dup);
+	}
+
+	ring_pop(c);
+}
+
 static void mp_cache_next_video(mp_cache_t *c, bool preload)
 {
 	/* eof check */
-	if (c->next_v_idx == c->video_frames.num) {
+	if (c->next_v_idx == c->data->video_frames.num) {
 		if (mp_media_can_play_video(c))
 			c->cur_v_idx = c->next_v_idx;
 		return;
 	}
 
-	struct obs_source_frame *frame = &c->video_frames.array[c->next_v_idx];
+	struct obs_source_frame *frame = &c->data->video_frames.array[c->next_v_idx];
 	struct obs_source_frame dup = *frame;
 
 	dup.timestamp = c->base_ts + dup.timestamp - c->start_ts + c->play_sys_ts - base_sys_ts;
+	set_frame_flags(c, &dup);
 
 	if (!preload) {
 		if (!mp_media_can_play_video(c))
 			return;
 
-		if (c->v_cb)
+		if (c->budgeted && c->next_v_idx)
+			mp_cache_output_ahead(c, frame);
+		else if (c->v_cb)
 			c->v_cb(c->opaque, &dup);
 
 		if (c->cur_v_idx < c->next_v_idx)
 			++c->cur_v_idx;
 		++c->next_v_idx;
+		++c->play_seq;
 		calc_next_v_ts(c, frame);
-	} else {
+	} else if (!c->budgeted || !c->next_v_idx) {
 		if (c->seek_next_ts && c->v_seek_cb) {
 			c->v_seek_cb(c->opaque, &dup);
 		} else if (!c->request_preload) {
@@ -268,7 +1036,7 @@ static void mp_cache_next_video(mp_cache_t *c, bool preload)
 static void mp_cache_next_audio(mp_cache_t *c)
 {
 	/* eof check */
-	if (c->next_a_idx == c->audio_segments.num) {
+	if (c->next_a_idx == c->data->audio_segments.num) {
 		if (mp_media_can_play_audio(c))
 			c->cur_a_idx = c->next_a_idx;
 		return;
@@ -277,7 +1045,7 @@ static void mp_cache_next_audio(mp_cache_t *c)
 	if (!mp_media_can_play_audio(c))
 		return;
 
-	struct obs_source_audio *audio = &c->audio_segments.array[c->next_a_idx];
+	struct obs_source_audio *audio = &c->data->audio_segments.array[c->next_a_idx];
 	struct obs_source_audio dup = *audio;
 
 	dup.timestamp = c->base_ts + dup.timestamp - c->start_ts + c->play_sys_ts - base_sys_ts;
@@ -299,6 +1067,10 @@ static bool mp_cache_reset(mp_cache_t *c)
 	int64_t offset = next_ts - c->next_pts_ns;
 	int64_t start_time = c->start_time;
 
+	/* the ahead thread already continues from the start after the end */
+	if (c->budgeted && c->next_v_idx != c->data->video_frames.num)
+		ring_restart(c, 0);
+
 	c->eof = false;
 	c->base_ts += next_ts;
 	c->seek_next_ts = false;
@@ -312,14 +1084,14 @@ static bool mp_cache_reset(mp_cache_t *c)
 	pthread_mutex_unlock(&c->mutex);
 
 	if (c->has_video) {
-		size_t next_idx = c->video_frames.num > 1 ? 1 : 0;
+		size_t next_idx = c->data->video_frames.num > 1 ? 1 : 0;
 		c->cur_v_idx = c->next_v_idx = 0;
-		c->next_v_ts = c->video_frames.array[next_idx].timestamp;
+		c->next_v_ts = c->data->video_frames.array[next_idx].timestamp;
 	}
 	if (c->has_audio) {
-		size_t next_idx = c->audio_segments.num > 1 ? 1 : 0;
+		size_t next_idx = c->data->audio_segments.num > 1 ? 1 : 0;
 		c->cur_a_idx = c->next_a_idx = 0;
-		c->next_a_ts = c->audio_segments.array[next_idx].timestamp;
+		c->next_a_ts = c->data->audio_segments.array[next_idx].timestamp;
 	}
 
 	if (active) {
@@ -369,10 +1141,15 @@ static inline bool mp_cache_thread(mp_cache_t *c)
 {
 	os_set_thread_name("mp_cache_thread");
 
-	if (!mp_cache_decode(c)) {
+	if (!cache_data_wait(c->data)) {
+		return false;
+	}
+	if (c->data->budgeted && !mp_cache_ahead_init(c)) {
 		return false;
 	}
 
+	c->start_time = c->data->start_time;
+
 	for (;;) {
 		bool reset, kill, is_active, seek, pause, reset_time, preload_frame;
 		int64_t seek_pos;
@@ -421,6 +1198,8 @@ static inline bool mp_cache_thread(mp_cache_t *c)
 		if (seek) {
 			c->seek_next_ts = true;
 			seek_to(c, seek_pos);
+			if (c->budgeted)
+				ring_restart(c, c->next_v_idx);
 			continue;
 		}
 
@@ -432,8 +1211,11 @@ static inline bool mp_cache_thread(mp_cache_t *c)
 		if (pause)
 			continue;
 
-		if (preload_frame)
-			c->v_preload_cb(c->opaque, &c->video_frames.array[0]);
+		if (preload_frame) {
+			struct obs_source_frame dup = c->data->video_frames.array[0];
+			set_frame_flags(c, &dup);
+			c->v_preload_cb(c->opaque, &dup);
+		}
 
 		/* frames are ready */
 		if (is_active && !timeout) {
@@ -465,51 +1247,7 @@ static void *mp_cache_thread_start(void *opaque)
 	return NULL;
 }
 
-static void fill_video(void *data, struct obs_source_frame *frame)
-{
-	mp_cache_t *c = data;
-	struct obs_source_frame dup;
-
-	obs_source_frame_init(&dup, frame->format, frame->width, frame->height);
-	obs_source_frame_copy(&dup, frame);
-
-	dup.timestamp = frame->timestamp;
-
-	c->final_v_duration = c->m.v.last_duration;
-
-	da_push_back(c->video_frames, &dup);
-}
-
-static void fill_audio(void *data, struct obs_source_audio *audio)
-{
-	mp_cache_t *c = data;
-	struct obs_source_audio dup = *audio;
-
-	size_t size = get_total_audio_size(dup.format, dup.speakers, dup.frames);
-	dup.data[0] = bmalloc(size);
-
-	size_t planes = get_audio_planes(dup.format, dup.speakers);
-	if (planes > 1) {
-		size = get_audio_bytes_per_channel(dup.format) * dup.frames;
-		uint8_t *out = (uint8_t *)dup.data[0];
-
-		for (size_t i = 0; i < planes; i++) {
-			if (i > 0)
-				dup.data[i] = out;
-
-			memcpy(out, audio->data[i], size);
-			out += size;
-		}
-	} else {
-		memcpy((uint8_t *)dup.data[0], audio->data[0], size);
-	}
-
-	c->final_a_duration = c->m.a.last_duration;
-
-	da_push_back(c->audio_segments, &dup);
-}
-
-static inline bool mp_cache_init_internal(mp_cache_t *c, const struct mp_media_info *info)
+static inline bool mp_cache_init_internal(mp_cache_t *c)
 {
 	if (pthread_mutex_init(&c->mutex, NULL) != 0) {
 		blog(LOG_WARNING, "MP: Failed to init mutex");
@@ -520,9 +1258,6 @@ static inline bool mp_cache_init_internal(mp_cache_t *c, const struct mp_media_i
 		return false;
 	}
 
-	c->path = info->path ? bstrdup(info->path) : NULL;
-	c->format_name = info->format ? bstrdup(info->format) : NULL;
-
 	if (pthread_create(&c->thread, NULL, mp_cache_thread_start, c) != 0) {
 		blog(LOG_WARNING, "MP: Could not create media thread");
 		return false;
@@ -534,25 +1269,11 @@ static inline bool mp_cache_init_internal(mp_cache_t *c, const struct mp_media_i
 
 bool mp_cache_init(mp_cache_t *c, const struct mp_media_info *info)
 {
-	struct mp_media_info info2 = *info;
-
-	info2.opaque = c;
-	info2.v_cb = fill_video;
-	info2.a_cb = fill_audio;
-	info2.v_preload_cb = NULL;
-	info2.v_seek_cb = NULL;
-	info2.stop_cb = NULL;
-	info2.full_decode = true;
-
-	mp_media_t *m = &c->m;
-
 	pthread_mutex_init_value(&c->mutex);
+	pthread_mutex_init_value(&c->ring_mutex);
 
-	if (!mp_media_init(m, &info2)) {
-		mp_cache_free(c);
-		return false;
-	}
-	if (!mp_media_init2(m)) {
+	c->data = cache_data_get(info);
+	if (!c->data) {
 		mp_cache_free(c);
 		return false;
 	}
@@ -561,20 +1282,20 @@ bool mp_cache_init(mp_cache_t *c, const struct mp_media_info *info)
 	c->v_cb = info->v_cb;
 	c->a_cb = info->a_cb;
 	c->stop_cb = info->stop_cb;
-	c->ffmpeg_options = info->ffmpeg_options;
 	c->v_seek_cb = info->v_seek_cb;
 	c->v_preload_cb = info->v_preload_cb;
 	c->request_preload = info->request_preload;
+	c->is_linear_alpha = info->is_linear_alpha;
 	c->speed = info->speed;
-	c->media_duration = m->fmt->duration;
+	c->media_duration = c->data->media_duration;
 
-	c->has_video = m->has_video;
-	c->has_audio = m->has_audio;
+	c->has_video = c->data->has_video;
+	c->has_audio = c->data->has_audio;
 
 	if (!base_sys_ts)
 		base_sys_ts = (int64_t)os_gettime_ns();
 
-	if (!mp_cache_init_internal(c, info)) {
+	if (!mp_cache_init_internal(c)) {
 		mp_cache_free(c);
 		return false;
 	}
@@ -601,23 +1322,10 @@ void mp_cache_free(mp_cache_t *c)
 
 	mp_cache_stop(c);
 	mp_kill_thread(c);
+	mp_cache_ahead_free(c);
 
-	if (c->m.fmt)
-		mp_media_free(&c->m);
-
-	for (size_t i = 0; i < c->video_frames.num; i++) {
-		struct obs_source_frame *f = &c->video_frames.array[i];
-		obs_source_frame_free(f);
-	}
-	for (size_t i = 0; i < c->audio_segments.num; i++) {
-		struct obs_source_audio *a = &c->audio_segments.array[i];
-		bfree((void *)a->data[0]);
-	}
-	da_free(c->video_frames);
-	da_free(c->audio_segments);
+	cache_data_release(c->data);
 
-	bfree(c->path);
-	bfree(c->format_name);
 	pthread_mutex_destroy(&c->mutex);
 	os_sem_destroy(c->sem);
 	memset(c, 0, sizeof(*c));
@@ -692,7 +1400,7 @@ void mp_cache_seek(mp_cache_t *c, int64_t pos)
 
 int64_t mp_cache_get_frames(mp_cache_t *c)
 {
-	return c->video_frames.num;
+	return c->data->video_frames.num;
 }
 
 int64_t mp_cache_get_duration(mp_cache_t *c)
@@ -22,6 +22,13 @@
 
 #include "media.h"
 
+struct mp_cache_data;
+
+struct mp_cache_slot {
+	struct obs_source_frame frame;
+	uint64_t seq;
+};
+
 struct mp_cache {
 	mp_video_cb v_preload_cb;
 	mp_video_cb v_seek_cb;
@@ -32,11 +39,8 @@ struct mp_cache {
 	bool request_preload;
 	bool has_video;
 	bool has_audio;
+	bool is_linear_alpha;
 
-	char *path;
-	char *format_name;
-	char *ffmpeg_options;
-	int buffering;
 	int speed;
 
 	pthread_mutex_t mutex;
@@ -51,8 +55,37 @@ struct mp_cache {
 	bool thread_valid;
 	pthread_t thread;
 
-	DARRAY(struct obs_source_frame) video_frames;
-	DARRAY(struct obs_source_audio) audio_segments;
+	/* decoded frames, shared with other caches of the same file */
+	struct mp_cache_data *data;
+
+	/* when the decoded video doesn't fit in memory, video frames are
+	 * decoded ahead of playback into a ring by the ahead thread */
+	bool budgeted;
+	mp_media_t ahead;
+	AVIOContext *ahead_io;
+	size_t ahead_io_pos;
+	size_t ahead_target;
+	uint64_t ahead_seq;
+	uint64_t ahead_gen;
+
+	pthread_mutex_t ring_mutex;
+	os_sem_t *ring_sem;
+	os_event_t *ring_event;
+	struct mp_cache_slot *ring;
+	size_t ring_size;
+	size_t ring_bytes;
+	size_t ring_head;
+	size_t ring_count;
+	uint64_t ring_gen;
+	size_t ring_start_idx;
+	bool ring_kill;
+
+	bool ahead_thread_valid;
+	pthread_t ahead_thread;
+
+	uint64_t play_seq;
+	uint64_t hits;
+	uint64_t misses;
 
 	size_t cur_v_idx;
 	size_t cur_a_idx;
@@ -61,9 +94,6 @@ struct mp_cache {
 	int64_t next_v_ts;
 	int64_t next_a_ts;
 
-	int64_t final_v_duration;
-	int64_t final_a_duration;
-
 	int64_t play_sys_ts;
 	int64_t next_pts_ns;
 	uint64_t next_ns;
@@ -78,8 +108,6 @@ struct mp_cache {
 	int64_t seek_pos;
 	int64_t start_time;
 	int64_t media_duration;
-
-	mp_media_t m;
 };
 
 typedef struct mp_cache mp_cache_t;
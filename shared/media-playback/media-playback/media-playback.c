@@ -96,7 +96,7 @@ void media_playback_set_looping(media_playback_t *mp, bool looping)
 void media_playback_set_is_linear_alpha(media_playback_t *mp, bool is_linear_alpha)
 {
 	if (mp->is_cached)
-		mp->cache.m.is_linear_alpha = is_linear_alpha;
+		mp->cache.is_linear_alpha = is_linear_alpha;
 	else
 		mp->media.is_linear_alpha = is_linear_alpha;
 }
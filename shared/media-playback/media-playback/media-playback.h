@@ -46,6 +46,10 @@ struct mp_media_info {
 	bool reconnecting;
 	bool request_preload;
 	bool full_decode;
+
+	/* with full_decode, keeps only frames ahead of playback decoded once
+	 * the decoded video would take more memory than this, 0 for no limit */
+	size_t full_decode_max_size;
 };
 
 extern media_playback_t *media_playback_create(const struct mp_media_info *info);
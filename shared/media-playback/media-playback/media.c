@@ -543,6 +543,11 @@ static void seek_to(mp_media_t *m, int64_t pos)
 		mp_decode_flush(&m->a);
 }
 
+void mp_media_seek_to(mp_media_t *m, int64_t pos)
+{
+	seek_to(m, pos);
+}
+
 bool mp_media_reset(mp_media_t *m)
 {
 	bool stopping;
@@ -678,6 +683,8 @@ static bool init_avformat(mp_media_t *m)
 	}
 
 	m->fmt = avformat_alloc_context();
+	if (m->custom_io)
+		m->fmt->pb = m->custom_io;
 	if (m->buffering == 0) {
 		m->fmt->flags |= AVFMT_FLAG_NOBUFFER;
 	}
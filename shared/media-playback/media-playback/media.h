@@ -41,6 +41,9 @@ extern "C" {
 struct mp_media {
 	AVFormatContext *fmt;
 
+	/* optional, read from this instead of opening the path */
+	AVIOContext *custom_io;
+
 	mp_video_cb v_preload_cb;
 	mp_video_cb v_seek_cb;
 	mp_stop_cb stop_cb;
@@ -30,6 +30,14 @@ struct obs_script {
 	struct dstr path;
 	struct dstr file;
 	struct dstr desc;
+
+	/* script_tick time budget, only used on the tick thread */
+	const char *tick_profile_name;
+	float tick_seconds;
+	uint64_t tick_start;
+	uint32_t tick_skip;
+	uint64_t tick_overruns;
+	uint64_t tick_throttled;
 };
 
 struct script_callback;
@@ -37,6 +45,18 @@ typedef void (*defer_call_cb)(void *param);
 
 extern void defer_call_post(defer_call_cb call, void *cb);
 
+/* Script ticks and timers run on the scripting tick thread instead of the
+ * graphics thread, once per frame or less often if it falls behind */
+typedef void (*script_tick_cb)(void *param, float seconds);
+
+extern void script_tick_add(script_tick_cb tick, void *param);
+extern void script_tick_remove(script_tick_cb tick, void *param);
+
+/* Returns false while the script is throttled for going over its budget,
+ * otherwise seconds is set to the time since its last script_tick */
+extern bool script_tick_begin(obs_script_t *script, float *seconds);
+extern void script_tick_end(obs_script_t *script);
+
 extern void script_log(obs_script_t *script, int level, const char *format, ...);
 extern void script_log_va(obs_script_t *script, int level, const char *format, va_list args);
 
@@ -378,7 +378,7 @@ static void obs_lua_tick_callback(void *priv, float seconds)
 	lua_State *script = cb->script;
 
 	if (script_callback_removed(&cb->base)) {
-		obs_remove_tick_callback(obs_lua_tick_callback, cb);
+		script_tick_remove(obs_lua_tick_callback, cb);
 		return;
 	}
 
@@ -403,7 +403,7 @@ static int obs_lua_remove_tick_callback(lua_State *script)
 
 static void defer_add_tick(void *cb)
 {
-	obs_add_tick_callback(obs_lua_tick_callback, cb);
+	script_tick_add(obs_lua_tick_callback, cb);
 }
 
 static int obs_lua_add_tick_callback(lua_State *script)
@@ -418,6 +418,34 @@ static int obs_lua_add_tick_callback(lua_State *script)
 
 /* -------------------------------------------- */
 
+static void obs_lua_graphics_task(void *priv)
+{
+	struct lua_obs_callback *cb = priv;
+	lua_State *script = cb->script;
+
+	if (script_callback_removed(&cb->base))
+		return;
+
+	lock_callback();
+
+	call_func(obs_lua_graphics_task, 0, 0);
+	remove_lua_obs_callback(cb);
+
+	unlock_callback();
+}
+
+static int obs_lua_queue_graphics_task(lua_State *script)
+{
+	if (!verify_args1(script, is_function))
+		return 0;
+
+	struct lua_obs_callback *cb = add_lua_obs_callback(script, 1);
+	obs_queue_task(OBS_TASK_GRAPHICS, obs_lua_graphics_task, cb, false);
+	return 0;
+}
+
+/* -------------------------------------------- */
+
 static void calldata_signal_callback(void *priv, calldata_t *cd)
 {
 	struct lua_obs_callback *cb = priv;
@@ -1020,6 +1048,7 @@ static void add_hook_functions(lua_State *script)
 	add_func("obs_remove_main_render_callback", obs_lua_remove_main_render_callback);
 	add_func("obs_add_tick_callback", obs_lua_add_tick_callback);
 	add_func("obs_remove_tick_callback", obs_lua_remove_tick_callback);
+	add_func("obs_queue_graphics_task", obs_lua_queue_graphics_task);
 	add_func("signal_handler_connect", obs_lua_signal_handler_connect);
 	add_func("signal_handler_disconnect", obs_lua_signal_handler_disconnect);
 	add_func("signal_handler_connect_global", obs_lua_signal_handler_connect_global);
@@ -1053,8 +1082,12 @@ static void lua_tick(void *param, float seconds)
 
 		pthread_mutex_lock(&data->mutex);
 
-		lua_pushnumber(script, (double)seconds);
-		call_func_(script, data->tick, 1, 0, "tick", __FUNCTION__);
+		float tick_seconds = seconds;
+		if (script_tick_begin(&data->base, &tick_seconds)) {
+			lua_pushnumber(script, (double)tick_seconds);
+			call_func_(script, data->tick, 1, 0, "tick", __FUNCTION__);
+			script_tick_end(&data->base);
+		}
 
 		pthread_mutex_unlock(&data->mutex);
 
@@ -1364,12 +1397,12 @@ void obs_lua_load(void)
 	dstr_free(&package_cpath);
 	startup_script = tmp.array;
 
-	obs_add_tick_callback(lua_tick, NULL);
+	script_tick_add(lua_tick, NULL);
 }
 
 void obs_lua_unload(void)
 {
-	obs_remove_tick_callback(lua_tick, NULL);
+	script_tick_remove(lua_tick, NULL);
 
 	bfree(startup_script);
 	pthread_mutex_destroy(&tick_mutex);
@@ -465,7 +465,7 @@ static void obs_python_tick_callback(void *priv, float seconds)
 	struct python_obs_callback *cb = priv;
 
 	if (script_callback_removed(&cb->base)) {
-		obs_remove_tick_callback(obs_python_tick_callback, cb);
+		script_tick_remove(obs_python_tick_callback, cb);
 		return;
 	}
 
@@ -521,7 +521,48 @@ static PyObject *obs_python_add_tick_callback(PyObject *self, PyObject *args)
 		return python_none();
 
 	struct python_obs_callback *cb = add_python_obs_callback(script, py_cb);
-	obs_add_tick_callback(obs_python_tick_callback, cb);
+	script_tick_add(obs_python_tick_callback, cb);
+	return python_none();
+}
+
+/* -------------------------------------------- */
+
+static void obs_python_graphics_task(void *priv)
+{
+	struct python_obs_callback *cb = priv;
+
+	if (script_callback_removed(&cb->base))
+		return;
+
+	lock_callback(cb);
+
+	PyObject *py_ret = PyObject_CallObject(cb->func, NULL);
+	py_error();
+	Py_XDECREF(py_ret);
+	remove_python_obs_callback(cb);
+
+	unlock_callback();
+}
+
+static PyObject *obs_python_queue_graphics_task(PyObject *self, PyObject *args)
+{
+	struct obs_python_script *script = cur_python_script;
+	PyObject *py_cb = NULL;
+
+	if (!script) {
+		PyErr_SetString(PyExc_RuntimeError, "No active script, report this to Lain");
+		return NULL;
+	}
+
+	UNUSED_PARAMETER(self);
+
+	if (!parse_args(args, "O", &py_cb))
+		return python_none();
+	if (!py_cb || !PyFunction_Check(py_cb))
+		return python_none();
+
+	struct python_obs_callback *cb = add_python_obs_callback(script, py_cb);
+	obs_queue_task(OBS_TASK_GRAPHICS, obs_python_graphics_task, cb, false);
 	return python_none();
 }
 
@@ -1211,6 +1252,7 @@ static void add_hook_functions(PyObject *module)
 		DEF_FUNC("obs_sceneitem_group_enum_items", sceneitem_group_enum_items),
 		DEF_FUNC("obs_remove_tick_callback", obs_python_remove_tick_callback),
 		DEF_FUNC("obs_add_tick_callback", obs_python_add_tick_callback),
+		DEF_FUNC("obs_queue_graphics_task", obs_python_queue_graphics_task),
 		DEF_FUNC("signal_handler_disconnect", obs_python_signal_handler_disconnect),
 		DEF_FUNC("signal_handler_connect", obs_python_signal_handler_connect),
 		DEF_FUNC("signal_handler_disconnect_global", obs_python_signal_handler_disconnect_global),
@@ -1496,8 +1538,6 @@ static void python_tick(void *param, float seconds)
 	if (valid) {
 		lock_python();
 
-		PyObject *args = Py_BuildValue("(f)", seconds);
-
 		pthread_mutex_lock(&tick_mutex);
 		data = first_tick_script;
 
@@ -1505,11 +1545,17 @@ static void python_tick(void *param, float seconds)
 			busy_script = cur_python_script;
 
 		while (data) {
+			float tick_seconds = seconds;
 			cur_python_script = data;
 
-			PyObject *py_ret = PyObject_CallObject(data->tick, args);
-			Py_XDECREF(py_ret);
-			py_error();
+			if (script_tick_begin(&data->base, &tick_seconds)) {
+				PyObject *args = Py_BuildValue("(f)", tick_seconds);
+				PyObject *py_ret = PyObject_CallObject(data->tick, args);
+				Py_XDECREF(py_ret);
+				Py_XDECREF(args);
+				py_error();
+				script_tick_end(&data->base);
+			}
 
 			data = data->next_tick;
 		}
@@ -1522,8 +1568,6 @@ static void python_tick(void *param, float seconds)
 
 		pthread_mutex_unlock(&tick_mutex);
 
-		Py_XDECREF(args);
-
 		unlock_python();
 	}
 
@@ -1732,13 +1776,15 @@ out:
 	python_loaded_at_all = success;
 
 	if (python_loaded)
-		obs_add_tick_callback(python_tick, NULL);
+		script_tick_add(python_tick, NULL);
 
 	return python_loaded;
 }
 
 void obs_python_unload(void)
 {
+	script_tick_remove(python_tick, NULL);
+
 	if (mutexes_loaded) {
 		pthread_mutex_destroy(&tick_mutex);
 		pthread_mutex_destroy(&timer_mutex);
@@ -1756,8 +1802,6 @@ void obs_python_unload(void)
 
 	/* ---------------------- */
 
-	obs_remove_tick_callback(python_tick, NULL);
-
 	for (size_t i = 0; i < python_paths.num; i++)
 		bfree(python_paths.array[i]);
 	da_free(python_paths);
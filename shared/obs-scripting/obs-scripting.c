@@ -15,11 +15,14 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <inttypes.h>
 #include <obs.h>
 #include <util/dstr.h>
 #include <util/platform.h>
 #include <util/threading.h>
 #include <util/deque.h>
+#include <util/darray.h>
+#include <util/profiler.h>
 
 #include "obs-scripting-internal.h"
 #include "obs-scripting-callback.h"
@@ -117,6 +120,206 @@ void defer_call_post(defer_call_cb call, void *cb)
 
 /* -------------------------------------------- */
 
+/* a script_tick that takes longer than this fraction of the frame interval
+ * is skipped for as many frames as it went over */
+#define TICK_BUDGET_DIVISOR 4
+#define TICK_MAX_SKIP 30
+
+struct script_tick_callback {
+	script_tick_cb tick;
+	void *param;
+};
+
+static pthread_mutex_t tick_mutex;
+static DARRAY(struct script_tick_callback) tick_callbacks;
+
+static pthread_mutex_t tick_data_mutex;
+static float tick_seconds = 0.0f;
+static bool tick_pending = false;
+static uint64_t tick_frames_missed = 0;
+
+static bool tick_exit = false;
+static os_event_t *tick_event;
+static pthread_t tick_thread;
+
+static const char *script_tick_thread_name = "scripting_tick";
+
+static void *tick_thread_func(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	os_set_thread_name("scripting: tick");
+
+	profile_register_root(script_tick_thread_name, obs_get_frame_interval_ns());
+
+	while (os_event_wait(tick_event) == 0) {
+		float seconds;
+
+		pthread_mutex_lock(&tick_data_mutex);
+		if (tick_exit) {
+			pthread_mutex_unlock(&tick_data_mutex);
+			break;
+		}
+
+		seconds = tick_seconds;
+		tick_seconds = 0.0f;
+		tick_pending = false;
+		pthread_mutex_unlock(&tick_data_mutex);
+
+		profile_start(script_tick_thread_name);
+
+		pthread_mutex_lock(&tick_mutex);
+		for (size_t i = tick_callbacks.num; i > 0; i--) {
+			struct script_tick_callback *cb = tick_callbacks.array + (i - 1);
+			cb->tick(cb->param, seconds);
+		}
+		pthread_mutex_unlock(&tick_mutex);
+
+		profile_end(script_tick_thread_name);
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+/* only hands the tick over, the graphics thread never waits for scripts */
+static void scripting_tick(void *param, float seconds)
+{
+	pthread_mutex_lock(&tick_data_mutex);
+	if (tick_pending)
+		tick_frames_missed++;
+	tick_seconds += seconds;
+	tick_pending = true;
+	pthread_mutex_unlock(&tick_data_mutex);
+
+	os_event_signal(tick_event);
+
+	UNUSED_PARAMETER(param);
+}
+
+void script_tick_add(script_tick_cb tick, void *param)
+{
+	struct script_tick_callback data = {tick, param};
+
+	pthread_mutex_lock(&tick_mutex);
+	da_insert(tick_callbacks, 0, &data);
+	pthread_mutex_unlock(&tick_mutex);
+}
+
+void script_tick_remove(script_tick_cb tick, void *param)
+{
+	struct script_tick_callback data = {tick, param};
+
+	pthread_mutex_lock(&tick_mutex);
+	da_erase_item(tick_callbacks, &data);
+	pthread_mutex_unlock(&tick_mutex);
+}
+
+bool script_tick_begin(obs_script_t *script, float *seconds)
+{
+	script->tick_seconds += *seconds;
+
+	if (script->tick_skip) {
+		script->tick_skip--;
+		script->tick_throttled++;
+		return false;
+	}
+
+	if (!script->tick_profile_name)
+		script->tick_profile_name =
+			profile_store_name(obs_get_profiler_name_store(), "script_tick(%s)", script->file.array);
+
+	*seconds = script->tick_seconds;
+	script->tick_seconds = 0.0f;
+
+	profile_start(script->tick_profile_name);
+	script->tick_start = os_gettime_ns();
+	return true;
+}
+
+void script_tick_end(obs_script_t *script)
+{
+	uint64_t elapsed = os_gettime_ns() - script->tick_start;
+	uint64_t budget = obs_get_frame_interval_ns() / TICK_BUDGET_DIVISOR;
+
+	profile_end(script->tick_profile_name);
+
+	if (!budget || elapsed <= budget)
+		return;
+
+	uint64_t skip = elapsed / budget;
+	script->tick_skip = (uint32_t)(skip < TICK_MAX_SKIP ? skip : TICK_MAX_SKIP);
+
+	if (script->tick_overruns++ == 0)
+		script_warn(script,
+			    "script_tick took %.2f ms, which is over its budget of %.2f ms. "
+			    "It will be called less often while it is too slow.",
+			    (double)elapsed / 1000000.0, (double)budget / 1000000.0);
+}
+
+static inline void script_tick_reset(obs_script_t *script)
+{
+	if (script->tick_overruns)
+		script_info(script, "script_tick went over its budget %" PRIu64 " times, skipped %" PRIu64 " ticks",
+			    script->tick_overruns, script->tick_throttled);
+
+	script->tick_seconds = 0.0f;
+	script->tick_skip = 0;
+	script->tick_overruns = 0;
+	script->tick_throttled = 0;
+}
+
+static void flush_graphics_tasks(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+}
+
+static bool start_tick_thread(void)
+{
+	if (pthread_mutex_init_recursive(&tick_mutex) != 0)
+		return false;
+	if (pthread_mutex_init(&tick_data_mutex, NULL) != 0)
+		goto fail_data_mutex;
+	if (os_event_init(&tick_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail_event;
+
+	tick_exit = false;
+	if (pthread_create(&tick_thread, NULL, tick_thread_func, NULL) != 0)
+		goto fail_thread;
+
+	obs_add_tick_callback(scripting_tick, NULL);
+	return true;
+
+fail_thread:
+	os_event_destroy(tick_event);
+fail_event:
+	pthread_mutex_destroy(&tick_data_mutex);
+fail_data_mutex:
+	pthread_mutex_destroy(&tick_mutex);
+	return false;
+}
+
+static void stop_tick_thread(void)
+{
+	obs_remove_tick_callback(scripting_tick, NULL);
+
+	pthread_mutex_lock(&tick_data_mutex);
+	tick_exit = true;
+	pthread_mutex_unlock(&tick_data_mutex);
+
+	os_event_signal(tick_event);
+	pthread_join(tick_thread, NULL);
+
+	if (tick_frames_missed)
+		blog(LOG_INFO, "[Scripting] Script ticks fell behind rendering %" PRIu64 " times", tick_frames_missed);
+
+	da_free(tick_callbacks);
+	os_event_destroy(tick_event);
+	pthread_mutex_destroy(&tick_data_mutex);
+	pthread_mutex_destroy(&tick_mutex);
+}
+
+/* -------------------------------------------- */
+
 bool obs_scripting_load(void)
 {
 	deque_init(&defer_call_queue);
@@ -141,6 +344,20 @@ bool obs_scripting_load(void)
 		return false;
 	}
 
+	if (!start_tick_thread()) {
+		pthread_mutex_lock(&defer_call_mutex);
+		defer_call_exit = true;
+		pthread_mutex_unlock(&defer_call_mutex);
+
+		os_sem_post(defer_call_semaphore);
+		pthread_join(defer_call_thread, NULL);
+
+		os_sem_destroy(defer_call_semaphore);
+		pthread_mutex_destroy(&defer_call_mutex);
+		pthread_mutex_destroy(&detach_mutex);
+		return false;
+	}
+
 #if defined(LUAJIT_FOUND)
 	obs_lua_load();
 #endif
@@ -171,6 +388,12 @@ void obs_scripting_unload(void)
 	obs_python_unload();
 #endif
 
+	stop_tick_thread();
+
+	/* graphics tasks queued by scripts still point to their callbacks */
+	if (obs_get_video())
+		obs_queue_task(OBS_TASK_GRAPHICS, flush_graphics_tasks, NULL, true);
+
 	dstr_free(&file_filter);
 
 	/* ---------------------- */
@@ -390,6 +613,7 @@ bool obs_script_reload(obs_script_t *script)
 #if defined(LUAJIT_FOUND)
 	if (script->type == OBS_SCRIPT_LANG_LUA) {
 		obs_lua_script_unload(script);
+		script_tick_reset(script);
 		clear_call_queue();
 		obs_lua_script_load(script);
 		goto out;
@@ -398,6 +622,7 @@ bool obs_script_reload(obs_script_t *script)
 #if defined(Python_FOUND)
 	if (script->type == OBS_SCRIPT_LANG_PYTHON) {
 		obs_python_script_unload(script);
+		script_tick_reset(script);
 		clear_call_queue();
 		obs_python_script_load(script);
 		goto out;
@@ -421,6 +646,7 @@ void obs_script_destroy(obs_script_t *script)
 #if defined(LUAJIT_FOUND)
 	if (script->type == OBS_SCRIPT_LANG_LUA) {
 		obs_lua_script_unload(script);
+		script_tick_reset(script);
 		obs_lua_script_destroy(script);
 		return;
 	}
@@ -428,6 +654,7 @@ void obs_script_destroy(obs_script_t *script)
 #if defined(Python_FOUND)
 	if (script->type == OBS_SCRIPT_LANG_PYTHON) {
 		obs_python_script_unload(script);
+		script_tick_reset(script);
 		obs_python_script_destroy(script);
 		return;
 	}
@@ -0,0 +1,145 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <math.h>
+#include <cmocka.h>
+
+#include <media-io/audio-mix.h>
+
+/* odd size so that the scalar tail is exercised as well */
+#define FRAMES 1027
+#define CHANNELS 8
+
+static float samples[CHANNELS][FRAMES];
+
+static void fill_samples(void)
+{
+	uint32_t seed = 0x12345678;
+
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		for (size_t i = 0; i < FRAMES; i++) {
+			seed = seed * 1664525 + 1013904223;
+			samples[ch][i] = ((float)(seed >> 8) / (float)(1 << 24)) * 4.0f - 2.0f;
+		}
+	}
+
+	samples[0][3] = NAN;
+	samples[0][FRAMES - 1] = NAN;
+	samples[1][5] = INFINITY;
+	samples[1][6] = -INFINITY;
+	samples[2][7] = -0.0f;
+}
+
+/* multiply-adds may be fused into FMA by the compiler, which rounds once */
+static void assert_close(const float *ref, const float *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		assert_true(fabsf(ref[i] - out[i]) <= fabsf(ref[i]) * 1e-6f + 1e-6f);
+}
+
+static void audio_mix_add_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static float ref[FRAMES], out[FRAMES];
+
+	for (size_t i = 0; i < FRAMES; i++)
+		ref[i] = out[i] = samples[2][i];
+
+	for (size_t i = 0; i < FRAMES; i++)
+		ref[i] += samples[3][i];
+	audio_mix_add(out, samples[3], FRAMES);
+	assert_memory_equal(ref, out, sizeof(ref));
+
+	/* unaligned destination, as used when a source starts mid-tick */
+	for (size_t i = 1; i < FRAMES; i++)
+		ref[i] += samples[4][i - 1];
+	audio_mix_add(out + 1, samples[4], FRAMES - 1);
+	assert_memory_equal(ref, out, sizeof(ref));
+
+	for (size_t i = 0; i < FRAMES; i++)
+		ref[i] += samples[5][i] * samples[6][i];
+	audio_mix_add_mul(out, samples[5], samples[6], FRAMES);
+	assert_close(ref, out, FRAMES);
+}
+
+static void audio_mix_mul_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static float ref[FRAMES], out[FRAMES];
+	const float mul = 0.70710677f;
+
+	for (size_t i = 0; i < FRAMES; i++) {
+		ref[i] = samples[3][i] * mul;
+		out[i] = samples[3][i];
+	}
+
+	audio_mix_mul(out, mul, FRAMES);
+	assert_memory_equal(ref, out, sizeof(ref));
+}
+
+static void audio_mix_clamp_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static float ref[CHANNELS][FRAMES], out[CHANNELS][FRAMES];
+
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		for (size_t i = 0; i < FRAMES; i++) {
+			float val = samples[ch][i];
+			val = (val == val) ? val : 0.0f;
+			val = (val > 1.0f) ? 1.0f : val;
+			val = (val < -1.0f) ? -1.0f : val;
+			ref[ch][i] = val;
+		}
+
+		memcpy(out[ch], samples[ch], sizeof(out[ch]));
+		audio_mix_clamp(out[ch], FRAMES);
+		assert_memory_equal(ref[ch], out[ch], sizeof(ref[ch]));
+	}
+}
+
+static void audio_mix_downmix_mono_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static float ref[CHANNELS][FRAMES], out[CHANNELS][FRAMES];
+	float *planes[CHANNELS];
+
+	for (size_t channels = 2; channels <= CHANNELS; channels += 2) {
+		const float channels_i = 1.0f / (float)channels;
+
+		memcpy(ref, samples, sizeof(ref));
+		memcpy(out, samples, sizeof(out));
+
+		for (size_t ch = 1; ch < channels; ch++) {
+			for (size_t i = 0; i < FRAMES; i++)
+				ref[0][i] += ref[ch][i];
+		}
+		for (size_t i = 0; i < FRAMES; i++)
+			ref[0][i] *= channels_i;
+		for (size_t ch = 1; ch < channels; ch++)
+			memcpy(ref[ch], ref[0], sizeof(ref[ch]));
+
+		for (size_t ch = 0; ch < CHANNELS; ch++)
+			planes[ch] = out[ch];
+
+		audio_mix_downmix_mono(planes, channels, FRAMES);
+		assert_memory_equal(ref, out, sizeof(ref));
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(audio_mix_add_test),
+		cmocka_unit_test(audio_mix_mul_test),
+		cmocka_unit_test(audio_mix_clamp_test),
+		cmocka_unit_test(audio_mix_downmix_mono_test),
+	};
+
+	fill_samples();
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
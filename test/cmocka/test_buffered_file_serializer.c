@@ -0,0 +1,253 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include <util/bmem.h>
+#include <util/buffered-file-serializer.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define FILE_SIZE (16 * 1024 * 1024)
+#define MAX_WRITE_SIZE (96 * 1024)
+#define HEADER_SIZE 64
+
+/* the benchmark writes 1.5 GiB, so it only runs when this is set */
+#define BENCH_ENV "OBS_TEST_BENCHMARK"
+#define BENCH_FILE_SIZE (512ULL * 1024 * 1024)
+#define BENCH_WRITE_SIZE (188 * 1024)
+
+static void get_test_path(struct dstr *path, const char *name)
+{
+	dstr_copy(path, "obs-test-");
+	dstr_cat(path, name);
+	dstr_cat(path, ".bin");
+}
+
+/* io_uring may be missing from the kernel or blocked by a sandbox, in which
+ * case the serializer falls back to stdio */
+static bool io_uring_available(void)
+{
+#ifdef __NR_io_uring_setup
+	struct io_uring_params params = {0};
+	int fd = (int)syscall(__NR_io_uring_setup, 1, &params);
+	if (fd < 0)
+		return false;
+
+	close(fd);
+	return true;
+#else
+	return false;
+#endif
+}
+
+static uint8_t pattern(size_t pos, size_t pass)
+{
+	return (uint8_t)((pos * 31) ^ (pos >> 13) ^ pass);
+}
+
+/* writes data in uneven sizes like a muxer, then seeks back to patch the
+ * header and a few places in the middle of the file */
+static void write_file(struct serializer *s, uint8_t *expected)
+{
+	uint8_t *buf = bmalloc(MAX_WRITE_SIZE);
+	size_t pos = 0;
+	size_t idx = 0;
+
+	while (pos < FILE_SIZE) {
+		size_t size = 1 + (idx++ * 7919) % MAX_WRITE_SIZE;
+		if (size > FILE_SIZE - pos)
+			size = FILE_SIZE - pos;
+
+		for (size_t i = 0; i < size; i++)
+			buf[i] = expected[pos + i] = pattern(pos + i, 0);
+
+		assert_int_equal(s_write(s, buf, size), size);
+		pos += size;
+	}
+
+	for (size_t patch = 0; patch < 4; patch++) {
+		size_t offset = patch * (FILE_SIZE / 4) + 4093;
+		if (!patch)
+			offset = 0;
+
+		for (size_t i = 0; i < HEADER_SIZE; i++)
+			buf[i] = expected[offset + i] = pattern(offset + i, patch + 1);
+
+		assert_int_equal(serializer_seek(s, (int64_t)offset, SERIALIZE_SEEK_START), offset);
+		assert_int_equal(s_write(s, buf, HEADER_SIZE), HEADER_SIZE);
+	}
+
+	bfree(buf);
+}
+
+static void check_file(const char *path, const uint8_t *expected)
+{
+	FILE *file = os_fopen(path, "rb");
+	uint8_t *data = bmalloc(FILE_SIZE + 1);
+
+	assert_non_null(file);
+	assert_int_equal(fread(data, 1, FILE_SIZE + 1, file), FILE_SIZE);
+	assert_memory_equal(data, expected, FILE_SIZE);
+
+	fclose(file);
+	bfree(data);
+}
+
+static void run_backend_test(const char *name, const char *backend,
+			     const struct buffered_file_serializer_options *options)
+{
+	struct buffered_file_serializer_stats stats;
+	struct serializer s;
+	struct dstr path = {0};
+	uint8_t *expected = bmalloc(FILE_SIZE);
+
+	get_test_path(&path, name);
+
+	assert_true(buffered_file_serializer_init_with_options(&s, path.array, options));
+	write_file(&s, expected);
+
+	assert_true(buffered_file_serializer_get_stats(&s, &stats));
+	assert_string_equal(stats.backend, backend);
+	assert_true(stats.queue_depth >= 1);
+
+	buffered_file_serializer_free(&s);
+	check_file(path.array, expected);
+
+	os_unlink(path.array);
+	dstr_free(&path);
+	bfree(expected);
+}
+
+static void stdio_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct buffered_file_serializer_options options = {
+		.backend = BUFFERED_FILE_IO_STDIO,
+		.chunk_size = 256 * 1024,
+	};
+
+	run_backend_test("stdio", "stdio", &options);
+}
+
+static void uring_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct buffered_file_serializer_options options = {
+		.backend = BUFFERED_FILE_IO_URING,
+		.chunk_size = 256 * 1024,
+		.queue_depth = 8,
+	};
+
+	if (!io_uring_available())
+		skip();
+
+	run_backend_test("uring", "io_uring", &options);
+}
+
+static void uring_direct_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct buffered_file_serializer_options options = {
+		.backend = BUFFERED_FILE_IO_URING,
+		.chunk_size = 256 * 1024,
+		.queue_depth = 8,
+		.direct_io = true,
+		.preallocate_size = 4 * 1024 * 1024,
+	};
+
+	if (!io_uring_available())
+		skip();
+
+	run_backend_test("uring-direct", "io_uring", &options);
+}
+
+/* ------------------------------------------------------------------------- */
+/* throughput of a long sequential recording                                 */
+
+static void run_benchmark(const char *name, const struct buffered_file_serializer_options *options)
+{
+	struct buffered_file_serializer_stats stats;
+	struct serializer s;
+	struct dstr path = {0};
+	uint8_t *buf = bmalloc(BENCH_WRITE_SIZE);
+	uint64_t start;
+
+	memset(buf, 0x5a, BENCH_WRITE_SIZE);
+	get_test_path(&path, name);
+
+	start = os_gettime_ns();
+	assert_true(buffered_file_serializer_init_with_options(&s, path.array, options));
+
+	for (uint64_t pos = 0; pos < BENCH_FILE_SIZE; pos += BENCH_WRITE_SIZE)
+		s_write(&s, buf, BENCH_WRITE_SIZE);
+
+	assert_true(buffered_file_serializer_get_stats(&s, &stats));
+	uint64_t write_ns = os_gettime_ns() - start;
+
+	buffered_file_serializer_free(&s);
+	uint64_t total_ns = os_gettime_ns() - start;
+
+	print_message("%-14s %-8s writes %7.2f ms, total %7.2f ms (%6.1f MiB/s), max in flight %u/%u, "
+		      "buffer full waits %llu\n",
+		      name, stats.backend, (double)write_ns / 1000000.0, (double)total_ns / 1000000.0,
+		      (double)BENCH_FILE_SIZE / 1048576.0 / ((double)total_ns / 1000000000.0), stats.max_in_flight,
+		      stats.queue_depth, (unsigned long long)stats.buffer_full_waits);
+
+	os_unlink(path.array);
+	dstr_free(&path);
+	bfree(buf);
+}
+
+static void benchmark_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct buffered_file_serializer_options stdio_options = {
+		.backend = BUFFERED_FILE_IO_STDIO,
+		.max_bufsize = 64 * 1024 * 1024,
+	};
+	struct buffered_file_serializer_options uring_options = {
+		.backend = BUFFERED_FILE_IO_URING,
+		.max_bufsize = 64 * 1024 * 1024,
+	};
+	struct buffered_file_serializer_options direct_options = {
+		.backend = BUFFERED_FILE_IO_URING,
+		.max_bufsize = 64 * 1024 * 1024,
+		.direct_io = true,
+		.preallocate_size = 64 * 1024 * 1024,
+	};
+
+	if (!getenv(BENCH_ENV))
+		skip();
+
+	run_benchmark("bench-stdio", &stdio_options);
+	run_benchmark("bench-uring", &uring_options);
+	run_benchmark("bench-direct", &direct_options);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(stdio_test),
+		cmocka_unit_test(uring_test),
+		cmocka_unit_test(uring_direct_test),
+		cmocka_unit_test(benchmark_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
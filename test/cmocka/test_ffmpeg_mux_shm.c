@@ -0,0 +1,312 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "ffmpeg-mux-shm.h"
+
+#define RING_SIZE (64 * 1024)
+#define MAX_CHUNK_SIZE (100 * 1024)
+#define TOTAL_SIZE (64 * 1024 * 1024)
+
+#define BENCH_CHUNK_SIZE (64 * 1024)
+#define BENCH_TOTAL_SIZE (512 * 1024 * 1024)
+
+static inline uint8_t pattern(uint64_t pos)
+{
+	return (uint8_t)((pos * 7) % 251);
+}
+
+/* packet sized chunks, some of them larger than the ring itself */
+static inline size_t chunk_size(size_t idx)
+{
+	return 1 + (idx * 7919) % MAX_CHUNK_SIZE;
+}
+
+struct reader {
+	struct ffm_shm *shm;
+	const char *name;
+	pthread_t thread;
+	uint64_t received;
+	bool mismatch;
+	bool close_early;
+};
+
+static void *reader_thread(void *param)
+{
+	struct reader *r = param;
+	uint8_t *buf = bmalloc(MAX_CHUNK_SIZE);
+	size_t n;
+
+	r->shm = ffm_shm_attach(r->name);
+	if (!r->shm)
+		goto finish;
+
+	if (r->close_early) {
+		ffm_shm_read(r->shm, buf, 1);
+		ffm_shm_destroy(r->shm);
+		r->shm = NULL;
+		goto finish;
+	}
+
+	while ((n = ffm_shm_read(r->shm, buf, MAX_CHUNK_SIZE)) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			if (buf[i] != pattern(r->received + i))
+				r->mismatch = true;
+		}
+		r->received += n;
+	}
+
+	ffm_shm_destroy(r->shm);
+
+finish:
+	bfree(buf);
+	return NULL;
+}
+
+static void wait_attached(struct ffm_shm *shm)
+{
+	for (int i = 0; i < 5000 && !ffm_shm_attached(shm); i++)
+		os_sleep_ms(1);
+
+	assert_true(ffm_shm_attached(shm));
+}
+
+static void start_reader(struct reader *r, struct ffm_shm *shm)
+{
+	r->name = ffm_shm_get_name(shm);
+	assert_int_equal(pthread_create(&r->thread, NULL, reader_thread, r), 0);
+	wait_attached(shm);
+}
+
+static void transfer_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct reader r = {0};
+	uint8_t *buf = bmalloc(MAX_CHUNK_SIZE);
+	uint64_t pos = 0;
+
+	struct ffm_shm *shm = ffm_shm_create(RING_SIZE);
+	assert_non_null(shm);
+	start_reader(&r, shm);
+
+	for (size_t idx = 0; pos < TOTAL_SIZE; idx++) {
+		size_t size = chunk_size(idx);
+
+		for (size_t i = 0; i < size; i++)
+			buf[i] = pattern(pos + i);
+
+		assert_true(ffm_shm_write(shm, buf, size));
+		pos += size;
+	}
+
+	/* the reader has to drain the ring before it sees the end */
+	ffm_shm_close(shm);
+	pthread_join(r.thread, NULL);
+
+	assert_false(r.mismatch);
+	assert_int_equal(r.received, pos);
+
+	ffm_shm_destroy(shm);
+	bfree(buf);
+}
+
+static void reject_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct ffm_shm *shm = ffm_shm_create(RING_SIZE);
+	assert_non_null(shm);
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s", ffm_shm_get_name(shm));
+
+	/* nobody attaches before the writer is done, so everything went
+	 * through the pipe and a late reader must not be able to attach */
+	assert_false(ffm_shm_attached(shm));
+	ffm_shm_close(shm);
+	assert_null(ffm_shm_attach(name));
+
+	ffm_shm_destroy(shm);
+}
+
+static void reader_gone_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct reader r = {.close_early = true};
+	uint8_t *buf = bzalloc(RING_SIZE);
+
+	struct ffm_shm *shm = ffm_shm_create(RING_SIZE);
+	assert_non_null(shm);
+	start_reader(&r, shm);
+
+	/* once the reader is gone, a writer waiting for space has to fail
+	 * instead of blocking forever */
+	bool success = true;
+	for (size_t i = 0; i < 4 && success; i++)
+		success = ffm_shm_write(shm, buf, RING_SIZE);
+	assert_false(success);
+
+	pthread_join(r.thread, NULL);
+	ffm_shm_destroy(shm);
+	bfree(buf);
+}
+
+static void *abandon_thread(void *param)
+{
+	/* exits while still holding the reader lock, as a crashing mux process
+	 * would */
+	return ffm_shm_attach(param);
+}
+
+static void reader_died_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	pthread_t thread;
+	struct ffm_shm *reader = NULL;
+	uint8_t *buf = bzalloc(RING_SIZE);
+
+	struct ffm_shm *shm = ffm_shm_create(RING_SIZE);
+	assert_non_null(shm);
+
+	pthread_create(&thread, NULL, abandon_thread, (void *)ffm_shm_get_name(shm));
+	wait_attached(shm);
+	pthread_join(thread, (void **)&reader);
+	assert_non_null(reader);
+
+	bool success = true;
+	for (size_t i = 0; i < 4 && success; i++)
+		success = ffm_shm_write(shm, buf, RING_SIZE);
+	assert_false(success);
+
+	ffm_shm_destroy(shm);
+	bfree(buf);
+
+	/* a crashed process would not clean up either, only free the handle */
+	free(reader);
+}
+
+/* ------------------------------------------------------------------------- */
+/* throughput of the shared memory ring compared to a pipe                   */
+
+struct pipe_reader {
+	int fd;
+	pthread_t thread;
+	uint64_t received;
+};
+
+static void *pipe_reader_thread(void *param)
+{
+	struct pipe_reader *r = param;
+	uint8_t *buf = bmalloc(BENCH_CHUNK_SIZE);
+	ssize_t n;
+
+	while ((n = read(r->fd, buf, BENCH_CHUNK_SIZE)) > 0)
+		r->received += (uint64_t)n;
+
+	bfree(buf);
+	return NULL;
+}
+
+static void *shm_bench_reader_thread(void *param)
+{
+	struct reader *r = param;
+	uint8_t *buf = bmalloc(BENCH_CHUNK_SIZE);
+	size_t n;
+
+	r->shm = ffm_shm_attach(r->name);
+	if (r->shm) {
+		while ((n = ffm_shm_read(r->shm, buf, BENCH_CHUNK_SIZE)) > 0)
+			r->received += n;
+		ffm_shm_destroy(r->shm);
+	}
+
+	bfree(buf);
+	return NULL;
+}
+
+static inline double get_mb_per_sec(uint64_t bytes, uint64_t ns)
+{
+	return (double)bytes / (1024.0 * 1024.0) / ((double)ns / 1000000000.0);
+}
+
+static void throughput_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	uint8_t *buf = bmalloc(BENCH_CHUNK_SIZE);
+	struct pipe_reader pr = {0};
+	struct reader sr = {0};
+	int fds[2];
+	uint64_t start;
+
+	for (size_t i = 0; i < BENCH_CHUNK_SIZE; i++)
+		buf[i] = pattern(i);
+
+	/* pipe */
+	assert_int_equal(pipe(fds), 0);
+	pr.fd = fds[0];
+	pthread_create(&pr.thread, NULL, pipe_reader_thread, &pr);
+
+	start = os_gettime_ns();
+	for (uint64_t pos = 0; pos < BENCH_TOTAL_SIZE; pos += BENCH_CHUNK_SIZE) {
+		size_t written = 0;
+		while (written < BENCH_CHUNK_SIZE) {
+			ssize_t n = write(fds[1], buf + written, BENCH_CHUNK_SIZE - written);
+			assert_true(n > 0);
+			written += (size_t)n;
+		}
+	}
+	close(fds[1]);
+	pthread_join(pr.thread, NULL);
+	uint64_t pipe_ns = os_gettime_ns() - start;
+
+	close(fds[0]);
+	assert_int_equal(pr.received, BENCH_TOTAL_SIZE);
+
+	/* shared memory */
+	struct ffm_shm *shm = ffm_shm_create(FFM_SHM_DEFAULT_SIZE);
+	assert_non_null(shm);
+	sr.name = ffm_shm_get_name(shm);
+	pthread_create(&sr.thread, NULL, shm_bench_reader_thread, &sr);
+	wait_attached(shm);
+
+	start = os_gettime_ns();
+	for (uint64_t pos = 0; pos < BENCH_TOTAL_SIZE; pos += BENCH_CHUNK_SIZE)
+		assert_true(ffm_shm_write(shm, buf, BENCH_CHUNK_SIZE));
+	ffm_shm_close(shm);
+	pthread_join(sr.thread, NULL);
+	uint64_t shm_ns = os_gettime_ns() - start;
+
+	ffm_shm_destroy(shm);
+	assert_int_equal(sr.received, BENCH_TOTAL_SIZE);
+
+	print_message("pipe: %.0f MB/s, shared memory: %.0f MB/s\n", get_mb_per_sec(BENCH_TOTAL_SIZE, pipe_ns),
+		      get_mb_per_sec(BENCH_TOTAL_SIZE, shm_ns));
+
+	bfree(buf);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(transfer_test),
+		cmocka_unit_test(reject_test),
+		cmocka_unit_test(reader_gone_test),
+		cmocka_unit_test(reader_died_test),
+		cmocka_unit_test(throughput_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
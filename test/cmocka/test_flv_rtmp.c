@@ -0,0 +1,266 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/darray.h>
+#include <util/threading.h>
+
+#include "flv-mux.h"
+#include "librtmp/rtmp.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define NUM_PACKETS 8
+
+struct test_packets {
+	struct encoder_packet packets[NUM_PACKETS];
+	uint8_t *data[NUM_PACKETS];
+};
+
+static void init_packets(struct test_packets *tp)
+{
+	/* sizes span several 4096 byte chunks, repeat to get compressed chunk
+	 * headers, and the last dts needs an extended timestamp */
+	static const size_t sizes[NUM_PACKETS] = {10000, 300, 300, 4096, 9000, 1, 20000, 5000};
+	static const int64_t dts[NUM_PACKETS] = {0, 0, 23, 33, 66, 66, 100, 17000000};
+
+	memset(tp, 0, sizeof(*tp));
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		struct encoder_packet *packet = &tp->packets[i];
+
+		tp->data[i] = bmalloc(sizes[i]);
+		for (size_t j = 0; j < sizes[i]; j++)
+			tp->data[i][j] = (uint8_t)(j * 7 + i);
+
+		packet->data = tp->data[i];
+		packet->size = sizes[i];
+		packet->type = (i == 1 || i == 2 || i == 5) ? OBS_ENCODER_AUDIO : OBS_ENCODER_VIDEO;
+		packet->timebase_num = 1;
+		packet->timebase_den = 1000;
+		packet->dts = dts[i];
+		packet->pts = dts[i] + ((i % 2) ? 0 : 33);
+		packet->keyframe = i == 0;
+	}
+}
+
+static void free_packets(struct test_packets *tp)
+{
+	for (size_t i = 0; i < NUM_PACKETS; i++)
+		bfree(tp->data[i]);
+}
+
+static void assert_tag_equal(struct encoder_packet *packet, const uint8_t *tag, size_t tag_size, const uint8_t *header,
+			     size_t header_size, const uint8_t *footer)
+{
+	assert_int_equal(tag_size, header_size + packet->size + FLV_TAG_FOOTER_SIZE);
+	assert_memory_equal(tag, header, header_size);
+	assert_memory_equal(tag + header_size, packet->data, packet->size);
+	assert_memory_equal(tag + header_size + packet->size, footer, FLV_TAG_FOOTER_SIZE);
+}
+
+static void flv_header_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct test_packets tp;
+	uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+	uint8_t footer[FLV_TAG_FOOTER_SIZE];
+	uint8_t *tag;
+	size_t tag_size;
+	size_t header_size;
+
+	init_packets(&tp);
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		struct encoder_packet *packet = &tp.packets[i];
+
+		flv_packet_mux(packet, 10, &tag, &tag_size, false);
+		header_size = flv_packet_mux_header(packet, 10, header, footer, false);
+		assert_tag_equal(packet, tag, tag_size, header, header_size, footer);
+		bfree(tag);
+
+		for (size_t idx = 0; idx < 2; idx++) {
+			if (packet->type == OBS_ENCODER_VIDEO) {
+				flv_packet_frames(packet, CODEC_H264, 10, &tag, &tag_size, idx);
+				header_size = flv_packet_frames_header(packet, CODEC_H264, 10, header, footer, idx);
+				assert_tag_equal(packet, tag, tag_size, header, header_size, footer);
+				bfree(tag);
+
+				flv_packet_frames(packet, CODEC_AV1, 10, &tag, &tag_size, idx);
+				header_size = flv_packet_frames_header(packet, CODEC_AV1, 10, header, footer, idx);
+				assert_tag_equal(packet, tag, tag_size, header, header_size, footer);
+				bfree(tag);
+			} else {
+				flv_packet_audio_frames(packet, AUDIO_CODEC_AAC, 10, &tag, &tag_size, idx);
+				header_size =
+					flv_packet_audio_frames_header(packet, AUDIO_CODEC_AAC, 10, header, footer, idx);
+				assert_tag_equal(packet, tag, tag_size, header, header_size, footer);
+				bfree(tag);
+			}
+		}
+	}
+
+	free_packets(&tp);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int capture_send(RTMPSockBuf *sb, const char *buf, int len, void *param)
+{
+	DARRAY(uint8_t) *out = param;
+
+	UNUSED_PARAMETER(sb);
+	da_push_back_array(*out, (const uint8_t *)buf, len);
+	return len;
+}
+
+static void init_rtmp(RTMP *r)
+{
+	RTMP_Init(r);
+	r->m_outChunkSize = 4096;
+	r->Link.streams[0].id = 1;
+}
+
+static void send_packets(RTMP *r, struct test_packets *tp, bool vectored)
+{
+	uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+	uint8_t footer[FLV_TAG_FOOTER_SIZE];
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		struct encoder_packet *packet = &tp->packets[i];
+		int ret;
+
+		if (vectored) {
+			size_t header_size = flv_packet_mux_header(packet, 0, header, footer, false);
+			RTMPIOVec vec[3] = {
+				{(const char *)header, (int)header_size},
+				{(const char *)packet->data, (int)packet->size},
+				{(const char *)footer, FLV_TAG_FOOTER_SIZE},
+			};
+
+			ret = RTMP_WriteV(r, vec, 3, 0);
+		} else {
+			uint8_t *tag;
+			size_t tag_size;
+
+			flv_packet_mux(packet, 0, &tag, &tag_size, false);
+			ret = RTMP_Write(r, (const char *)tag, (int)tag_size, 0);
+			bfree(tag);
+		}
+
+		assert_true(ret > 0);
+	}
+}
+
+static void custom_send_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct test_packets tp;
+	DARRAY(uint8_t) copied = {0};
+	DARRAY(uint8_t) vectored = {0};
+	RTMP r;
+
+	init_packets(&tp);
+
+	init_rtmp(&r);
+	r.m_bCustomSend = 1;
+	r.m_customSendFunc = capture_send;
+	r.m_customSendParam = &copied;
+	send_packets(&r, &tp, false);
+	RTMP_Close(&r);
+
+	init_rtmp(&r);
+	r.m_bCustomSend = 1;
+	r.m_customSendFunc = capture_send;
+	r.m_customSendParam = &vectored;
+	send_packets(&r, &tp, true);
+	RTMP_Close(&r);
+
+	assert_true(copied.num > 0);
+	assert_int_equal(copied.num, vectored.num);
+	assert_memory_equal(copied.array, vectored.array, copied.num);
+
+	da_free(copied);
+	da_free(vectored);
+	free_packets(&tp);
+}
+
+#ifndef _WIN32
+struct socket_reader {
+	int fd;
+	DARRAY(uint8_t) data;
+};
+
+static void *socket_reader_thread(void *param)
+{
+	struct socket_reader *reader = param;
+	uint8_t buf[4096];
+	ssize_t n;
+
+	while ((n = read(reader->fd, buf, sizeof(buf))) > 0)
+		da_push_back_array(reader->data, buf, (size_t)n);
+	return NULL;
+}
+
+static void capture_socket(struct test_packets *tp, bool vectored, struct socket_reader *reader)
+{
+	pthread_t thread;
+	int fds[2];
+	RTMP r;
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+	reader->fd = fds[1];
+	da_init(reader->data);
+	pthread_create(&thread, NULL, socket_reader_thread, reader);
+
+	init_rtmp(&r);
+	r.m_sb.sb_socket = fds[0];
+	send_packets(&r, tp, vectored);
+	RTMP_Close(&r);
+
+	pthread_join(thread, NULL);
+	close(fds[1]);
+}
+
+static void socket_send_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct test_packets tp;
+	struct socket_reader copied;
+	struct socket_reader vectored;
+
+	init_packets(&tp);
+
+	capture_socket(&tp, false, &copied);
+	capture_socket(&tp, true, &vectored);
+
+	assert_true(copied.data.num > 0);
+	assert_int_equal(copied.data.num, vectored.data.num);
+	assert_memory_equal(copied.data.array, vectored.data.array, copied.data.num);
+
+	da_free(copied.data);
+	da_free(vectored.data);
+	free_packets(&tp);
+}
+#endif
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(flv_header_test),
+		cmocka_unit_test(custom_send_test),
+#ifndef _WIN32
+		cmocka_unit_test(socket_send_test),
+#endif
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,196 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/deque.h>
+
+#include "replay-store.h"
+
+#define SEGMENT_SIZE (1024 * 1024)
+#define MAX_PACKET_SIZE (64 * 1024)
+
+static uint8_t packet_buf[MAX_PACKET_SIZE];
+
+static void make_packet(struct encoder_packet *packet, size_t idx)
+{
+	size_t size = 1000 + (idx * 7919) % (MAX_PACKET_SIZE - 1000);
+
+	for (size_t i = 0; i < size; i++)
+		packet_buf[i] = (uint8_t)(i * 31 + idx);
+
+	memset(packet, 0, sizeof(*packet));
+	packet->data = packet_buf;
+	packet->size = size;
+	packet->type = (idx % 3) ? OBS_ENCODER_AUDIO : OBS_ENCODER_VIDEO;
+	packet->track_idx = idx % 2;
+	packet->keyframe = (idx % 30) == 0;
+	packet->timebase_num = 1;
+	packet->timebase_den = 1000;
+	packet->dts = (int64_t)idx * 16;
+	packet->pts = packet->dts + 33;
+	packet->dts_usec = packet->dts * 1000;
+}
+
+static void check_entry(replay_store_t *store, const struct replay_store_entry *entry, size_t idx)
+{
+	struct encoder_packet expected;
+	struct encoder_packet packet;
+
+	make_packet(&expected, idx);
+
+	assert_true(replay_store_get_packet(store, entry, &packet));
+	assert_int_equal(packet.size, expected.size);
+	assert_int_equal(packet.pts, expected.pts);
+	assert_int_equal(packet.dts, expected.dts);
+	assert_int_equal(packet.dts_usec, expected.dts_usec);
+	assert_int_equal(packet.type, expected.type);
+	assert_int_equal(packet.track_idx, expected.track_idx);
+	assert_int_equal(packet.keyframe, expected.keyframe);
+	assert_memory_equal(packet.data, expected.data, expected.size);
+}
+
+static void push_packet(replay_store_t *store, struct deque *entries, size_t idx)
+{
+	struct encoder_packet packet;
+	struct replay_store_entry entry;
+
+	make_packet(&packet, idx);
+	assert_true(replay_store_push(store, &packet, &entry));
+	deque_push_back(entries, &entry, sizeof(entry));
+}
+
+static void release_front(replay_store_t *store, struct deque *entries, size_t *size)
+{
+	struct replay_store_entry entry;
+
+	deque_pop_front(entries, &entry, sizeof(entry));
+	replay_store_release(store, &entry);
+	*size -= entry.size;
+}
+
+static void release_all(replay_store_t *store, struct deque *entries)
+{
+	size_t size = 0;
+
+	while (entries->size)
+		release_front(store, entries, &size);
+	deque_free(entries);
+}
+
+static void ring_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct deque entries = {0};
+	size_t live_size = 0;
+	size_t first = 0;
+
+	replay_store_t *store = replay_store_create(".", SEGMENT_SIZE);
+	assert_non_null(store);
+
+	/* keep about two segments worth of data alive while pushing more than
+	 * twenty segments through the store */
+	for (size_t idx = 0; idx < 1000; idx++) {
+		struct encoder_packet packet;
+		make_packet(&packet, idx);
+
+		while (live_size + packet.size > 2 * SEGMENT_SIZE) {
+			release_front(store, &entries, &live_size);
+			first++;
+		}
+
+		push_packet(store, &entries, idx);
+		live_size += packet.size;
+	}
+
+	/* two live segments may be partially used at either end */
+	assert_true(replay_store_segment_count(store) <= 4);
+
+	size_t num = entries.size / sizeof(struct replay_store_entry);
+	for (size_t i = 0; i < num; i++) {
+		struct replay_store_entry *entry = deque_data(&entries, i * sizeof(*entry));
+		check_entry(store, entry, first + i);
+	}
+
+	replay_store_read_end(store);
+	release_all(store, &entries);
+	replay_store_destroy(store);
+}
+
+static void referenced_segments_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct deque entries = {0};
+	struct deque saved = {0};
+	size_t idx = 0;
+
+	replay_store_t *store = replay_store_create(".", SEGMENT_SIZE);
+	assert_non_null(store);
+
+	while (replay_store_segment_count(store) < 3)
+		push_packet(store, &entries, idx++);
+
+	/* hold on to everything like a save in progress would, then purge the
+	 * buffer itself */
+	size_t num = entries.size / sizeof(struct replay_store_entry);
+	for (size_t i = 0; i < num; i++) {
+		struct replay_store_entry *entry = deque_data(&entries, i * sizeof(*entry));
+		replay_store_ref(store, entry);
+		deque_push_back(&saved, entry, sizeof(*entry));
+	}
+	release_all(store, &entries);
+
+	/* referenced segments must not be overwritten */
+	size_t count = replay_store_segment_count(store);
+	for (size_t i = 0; i < 100; i++)
+		push_packet(store, &entries, idx + i);
+	assert_true(replay_store_segment_count(store) > count);
+
+	for (size_t i = 0; i < num; i++) {
+		struct replay_store_entry *entry = deque_data(&saved, i * sizeof(*entry));
+		check_entry(store, entry, i);
+	}
+	replay_store_read_end(store);
+	release_all(store, &saved);
+	release_all(store, &entries);
+
+	/* once released, the segments are reused instead of growing the file */
+	count = replay_store_segment_count(store);
+	for (size_t i = 0; i < 100; i++)
+		push_packet(store, &entries, i);
+	assert_int_equal(replay_store_segment_count(store), count);
+
+	release_all(store, &entries);
+	replay_store_destroy(store);
+}
+
+static void oversized_packet_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct encoder_packet packet = {0};
+	struct replay_store_entry entry;
+
+	replay_store_t *store = replay_store_create(".", SEGMENT_SIZE);
+	assert_non_null(store);
+
+	packet.data = bzalloc(SEGMENT_SIZE + 1);
+	packet.size = SEGMENT_SIZE + 1;
+	assert_false(replay_store_push(store, &packet, &entry));
+	bfree(packet.data);
+
+	replay_store_destroy(store);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(ring_test),
+		cmocka_unit_test(referenced_segments_test),
+		cmocka_unit_test(oversized_packet_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,199 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "rtmp-stream.h"
+
+#define WRITE_BUF_SIZE (128 * 1024)
+#define CHUNK_SIZE 1000
+#define TOTAL_SIZE (8000 * CHUNK_SIZE)
+
+struct loopback {
+	int listen_fd;
+	int server_fd;
+	int client_fd;
+};
+
+static void loopback_init(struct loopback *lb)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+	int size = 16384;
+
+	lb->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert_true(lb->listen_fd >= 0);
+
+	/* small kernel buffers so the write buffer fills up quickly */
+	setsockopt(lb->listen_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert_int_equal(bind(lb->listen_fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+	assert_int_equal(listen(lb->listen_fd, 1), 0);
+	assert_int_equal(getsockname(lb->listen_fd, (struct sockaddr *)&addr, &len), 0);
+
+	lb->client_fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert_true(lb->client_fd >= 0);
+	setsockopt(lb->client_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	assert_int_equal(connect(lb->client_fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+	lb->server_fd = accept(lb->listen_fd, NULL, NULL);
+	assert_true(lb->server_fd >= 0);
+
+	fcntl(lb->client_fd, F_SETFL, fcntl(lb->client_fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void loopback_free(struct loopback *lb)
+{
+	if (lb->server_fd >= 0)
+		close(lb->server_fd);
+	close(lb->listen_fd);
+}
+
+static struct rtmp_stream *stream_create(int fd)
+{
+	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
+
+	RTMP_Init(&stream->rtmp);
+	stream->rtmp.m_sb.sb_socket = fd;
+	stream->new_socket_loop = true;
+	stream->write_buf_size = WRITE_BUF_SIZE;
+	stream->write_buf = bmalloc(WRITE_BUF_SIZE);
+	stream->socket_wake_fd = -1;
+
+	pthread_mutex_init(&stream->write_buf_mutex, NULL);
+	os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL);
+	os_event_init(&stream->buffer_space_available_event, OS_EVENT_TYPE_AUTO);
+	os_event_init(&stream->send_thread_signaled_exit, OS_EVENT_TYPE_MANUAL);
+
+	assert_true(socket_thread_linux_start(stream));
+	return stream;
+}
+
+static void stream_destroy(struct rtmp_stream *stream)
+{
+	socket_thread_linux_stop(stream);
+
+	if (stream->rtmp.m_sb.sb_socket >= 0)
+		close(stream->rtmp.m_sb.sb_socket);
+
+	os_event_destroy(stream->stop_event);
+	os_event_destroy(stream->buffer_space_available_event);
+	os_event_destroy(stream->send_thread_signaled_exit);
+	pthread_mutex_destroy(&stream->write_buf_mutex);
+	bfree(stream->write_buf);
+	bfree(stream);
+}
+
+struct producer {
+	struct rtmp_stream *stream;
+	pthread_t thread;
+	volatile long queued;
+	bool failed;
+};
+
+static void *producer_thread(void *param)
+{
+	struct producer *p = param;
+	char chunk[CHUNK_SIZE];
+
+	for (size_t pos = 0; pos < TOTAL_SIZE; pos += CHUNK_SIZE) {
+		for (size_t i = 0; i < CHUNK_SIZE; i++)
+			chunk[i] = (char)((pos + i) % 251);
+
+		if (socket_queue_data_linux(&p->stream->rtmp.m_sb, chunk, CHUNK_SIZE, p->stream) != CHUNK_SIZE) {
+			p->failed = true;
+			break;
+		}
+
+		os_atomic_set_long(&p->queued, (long)(pos + CHUNK_SIZE));
+	}
+	return NULL;
+}
+
+static void backpressure_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct loopback lb;
+	struct producer p = {0};
+	uint8_t buf[65536];
+	size_t received = 0;
+
+	loopback_init(&lb);
+	p.stream = stream_create(lb.client_fd);
+	pthread_create(&p.thread, NULL, producer_thread, &p);
+
+	/* nothing is read yet, so the producer has to block on a full write
+	 * buffer and the congestion has to show it */
+	os_sleep_ms(500);
+	long queued = os_atomic_load_long(&p.queued);
+	assert_true(queued < TOTAL_SIZE);
+
+	pthread_mutex_lock(&p.stream->write_buf_mutex);
+	assert_true(p.stream->write_buf_len > WRITE_BUF_SIZE / 2);
+	pthread_mutex_unlock(&p.stream->write_buf_mutex);
+	assert_true(socket_thread_linux_congestion(p.stream) > 0.5f);
+
+	os_sleep_ms(100);
+	assert_int_equal(os_atomic_load_long(&p.queued) - queued, 0);
+
+	while (received < TOTAL_SIZE) {
+		ssize_t n = recv(lb.server_fd, buf, sizeof(buf), 0);
+		assert_true(n > 0);
+
+		for (ssize_t i = 0; i < n; i++) {
+			if (buf[i] != (uint8_t)((received + i) % 251))
+				fail_msg("data mismatch at byte %zu", received + i);
+		}
+		received += n;
+	}
+
+	pthread_join(p.thread, NULL);
+	assert_false(p.failed);
+	assert_int_equal(received, TOTAL_SIZE);
+
+	stream_destroy(p.stream);
+	loopback_free(&lb);
+}
+
+static void peer_close_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct loopback lb;
+	struct producer p = {0};
+
+	loopback_init(&lb);
+	p.stream = stream_create(lb.client_fd);
+	pthread_create(&p.thread, NULL, producer_thread, &p);
+
+	os_sleep_ms(100);
+	close(lb.server_fd);
+	lb.server_fd = -1;
+
+	/* the blocked producer has to be released with an error */
+	pthread_join(p.thread, NULL);
+	assert_true(p.failed);
+	assert_false(RTMP_IsConnected(&p.stream->rtmp));
+
+	stream_destroy(p.stream);
+	loopback_free(&lb);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(backpressure_test),
+		cmocka_unit_test(peer_close_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,290 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+
+#include <obs.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define SOURCE_COUNT 200
+#define BENCH_SOURCE_COUNT 2000
+#define FILTER_COUNT 2
+
+static const char *test_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "test";
+}
+
+static void *test_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void test_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static void test_update(void *data, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(settings);
+}
+
+static struct obs_source_info test_input = {
+	.id = "save_cache_test_input",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.get_name = test_get_name,
+	.create = test_create,
+	.destroy = test_destroy,
+	.update = test_update,
+};
+
+static struct obs_source_info test_filter = {
+	.id = "save_cache_test_filter",
+	.type = OBS_SOURCE_TYPE_FILTER,
+	.get_name = test_get_name,
+	.create = test_create,
+	.destroy = test_destroy,
+	.update = test_update,
+};
+
+static bool save_all(void *data, obs_source_t *source)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(source);
+	return true;
+}
+
+static int setup(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_register_source(&test_input);
+	obs_register_source(&test_filter);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_shutdown();
+	return 0;
+}
+
+/* settings large enough to resemble real sources */
+static obs_source_t *create_test_source(size_t idx)
+{
+	obs_data_t *settings = obs_data_create();
+	struct dstr name = {0};
+
+	for (int i = 0; i < 20; i++) {
+		dstr_printf(&name, "setting_%d", i);
+		obs_data_set_int(settings, name.array, (long long)(idx * 20 + i));
+	}
+	obs_data_set_string(settings, "file", "/home/user/videos/some/long/path/to/a/file.mkv");
+
+	dstr_printf(&name, "source %zu", idx);
+	obs_source_t *source = obs_source_create("save_cache_test_input", name.array, settings, NULL);
+
+	for (int i = 0; i < FILTER_COUNT; i++) {
+		dstr_printf(&name, "filter %d", i);
+		obs_source_t *filter = obs_source_create("save_cache_test_filter", name.array, settings, NULL);
+		obs_source_filter_add(source, filter);
+		obs_source_release(filter);
+	}
+
+	obs_data_release(settings);
+	dstr_free(&name);
+	return source;
+}
+
+static void create_test_sources(obs_source_t **sources, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		sources[i] = create_test_source(i);
+}
+
+static void remove_test_sources(obs_source_t **sources, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (sources[i]) {
+			obs_source_remove(sources[i]);
+			obs_source_release(sources[i]);
+		}
+	}
+
+	while (obs_wait_for_destroy_queue())
+		;
+}
+
+/* the array as it would be written to the scene collection file */
+static char *full_save_json(void)
+{
+	obs_data_t *data = obs_data_create();
+	obs_data_array_t *array = obs_save_sources_filtered(save_all, NULL);
+	char *json;
+
+	obs_data_set_array(data, "sources", array);
+	json = bstrdup(obs_data_get_json_pretty(data));
+
+	obs_data_array_release(array);
+	obs_data_release(data);
+	return json;
+}
+
+static char *cached_save_json(obs_save_cache_t *cache)
+{
+	char *array = obs_save_cache_sources_json(cache, save_all, NULL, 4);
+	struct dstr json = {0};
+
+	dstr_printf(&json, "{\n    \"sources\": %s\n}", array);
+	bfree(array);
+	return json.array;
+}
+
+static void assert_cache_matches(obs_save_cache_t *cache)
+{
+	char *expected = full_save_json();
+	char *actual = cached_save_json(cache);
+
+	assert_string_equal(actual, expected);
+
+	bfree(expected);
+	bfree(actual);
+}
+
+static void empty_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_save_cache_t *cache = obs_save_cache_create();
+	char *json = obs_save_cache_sources_json(cache, save_all, NULL, 4);
+
+	assert_string_equal(json, "[]");
+
+	bfree(json);
+	obs_save_cache_destroy(cache);
+}
+
+static void changes_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_source_t *sources[SOURCE_COUNT];
+	obs_save_cache_t *cache = obs_save_cache_create();
+
+	create_test_sources(sources, SOURCE_COUNT);
+	assert_cache_matches(cache);
+
+	/* unchanged */
+	assert_cache_matches(cache);
+
+	/* settings */
+	obs_data_t *settings = obs_data_create();
+	obs_data_set_string(settings, "file", "/changed");
+	obs_source_update(sources[10], settings);
+	obs_data_release(settings);
+	assert_cache_matches(cache);
+
+	/* settings modified through the getter */
+	settings = obs_source_get_settings(sources[11]);
+	obs_data_set_int(settings, "setting_0", -1);
+	obs_data_release(settings);
+	assert_cache_matches(cache);
+
+	/* name, volume and flags */
+	obs_source_set_name(sources[12], "renamed");
+	obs_source_set_volume(sources[13], 0.5f);
+	obs_source_set_muted(sources[14], true);
+	assert_cache_matches(cache);
+
+	/* filters */
+	obs_source_t *filter = obs_source_get_filter_by_name(sources[15], "filter 0");
+	obs_source_filter_remove(sources[15], filter);
+	obs_source_release(filter);
+
+	filter = obs_source_get_filter_by_name(sources[16], "filter 1");
+	obs_source_update(filter, NULL);
+	obs_source_set_enabled(filter, false);
+	obs_source_release(filter);
+	assert_cache_matches(cache);
+
+	/* removed sources */
+	obs_source_remove(sources[17]);
+	obs_source_release(sources[17]);
+	sources[17] = NULL;
+	assert_cache_matches(cache);
+
+	/* different indentation */
+	char *json = obs_save_cache_sources_json(cache, save_all, NULL, 8);
+	assert_non_null(strstr(json, "\n            \"name\": \"source 0\""));
+	bfree(json);
+
+	obs_save_cache_destroy(cache);
+	remove_test_sources(sources, SOURCE_COUNT);
+}
+
+/* ------------------------------------------------------------------------- */
+/* saving a large collection after a single change                           */
+
+static void benchmark_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_source_t **sources = bzalloc(sizeof(obs_source_t *) * BENCH_SOURCE_COUNT);
+	obs_save_cache_t *cache = obs_save_cache_create();
+	obs_data_t *settings = obs_data_create();
+	uint64_t start;
+	char *json;
+
+	create_test_sources(sources, BENCH_SOURCE_COUNT);
+
+	start = os_gettime_ns();
+	json = full_save_json();
+	uint64_t full_ns = os_gettime_ns() - start;
+	bfree(json);
+
+	start = os_gettime_ns();
+	json = obs_save_cache_sources_json(cache, save_all, NULL, 4);
+	uint64_t first_ns = os_gettime_ns() - start;
+	bfree(json);
+
+	obs_data_set_int(settings, "setting_0", -1);
+	obs_source_update(sources[BENCH_SOURCE_COUNT / 2], settings);
+
+	start = os_gettime_ns();
+	json = obs_save_cache_sources_json(cache, save_all, NULL, 4);
+	uint64_t cached_ns = os_gettime_ns() - start;
+	bfree(json);
+
+	print_message("%d sources: full save %.2f ms, first cached save %.2f ms, "
+		      "cached save after one change %.2f ms\n",
+		      BENCH_SOURCE_COUNT, (double)full_ns / 1000000.0, (double)first_ns / 1000000.0,
+		      (double)cached_ns / 1000000.0);
+
+	obs_data_release(settings);
+	obs_save_cache_destroy(cache);
+	remove_test_sources(sources, BENCH_SOURCE_COUNT);
+	bfree(sources);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(empty_test),
+		cmocka_unit_test(changes_test),
+		cmocka_unit_test(benchmark_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,298 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/task.h>
+#include <util/threading.h>
+#include <util/darray.h>
+
+struct order_data {
+	pthread_mutex_t mutex;
+	DARRAY(int) order;
+};
+
+struct order_task {
+	struct order_data *data;
+	int value;
+};
+
+static void record_order(void *param)
+{
+	struct order_task *task = param;
+
+	pthread_mutex_lock(&task->data->mutex);
+	da_push_back(task->data->order, &task->value);
+	pthread_mutex_unlock(&task->data->mutex);
+}
+
+struct block_data {
+	os_event_t *started;
+	os_event_t *release;
+};
+
+static void block_task(void *param)
+{
+	struct block_data *data = param;
+
+	os_event_signal(data->started);
+	os_event_wait(data->release);
+}
+
+static void init_block_data(struct block_data *data)
+{
+	os_event_init(&data->started, OS_EVENT_TYPE_MANUAL);
+	os_event_init(&data->release, OS_EVENT_TYPE_MANUAL);
+}
+
+static void free_block_data(struct block_data *data)
+{
+	os_event_destroy(data->started);
+	os_event_destroy(data->release);
+}
+
+static void serial_lane_order_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data = {0};
+	struct order_task tasks[1000];
+
+	pthread_mutex_init(&data.mutex, NULL);
+
+	os_task_pool_t *pool = os_task_pool_create(4);
+	os_task_lane_t *lane = os_task_lane_create(pool, true, OS_TASK_PRIORITY_NORMAL);
+	assert_non_null(lane);
+
+	for (int i = 0; i < 1000; i++) {
+		tasks[i].data = &data;
+		tasks[i].value = i;
+		assert_true(os_task_lane_queue_task(lane, record_order, &tasks[i]));
+	}
+
+	os_task_lane_wait(lane);
+	assert_int_equal(data.order.num, 1000);
+	for (int i = 0; i < 1000; i++)
+		assert_int_equal(data.order.array[i], i);
+
+	os_task_lane_destroy(lane);
+	os_task_pool_release(pool);
+
+	da_free(data.order);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+static void cancel_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data = {0};
+	struct order_task tasks[10];
+	struct block_data block;
+
+	pthread_mutex_init(&data.mutex, NULL);
+	init_block_data(&block);
+
+	os_task_pool_t *pool = os_task_pool_create(2);
+	os_task_lane_t *lane = os_task_lane_create(pool, true, OS_TASK_PRIORITY_NORMAL);
+
+	os_task_lane_queue_task(lane, block_task, &block);
+	os_event_wait(block.started);
+
+	for (int i = 0; i < 10; i++) {
+		tasks[i].data = &data;
+		tasks[i].value = i;
+		os_task_lane_queue_task(lane, record_order, &tasks[i]);
+	}
+
+	assert_int_equal(os_task_lane_cancel(lane), 10);
+	os_event_signal(block.release);
+
+	os_task_lane_wait(lane);
+	assert_int_equal(data.order.num, 0);
+
+	/* the lane keeps working after a cancel */
+	os_task_lane_queue_task(lane, record_order, &tasks[0]);
+	os_task_lane_wait(lane);
+	assert_int_equal(data.order.num, 1);
+
+	os_task_lane_destroy(lane);
+	os_task_pool_release(pool);
+
+	free_block_data(&block);
+	da_free(data.order);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+static void slow_task_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data = {0};
+	struct order_task task = {&data, 1};
+	struct block_data block;
+
+	pthread_mutex_init(&data.mutex, NULL);
+	init_block_data(&block);
+
+	os_task_pool_t *pool = os_task_pool_create(2);
+	os_task_lane_t *slow = os_task_lane_create(pool, true, OS_TASK_PRIORITY_NORMAL);
+	os_task_lane_t *fast = os_task_lane_create(pool, true, OS_TASK_PRIORITY_NORMAL);
+
+	os_task_lane_queue_task(slow, block_task, &block);
+	os_event_wait(block.started);
+
+	/* a blocked lane must not hold up tasks of other lanes */
+	os_task_lane_queue_task(fast, record_order, &task);
+	os_task_lane_wait(fast);
+	assert_int_equal(data.order.num, 1);
+
+	os_event_signal(block.release);
+
+	os_task_lane_destroy(fast);
+	os_task_lane_destroy(slow);
+	os_task_pool_release(pool);
+
+	free_block_data(&block);
+	da_free(data.order);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+static void priority_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data = {0};
+	struct order_task low = {&data, OS_TASK_PRIORITY_LOW};
+	struct order_task normal = {&data, OS_TASK_PRIORITY_NORMAL};
+	struct order_task high = {&data, OS_TASK_PRIORITY_HIGH};
+	struct block_data block;
+
+	pthread_mutex_init(&data.mutex, NULL);
+	init_block_data(&block);
+
+	os_task_pool_t *pool = os_task_pool_create(1);
+	os_task_lane_t *lane = os_task_lane_create(pool, false, OS_TASK_PRIORITY_LOW);
+
+	os_task_pool_queue_task(pool, OS_TASK_PRIORITY_NORMAL, block_task, &block);
+	os_event_wait(block.started);
+
+	os_task_lane_queue_task(lane, record_order, &low);
+	os_task_pool_queue_task(pool, OS_TASK_PRIORITY_NORMAL, record_order, &normal);
+	os_task_pool_queue_task(pool, OS_TASK_PRIORITY_HIGH, record_order, &high);
+
+	os_event_signal(block.release);
+	os_task_lane_wait(lane);
+
+	assert_int_equal(data.order.num, 3);
+	assert_int_equal(data.order.array[0], OS_TASK_PRIORITY_HIGH);
+	assert_int_equal(data.order.array[1], OS_TASK_PRIORITY_NORMAL);
+	assert_int_equal(data.order.array[2], OS_TASK_PRIORITY_LOW);
+
+	os_task_lane_destroy(lane);
+	os_task_pool_release(pool);
+
+	free_block_data(&block);
+	da_free(data.order);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+static void separate_pool_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data = {0};
+	struct order_task encode_tasks[10];
+	struct order_task render_task = {&data, -1};
+	struct block_data block;
+
+	pthread_mutex_init(&data.mutex, NULL);
+	init_block_data(&block);
+
+	os_task_pool_t *encode_pool = os_task_pool_create(1);
+	os_task_pool_t *render_pool = os_task_pool_create(1);
+	os_task_lane_t *encode = os_task_lane_create(encode_pool, true, OS_TASK_PRIORITY_HIGH);
+	os_task_lane_t *render = os_task_lane_create(render_pool, false, OS_TASK_PRIORITY_HIGH);
+
+	os_task_lane_queue_task(encode, block_task, &block);
+	os_event_wait(block.started);
+
+	for (int i = 0; i < 10; i++) {
+		encode_tasks[i].data = &data;
+		encode_tasks[i].value = i;
+		os_task_lane_queue_task(encode, record_order, &encode_tasks[i]);
+	}
+
+	/* a render task must run while every encode worker is busy and
+	 * encode tasks are still queued */
+	os_task_lane_queue_task(render, record_order, &render_task);
+	os_task_lane_wait(render);
+	assert_int_equal(data.order.num, 1);
+	assert_int_equal(data.order.array[0], -1);
+
+	os_event_signal(block.release);
+	os_task_lane_wait(encode);
+	assert_int_equal(data.order.num, 11);
+
+	os_task_lane_destroy(render);
+	os_task_lane_destroy(encode);
+	os_task_pool_release(render_pool);
+	os_task_pool_release(encode_pool);
+
+	free_block_data(&block);
+	da_free(data.order);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+static void check_inside(void *param)
+{
+	os_task_queue_t *tq = param;
+	assert_true(os_task_queue_inside(tq));
+}
+
+static void task_queue_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data = {0};
+	struct order_task tasks[100];
+
+	pthread_mutex_init(&data.mutex, NULL);
+
+	os_task_queue_t *tq = os_task_queue_create();
+	assert_non_null(tq);
+	assert_false(os_task_queue_inside(tq));
+
+	for (int i = 0; i < 100; i++) {
+		tasks[i].data = &data;
+		tasks[i].value = i;
+		os_task_queue_queue_task(tq, record_order, &tasks[i]);
+	}
+	os_task_queue_queue_task(tq, check_inside, tq);
+
+	os_task_queue_wait(tq);
+	assert_false(os_task_queue_wait(tq));
+
+	assert_int_equal(data.order.num, 100);
+	for (int i = 0; i < 100; i++)
+		assert_int_equal(data.order.array[i], i);
+
+	os_task_queue_destroy(tq);
+
+	da_free(data.order);
+	pthread_mutex_destroy(&data.mutex);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(serial_lane_order_test),
+		cmocka_unit_test(cancel_test),
+		cmocka_unit_test(slow_task_test),
+		cmocka_unit_test(priority_test),
+		cmocka_unit_test(separate_pool_test),
+		cmocka_unit_test(task_queue_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
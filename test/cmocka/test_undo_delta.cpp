@@ -0,0 +1,130 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string>
+#include <vector>
+
+#include <util/c99defs.h>
+
+#include "undo-delta.hpp"
+
+struct action {
+	std::string undo_json;
+	std::string redo_json;
+	undo_delta_ptr undo_data;
+	undo_delta_ptr redo_data;
+};
+
+/* stores data the same way the undo stack does, as a delta to whatever
+ * was stored last */
+struct delta_writer {
+	undo_delta_ptr last_delta;
+	std::string last_data;
+
+	undo_delta_ptr push(const std::string &data)
+	{
+		last_delta = undo_delta::make(last_delta, last_data, data);
+		last_data = data;
+		return last_delta;
+	}
+};
+
+static std::string make_scene_json(int num_sources, int changed, int value)
+{
+	std::string json = "{\"name\":\"Scene\",\"sources\":[";
+
+	for (int i = 0; i < num_sources; i++) {
+		if (i)
+			json += ",";
+		json += "{\"name\":\"Source " + std::to_string(i) + "\",\"settings\":{\"x\":";
+		json += std::to_string(i == changed ? value : i * 10);
+		json += ",\"y\":" + std::to_string(i * 20) + ",\"visible\":true}}";
+	}
+
+	return json + "]}";
+}
+
+static void check_actions(const std::vector<action> &actions)
+{
+	/* undo everything, then redo everything */
+	for (auto it = actions.rbegin(); it != actions.rend(); ++it)
+		assert_string_equal(it->undo_data->materialize().c_str(), it->undo_json.c_str());
+	for (const action &a : actions)
+		assert_string_equal(a.redo_data->materialize().c_str(), a.redo_json.c_str());
+}
+
+static void round_trip_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	delta_writer writer;
+	std::vector<action> actions;
+	int num_sources = 20;
+
+	/* long enough to go past the maximum delta chain depth */
+	for (int i = 0; i < 100; i++) {
+		action a;
+		a.undo_json = make_scene_json(num_sources, i % num_sources, i);
+		if (i % 10 == 9)
+			num_sources++;
+		a.redo_json = make_scene_json(num_sources, i % num_sources, i + 1);
+
+		a.undo_data = writer.push(a.undo_json);
+		a.redo_data = writer.push(a.redo_json);
+		actions.push_back(a);
+	}
+
+	check_actions(actions);
+}
+
+static void unrelated_data_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	delta_writer writer;
+	std::vector<action> actions;
+	const char *data[] = {"{\"a\":1}", "", "[1,2,3]", "{\"a\":1}", "{\"a\":12}", "{}", "", ""};
+
+	for (size_t i = 0; i + 1 < sizeof(data) / sizeof(data[0]); i++) {
+		action a;
+		a.undo_json = data[i];
+		a.redo_json = data[i + 1];
+		a.undo_data = writer.push(a.undo_json);
+		a.redo_data = writer.push(a.redo_json);
+		actions.push_back(a);
+	}
+
+	check_actions(actions);
+}
+
+static void repeatable_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	delta_writer writer;
+	action a;
+
+	/* repeated actions replace the redo data of the last action, which
+	 * leaves the old redo data as the base of the new one */
+	a.undo_json = make_scene_json(10, 3, 0);
+	a.undo_data = writer.push(a.undo_json);
+	for (int i = 1; i <= 50; i++) {
+		a.redo_json = make_scene_json(10, 3, i);
+		a.redo_data = writer.push(a.redo_json);
+	}
+
+	check_actions({a});
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(round_trip_test),
+		cmocka_unit_test(unrelated_data_test),
+		cmocka_unit_test(repeatable_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}